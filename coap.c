@@ -7,12 +7,75 @@
 
 #include "inet.h"
 #include "coap.h"
+#include "coap_stats.h"
+#include "coap_trace.h"
 
 /* --- PRIVATE -------------------------------------------------------------- */
+/* range of the link format going into a buffer */
+typedef struct
+{
+    uint8_t *buf;                       //!< the part
+    size_t size;                        //!< size of the part
+    size_t skip;                        //!< offset of the part
+    size_t total;                       //!< bytes rendered so far
+} _window_t;
+
+/* confirmable request acknowledged empty, the handler runs on the next call */
+typedef struct
+{
+    const coap_resource_t *resource;    //!< resource requested, NULL if none
+    uint16_t msgid;                     //!< message ID of the request
+    size_t toklen;                      //!< size of tok
+    uint8_t tok[8];                     //!< token of the request
+} _acked_t;
+
 static const coap_option_t *_find_options(const coap_packet_t *pkt,
                                           const coap_option_num_t num,
                                           uint8_t *count);
 static void _option_nibble(const uint32_t value, uint8_t *nibble);
+static size_t _options_len(const coap_packet_t *pkt);
+static bool _segment_equals(const char *item, const coap_buffer_t *seg);
+static bool _is_path_param(const char *item);
+static bool _is_path_wildcard(const char *item);
+static bool _is_acceptable(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt);
+static coap_resource_t *_find_resource(coap_resource_t *resources,
+                                      const coap_packet_t *inpkt,
+                                      coap_responsecode_t *rspcode);
+static bool _is_response(const int state);
+static bool _is_acked(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt);
+static void _forget_acked(const coap_resource_t *resource,
+                          const coap_packet_t *inpkt);
+static bool _is_piggybacked(const coap_resource_t *resource,
+                            const coap_packet_t *inpkt);
+static int _dispatch(coap_resource_t *resource, const coap_responsecode_t rspcode,
+                     const coap_packet_t *inpkt, coap_packet_t *pkt);
+static int _stamp_response(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           uint8_t *buf, size_t *buflen);
+static int _build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen);
+static bool _is_listed(const coap_resource_t *resource);
+static bool _match_link(const coap_link_filter_t *filter,
+                        const coap_resource_t *resource);
+static void _put_link(_window_t *w, const coap_resource_t *resource);
+static int _respond_link_format(const coap_resource_t *resources,
+                                const coap_packet_t *inpkt,
+                                uint8_t *buf, size_t *buflen);
+static int _handle(coap_resource_t *resources,
+                   const uint8_t *inbuf, const size_t inlen,
+                   const coap_packet_compact_t *cpkt,
+                   uint8_t *outbuf, size_t *outlen,
+                   coap_offload_fn offload, void *ctx);
+
+// render cache of formats, off on threads sharing a resource table
+static __thread bool _content_cache = true;
+static __thread uint8_t _render[COAP_CONTENT_RENDER_MAX];
+// exchange acknowledged last, per thread rather than in the shared resource
+static __thread _acked_t _acked;
+
+// a compact packet is one cache line on 64 bit targets
+typedef char _compact_size_check[(sizeof(coap_packet_compact_t) <= 64) ? 1 : -1];
 
 /*
  * options are always stored consecutively,
@@ -59,8 +122,443 @@ static void _option_nibble(const uint32_t value, uint8_t *nibble)
     }
 }
 
-/* --- PUBLIC --------------------------------------------------------------- */
-int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
+/* number of bytes coap_build() needs for the options of pkt */
+static size_t _options_len(const coap_packet_t *pkt)
+{
+    size_t len = 0;
+    uint16_t running_delta = 0;
+    for (size_t i = 0; i < pkt->numopts; ++i) {
+        const uint32_t values[2] = {pkt->opts[i].num - running_delta,
+                                    pkt->opts[i].buf.len};
+        len += 1 + pkt->opts[i].buf.len;
+        for (int v = 0; v < 2; ++v) {
+            uint8_t nibble = 0;
+            _option_nibble(values[v], &nibble);
+            len += (nibble == 13) ? 1 : (nibble == 14) ? 2 : 0;
+        }
+        running_delta = pkt->opts[i].num;
+    }
+    return len;
+}
+
+/*
+ * compare without strlen, item is NUL terminated while the
+ * segment is not, and may even contain NUL bytes
+ */
+static bool _segment_equals(const char *item, const coap_buffer_t *seg)
+{
+    for (size_t i = 0; i < seg->len; ++i) {
+        if ((item[i] == '\0') || (item[i] != (char)seg->p[i])) {
+            return false;
+        }
+    }
+    return (item[seg->len] == '\0');
+}
+
+static bool _is_path_param(const char *item)
+{
+    return (item[0] == '{');
+}
+
+static bool _is_path_wildcard(const char *item)
+{
+    return (item[0] == '*') && (item[1] == '\0');
+}
+
+static bool _is_acceptable(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt)
+{
+    coap_content_format_t *format;
+    uint32_t accept;
+    if (resource->formats) {
+        return (coap_negotiate_content(resource, inpkt, &format) == COAP_SUCCESS);
+    }
+    // single fixed representation, if any
+    if (COAP_CONTENTTYPE_NONE == COAP_GET_CONTENTTYPE(resource->content_type)) {
+        return true;
+    }
+    if (coap_get_option_uint(inpkt, COAP_OPTION_ACCEPT, &accept)) {
+        return true;
+    }
+    return (accept == (uint16_t)COAP_GET_CONTENTTYPE(resource->content_type));
+}
+
+/* resource serving the request, or NULL and the error to respond with */
+static coap_resource_t *_find_resource(coap_resource_t *resources,
+                                      const coap_packet_t *inpkt,
+                                      coap_responsecode_t *rspcode)
+{
+    uint8_t count;
+    const coap_option_t *opt = _find_options(inpkt, COAP_OPTION_URI_PATH, &count);
+    *rspcode = COAP_RSPCODE_NOT_FOUND;
+    for (coap_resource_t *rs = resources; rs->handler; ++rs) {
+        if (!rs->path || !coap_match_path(rs->path, opt, count)) {
+            continue;
+        }
+        if (rs->method != inpkt->hdr.code) {
+            // path exists, but not for this method
+            *rspcode = COAP_RSPCODE_METHOD_NOT_ALLOWED;
+            continue;
+        }
+        // matching resource found, refuse early if nothing is acceptable
+        if (!_is_acceptable(rs, inpkt)) {
+            *rspcode = COAP_RSPCODE_NOT_ACCEPTABLE;
+            return NULL;
+        }
+        return rs;
+    }
+    return NULL;
+}
+
+/* pkt holds a packet to send, a response or an empty ACK */
+static bool _is_response(const int state)
+{
+    return (state == COAP_STATE_RSP_SEND) || (state == COAP_STATE_ACK_SEND);
+}
+
+static bool _is_acked(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt)
+{
+    return (_acked.resource == resource) && (_acked.msgid == inpkt->hdr.id) &&
+           (_acked.toklen == inpkt->tok.len) &&
+           (!inpkt->tok.len || !memcmp(_acked.tok, inpkt->tok.p, inpkt->tok.len));
+}
+
+/* the exchange got its response */
+static void _forget_acked(const coap_resource_t *resource,
+                          const coap_packet_t *inpkt)
+{
+    if (_is_acked(resource, inpkt)) {
+        _acked.resource = NULL;
+    }
+}
+
+static bool _is_piggybacked(const coap_resource_t *resource,
+                            const coap_packet_t *inpkt)
+{
+    return (inpkt->hdr.t != COAP_TYPE_CON) ||
+           (resource->msg_type == COAP_TYPE_ACK) ||
+           _is_acked(resource, inpkt);
+}
+
+/* run handler of resource, or respond with rspcode if there is none */
+static int _dispatch(coap_resource_t *resource, const coap_responsecode_t rspcode,
+                     const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    if (!resource) {
+        COAP_TRACE4(dispatch, 0, inpkt->hdr.code, inpkt->hdr.id, 0);
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                  COAP_TYPE_ACK, rspcode,
+                                  NULL, NULL, 0, pkt);
+    }
+    COAP_TRACE4(dispatch, resource, inpkt->hdr.code, inpkt->hdr.id,
+                (resource->path && resource->path->count) ?
+                resource->path->items[resource->path->count - 1] : NULL);
+    int state;
+    if (resource->flags & COAP_RESOURCE_ASYNC) {
+        // coroutine, runs in a task of coap_async.h only
+        state = coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                   COAP_TYPE_ACK,
+                                   COAP_RSPCODE_SERVICE_UNAVAILABLE,
+                                   NULL, NULL, 0, pkt);
+    }
+    else if (!_is_piggybacked(resource, inpkt)) { // no piggyback
+        state = coap_make_ack(inpkt, pkt);
+        if ((state == COAP_STATE_ACK_SEND) && (inpkt->tok.len <= sizeof(_acked.tok))) {
+            _acked.resource = resource;
+            _acked.msgid = inpkt->hdr.id;
+            _acked.toklen = inpkt->tok.len;
+            if (inpkt->tok.len) {
+                memcpy(_acked.tok, inpkt->tok.p, inpkt->tok.len);
+            }
+        }
+    }
+    else {
+        _forget_acked(resource, inpkt);
+        state = resource->handler(resource, inpkt, pkt);
+    }
+    // handlers failing or responding later may leave pkt untouched
+    COAP_TRACE3(handler_return, resource, state,
+                _is_response(state) ? pkt->hdr.code : 0);
+    return state;
+}
+
+/* copy pre-encoded response, with token inserted behind the header */
+static int _stamp_response(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           uint8_t *buf, size_t *buflen)
+{
+    const coap_response_template_t *tpl = resource->response;
+    const size_t hdrlen = sizeof(coap_raw_header_t);
+    const size_t tkl = inpkt->tok.len;
+    if (*buflen < tpl->len + tkl) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    const coap_msgtype_t t = (inpkt->hdr.t == COAP_TYPE_CON) ?
+                             COAP_TYPE_ACK : COAP_TYPE_NONCON;
+    buf[0] = (tpl->buf.p[0] & 0xC0) | (t << 4) | (uint8_t)tkl;
+    buf[1] = tpl->buf.p[1];
+    buf[2] = (uint8_t)(inpkt->hdr.id >> 8);
+    buf[3] = (uint8_t)(inpkt->hdr.id & 0xFF);
+    memcpy(buf + hdrlen, inpkt->tok.p, tkl);
+    memcpy(buf + hdrlen + tkl, tpl->buf.p + hdrlen, tpl->len - hdrlen);
+    if (tpl->patch) {
+        int rc = tpl->patch(resource, inpkt,
+                            buf + tkl + tpl->payload + tpl->patch_offset,
+                            tpl->patch_len);
+        if (rc) {
+            return rc;
+        }
+    }
+    *buflen = tpl->len + tkl;
+    return COAP_SUCCESS;
+}
+
+/* copy the part of the link format falling into the window */
+static void _put(_window_t *w, const char *s, const size_t len)
+{
+    const size_t end = w->skip + w->size;
+    if ((w->total < end) && (w->total + len > w->skip)) {
+        const size_t from = (w->total > w->skip) ? w->total : w->skip;
+        const size_t to = (w->total + len < end) ? w->total + len : end;
+        memcpy(w->buf + (from - w->skip), s + (from - w->total), to - from);
+    }
+    w->total += len;
+}
+
+static void _puts(_window_t *w, const char *s)
+{
+    _put(w, s, strlen(s));
+}
+
+static void _put_uint(_window_t *w, uint32_t value)
+{
+    char digits[10];
+    size_t i = sizeof(digits);
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    _put(w, digits + i, sizeof(digits) - i);
+}
+
+/* rendered past the window, whether more follows is known */
+static bool _full(const _window_t *w)
+{
+    return w->total > w->skip + w->size;
+}
+
+/* links are listed if there is a content format to tell */
+static bool _is_listed(const coap_resource_t *resource)
+{
+    return resource->path &&
+           (resource->formats ||
+            (COAP_CONTENTTYPE_NONE != COAP_GET_CONTENTTYPE(resource->content_type)));
+}
+
+/* exact match, or prefix match if the filter ends in '*' */
+static bool _match_value(const coap_buffer_t *filter,
+                         const char *value, const size_t len)
+{
+    size_t n = filter->len;
+    if (n && (filter->p[n - 1] == '*')) {
+        n--;
+        return (len >= n) && !memcmp(filter->p, value, n);
+    }
+    return (len == n) && !memcmp(filter->p, value, n);
+}
+
+/* any value of a space separated list matches */
+static bool _match_list(const coap_buffer_t *filter, const char *list)
+{
+    if (!filter->len) {
+        return true;
+    }
+    while (list && *list) {
+        const char *end = strchr(list, ' ');
+        const size_t len = end ? (size_t)(end - list) : strlen(list);
+        if (len && _match_value(filter, list, len)) {
+            return true;
+        }
+        list = end ? end + 1 : NULL;
+    }
+    return false;
+}
+
+/* compare "/item/item" with the filter while walking the path */
+static bool _match_href(const coap_buffer_t *filter,
+                        const coap_resource_path_t *path)
+{
+    if (!filter->len) {
+        return true;
+    }
+    const bool prefix = (filter->p[filter->len - 1] == '*');
+    const size_t n = filter->len - prefix;
+    size_t pos = 0;
+    for (int i = 0; i < path->count; ++i) {
+        const char *item = path->items[i];
+        const size_t len = strlen(item);
+        if ((pos < n) && (filter->p[pos] != '/')) {
+            return false;
+        }
+        pos++;
+        const size_t cmp = (pos >= n) ? 0 : (n - pos < len) ? n - pos : len;
+        if (cmp && memcmp(filter->p + pos, item, cmp)) {
+            return false;
+        }
+        pos += len;
+    }
+    return prefix ? (pos >= n) : (pos == n);
+}
+
+static bool _match_ct(const int32_t ct, const coap_resource_t *resource)
+{
+    if (ct < 0) {
+        return true;
+    }
+    if (!resource->formats) {
+        return ct == (uint16_t)COAP_GET_CONTENTTYPE(resource->content_type);
+    }
+    for (const coap_content_format_t *f = resource->formats; f->encoder; ++f) {
+        if (ct == (uint16_t)COAP_GET_CONTENTTYPE(f->content_type)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _match_link(const coap_link_filter_t *filter,
+                        const coap_resource_t *resource)
+{
+    const coap_link_attrs_t *link = resource->link;
+    return _match_href(&filter->href, resource->path) &&
+           _match_ct(filter->ct, resource) &&
+           _match_list(&filter->rt, link ? link->rt : NULL) &&
+           _match_list(&filter->iface, link ? link->iface : NULL);
+}
+
+/* https://tools.ietf.org/html/rfc6690#section-2 */
+static void _put_link(_window_t *w, const coap_resource_t *resource)
+{
+    _put(w, "<", 1);
+    for (int i = 0; i < resource->path->count; ++i) {
+        _put(w, "/", 1);
+        _puts(w, resource->path->items[i]);
+    }
+    // content type, or list of all formats offered
+    if (!resource->formats) {
+        _put(w, ">;ct=", 5);
+        _put_uint(w, (uint16_t)COAP_GET_CONTENTTYPE(resource->content_type));
+    }
+    else {
+        _put(w, ">;ct=\"", 6);
+        for (const coap_content_format_t *f = resource->formats; f->encoder; ++f) {
+            if (f != resource->formats) {
+                _put(w, " ", 1);
+            }
+            _put_uint(w, (uint16_t)COAP_GET_CONTENTTYPE(f->content_type));
+        }
+        _put(w, "\"", 1);
+    }
+    const coap_link_attrs_t *link = resource->link;
+    if (!link) {
+        return;
+    }
+    if (link->rt) {
+        _put(w, ";rt=\"", 5);
+        _puts(w, link->rt);
+        _put(w, "\"", 1);
+    }
+    if (link->iface) {
+        _put(w, ";if=\"", 5);
+        _puts(w, link->iface);
+        _put(w, "\"", 1);
+    }
+    if (link->sz) {
+        _put(w, ";sz=", 4);
+        _put_uint(w, link->sz);
+    }
+    if (link->obs) {
+        _put(w, ";obs", 4);
+    }
+}
+
+/*
+ * the block of the link format asked for, rendered into the payload of the
+ * response, see https://tools.ietf.org/html/rfc7959#section-2.4
+ */
+static int _respond_link_format(const coap_resource_t *resources,
+                                const coap_packet_t *inpkt,
+                                uint8_t *buf, size_t *buflen)
+{
+    static const uint8_t ct[2] = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT);
+    const coap_msgtype_t t = (inpkt->hdr.t == COAP_TYPE_CON) ?
+                             COAP_TYPE_ACK : COAP_TYPE_NONCON;
+    coap_packet_t pkt;
+    coap_link_filter_t filter;
+    coap_rw_buffer_t payload;
+    coap_block_t block = {0, true, COAP_BLOCK_MAX_SZX};
+    uint8_t value[4];
+    bool more = false;
+    if (coap_get_link_filter(inpkt, &filter)) {
+        coap_make_response(inpkt->hdr.id, &inpkt->tok, t, COAP_RSPCODE_BAD_REQUEST,
+                           NULL, NULL, 0, &pkt);
+        return coap_build(&pkt, buf, buflen);
+    }
+    coap_make_response(inpkt->hdr.id, &inpkt->tok, t, COAP_RSPCODE_CONTENT,
+                       ct, NULL, 0, &pkt);
+    const size_t numopts = pkt.numopts;
+    if (coap_get_block_option(inpkt, COAP_OPTION_BLOCK2, &block)) {
+        // all of it, if it fits into a datagram of moderate size
+        if (coap_build_payload_buffer(&pkt, buf, *buflen, &payload)) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        pkt.payload.p = payload.p;
+        pkt.payload.len = (payload.len < COAP_BLOCK_SIZE(COAP_BLOCK_MAX_SZX)) ?
+                          payload.len : COAP_BLOCK_SIZE(COAP_BLOCK_MAX_SZX);
+        coap_make_link_format_block(resources, &filter, 0, payload.p,
+                                    &pkt.payload.len, &more);
+        if (!more) {
+            return coap_build(&pkt, buf, buflen);
+        }
+    }
+    size_t len;
+    for (;;) {
+        // with the more flag set, the option cannot grow when it is cleared
+        block.more = true;
+        pkt.numopts = numopts;
+        len = coap_encode_block_option(&block, value);
+        coap_add_option(&pkt, COAP_OPTION_BLOCK2, value, len);
+        if (coap_build_payload_buffer(&pkt, buf, *buflen, &payload)) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        if ((COAP_BLOCK_SIZE(block.szx) <= payload.len) || !block.szx) {
+            break;
+        }
+        // smaller blocks than asked for, same offset
+        block.num <<= 1;
+        block.szx--;
+    }
+    if (COAP_BLOCK_SIZE(block.szx) > payload.len) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    pkt.payload.p = payload.p;
+    pkt.payload.len = COAP_BLOCK_SIZE(block.szx);
+    if (coap_make_link_format_block(resources, &filter,
+                                    (size_t)block.num << (block.szx + 4),
+                                    payload.p, &pkt.payload.len, &more)) {
+        coap_make_response(inpkt->hdr.id, &inpkt->tok, t, COAP_RSPCODE_BAD_OPTION,
+                           NULL, NULL, 0, &pkt);
+        return coap_build(&pkt, buf, buflen);
+    }
+    if (!more) {
+        // keeps its length, the payload stays in place
+        value[len - 1] &= ~0x08;
+    }
+    return coap_build(&pkt, buf, buflen);
+}
+
+static int _build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
 {
     // build header
     if (*buflen < (sizeof(coap_raw_header_t) + pkt->hdr.tkl)) {
@@ -105,7 +603,7 @@ int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
             *p++ = (pkt->opts[i].buf.len - 13);
         }
         else if (len == 14) {
-            *p++ = (pkt->opts[i].buf.len >> 8);
+            *p++ = ((pkt->opts[i].buf.len-269) >> 8);
             *p++ = (0xFF & (pkt->opts[i].buf.len-269));
         }
 
@@ -120,8 +618,11 @@ int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
             return COAP_ERR_BUFFER_TOO_SMALL;
         }
         buf[sizeof(coap_raw_header_t) + opts_len] = 0xFF;  // payload marker
-        memcpy(buf + sizeof(coap_raw_header_t) + opts_len + 1,
-               pkt->payload.p, pkt->payload.len);
+        // payload may have been encoded in place already
+        uint8_t *dst = buf + sizeof(coap_raw_header_t) + opts_len + 1;
+        if (dst != pkt->payload.p) {
+            memcpy(dst, pkt->payload.p, pkt->payload.len);
+        }
         *buflen = sizeof(coap_raw_header_t) + opts_len + 1 + pkt->payload.len;
     }
     else {
@@ -129,6 +630,30 @@ int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
     }
     return COAP_SUCCESS;
 }
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen)
+{
+    int rc = _build(pkt, buf, buflen);
+    COAP_TRACE3(build, pkt, *buflen, rc);
+    return rc;
+}
+
+int coap_build_payload_buffer(const coap_packet_t *pkt,
+                              uint8_t *buf, const size_t buflen,
+                              coap_rw_buffer_t *payload)
+{
+    // header, token, options and payload marker precede the payload
+    const size_t offset = sizeof(coap_raw_header_t) + pkt->hdr.tkl +
+                          _options_len(pkt) + 1;
+    if (offset >= buflen) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    payload->p = buf + offset;
+    payload->len = buflen - offset;
+    return COAP_SUCCESS;
+}
+
 int coap_make_request(const uint16_t msgid, const coap_buffer_t* tok,
                       const coap_resource_t *resource,
                       const uint8_t *content, const size_t content_len,
@@ -176,6 +701,65 @@ int coap_make_request(const uint16_t msgid, const coap_buffer_t* tok,
     return COAP_STATE_REQ_SEND;
 }
 
+int coap_make_request_template(const coap_resource_t *resource,
+                               coap_request_template_t *tpl)
+{
+    coap_packet_t pkt;
+    uint8_t buf[sizeof(coap_raw_header_t) + COAP_TEMPLATE_MAXLEN];
+    size_t buflen = sizeof(buf);
+    int rc = coap_make_request(0, NULL, resource, NULL, 0, &pkt);
+    if (COAP_IS_ERROR(rc)) {
+        return rc;
+    }
+    if (_options_len(&pkt) > COAP_TEMPLATE_MAXLEN) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    // same encoder as coap_build(), so both yield identical bytes
+    rc = coap_build(&pkt, buf, &buflen);
+    if (rc) {
+        return rc;
+    }
+    tpl->hdr[0] = buf[0];
+    tpl->hdr[1] = buf[1];
+    tpl->optslen = buflen - sizeof(coap_raw_header_t);
+    memcpy(tpl->opts, buf + sizeof(coap_raw_header_t), tpl->optslen);
+    return COAP_SUCCESS;
+}
+
+int coap_build_request(const coap_request_template_t *tpl,
+                       const uint16_t msgid, const coap_buffer_t *tok,
+                       const uint8_t *content, const size_t content_len,
+                       uint8_t *buf, size_t *buflen)
+{
+    const size_t tkl = tok ? tok->len : 0;
+    if (tkl > COAP_MAX_TOKLEN) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    const size_t len = sizeof(coap_raw_header_t) + tkl + tpl->optslen +
+                       (content_len ? 1 + content_len : 0);
+    if (*buflen < len) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    // token length is the low nibble of the first byte
+    buf[0] = tpl->hdr[0] | (uint8_t)tkl;
+    buf[1] = tpl->hdr[1];
+    buf[2] = (uint8_t)(msgid >> 8);
+    buf[3] = (uint8_t)(msgid & 0xFF);
+    uint8_t *p = buf + sizeof(coap_raw_header_t);
+    if (tkl) {
+        memcpy(p, tok->p, tkl);
+        p += tkl;
+    }
+    memcpy(p, tpl->opts, tpl->optslen);
+    p += tpl->optslen;
+    if (content_len) {
+        *p++ = 0xFF;
+        memcpy(p, content, content_len);
+    }
+    *buflen = len;
+    return COAP_SUCCESS;
+}
+
 int coap_make_ack(const coap_packet_t *inpkt, coap_packet_t *pkt)
 {
     return coap_make_response(inpkt->hdr.id, &inpkt->tok,
@@ -215,43 +799,231 @@ int coap_make_response(const uint16_t msgid, const coap_buffer_t* tok,
     return COAP_STATE_RSP_SEND;
 }
 
+int coap_negotiate_content(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_content_format_t **format)
+{
+    uint32_t accept;
+    *format = NULL;
+    if (!resource->formats) {
+        return COAP_SUCCESS;
+    }
+    // no preference, serve the first format offered
+    if (coap_get_option_uint(inpkt, COAP_OPTION_ACCEPT, &accept)) {
+        *format = resource->formats;
+        return COAP_SUCCESS;
+    }
+    for (coap_content_format_t *f = resource->formats; f->encoder; ++f) {
+        if (accept == (uint16_t)COAP_GET_CONTENTTYPE(f->content_type)) {
+            *format = f;
+            return COAP_SUCCESS;
+        }
+    }
+    return COAP_ERR_NOT_ACCEPTABLE;
+}
+
+int coap_make_content_response(const coap_resource_t *resource,
+                               const coap_packet_t *inpkt,
+                               const coap_msgtype_t msgtype,
+                               const coap_responsecode_t rspcode,
+                               coap_packet_t *pkt)
+{
+    coap_content_format_t *format;
+    if (coap_negotiate_content(resource, inpkt, &format) || !format) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                  msgtype, COAP_RSPCODE_NOT_ACCEPTABLE,
+                                  NULL, NULL, 0, pkt);
+    }
+    // threads without the cache render on their own, every time
+    if (!_content_cache) {
+        size_t buflen = (format->cache.len < sizeof(_render)) ?
+                        format->cache.len : sizeof(_render);
+        if (format->encoder(resource, _render, &buflen)) {
+            return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                      msgtype, COAP_RSPCODE_INTERNAL_SERVER_ERROR,
+                                      NULL, NULL, 0, pkt);
+        }
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                  msgtype, rspcode, format->content_type,
+                                  _render, buflen, pkt);
+    }
+    // render only if there is no current representation; an invalidation
+    // while rendering leaves the cache invalid, this response still uses it
+    if (__atomic_load_n(&format->valid, __ATOMIC_ACQUIRE) != COAP_CONTENT_VALID) {
+        __atomic_store_n(&format->valid, COAP_CONTENT_FILLING, __ATOMIC_RELAXED);
+        size_t buflen = format->cache.len;
+        if (format->encoder(resource, format->cache.p, &buflen)) {
+            __atomic_store_n(&format->valid, COAP_CONTENT_INVALID, __ATOMIC_RELAXED);
+            return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                      msgtype, COAP_RSPCODE_INTERNAL_SERVER_ERROR,
+                                      NULL, NULL, 0, pkt);
+        }
+        format->cache_len = buflen;
+        unsigned state = COAP_CONTENT_FILLING;
+        __atomic_compare_exchange_n(&format->valid, &state, COAP_CONTENT_VALID, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              msgtype, rspcode,
+                              format->content_type,
+                              format->cache.p, format->cache_len, pkt);
+}
+
+void coap_content_cache(const bool enabled)
+{
+    _content_cache = enabled;
+}
+
+void coap_invalidate_content(coap_content_format_t *formats)
+{
+    if (!formats) {
+        return;
+    }
+    for (coap_content_format_t *f = formats; f->encoder; ++f) {
+        __atomic_store_n(&f->valid, COAP_CONTENT_INVALID, __ATOMIC_RELEASE);
+    }
+}
+
 int coap_handle_request(coap_resource_t *resources,
                         const coap_packet_t *inpkt,
                         coap_packet_t *pkt)
 {
-    uint8_t count;
-    coap_responsecode_t rspcode = COAP_RSPCODE_NOT_IMPLEMENTED;
-    const coap_option_t *opt = _find_options(inpkt, COAP_OPTION_URI_PATH, &count);
+    coap_responsecode_t rspcode;
     // find handler for requested resource
-    for (coap_resource_t *rs = resources; rs->handler && opt; ++rs) {
-        if ((rs->method == inpkt->hdr.code) && (count == rs->path->count)) {
-            int i;
-            for (i = 0; i < count; ++i) {
-                if (opt[i].buf.len != strlen(rs->path->items[i])) {
-                    break;
-                }
-                if (memcmp(rs->path->items[i], opt[i].buf.p, opt[i].buf.len)) {
-                    break;
-                }
-            }
-            if (i == count) { // matching resource found
-                if ((inpkt->hdr.t == COAP_TYPE_CON) && (rs->msg_type != COAP_TYPE_ACK) && (rs->state != COAP_STATE_ACK_SEND)) { // no piggyback
-                    rs->state = coap_make_ack(inpkt, pkt);
-                }
-                else {
-                    rs->state = rs->handler(rs, inpkt, pkt);
-                }
-                return rs->state;
-            }
-            rspcode = COAP_RSPCODE_NOT_FOUND;
+    coap_resource_t *rs = _find_resource(resources, inpkt, &rspcode);
+    return _dispatch(rs, rspcode, inpkt, pkt);
+}
+
+int coap_handle_packet(coap_resource_t *resources,
+                       const uint8_t *inbuf, const size_t inlen,
+                       uint8_t *outbuf, size_t *outlen)
+{
+    return coap_handle_packet_offload(resources, inbuf, inlen, outbuf, outlen,
+                                      NULL, NULL);
+}
+
+int coap_handle_packet_offload(coap_resource_t *resources,
+                               const uint8_t *inbuf, const size_t inlen,
+                               uint8_t *outbuf, size_t *outlen,
+                               coap_offload_fn offload, void *ctx)
+{
+    return _handle(resources, inbuf, inlen, NULL, outbuf, outlen, offload, ctx);
+}
+
+int coap_handle_compact(coap_resource_t *resources,
+                        const coap_packet_compact_t *cpkt,
+                        uint8_t *outbuf, size_t *outlen,
+                        coap_offload_fn offload, void *ctx)
+{
+    return _handle(resources, cpkt->base, cpkt->len, cpkt, outbuf, outlen, offload, ctx);
+}
+
+/* dispatch a datagram, parsed already if cpkt is set */
+static int _handle(coap_resource_t *resources,
+                   const uint8_t *inbuf, const size_t inlen,
+                   const coap_packet_compact_t *cpkt,
+                   uint8_t *outbuf, size_t *outlen,
+                   coap_offload_fn offload, void *ctx)
+{
+    coap_packet_t inpkt;
+    coap_packet_t pkt;
+    coap_responsecode_t rspcode;
+    int rc = COAP_SUCCESS;
+    memset(&pkt, 0, sizeof(pkt));
+    COAP_STATS_BEGIN(t);
+    if (cpkt) {
+        coap_expand_compact(cpkt, &inpkt);
+    }
+    else {
+        rc = coap_parse(inbuf, inlen, &inpkt);
+    }
+    COAP_STATS_LAP(t, COAP_STATS_PARSE);
+    if (rc) {
+        return rc;
+    }
+    coap_resource_t *rs = _find_resource(resources, &inpkt, &rspcode);
+    COAP_STATS_LAP(t, COAP_STATS_LOOKUP);
+    if (rs && (rs->flags & COAP_RESOURCE_LINK_FORMAT) &&
+        (inpkt.hdr.code == COAP_METHOD_GET) && _is_piggybacked(rs, &inpkt)) {
+        _forget_acked(rs, &inpkt);
+        COAP_TRACE2(link_format, rs, inpkt.hdr.id);
+        rc = _respond_link_format(resources, &inpkt, outbuf, outlen);
+        COAP_STATS_LAP(t, COAP_STATS_HANDLER);
+        COAP_STATS_END(t, resources, rs);
+        return rc;
+    }
+    // fast path, copy the pre-encoded response
+    if (rs && rs->response && rs->response->valid &&
+        _is_piggybacked(rs, &inpkt) &&
+        !_stamp_response(rs, &inpkt, outbuf, outlen)) {
+        _forget_acked(rs, &inpkt);
+        COAP_TRACE2(template, rs, inpkt.hdr.id);
+        COAP_STATS_LAP(t, COAP_STATS_HANDLER);
+        COAP_STATS_END(t, resources, rs);
+        return COAP_SUCCESS;
+    }
+    if (rs && offload && (rs->flags & (COAP_RESOURCE_BLOCKING | COAP_RESOURCE_ASYNC))) {
+        const bool con = (inpkt.hdr.t == COAP_TYPE_CON);
+        if (offload(ctx, rs, inbuf, inlen)) {
+            coap_make_response(inpkt.hdr.id, &inpkt.tok,
+                               con ? COAP_TYPE_ACK : COAP_TYPE_NONCON,
+                               COAP_RSPCODE_SERVICE_UNAVAILABLE, NULL, NULL, 0, &pkt);
+        }
+        else if (con) {
+            // empty message, without token
+            coap_make_response(inpkt.hdr.id, NULL, COAP_TYPE_ACK,
+                               COAP_RSPCODE_EMPTY, NULL, NULL, 0, &pkt);
         }
         else {
-            rspcode = COAP_RSPCODE_METHOD_NOT_ALLOWED;
+            COAP_STATS_LAP(t, COAP_STATS_HANDLER);
+            COAP_STATS_END(t, resources, rs);
+            return COAP_STATE_RSP_WAIT;
         }
     }
-    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
-                              COAP_TYPE_ACK, rspcode,
-                              NULL, NULL, 0, pkt);
+    else {
+        // errors, and responses that follow, leave nothing to send
+        rc = _dispatch(rs, rspcode, &inpkt, &pkt);
+        if (!_is_response(rc)) {
+            COAP_STATS_LAP(t, COAP_STATS_HANDLER);
+            COAP_STATS_END(t, resources, rs);
+            return rc;
+        }
+        // answers to non-confirmable requests are no ACKs, e.g. to a group
+        if ((inpkt.hdr.t == COAP_TYPE_NONCON) && (pkt.hdr.t == COAP_TYPE_ACK) &&
+            (pkt.hdr.code != COAP_RSPCODE_EMPTY)) {
+            pkt.hdr.t = COAP_TYPE_NONCON;
+        }
+    }
+    COAP_STATS_LAP(t, COAP_STATS_HANDLER);
+    rc = coap_build(&pkt, outbuf, outlen);
+    COAP_STATS_LAP(t, COAP_STATS_BUILD);
+    COAP_STATS_END(t, resources, rs);
+    return rc;
+}
+
+int coap_make_response_template(const coap_packet_t *pkt,
+                                coap_response_template_t *tpl)
+{
+    coap_packet_t p = *pkt;
+    p.hdr.tkl = 0;
+    p.tok.p = NULL;
+    p.tok.len = 0;
+    tpl->valid = false;
+    // coap_build() does not check the room for options precisely
+    const size_t len = sizeof(coap_raw_header_t) + _options_len(&p) +
+                       (p.payload.len ? 1 + p.payload.len : 0);
+    if ((len > tpl->buf.len) ||
+        (tpl->patch && (tpl->patch_offset + tpl->patch_len > p.payload.len))) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    tpl->len = tpl->buf.len;
+    int rc = coap_build(&p, tpl->buf.p, &tpl->len);
+    if (rc) {
+        return rc;
+    }
+    tpl->payload = p.payload.len ? tpl->len - p.payload.len : 0;
+    tpl->valid = true;
+    return COAP_SUCCESS;
 }
 
 int coap_handle_response(coap_resource_t *resources,
@@ -271,63 +1043,171 @@ int coap_handle_response(coap_resource_t *resources,
     // find handler for requested resource
     for (coap_resource_t *rs = resources; rs->handler; ++rs) {
         if (reqpkt->hdr.code != rs->method) continue;
-        if (count == rs->path->count) {
-            int i;
-            for (i = 0; i < count; ++i) {
-                if (opt[i].buf.len != strlen(rs->path->items[i])) {
-                    break;
-                }
-                if (memcmp(rs->path->items[i], opt[i].buf.p, opt[i].buf.len)) {
-                    break;
+        if (rs->path && coap_match_path(rs->path, opt, count)) {
+            return rs->handler(rs, reqpkt, rsppkt);
+        }
+    }
+    return COAP_ERR_REQUEST_NOT_FOUND;
+}
+
+bool coap_match_path(const coap_resource_path_t *path,
+                     const coap_option_t *opt, const uint8_t count)
+{
+    int i;
+    for (i = 0; i < path->count; ++i) {
+        const char *item = path->items[i];
+        // trailing wildcard swallows whatever is left
+        if ((i == path->count - 1) && _is_path_wildcard(item)) {
+            return true;
+        }
+        if (i >= count) {
+            return false;
+        }
+        if (_is_path_param(item)) {
+            continue;
+        }
+        if (!_segment_equals(item, &opt[i].buf)) {
+            return false;
+        }
+    }
+    return (i == count);
+}
+
+int coap_get_path_params(const coap_resource_t *resource,
+                         const coap_packet_t *inpkt,
+                         coap_buffer_t *params, uint8_t *count)
+{
+    const coap_resource_path_t *path = resource->path;
+    uint8_t numsegs;
+    const coap_option_t *opt = _find_options(inpkt, COAP_OPTION_URI_PATH, &numsegs);
+    uint8_t max = *count;
+    *count = 0;
+    if (!path || !coap_match_path(path, opt, numsegs)) {
+        return COAP_ERR_OPTION_NOT_FOUND;
+    }
+    const bool wildcard = (path->count > 0) &&
+                          _is_path_wildcard(path->items[path->count - 1]);
+    for (int i = 0; i < numsegs; ++i) {
+        // segments from the wildcard item on are all captured
+        const bool captured = (wildcard && (i >= path->count - 1)) ||
+                              _is_path_param(path->items[i]);
+        if (!captured) {
+            continue;
+        }
+        if (*count >= max) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        params[(*count)++] = opt[i].buf;
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_get_path_param(const coap_resource_t *resource,
+                        const coap_packet_t *inpkt,
+                        const char *name, coap_buffer_t *param)
+{
+    const coap_resource_path_t *path = resource->path;
+    uint8_t count;
+    const coap_option_t *opt = _find_options(inpkt, COAP_OPTION_URI_PATH, &count);
+    if (!path || !coap_match_path(path, opt, count)) {
+        return COAP_ERR_OPTION_NOT_FOUND;
+    }
+    const size_t namelen = strlen(name);
+    for (int i = 0; (i < path->count) && (i < count); ++i) {
+        const char *item = path->items[i];
+        if (_is_path_param(item) && (strncmp(item + 1, name, namelen) == 0) &&
+            (item[namelen + 1] == '}')) {
+            *param = opt[i].buf;
+            return COAP_SUCCESS;
+        }
+    }
+    return COAP_ERR_OPTION_NOT_FOUND;
+}
+
+int coap_get_link_filter(const coap_packet_t *inpkt, coap_link_filter_t *filter)
+{
+    uint8_t count;
+    const coap_option_t *opt = _find_options(inpkt, COAP_OPTION_URI_QUERY, &count);
+    memset(filter, 0, sizeof(*filter));
+    filter->ct = -1;
+    for (uint8_t i = 0; i < count; ++i) {
+        const coap_buffer_t *query = &opt[i].buf;
+        const uint8_t *eq = memchr(query->p, '=', query->len);
+        if (!eq) {
+            return COAP_ERR_UNSUPPORTED;
+        }
+        const size_t namelen = eq - query->p;
+        const coap_buffer_t value = {eq + 1, query->len - namelen - 1};
+        if ((namelen == 2) && !memcmp(query->p, "rt", 2)) {
+            filter->rt = value;
+        }
+        else if ((namelen == 2) && !memcmp(query->p, "if", 2)) {
+            filter->iface = value;
+        }
+        else if ((namelen == 4) && !memcmp(query->p, "href", 4)) {
+            filter->href = value;
+        }
+        else if ((namelen == 2) && !memcmp(query->p, "ct", 2)) {
+            // content formats are numbers, no prefix match
+            uint32_t ct = 0;
+            for (size_t k = 0; k < value.len; ++k) {
+                if ((value.p[k] < '0') || (value.p[k] > '9') || (ct > 0xFFFF)) {
+                    return COAP_ERR_UNSUPPORTED;
                 }
+                ct = ct * 10 + (value.p[k] - '0');
             }
-            if (i == count) { // matching resource found
-                return rs->handler(rs, reqpkt, rsppkt);
+            if (!value.len || (ct > 0xFFFF)) {
+                return COAP_ERR_UNSUPPORTED;
             }
+            filter->ct = (int32_t)ct;
+        }
+        else {
+            return COAP_ERR_UNSUPPORTED;
         }
     }
-    return COAP_ERR_REQUEST_NOT_FOUND;
+    return COAP_SUCCESS;
+}
+
+int coap_make_link_format_block(const coap_resource_t *resources,
+                                const coap_link_filter_t *filter,
+                                const size_t offset,
+                                uint8_t *buf, size_t *buflen, bool *more)
+{
+    _window_t w = {buf, *buflen, offset, 0};
+    // stop once the window is passed, the rest is not needed
+    for (const coap_resource_t *rs = resources; rs->handler && !_full(&w); ++rs) {
+        if (!_is_listed(rs) || (filter && !_match_link(filter, rs))) {
+            continue;
+        }
+        if (w.total) {
+            _put(&w, ",", 1);
+        }
+        _put_link(&w, rs);
+    }
+    if (offset && (w.total <= offset)) {
+        return COAP_ERR_OPTION_NOT_FOUND;
+    }
+    *more = _full(&w);
+    *buflen = *more ? w.size : w.total - w.skip;
+    return COAP_SUCCESS;
 }
 
 int coap_make_link_format(const coap_resource_t *resources,
                           char *buf, size_t buflen)
 {
-    if (buflen < 4) { // <>;
+    if (buflen < 1) {
         return COAP_ERR_BUFFER_TOO_SMALL;
     }
-    memset(buf,0,buflen);
-    // loop over resources
-    int len = buflen - 1;
-    for (const coap_resource_t *rs = resources; rs->handler; ++rs) {
-        if (0 > len)
-            return COAP_ERR_BUFFER_TOO_SMALL;
-        // skip if missing content type
-        if (COAP_CONTENTTYPE_NONE == COAP_GET_CONTENTTYPE(rs->content_type))
-            continue;
-        // comma separated list
-        if (0 < strlen(buf)) {
-            strncat(buf, ",", len);
-            len--;
-        }
-        // insert < at path beginning
-        strncat(buf, "<", len);
-        len--;
-        // insert path by elements
-        for (int i = 0; i < rs->path->count; i++) {
-            strncat(buf, "/", len);
-            len--;
-
-            strncat(buf, rs->path->items[i], len);
-            len -= strlen(rs->path->items[i]);
-        }
-        // insert >; after path
-        strncat(buf, ">;", len);
-        len -= 2;
-        // append content type
-        len -= sprintf(buf + (buflen - len - 1), "ct=%d",
-                       COAP_GET_CONTENTTYPE(rs->content_type));
+    // room for the terminating NUL
+    size_t len = buflen - 1;
+    bool more;
+    int rc = coap_make_link_format_block(resources, NULL, 0, (uint8_t *)buf,
+                                         &len, &more);
+    buf[len] = '\0';
+    if (rc) {
+        return rc;
     }
-    return COAP_SUCCESS;
+    return more ? COAP_ERR_BUFFER_TOO_SMALL : COAP_SUCCESS;
 }
 
 const coap_option_t *coap_find_uri_path(const coap_packet_t *pkt,
@@ -336,8 +1216,108 @@ const coap_option_t *coap_find_uri_path(const coap_packet_t *pkt,
     return _find_options(pkt, COAP_OPTION_URI_PATH, count);
 }
 
+int coap_get_option_uint(const coap_packet_t *pkt,
+                         const coap_option_num_t num, uint32_t *value)
+{
+    const coap_option_t *opt = _find_options(pkt, num, NULL);
+    if (!opt) {
+        return COAP_ERR_OPTION_NOT_FOUND;
+    }
+    if (opt->buf.len > 4) {
+        return COAP_ERR_OPTION_LEN_INVALID;
+    }
+    *value = 0;
+    for (size_t i = 0; i < opt->buf.len; ++i) {
+        *value = (*value << 8) | opt->buf.p[i];
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_get_block_option(const coap_packet_t *pkt,
+                          const coap_option_num_t num, coap_block_t *block)
+{
+    uint32_t value;
+    int rc = coap_get_option_uint(pkt, num, &value);
+    if (rc) {
+        return rc;
+    }
+    // szx 7 is reserved, block numbers have at most 20 bits
+    if (((value & 0x07) == 7) || (value > 0xFFFFFF)) {
+        return COAP_ERR_OPTION_LEN_INVALID;
+    }
+    block->num = value >> 4;
+    block->more = (value & 0x08) != 0;
+    block->szx = value & 0x07;
+    return COAP_SUCCESS;
+}
+
+size_t coap_encode_block_option(const coap_block_t *block, uint8_t *buf)
+{
+    const uint32_t value = (block->num << 4) | (block->more ? 0x08 : 0) |
+                           (block->szx & 0x07);
+    return coap_encode_option_uint(value, buf);
+}
+
+size_t coap_encode_option_uint(const uint32_t value, uint8_t *buf)
+{
+    size_t len = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        // skip leading zero bytes, zero itself is empty
+        if (len || (value >> shift)) {
+            buf[len++] = value >> shift;
+        }
+    }
+    return len;
+}
+
+int coap_add_option(coap_packet_t *pkt, const coap_option_num_t num,
+                    const uint8_t *value, const size_t len)
+{
+    if (pkt->numopts >= COAP_MAX_OPTIONS) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    // insert behind options with same or lower number
+    size_t i = pkt->numopts;
+    while ((i > 0) && (pkt->opts[i - 1].num > num)) {
+        pkt->opts[i] = pkt->opts[i - 1];
+        --i;
+    }
+    pkt->opts[i].num = num;
+    pkt->opts[i].buf.p = value;
+    pkt->opts[i].buf.len = len;
+    pkt->numopts++;
+    return COAP_SUCCESS;
+}
+
 const coap_option_t *coap_find_option(const coap_packet_t *pkt,
                                       const coap_option_num_t num)
 {
     return _find_options(pkt, num, NULL);
 }
+
+int coap_compact_find_option(const coap_packet_compact_t *cpkt,
+                             const coap_option_num_t num, coap_buffer_t *value)
+{
+    // numbers are ordered, as in _find_options()
+    for (size_t i = 0; (i < cpkt->numopts) && (cpkt->optnum[i] <= num); ++i) {
+        if (cpkt->optnum[i] == num) {
+            value->p = cpkt->base + cpkt->optoff[i];
+            value->len = cpkt->optlen[i];
+            return COAP_SUCCESS;
+        }
+    }
+    return COAP_ERR_OPTION_NOT_FOUND;
+}
+
+void coap_expand_compact(const coap_packet_compact_t *cpkt, coap_packet_t *pkt)
+{
+    pkt->hdr = cpkt->hdr;
+    pkt->tok = coap_compact_token(cpkt);
+    pkt->numopts = cpkt->numopts;
+    for (size_t i = 0; i < cpkt->numopts; ++i) {
+        pkt->opts[i].num = cpkt->optnum[i];
+        pkt->opts[i].buf.p = cpkt->base + cpkt->optoff[i];
+        pkt->opts[i].buf.len = cpkt->optlen[i];
+    }
+    pkt->payload = coap_compact_payload(cpkt);
+}
@@ -87,6 +87,55 @@ typedef struct coap_packet
     coap_buffer_t payload;  //!< Buffer for payload carried by the packet
 } coap_packet_t;
 
+/**
+ * Compact CoAP packet container, for holding many parsed packets at once
+ *
+ * Same content as coap_packet_t, but token, option values and payload are
+ * 16 bit offsets into the datagram at \p base, and options are kept as
+ * arrays of numbers, offsets and lengths. The whole container is 64 bytes,
+ * one cache line, against about 240 bytes for coap_packet_t. The datagram
+ * must stay valid as long as the container is used. Read it with
+ * coap_compact_token(), coap_compact_option(), coap_compact_find_option()
+ * and coap_compact_payload(), or expand it with coap_expand_compact().
+ */
+typedef struct coap_packet_compact
+{
+    const uint8_t *base;                //!< the datagram, offsets are relative to it
+    coap_header_t hdr;                  //!< Header of the packet
+    uint16_t len;                       //!< size of the datagram
+    uint16_t payload;                   //!< offset of the payload, 0 if none
+    uint16_t optoff[COAP_MAX_OPTIONS];  //!< offsets of the option values
+    uint16_t optlen[COAP_MAX_OPTIONS];  //!< lengths of the option values
+    uint8_t optnum[COAP_MAX_OPTIONS];   //!< option numbers
+    uint8_t numopts;                    //!< Number of options included in this packet
+} coap_packet_compact_t;
+
+#ifndef COAP_ENDPOINT_MAXLEN
+#define COAP_ENDPOINT_MAXLEN 28     //!< fits struct sockaddr_in6
+#endif
+
+/**
+ * Transport address of a peer, opaque to the protocol layer
+ */
+typedef struct coap_endpoint
+{
+    uint8_t len;                        //!< number of bytes used in addr
+    uint8_t addr[COAP_ENDPOINT_MAXLEN]; //!< e.g. struct sockaddr_in(6)
+} coap_endpoint_t;
+
+/**
+ * @brief callback function sending a datagram
+ *
+ * @param[in] ctx Context given along with the callback
+ * @param[in] ep Destination of the datagram
+ * @param[in] buf The datagram
+ * @param[in] buflen Size of \p buf in bytes
+ *
+ * @return 0 on success, some error code otherwise
+ */
+typedef int (*coap_transport_send)(void *ctx, const coap_endpoint_t *ep,
+                                   const uint8_t *buf, const size_t buflen);
+
 /////////////////////////////////////////
 
 /**
@@ -106,6 +155,8 @@ typedef enum
     COAP_OPTION_OBSERVE         = 6,
     COAP_OPTION_URI_PORT        = 7,
     COAP_OPTION_LOCATION_PATH   = 8,
+    // OSCORE, https://tools.ietf.org/html/rfc8613#section-2
+    COAP_OPTION_OSCORE          = 9,
     COAP_OPTION_URI_PATH        = 11,
     COAP_OPTION_CONTENT_FORMAT  = 12,
     COAP_OPTION_MAX_AGE         = 14,
@@ -122,6 +173,8 @@ typedef enum
     COAP_OPTION_PROXY_URI       = 35,
     COAP_OPTION_PROXY_SCHEME    = 39,
     COAP_OPTION_SIZE1           = 60,
+    // Echo, https://tools.ietf.org/html/rfc9175#section-2.2
+    COAP_OPTION_ECHO            = 252,
 } coap_option_num_t;
 
 /**
@@ -204,6 +257,10 @@ typedef enum
     COAP_CONTENTTYPE_APP_OCTECT_STREAM      = 42,
     COAP_CONTENTTYPE_APP_EXI                = 47,
     COAP_CONTENTTYPE_APP_JSON               = 50,
+    COAP_CONTENTTYPE_APP_CBOR               = 60,
+    // https://tools.ietf.org/html/rfc8428#section-12.3
+    COAP_CONTENTTYPE_APP_SENML_JSON         = 110,
+    COAP_CONTENTTYPE_APP_SENML_CBOR         = 112,
 } coap_content_type_t;
 
 ///////////////////////
@@ -230,6 +287,19 @@ typedef enum
     COAP_ERR_REQUEST_MSGID_MISMATCH,
     COAP_ERR_REQUEST_TOKEN_MISMATCH,
     COAP_ERR_RESPONSE,
+    COAP_ERR_NOT_ACCEPTABLE,
+    COAP_ERR_INCOMPLETE,
+    COAP_ERR_MALFORMED,
+    COAP_ERR_TYPE_MISMATCH,
+    COAP_ERR_BLOCK_SEQUENCE,
+    COAP_ERR_TIMEOUT,
+    COAP_ERR_RESET,
+    COAP_ERR_BUSY,
+    COAP_ERR_IO,
+    COAP_ERR_DECRYPT,
+    COAP_ERR_REPLAY,
+    COAP_ERR_NO_CONTEXT,
+    COAP_ERR_FRESHNESS,
     COAP_ERR_MAX                            = 99,
 } coap_error_t;
 
@@ -251,13 +321,40 @@ typedef enum {
 } coap_state_t;
 
 
+///////////////////////
+
+/**
+ * Value of a Block1 or Block2 option,
+ * see https://tools.ietf.org/html/rfc7959#section-2.2
+ */
+typedef struct coap_block
+{
+    uint32_t num;           //!< block number
+    bool more;              //!< more blocks follow
+    uint8_t szx;            //!< size exponent, block size is 2^(szx + 4)
+} coap_block_t;
+
+#define COAP_BLOCK_SIZE(szx)    (16U << (szx))  //!< block size in bytes
+#define COAP_BLOCK_MAX_SZX      6               //!< 1024 byte blocks
+
 ///////////////////////
 
 #ifndef COAP_MAX_PATHITEMS
-#define COAP_MAX_PATHITEMS 2  //!< number of path elements
+#define COAP_MAX_PATHITEMS 4  //!< number of path elements
 #endif
+
+#define COAP_PATH_WILDCARD "*"  //!< trailing path item matching any remainder
+
 /**
  * Describes the path elements of a CoAP resource
+ *
+ * Each item is matched against one Uri-Path segment. Besides literal
+ * segments an item may be a parameter, written as "{name}", matching any
+ * single segment, or COAP_PATH_WILDCARD as last item, matching zero or more
+ * trailing segments. E.g. {3, {"sensor", "{id}", "value"}} serves
+ * /sensor/17/value and /sensor/18/value with one resource. Segments captured
+ * by parameters and the wildcard are available to the handler through
+ * coap_get_path_params() and coap_get_path_param().
  */
 typedef struct coap_resource_path
 {
@@ -267,6 +364,81 @@ typedef struct coap_resource_path
 
 typedef struct coap_resource coap_resource_t;
 
+/**
+ * @brief callback function rendering a resource representation
+ *
+ * @param[in] resource Pointer to the resource to be rendered
+ * @param[out] buf Buffer the representation is written to
+ * @param[in,out] buflen Contains the size of \p buf, then stores how many
+ * bytes have been written to \p buf.
+ *
+ * @return 0 on success, some coap_error_t otherwise
+ */
+typedef int (*coap_content_encoder)(const coap_resource_t *resource,
+                                    uint8_t *buf, size_t *buflen);
+
+#ifndef COAP_CONTENT_RENDER_MAX
+#define COAP_CONTENT_RENDER_MAX 1024    //!< per-thread rendering, cache disabled
+#endif
+
+#define COAP_CONTENT_INVALID    0       //!< cache empty or stale
+#define COAP_CONTENT_FILLING    1       //!< cache being rendered
+#define COAP_CONTENT_VALID      2       //!< cache holds current rendering
+
+/**
+ * Describes one representation of a resource in a distinct content format
+ *
+ * A rendered representation is kept in \p cache and reused for following
+ * requests, until coap_invalidate_content() is called. Arrays of formats are
+ * terminated by an entry without encoder.
+ *
+ * The cache is filled by one thread only, see coap_content_cache(); \p valid
+ * is accessed atomically, so other threads may invalidate it at any time.
+ */
+typedef struct coap_content_format
+{
+    const uint8_t content_type[2];      //!< content format of representation
+    coap_content_encoder encoder;       //!< callback rendering representation
+    coap_rw_buffer_t cache;             //!< storage of rendered representation
+    size_t cache_len;                   //!< number of bytes used in cache
+    unsigned valid;                     //!< COAP_CONTENT_INVALID, _FILLING or _VALID
+} coap_content_format_t;
+
+/**
+ * @brief callback function patching a pre-encoded response
+ *
+ * Writes the changing part of a response, e.g. a counter, in place.
+ *
+ * @param[in] resource Pointer to the resource requested
+ * @param[in] inpkt Pointer to the request packet
+ * @param[out] buf Bytes to be patched, within the outgoing datagram
+ * @param[in] len Number of bytes to be written to \p buf
+ *
+ * @return 0 on success, otherwise the resource handler responds instead
+ */
+typedef int (*coap_response_patcher)(const coap_resource_t *resource,
+                                     const coap_packet_t *inpkt,
+                                     uint8_t *buf, const size_t len);
+
+/**
+ * Pre-encoded response of a resource
+ *
+ * Holds options and payload encoded by coap_make_response_template().
+ * coap_handle_packet() answers requests with a copy, stamped with type,
+ * message ID and token of the request, and calls \p patch to fill in
+ * \p patch_len bytes at \p patch_offset of the payload, if set.
+ */
+typedef struct coap_response_template
+{
+    coap_rw_buffer_t buf;               //!< storage of encoded response, without token
+    size_t len;                         //!< number of bytes used in buf
+    size_t payload;                     //!< offset of payload in buf, 0 if none
+    coap_response_patcher patch;        //!< callback patching the payload, optional
+    size_t patch_offset;                //!< offset of patched bytes in payload
+    size_t patch_len;                   //!< number of patched bytes
+    bool valid;                         //!< buf holds the encoded response
+} coap_response_template_t;
+
 /**
  * @brief callback function for resource handler
  *
@@ -281,19 +453,73 @@ typedef int (*coap_resource_handler)(const coap_resource_t *resource,
                                      const coap_packet_t *inpkt,
                                      coap_packet_t *pkt);
 
+/**
+ * @brief callback function taking over a request of a blocking resource
+ *
+ * @param[in] ctx Context given to coap_handle_packet_offload()
+ * @param[in] resource The resource requested
+ * @param[in] inbuf The request datagram, valid during the callback only
+ * @param[in] inlen Size of \p inbuf in bytes
+ *
+ * @return 0 if the request was taken over, some error code otherwise
+ */
+typedef int (*coap_offload_fn)(void *ctx, coap_resource_t *resource,
+                               const uint8_t *inbuf, const size_t inlen);
+
+#define COAP_RESOURCE_BLOCKING  0x01    //!< handler may block, see coap_handle_packet_offload()
+#define COAP_RESOURCE_LINK_FORMAT 0x02  //!< GET serves the link format of the table, see coap_handle_packet_offload()
+#define COAP_RESOURCE_ASYNC     0x04    //!< handler is a coroutine, see coap_async.h
+#define COAP_RESOURCE_OSCORE    0x08    //!< protected requests only, see coap_oscore_handle_packet()
+
+/**
+ * Link attributes of a resource in addition to its content formats,
+ * see https://tools.ietf.org/html/rfc6690#section-3
+ */
+typedef struct coap_link_attrs
+{
+    const char *rt;                     //!< resource types, space separated, optional
+    const char *iface;                  //!< interface descriptions, space separated, optional
+    uint32_t sz;                        //!< maximum size estimate, 0 if unknown
+    bool obs;                           //!< observable
+} coap_link_attrs_t;
+
 /**
  * Describes a distinct resource served by a CoAP entpoint
+ *
+ * The fields following content_type are optional, tables may leave them out
+ * or name them with designated initializers, they are zero then.
  */
 struct coap_resource
 {
-    coap_state_t state;                 //!< message handling state
+    coap_state_t state;                 //!< unused, exchanges keep their state per thread
     const coap_method_t method;         //!< method POST, PUT or GET
     const coap_msgtype_t msg_type;      //!< message type CON, NONCON, ACK
     coap_resource_handler handler;      //!< callback function for method
     const coap_resource_path_t *path;   //!< resource path, e.g. foo/bar/
     const uint8_t content_type[2];      //!< content type of response
+    coap_content_format_t *formats;     //!< representations offered, optional
+    coap_response_template_t *response; //!< pre-encoded response, optional
+    unsigned flags;                     //!< COAP_RESOURCE_BLOCKING, _LINK_FORMAT, _ASYNC, _OSCORE
+    const coap_link_attrs_t *link;      //!< link attributes, optional
 };
 
+#ifndef COAP_TEMPLATE_MAXLEN
+#define COAP_TEMPLATE_MAXLEN 64     //!< max. size of pre-encoded options
+#endif
+
+/**
+ * Pre-encoded request for a resource
+ *
+ * Header and options are encoded once by coap_make_request_template(), then
+ * coap_build_request() merely stamps message ID, token and payload per send.
+ */
+typedef struct coap_request_template
+{
+    uint8_t hdr[2];                     //!< version, type and code, token length 0
+    size_t optslen;                     //!< number of bytes used in opts
+    uint8_t opts[COAP_TEMPLATE_MAXLEN]; //!< encoded options
+} coap_request_template_t;
+
 /**
  * @brief Set content type
  *
@@ -326,6 +552,65 @@ struct coap_resource
  */
 int coap_parse(const uint8_t *buf, const size_t buflen, coap_packet_t *pkt);
 
+/**
+ * @brief Parse CoAP packet/message into the compact container
+ *
+ * Like coap_parse(), but writes the 64 byte coap_packet_compact_t, so that
+ * batches of parsed packets take a quarter of the cache.
+ *
+ * @param[in] buf The datagram, referenced by \p pkt afterwards
+ * @param[in] buflen The lenth of \p buf in bytes.
+ * @param[out] pkt The container to be filled.
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if \p buflen exceeds 16 bits,
+ * or the according coap_error_t
+ */
+int coap_parse_compact(const uint8_t *buf, const size_t buflen,
+                       coap_packet_compact_t *pkt);
+
+/**
+ * @brief Expand a compact packet into the regular container
+ *
+ * The result references the datagram of \p cpkt, as if it had been parsed
+ * by coap_parse(). Expanding into one coap_packet_t that stays in cache is
+ * cheaper than keeping a coap_packet_t per packet of a batch.
+ *
+ * @param[in] cpkt The compact packet
+ * @param[out] pkt The packet to be filled
+ */
+void coap_expand_compact(const coap_packet_compact_t *cpkt, coap_packet_t *pkt);
+
+/**
+ * @brief Token of a compact packet
+ */
+static inline coap_buffer_t coap_compact_token(const coap_packet_compact_t *cpkt)
+{
+    const coap_buffer_t tok = {cpkt->hdr.tkl ? cpkt->base + sizeof(coap_raw_header_t) : NULL,
+                               cpkt->hdr.tkl};
+    return tok;
+}
+
+/**
+ * @brief Payload of a compact packet, empty if there is none
+ */
+static inline coap_buffer_t coap_compact_payload(const coap_packet_compact_t *cpkt)
+{
+    const coap_buffer_t payload = {cpkt->payload ? cpkt->base + cpkt->payload : NULL,
+                                   cpkt->payload ? (size_t)(cpkt->len - cpkt->payload) : 0};
+    return payload;
+}
+
+/**
+ * @brief Option \p i of a compact packet, \p i below numopts
+ */
+static inline coap_option_t coap_compact_option(const coap_packet_compact_t *cpkt,
+                                                const size_t i)
+{
+    const coap_option_t opt = {cpkt->optnum[i],
+                               {cpkt->base + cpkt->optoff[i], cpkt->optlen[i]}};
+    return opt;
+}
+
 /**
  * @brief Writes CoAP packet/message to transmission buffer
  *
@@ -349,6 +634,26 @@ int coap_parse(const uint8_t *buf, const size_t buflen, coap_packet_t *pkt);
  */
 int coap_build(const coap_packet_t *pkt, uint8_t *buf, size_t *buflen);
 
+/**
+ * @brief Locate the payload of a CoAP packet within a transmission buffer
+ *
+ * Computes where coap_build() will place the payload of \p pkt when writing
+ * to \p buf, so that a payload can be encoded straight into the datagram.
+ * Set pkt->payload to the bytes written there, coap_build() then leaves them
+ * in place instead of copying.
+ *
+ * @param[in] pkt The packet, header, token and options must be final.
+ * @param[in] buf Byte buffer later passed to coap_build()
+ * @param[in] buflen The size of \p buf
+ * @param[out] payload Region of \p buf available for the payload
+ *
+ * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL if header and options
+ * leave no room for a payload.
+ */
+int coap_build_payload_buffer(const coap_packet_t *pkt,
+                              uint8_t *buf, const size_t buflen,
+                              coap_rw_buffer_t *payload);
+
 /**
  * @brief Create CoAP acknowledgement
  *
@@ -371,6 +676,45 @@ int coap_make_request(const uint16_t msgid, const coap_buffer_t* tok,
                       const uint8_t *content, const size_t content_len,
                       coap_packet_t *pkt);
 
+/**
+ * @brief Pre-encode the request for a resource
+ *
+ * Encodes message type, method, path and content format of \p resource as
+ * coap_make_request() and coap_build() would, for use with
+ * coap_build_request().
+ *
+ * @param[in] resource The resource requested
+ * @param[out] tpl The template
+ *
+ * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL if the options exceed
+ * COAP_TEMPLATE_MAXLEN or COAP_MAX_OPTIONS.
+ */
+int coap_make_request_template(const coap_resource_t *resource,
+                               coap_request_template_t *tpl);
+
+/**
+ * @brief Write a request from a template to transmission buffer
+ *
+ * Same result as coap_make_request() followed by coap_build(), without
+ * encoding options again.
+ *
+ * @param[in] tpl The template
+ * @param[in] msgid The message ID.
+ * @param[in] tok Pointer to the token, may be NULL
+ * @param[in] content The request payload.
+ * @param[in] content_len The size of \p content in bytes
+ * @param[out] buf Byte buffer the request is written to
+ * @param[in,out] buflen Contains the size of \p buf, then stores how
+ * many bytes have been written to \p buf.
+ *
+ * @return 0 on success, COAP_ERR_BUFFER_TOO_SMALL if \p buf is too short,
+ * or COAP_ERR_UNSUPPORTED if the token is longer than COAP_MAX_TOKLEN.
+ */
+int coap_build_request(const coap_request_template_t *tpl,
+                       const uint16_t msgid, const coap_buffer_t *tok,
+                       const uint8_t *content, const size_t content_len,
+                       uint8_t *buf, size_t *buflen);
+
 /**
  * @brief Create a CoAP response packet
  *
@@ -396,12 +740,83 @@ int coap_make_response(const uint16_t msgid, const coap_buffer_t* tok,
                        const uint8_t *content, const size_t content_len,
                        coap_packet_t *pkt);
 
+/**
+ * @brief Select representation of a resource for a request
+ *
+ * Matches the Accept option of \p inpkt against the formats offered by
+ * \p resource. Without Accept option the first format is selected.
+ *
+ * @param[in] resource Pointer to the resource offering the formats
+ * @param[in] inpkt Pointer to the request packet
+ * @param[out] format Selected format, NULL if the resource has no formats
+ *
+ * @return 0 on success, or COAP_ERR_NOT_ACCEPTABLE if no offered format
+ * matches the Accept option.
+ */
+int coap_negotiate_content(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_content_format_t **format);
+
+/**
+ * @brief Create a CoAP response with a negotiated representation
+ *
+ * Selects a format via coap_negotiate_content(), renders it into its cache
+ * unless a valid rendering is present, and creates a response carrying the
+ * cached representation. Responds with 4.06 if no format is acceptable and
+ * 5.00 if rendering fails.
+ *
+ * @param[in] resource Pointer to the resource offering the formats
+ * @param[in] inpkt Pointer to the request packet
+ * @param[in] msgtype The message type (CON, NON, ACK).
+ * @param[in] rspcode The response code on success.
+ * @param[out] pkt Pointer to the coap_packet_t that will be filled.
+ *
+ * @return the state as returned by coap_make_response()
+ */
+int coap_make_content_response(const coap_resource_t *resource,
+                               const coap_packet_t *inpkt,
+                               const coap_msgtype_t msgtype,
+                               const coap_responsecode_t rspcode,
+                               coap_packet_t *pkt);
+
+/**
+ * @brief Use the render cache of formats on the calling thread, or not
+ *
+ * On by default. The cache of a formats array must be used by one thread
+ * only, the one serving the resource table. Other threads handling the same
+ * resources, e.g. workers of coap_pool.h or coap_workers.h, turn it off and
+ * render into a buffer of their own, of COAP_CONTENT_RENDER_MAX bytes at
+ * most, which the response points to until the thread renders again.
+ *
+ * @param[in] enabled Whether coap_make_content_response() fills and serves
+ * the cache on this thread
+ */
+void coap_content_cache(const bool enabled);
+
+/**
+ * @brief Drop cached representations
+ *
+ * Call whenever the state behind \p formats changes, the next response will
+ * render its representation again. Resources may share one formats array,
+ * e.g. the PUT handler of a resource invalidates what its GET serves. Safe
+ * to call from any thread; a rendering in progress is not kept.
+ *
+ * @param[in,out] formats Array of formats as referenced by coap_resource_t
+ */
+void coap_invalidate_content(coap_content_format_t *formats);
+
 /**
  * @brief Handle incoming CoAP request
  *
  * Handles the CoAP request in \p inpkt, and creates a response packet which is
  * stored in \p pkt.
  *
+ * A confirmable request to a resource of another msg_type is acknowledged
+ * empty first, returning COAP_STATE_ACK_SEND; calling again with the same
+ * request on the same thread runs the handler for the separate response.
+ * The exchange is remembered per thread, never in the resource, so threads
+ * may share a table.
+ *
  * @param[in/out] resources Pointer to the coap_resource_t array of all resources.
  * @param[in] inpkt Pointer to the coap_packet_t structure containing the
  * request.
@@ -417,21 +832,202 @@ int coap_handle_request(coap_resource_t *resources,
 int coap_handle_response(coap_resource_t *resources,
                         const coap_packet_t *reqpkt,
                         coap_packet_t *rsppkt);
-int coap_handle_packet();
+
+/**
+ * @brief Handle a request datagram and write the response datagram
+ *
+ * Parses \p inbuf and dispatches the request like coap_handle_request().
+ * Resources with a valid pre-encoded response are answered by copying it
+ * to \p outbuf, without building the response packet.
+ *
+ * @param[in] resources Array of resources, terminated by one without handler
+ * @param[in] inbuf The received datagram
+ * @param[in] inlen The size of \p inbuf in bytes
+ * @param[out] outbuf Buffer for the response, must not overlap \p inbuf
+ * @param[in,out] outlen Contains the size of \p outbuf, then stores how
+ * many bytes have been written to \p outbuf.
+ *
+ * @return 0 if \p outbuf holds a datagram to send. Otherwise nothing is to be
+ * sent: COAP_STATE_RSP_WAIT if the handler responds later, or an error of
+ * coap_parse(), the handler or coap_build().
+ */
+int coap_handle_packet(coap_resource_t *resources,
+                       const uint8_t *inbuf, const size_t inlen,
+                       uint8_t *outbuf, size_t *outlen);
+
+/**
+ * @brief Handle a request datagram, handing blocking ones to \p offload
+ *
+ * Like coap_handle_packet(), except for requests of resources flagged
+ * COAP_RESOURCE_BLOCKING or COAP_RESOURCE_ASYNC: these are passed to
+ * \p offload, which runs the handler elsewhere and sends a separate
+ * response. Without \p offload, requests of COAP_RESOURCE_ASYNC resources
+ * are answered with 5.03. \p outbuf then holds the
+ * empty ACK of a confirmable request, as per
+ * https://tools.ietf.org/html/rfc7252#section-5.2.2, or 5.03 if \p offload
+ * fails.
+ *
+ * GET requests of resources flagged COAP_RESOURCE_LINK_FORMAT are answered
+ * with the link format of \p resources, filtered by the query of the
+ * request, see coap_get_link_filter(). It is rendered right into
+ * \p outbuf, in Block2 chunks if it exceeds \p outbuf or the block asked
+ * for, see https://tools.ietf.org/html/rfc7959#section-2.4.
+ *
+ * @param[in] offload Callback taking over requests, NULL to run all inline
+ * @param[in] ctx Context passed to \p offload
+ *
+ * @return as coap_handle_packet(), or COAP_STATE_RSP_WAIT if a
+ * non-confirmable request was taken over and there is nothing to send
+ */
+int coap_handle_packet_offload(coap_resource_t *resources,
+                               const uint8_t *inbuf, const size_t inlen,
+                               uint8_t *outbuf, size_t *outlen,
+                               coap_offload_fn offload, void *ctx);
+
+/**
+ * @brief Handle a request parsed by coap_parse_compact()
+ *
+ * Like coap_handle_packet_offload() for the datagram of \p cpkt, without
+ * parsing it again; handlers get it expanded as usual.
+ *
+ * @return as coap_handle_packet_offload()
+ */
+int coap_handle_compact(coap_resource_t *resources,
+                        const coap_packet_compact_t *cpkt,
+                        uint8_t *outbuf, size_t *outlen,
+                        coap_offload_fn offload, void *ctx);
+
+/**
+ * @brief Pre-encode the response of a resource
+ *
+ * Encodes \p pkt, e.g. from coap_make_response(), into the storage of
+ * \p tpl and marks it valid. Message type, ID and token of \p pkt are
+ * ignored. Set tpl->valid to false, or call again, when the response changes.
+ *
+ * @param[in] pkt The response packet
+ * @param[in,out] tpl The template, with buf, and patch fields if any, set
+ *
+ * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL if the response does
+ * not fit tpl->buf, or the patched range exceeds the payload.
+ */
+int coap_make_response_template(const coap_packet_t *pkt,
+                                coap_response_template_t *tpl);
+
+/**
+ * Query filter of a link format request,
+ * see https://tools.ietf.org/html/rfc6690#section-4.1
+ *
+ * Values ending in '*' match any value they are a prefix of.
+ */
+typedef struct coap_link_filter
+{
+    coap_buffer_t rt;                   //!< resource type, empty for any
+    coap_buffer_t iface;                //!< interface description, empty for any
+    coap_buffer_t href;                 //!< path, e.g. "/sensors/*", empty for any
+    int32_t ct;                         //!< content format, -1 for any
+} coap_link_filter_t;
+
+/**
+ * @brief Get the filter of a link format request from its Uri-Query options
+ *
+ * Recognizes rt, if, href and ct, several filters must all match.
+ *
+ * @param[in] inpkt The request
+ * @param[out] filter The filter, matching all links if there is no query
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED if a query is no filter
+ * on these attributes.
+ */
+int coap_get_link_filter(const coap_packet_t *inpkt, coap_link_filter_t *filter);
+
+/**
+ * @brief Render part of the link format of resources
+ *
+ * Renders the links of \p resources matching \p filter and copies the
+ * bytes from \p offset on to \p buf. The time taken is linear in the
+ * number of resources up to the end of the part, so consecutive parts serve
+ * the blocks of a Block2 transfer.
+ *
+ * @param[in] resources Array describing all available coap_resource_t
+ * @param[in] filter Filter on the links, NULL for all
+ * @param[in] offset Offset of the part in the link format
+ * @param[out] buf Buffer the part is written to
+ * @param[in,out] buflen Contains the size of \p buf, then stores how many
+ * bytes have been written to \p buf.
+ * @param[out] more Set if the link format continues behind the part
+ *
+ * @return 0 on success, or COAP_ERR_OPTION_NOT_FOUND if \p offset is
+ * beyond the end of a non-empty link format.
+ */
+int coap_make_link_format_block(const coap_resource_t *resources,
+                                const coap_link_filter_t *filter,
+                                const size_t offset,
+                                uint8_t *buf, size_t *buflen, bool *more);
 
 /**
  * @brief Create link format of resources
  *
  * @param[in] resources Array describing all available coap_resource_t
- * @param[out] buf Char buffer to which resource link format will be written to.
- * @param[in,out] buflen Contains the initial size of \p buf, then stores how
- * many bytes have been written to \p buf.
+ * @param[out] buf Char buffer the link format is written to, NUL terminated
+ * @param[in] buflen The size of \p buf
  *
  * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL if buflen is exceeded.
  */
 int coap_make_link_format(const coap_resource_t *resources,
                           char *buf, size_t buflen);
 
+/**
+ * @brief Match Uri-Path segments against a resource path
+ *
+ * Compares the \p count Uri-Path options in \p opt item by item with
+ * \p path, honouring parameters and a trailing wildcard. Every segment is
+ * looked at once, no backtracking takes place.
+ *
+ * @param[in] path Resource path, possibly containing parameters
+ * @param[in] opt Pointer to the first Uri-Path option of a packet
+ * @param[in] count Number of consecutive Uri-Path options at \p opt
+ *
+ * @return true if the segments match \p path, false otherwise
+ */
+bool coap_match_path(const coap_resource_path_t *path,
+                     const coap_option_t *opt, const uint8_t count);
+
+/**
+ * @brief Get segments captured by path parameters
+ *
+ * Fills \p params with the Uri-Path segments of \p inpkt that matched a
+ * "{name}" item or the trailing wildcard of the resource path, in path order.
+ * Each segment matched by the wildcard is a capture of its own. The buffers
+ * point into the datagram of \p inpkt, nothing is copied.
+ *
+ * @param[in] resource Resource that \p inpkt was dispatched to
+ * @param[in] inpkt Pointer to the request packet
+ * @param[out] params Array receiving the captured segments
+ * @param[in,out] count Contains the size of \p params, then stores the
+ * number of captured segments.
+ *
+ * @return 0 on success, COAP_ERR_OPTION_NOT_FOUND if the path of \p inpkt
+ * does not match, or COAP_ERR_BUFFER_TOO_SMALL if \p params is too short.
+ */
+int coap_get_path_params(const coap_resource_t *resource,
+                         const coap_packet_t *inpkt,
+                         coap_buffer_t *params, uint8_t *count);
+
+/**
+ * @brief Get the segment captured by a named path parameter
+ *
+ * @param[in] resource Resource that \p inpkt was dispatched to
+ * @param[in] inpkt Pointer to the request packet
+ * @param[in] name Parameter name without braces, e.g. "id" for "{id}"
+ * @param[out] param Captured segment, pointing into the datagram of \p inpkt
+ *
+ * @return 0 on success, or COAP_ERR_OPTION_NOT_FOUND if there is no such
+ * parameter or the path of \p inpkt does not match.
+ */
+int coap_get_path_param(const coap_resource_t *resource,
+                        const coap_packet_t *inpkt,
+                        const char *name, coap_buffer_t *param);
+
 /**
  * Find the first option of type @p num.
  *
@@ -443,6 +1039,83 @@ int coap_make_link_format(const coap_resource_t *resources,
 const coap_option_t *coap_find_option(const coap_packet_t *pkt,
                                           const coap_option_num_t num);
 
+/**
+ * Find the first option of type @p num in a compact packet.
+ *
+ * @param cpkt pointer to the compact packet.
+ * @param num option type number.
+ * @param value the option value found.
+ *
+ * @return 0 on success, or COAP_ERR_OPTION_NOT_FOUND if there is no such
+ * option.
+ */
+int coap_compact_find_option(const coap_packet_compact_t *cpkt,
+                             const coap_option_num_t num, coap_buffer_t *value);
+
+/**
+ * Read the value of the first option of type @p num as unsigned integer,
+ * see https://tools.ietf.org/html/rfc7252#section-3.2
+ *
+ * @param pkt pointer to the coap packet.
+ * @param num option type number.
+ * @param value the decoded option value.
+ *
+ * @return 0 on success, COAP_ERR_OPTION_NOT_FOUND if there is no such
+ * option, or COAP_ERR_OPTION_LEN_INVALID if the value exceeds 4 bytes.
+ */
+int coap_get_option_uint(const coap_packet_t *pkt,
+                         const coap_option_num_t num, uint32_t *value);
+
+/**
+ * Read a Block1 or Block2 option of a packet.
+ *
+ * @param pkt pointer to the coap packet.
+ * @param num COAP_OPTION_BLOCK1 or COAP_OPTION_BLOCK2.
+ * @param block the decoded block option.
+ *
+ * @return 0 on success, COAP_ERR_OPTION_NOT_FOUND if there is no such
+ * option, or COAP_ERR_OPTION_LEN_INVALID if the option is malformed.
+ */
+int coap_get_block_option(const coap_packet_t *pkt,
+                          const coap_option_num_t num, coap_block_t *block);
+
+/**
+ * Encode a block option value.
+ *
+ * @param block the block option.
+ * @param buf buffer of at least 3 bytes receiving the value.
+ *
+ * @return number of bytes written to @p buf.
+ */
+size_t coap_encode_block_option(const coap_block_t *block, uint8_t *buf);
+
+/**
+ * Encode an unsigned integer option value with minimal length.
+ *
+ * @param value the value.
+ * @param buf buffer of at least 4 bytes receiving the value.
+ *
+ * @return number of bytes written to @p buf.
+ */
+size_t coap_encode_option_uint(const uint32_t value, uint8_t *buf);
+
+/**
+ * Add an option to a packet, keeping options ordered by number.
+ *
+ * The value is not copied, @p value has to stay valid until the packet
+ * has been built.
+ *
+ * @param pkt pointer to the coap packet.
+ * @param num option type number.
+ * @param value option value.
+ * @param len length of @p value.
+ *
+ * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL if the packet already
+ * holds COAP_MAX_OPTIONS options.
+ */
+int coap_add_option(coap_packet_t *pkt, const coap_option_num_t num,
+                    const uint8_t *value, const size_t len);
+
 /**
  *
  * Find the URI PATH option and the number of them.
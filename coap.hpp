@@ -0,0 +1,448 @@
+#ifndef COAP_HPP
+#define COAP_HPP 1
+
+/**
+ * @file coap.hpp
+ *
+ * Header-only C++17 layer over coap.h, with resources declared as a route
+ * table known at compile time:
+ *
+ *     static constexpr auto routes = coap::routes(
+ *         coap::get("/light", COAP_CONTENTTYPE_TXT_PLAIN,
+ *                   [](const coap::exchange &ex) { return ex.reply(COAP_RSPCODE_CONTENT, "1"); }),
+ *         coap::put("/light", COAP_CONTENTTYPE_NONE, handle_light_put));
+ *
+ *     rc = coap::handle_packet<routes>(inbuf, inlen, outbuf, &outlen);
+ *
+ * Paths are split, hashed and checked against COAP_MAX_PATHITEMS by the
+ * compiler, and the link format of the table is rendered by it as well,
+ * see coap::link_format. Dispatch tries the routes in order, but as an
+ * unrolled sequence of comparisons with constant hashes, each calling its
+ * handler directly, so that handlers are inlined instead of being called
+ * through function pointers. Literal paths are matched by comparing the
+ * hash of the request path first, paths with "{name}" parameters or a
+ * trailing COAP_PATH_WILDCARD item segment by segment, as coap_match_path().
+ *
+ * Handlers are lambdas or function objects taking a coap::exchange and
+ * returning a coap_state_t like coap_resource_handler. The table has to be
+ * a constexpr variable with static storage duration, hence handlers must
+ * be literal types, e.g. lambdas without captures; they keep their state
+ * elsewhere. Responses are piggybacked, requests and responses are plain
+ * coap_packet_t as used by coap_parse() and coap_build().
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "coap.h"
+
+namespace coap {
+
+/* --- PRIVATE -------------------------------------------------------------- */
+
+// not constexpr, so calling it in a constant expression fails to compile
+inline void _path_has_too_many_items() {}
+
+// FNV-1a, the same at compile time and at run time
+constexpr uint32_t _hash(uint32_t h, const char *p, const size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    }
+    return (h ^ '/') * 16777619u;
+}
+
+constexpr uint32_t _HASH_BASIS = 2166136261u;
+
+/**
+ * Path of a route, split into items at compile time
+ */
+struct path
+{
+    std::string_view items[COAP_MAX_PATHITEMS];   //!< items without '/'
+    int count;                                    //!< number of items
+    bool pattern;                                 //!< has parameters or a wildcard
+    uint32_t hash;                                //!< hash of the items, unless pattern
+
+    constexpr path(std::string_view s) : items(), count(0), pattern(false), hash(_HASH_BASIS)
+    {
+        while (!s.empty()) {
+            if (s[0] == '/') {
+                s.remove_prefix(1);
+                continue;
+            }
+            const size_t end = s.find('/');
+            const std::string_view item = s.substr(0, end);
+            if (count == COAP_MAX_PATHITEMS) {
+                _path_has_too_many_items();
+                break;
+            }
+            items[count++] = item;
+            pattern = pattern || (item[0] == '{') || (item == COAP_PATH_WILDCARD);
+            hash = _hash(hash, item.data(), item.size());
+            s.remove_prefix(item.size());
+        }
+    }
+};
+
+/**
+ * Route of a method and path to its handler
+ */
+template <typename Handler>
+struct route
+{
+    coap_method_t method;               //!< method served
+    coap::path path;                    //!< path served
+    int content_type;                   //!< coap_content_type_t of responses
+    std::array<uint8_t, 2> ct;          //!< content_type as option value
+    Handler handler;                    //!< callable as int(const coap::exchange &)
+};
+
+/**
+ * Route table as built by coap::routes()
+ */
+template <typename... Routes>
+struct route_table
+{
+    std::tuple<Routes...> routes;       //!< routes, in order of precedence
+};
+
+/**
+ * Request being handled, passed to the handler of its route
+ */
+struct exchange
+{
+    const coap_packet_t &in;            //!< request
+    coap_packet_t &out;                 //!< response, filled by reply()
+    const uint8_t *content_type;        //!< option value of the route, NULL if none
+    const coap::path &path;             //!< path of the route
+    const coap_option_t *segments;      //!< Uri-Path options of the request
+    uint8_t count;                      //!< number of segments
+
+    /**
+     * @brief Respond, with the content format of the route if there is a payload
+     *
+     * @return the state as returned by coap_make_response()
+     */
+    int reply(const coap_responsecode_t rspcode, std::string_view payload = {}) const
+    {
+        return coap_make_response(in.hdr.id, &in.tok,
+                                  (in.hdr.t == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NONCON,
+                                  rspcode, payload.empty() ? NULL : content_type,
+                                  (const uint8_t *)payload.data(), payload.size(), &out);
+    }
+
+    /**
+     * @brief Segment captured by the path parameter "{name}"
+     *
+     * @return the segment, pointing into the request, empty if there is none
+     */
+    std::string_view param(std::string_view name) const
+    {
+        for (int i = 0; (i < path.count) && (i < count); ++i) {
+            const std::string_view item = path.items[i];
+            if ((item.size() == name.size() + 2) && (item[0] == '{') &&
+                (item.substr(1, name.size()) == name)) {
+                return std::string_view((const char *)segments[i].buf.p, segments[i].buf.len);
+            }
+        }
+        return {};
+    }
+};
+
+template <typename Handler>
+constexpr route<Handler> _route(const coap_method_t method, std::string_view p,
+                                const int content_type, Handler handler)
+{
+    return {method, coap::path(p), content_type,
+            {(uint8_t)((content_type & 0xFF00) >> 8), (uint8_t)(content_type & 0xFF)},
+            handler};
+}
+
+constexpr size_t _put(char *buf, size_t pos, std::string_view s)
+{
+    for (size_t i = 0; i < s.size(); ++i, ++pos) {
+        if (buf) {
+            buf[pos] = s[i];
+        }
+    }
+    return pos;
+}
+
+constexpr size_t _put_uint(char *buf, size_t pos, uint32_t value)
+{
+    char digits[10] = {};
+    size_t i = sizeof(digits);
+    do {
+        digits[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return _put(buf, pos, std::string_view(digits + i, sizeof(digits) - i));
+}
+
+/* https://tools.ietf.org/html/rfc6690#section-2, listed like _put_link() */
+template <typename... Routes>
+constexpr size_t _render_link_format(const route_table<Routes...> &table, char *buf)
+{
+    size_t pos = 0;
+    std::apply([&](const auto &... rt) {
+        auto link = [&](const auto &r) {
+            if (r.content_type == COAP_CONTENTTYPE_NONE) {
+                return;
+            }
+            if (pos) {
+                pos = _put(buf, pos, ",");
+            }
+            pos = _put(buf, pos, "<");
+            for (int i = 0; i < r.path.count; ++i) {
+                pos = _put(buf, pos, "/");
+                pos = _put(buf, pos, r.path.items[i]);
+            }
+            pos = _put(buf, pos, ">;ct=");
+            pos = _put_uint(buf, pos, (uint16_t)r.content_type);
+        };
+        (link(rt), ...);
+    }, table.routes);
+    return pos;
+}
+
+template <const auto &Table>
+struct _link_format
+{
+    static constexpr size_t size = _render_link_format(Table, nullptr);
+    static constexpr std::array<char, size + 1> text = [] {
+        std::array<char, size + 1> a{};
+        _render_link_format(Table, a.data());
+        return a;
+    }();
+};
+
+inline uint32_t _hash_segments(const coap_option_t *opt, const uint8_t count)
+{
+    uint32_t h = _HASH_BASIS;
+    for (uint8_t i = 0; i < count; ++i) {
+        h = _hash(h, (const char *)opt[i].buf.p, opt[i].buf.len);
+    }
+    return h;
+}
+
+inline bool _segment_equals(std::string_view item, const coap_buffer_t &seg)
+{
+    return (item.size() == seg.len) && !item.compare(0, seg.len, (const char *)seg.p, seg.len);
+}
+
+/* as coap_match_path(), literal paths compare their hash first */
+inline bool _match(const coap::path &p, const coap_option_t *opt,
+                   const uint8_t count, const uint32_t hash)
+{
+    if (!p.pattern) {
+        if ((hash != p.hash) || (count != p.count)) {
+            return false;
+        }
+        for (int i = 0; i < p.count; ++i) {
+            if (!_segment_equals(p.items[i], opt[i].buf)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    int i;
+    for (i = 0; i < p.count; ++i) {
+        if ((i == p.count - 1) && (p.items[i] == COAP_PATH_WILDCARD)) {
+            return true;
+        }
+        if (i >= count) {
+            return false;
+        }
+        if ((p.items[i][0] != '{') && !_segment_equals(p.items[i], opt[i].buf)) {
+            return false;
+        }
+    }
+    return (i == count);
+}
+
+/* single fixed representation, as _is_acceptable() */
+inline bool _is_acceptable(const int content_type, const coap_packet_t &in)
+{
+    uint32_t accept;
+    if (content_type == COAP_CONTENTTYPE_NONE) {
+        return true;
+    }
+    if (coap_get_option_uint(&in, COAP_OPTION_ACCEPT, &accept)) {
+        return true;
+    }
+    return accept == (uint16_t)content_type;
+}
+
+/* false if route I does not serve the request, rspcode tells why */
+template <const auto &Table, size_t I>
+inline bool _try(const coap_packet_t &in, coap_packet_t &out,
+                 const coap_option_t *opt, const uint8_t count, const uint32_t hash,
+                 coap_responsecode_t &rspcode, int &rc)
+{
+    constexpr const auto &r = std::get<I>(Table.routes);
+    if (!_match(r.path, opt, count, hash)) {
+        return false;
+    }
+    if (in.hdr.code != r.method) {
+        // path exists, but not for this method
+        rspcode = COAP_RSPCODE_METHOD_NOT_ALLOWED;
+        return false;
+    }
+    if (!_is_acceptable(r.content_type, in)) {
+        rspcode = COAP_RSPCODE_NOT_ACCEPTABLE;
+        return false;
+    }
+    const exchange ex{in, out,
+                      (r.content_type == COAP_CONTENTTYPE_NONE) ? NULL : r.ct.data(),
+                      r.path, opt, count};
+    rc = r.handler(ex);
+    return true;
+}
+
+template <const auto &Table, size_t... I>
+inline bool _dispatch(std::index_sequence<I...>, const coap_packet_t &in, coap_packet_t &out,
+                      const coap_option_t *opt, const uint8_t count,
+                      coap_responsecode_t &rspcode, int &rc)
+{
+    const uint32_t hash = _hash_segments(opt, count);
+    // stops at the first route serving the request, or refusing it as unacceptable
+    return (... || (_try<Table, I>(in, out, opt, count, hash, rspcode, rc) ||
+                    (rspcode == COAP_RSPCODE_NOT_ACCEPTABLE)));
+}
+
+inline bool _is_well_known_core(const coap_option_t *opt, const uint8_t count)
+{
+    return (count == 2) && _segment_equals(".well-known", opt[0].buf) &&
+           _segment_equals("core", opt[1].buf);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+
+/**
+ * @brief Route a GET, POST, PUT or DELETE request on \p p to \p handler
+ *
+ * @param[in] p Path, e.g. "/sensor/{id}/value", at most COAP_MAX_PATHITEMS items
+ * @param[in] content_type coap_content_type_t of responses, listed in the
+ * link format unless COAP_CONTENTTYPE_NONE
+ * @param[in] handler Callable as int(const coap::exchange &)
+ */
+template <typename Handler>
+constexpr route<Handler> get(std::string_view p, const int content_type, Handler handler)
+{
+    return _route(COAP_METHOD_GET, p, content_type, handler);
+}
+
+template <typename Handler>
+constexpr route<Handler> post(std::string_view p, const int content_type, Handler handler)
+{
+    return _route(COAP_METHOD_POST, p, content_type, handler);
+}
+
+template <typename Handler>
+constexpr route<Handler> put(std::string_view p, const int content_type, Handler handler)
+{
+    return _route(COAP_METHOD_PUT, p, content_type, handler);
+}
+
+template <typename Handler>
+constexpr route<Handler> del(std::string_view p, const int content_type, Handler handler)
+{
+    return _route(COAP_METHOD_DELETE, p, content_type, handler);
+}
+
+/**
+ * @brief Table of routes, the first one matching a request serves it
+ */
+template <typename... Routes>
+constexpr route_table<Routes...> routes(Routes... r)
+{
+    return {{r...}};
+}
+
+/**
+ * Link format of a route table, rendered at compile time
+ */
+template <const auto &Table>
+inline constexpr std::string_view link_format{_link_format<Table>::text.data(),
+                                              _link_format<Table>::size};
+
+/**
+ * @brief Handle a request with a route table, like coap_handle_request()
+ *
+ * Responds with 4.04, 4.05 or 4.06 if no route serves the request. GET
+ * /.well-known/core is answered with coap::link_format, unless routed.
+ *
+ * @param[in] in The request
+ * @param[out] out The response
+ *
+ * @return the state returned by the handler, or coap_make_response()
+ */
+template <const auto &Table>
+int handle_request(const coap_packet_t &in, coap_packet_t &out)
+{
+    constexpr size_t n = std::tuple_size<decltype(Table.routes)>::value;
+    static constexpr uint8_t ct_link_format[2] = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT);
+    uint8_t count;
+    const coap_option_t *opt = coap_find_uri_path(&in, &count);
+    coap_responsecode_t rspcode = COAP_RSPCODE_NOT_FOUND;
+    int rc = COAP_SUCCESS;
+    if (_dispatch<Table>(std::make_index_sequence<n>{}, in, out, opt, count, rspcode, rc) &&
+        (rspcode != COAP_RSPCODE_NOT_ACCEPTABLE)) {
+        return rc;
+    }
+    if ((rspcode == COAP_RSPCODE_NOT_FOUND) && (in.hdr.code == COAP_METHOD_GET) &&
+        _is_well_known_core(opt, count)) {
+        const std::string_view lf = link_format<Table>;
+        return coap_make_response(in.hdr.id, &in.tok,
+                                  (in.hdr.t == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NONCON,
+                                  COAP_RSPCODE_CONTENT, ct_link_format,
+                                  (const uint8_t *)lf.data(), lf.size(), &out);
+    }
+    return coap_make_response(in.hdr.id, &in.tok, COAP_TYPE_ACK, rspcode,
+                              NULL, NULL, 0, &out);
+}
+
+/**
+ * @brief Handle a request datagram and write the response datagram,
+ * like coap_handle_packet()
+ *
+ * @param[in] inbuf The request datagram
+ * @param[in] inlen Size of \p inbuf in bytes
+ * @param[out] outbuf Buffer the response is written to
+ * @param[in,out] outlen Contains the size of \p outbuf, then the size of
+ * the response
+ *
+ * @return 0 on success, the error of coap_parse() or coap_build(), or the
+ * state of a handler that produced no response, nothing is written then
+ */
+template <const auto &Table>
+int handle_packet(const uint8_t *inbuf, const size_t inlen,
+                  uint8_t *outbuf, size_t *outlen)
+{
+    coap_packet_t inpkt;
+    coap_packet_t pkt{};
+    int rc = coap_parse(inbuf, inlen, &inpkt);
+    if (rc) {
+        return rc;
+    }
+    // errors, and responses that follow, leave nothing to send
+    rc = handle_request<Table>(inpkt, pkt);
+    if ((rc != COAP_STATE_RSP_SEND) && (rc != COAP_STATE_ACK_SEND)) {
+        return rc;
+    }
+    // answers to non-confirmable requests are no ACKs, e.g. to a group
+    if ((inpkt.hdr.t == COAP_TYPE_NONCON) && (pkt.hdr.t == COAP_TYPE_ACK) &&
+        (pkt.hdr.code != COAP_RSPCODE_EMPTY)) {
+        pkt.hdr.t = COAP_TYPE_NONCON;
+    }
+    return coap_build(&pkt, outbuf, outlen);
+}
+
+} // namespace coap
+
+#endif //COAP_HPP
@@ -0,0 +1,199 @@
+#include <string.h>
+
+#include "coap_async.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+typedef struct
+{
+    coap_async_t *async;
+    const coap_endpoint_t *from;
+} _submit_t;
+
+static __thread coap_async_task_t *_current;
+
+static int _offload(void *ctx, coap_resource_t *resource,
+                    const uint8_t *inbuf, const size_t inlen);
+static void _step(coap_async_task_t *task);
+static void _remember(coap_async_task_t *task, const uint8_t *buf, const size_t buflen);
+static const coap_async_done_t *_recall(coap_async_t *a, const coap_endpoint_t *from,
+                                        const uint16_t msgid);
+static void _request_done(void *arg, const int status,
+                          const coap_packet_t *rsppkt);
+
+/* call the handler until it awaits, send the response once it is done */
+static void _step(coap_async_task_t *task)
+{
+    coap_async_t *a = task->async;
+    coap_packet_t pkt;
+    uint8_t buf[COAP_ASYNC_MAX_PDU];
+    coap_async_task_t *outer = _current;
+    _current = task;
+    const int rc = task->resource->handler(task->resource, &task->request, &pkt);
+    _current = outer;
+    if (rc == COAP_STATE_RSP_WAIT) {
+        return;
+    }
+    task->active = false;
+    // the request is acknowledged already, the client awaits an answer
+    if (rc != COAP_STATE_RSP_SEND) {
+        coap_make_response(0, &task->request.tok, COAP_TYPE_NONCON,
+                           COAP_RSPCODE_INTERNAL_SERVER_ERROR, NULL, NULL, 0, &pkt);
+    }
+    pkt.hdr.t = COAP_TYPE_NONCON;
+    pkt.hdr.id = coap_msgid_next();
+    size_t buflen = sizeof(buf);
+    if (!coap_build(&pkt, buf, &buflen)) {
+        _remember(task, buf, buflen);
+        a->client.send(a->client.ctx, &task->from, buf, buflen);
+    }
+}
+
+/* keep the response for retransmissions of the request, oldest goes first */
+static void _remember(coap_async_task_t *task, const uint8_t *buf, const size_t buflen)
+{
+    coap_async_t *a = task->async;
+    coap_async_done_t *d = &a->done[a->done_next];
+    a->done_next = (a->done_next + 1) % COAP_ASYNC_DONE;
+    d->from = task->from;
+    d->msgid = task->request.hdr.id;
+    d->expires = coap_clock_now() + COAP_ASYNC_DONE_MS;
+    d->len = buflen;
+    memcpy(d->rsp, buf, buflen);
+}
+
+static const coap_async_done_t *_recall(coap_async_t *a, const coap_endpoint_t *from,
+                                        const uint16_t msgid)
+{
+    const coap_tick_t now = coap_clock_now();
+    for (size_t i = 0; i < COAP_ASYNC_DONE; ++i) {
+        const coap_async_done_t *d = &a->done[i];
+        if (d->len && (d->msgid == msgid) && (d->expires > now) &&
+            coap_endpoint_equal(&d->from, from)) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+/* keep the response in the task, it is valid during the callback only */
+static void _request_done(void *arg, const int status,
+                          const coap_packet_t *rsppkt)
+{
+    coap_async_task_t *task = arg;
+    size_t len = sizeof(task->rsp);
+    task->waiting = false;
+    task->status = status;
+    if (!status) {
+        task->status = coap_build(rsppkt, task->rsp, &len);
+    }
+    if (!task->status) {
+        task->status = coap_parse(task->rsp, len, &task->response);
+    }
+    _step(task);
+}
+
+static int _offload(void *ctx, coap_resource_t *resource,
+                    const uint8_t *inbuf, const size_t inlen)
+{
+    const _submit_t *sub = ctx;
+    coap_async_t *a = sub->async;
+    coap_async_task_t *task = NULL;
+    coap_packet_t inpkt;
+    if (!(resource->flags & COAP_RESOURCE_ASYNC) || (inlen > COAP_ASYNC_MAX_PDU) ||
+        coap_parse(inbuf, inlen, &inpkt)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    for (size_t i = 0; i < COAP_ASYNC_MAX_TASKS; ++i) {
+        coap_async_task_t *t = &a->tasks[i];
+        if (!t->active) {
+            task = task ? task : t;
+            continue;
+        }
+        // retransmitted request, in progress already
+        if ((t->request.hdr.id == inpkt.hdr.id) && coap_endpoint_equal(&t->from, sub->from) &&
+            (t->request.tok.len == inpkt.tok.len) &&
+            !memcmp(t->request.tok.p, inpkt.tok.p, inpkt.tok.len)) {
+            return COAP_SUCCESS;
+        }
+    }
+    // retransmitted request, completed already: answer it again
+    const coap_async_done_t *done = _recall(a, sub->from, inpkt.hdr.id);
+    if (done) {
+        a->client.send(a->client.ctx, sub->from, done->rsp, done->len);
+        return COAP_SUCCESS;
+    }
+    if (!task) {
+        a->rejected++;
+        return COAP_ERR_BUSY;
+    }
+    task->active = true;
+    task->waiting = false;
+    task->resume = NULL;
+    task->resource = resource;
+    task->from = *sub->from;
+    task->deadline = COAP_TICK_NEVER;
+    task->status = COAP_SUCCESS;
+    task->inlen = inlen;
+    memcpy(task->in, inbuf, inlen);
+    coap_parse(task->in, inlen, &task->request);
+    memset(&task->locals, 0, sizeof(task->locals));
+    a->started++;
+    _step(task);
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_async_init(coap_async_t *a, coap_transport_send send, void *ctx)
+{
+    memset(a, 0, sizeof(*a));
+    coap_client_init(&a->client, send, ctx);
+    for (size_t i = 0; i < COAP_ASYNC_MAX_TASKS; ++i) {
+        a->tasks[i].async = a;
+    }
+}
+
+int coap_async_handle_packet(coap_async_t *a, coap_resource_t *resources,
+                             const coap_endpoint_t *from,
+                             const uint8_t *inbuf, const size_t inlen,
+                             uint8_t *outbuf, size_t *outlen)
+{
+    _submit_t sub = {a, from};
+    return coap_handle_packet_offload(resources, inbuf, inlen, outbuf, outlen,
+                                      _offload, &sub);
+}
+
+int coap_async_handle_response(coap_async_t *a, const coap_endpoint_t *from,
+                               const coap_packet_t *pkt)
+{
+    return coap_client_handle_packet(&a->client, from, pkt);
+}
+
+coap_tick_t coap_async_poll(coap_async_t *a)
+{
+    coap_tick_t next = coap_client_poll(&a->client);
+    const coap_tick_t now = coap_clock_now();
+    for (size_t i = 0; i < COAP_ASYNC_MAX_TASKS; ++i) {
+        coap_async_task_t *task = &a->tasks[i];
+        // COAP_ASYNC_SLEEP() clears the deadline as it continues
+        if (task->active && (task->deadline <= now)) {
+            _step(task);
+        }
+        if (task->active && (task->deadline < next)) {
+            next = task->deadline;
+        }
+    }
+    return next;
+}
+
+coap_async_task_t *coap_async_current(void)
+{
+    return _current;
+}
+
+int coap_async_request(coap_async_task_t *task, const coap_endpoint_t *ep,
+                       coap_packet_t *req)
+{
+    int rc = coap_client_request(&task->async->client, ep, req, _request_done, task);
+    task->waiting = !rc;
+    return rc;
+}
@@ -0,0 +1,243 @@
+#ifndef COAP_ASYNC_H
+#define COAP_ASYNC_H 1
+
+/**
+ * @file coap_async.h
+ *
+ * Handlers written as stackless coroutines, in the style of protothreads,
+ * that await client requests and timers without holding the receive
+ * thread.
+ *
+ * Resources flagged COAP_RESOURCE_ASYNC keep the usual coap_resource_handler,
+ * but are run in a task of their own: coap_async_handle_packet() copies
+ * the request into a free task, acknowledges it if confirmable, and calls
+ * the handler. Whenever the handler awaits something it returns
+ * COAP_STATE_RSP_WAIT, and is called again from the resume point once the
+ * response arrived, see coap_async_handle_response(), or the timer
+ * expired, see coap_async_poll(). When it returns anything else, \p pkt
+ * holds the response, which is sent as separate, non-confirmable response;
+ * a handler failing with an error code is answered with 5.00. The last
+ * COAP_ASYNC_DONE responses are kept for COAP_ASYNC_DONE_MS, so that a
+ * retransmission of a completed request gets its response again instead
+ * of running the handler twice.
+ *
+ *     static int handle_get(const coap_resource_t *resource,
+ *                           const coap_packet_t *inpkt, coap_packet_t *pkt)
+ *     {
+ *         coap_async_task_t *task = coap_async_current();
+ *         COAP_ASYNC_BEGIN(task);
+ *         COAP_ASYNC_SLEEP(task, 100);
+ *         make_upstream_request(&req);
+ *         COAP_ASYNC_REQUEST(task, &upstream, &req);
+ *         if (task->status) {
+ *             return coap_make_response(..., COAP_RSPCODE_GATEWAY_TIMEOUT, ...);
+ *         }
+ *         return coap_make_response(..., task->response.payload.p, ...);
+ *     }
+ *
+ * As with protothreads, local variables do not survive an await; whatever
+ * is needed afterwards is kept in COAP_ASYNC_LOCALS(), and \p inpkt, which
+ * points into the copy held by the task. The resume points are labels
+ * taken by address, a GNU C extension, so awaits may be placed in loops
+ * and switch statements, e.g. to fetch an upstream resource block by block.
+ *
+ * Tasks of an engine are served by one thread, which also owns its client.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "coap.h"
+#include "coap_client.h"
+#include "coap_time.h"
+
+#ifndef COAP_ASYNC_MAX_TASKS
+#define COAP_ASYNC_MAX_TASKS    COAP_CLIENT_MAX_EXCHANGES   //!< suspended handlers
+#endif
+#ifndef COAP_ASYNC_MAX_PDU
+#define COAP_ASYNC_MAX_PDU      1152    //!< max. size of request and awaited response
+#endif
+#ifndef COAP_ASYNC_LOCALS_SIZE
+#define COAP_ASYNC_LOCALS_SIZE  128     //!< bytes of state kept across awaits
+#endif
+#ifndef COAP_ASYNC_DONE
+#define COAP_ASYNC_DONE         16      //!< completed requests remembered
+#endif
+#ifndef COAP_ASYNC_DONE_MS
+#define COAP_ASYNC_DONE_MS      247000  //!< EXCHANGE_LIFETIME, RFC 7252 4.8.2
+#endif
+
+typedef struct coap_async coap_async_t;
+
+/**
+ * Request being handled by a coroutine
+ */
+typedef struct coap_async_task
+{
+    bool active;                        //!< slot in use
+    bool waiting;                       //!< client request outstanding
+    coap_async_t *async;                //!< owning engine
+    void *resume;                       //!< label to continue at, NULL at start
+    coap_resource_t *resource;          //!< resource requested
+    coap_endpoint_t from;               //!< sender of the request
+    coap_tick_t deadline;               //!< timer awaited, COAP_TICK_NEVER if none
+    int status;                         //!< outcome of the last client request
+    coap_packet_t request;              //!< the request, pointing into in
+    coap_packet_t response;             //!< response of the last client request, pointing into rsp
+    size_t inlen;                       //!< size of in
+    uint8_t in[COAP_ASYNC_MAX_PDU];     //!< request datagram
+    uint8_t rsp[COAP_ASYNC_MAX_PDU];    //!< response datagram
+    union {
+        uint8_t bytes[COAP_ASYNC_LOCALS_SIZE];
+        uint64_t u64;
+        double d;
+        void *p;
+    } locals;                           //!< state of the handler across awaits
+} coap_async_task_t;
+
+/**
+ * Request completed recently, and the response it was given
+ */
+typedef struct coap_async_done
+{
+    coap_endpoint_t from;               //!< sender of the request
+    uint16_t msgid;                     //!< message ID of the request
+    coap_tick_t expires;                //!< forgotten afterwards
+    size_t len;                         //!< size of rsp, 0 if the slot is unused
+    uint8_t rsp[COAP_ASYNC_MAX_PDU];    //!< separate response sent
+} coap_async_done_t;
+
+/**
+ * Engine running coroutines, and the client they send requests with
+ */
+struct coap_async
+{
+    coap_client_t client;               //!< requests awaited by handlers
+    uint64_t started;                   //!< requests taken over
+    uint64_t rejected;                  //!< requests refused, all tasks busy
+    coap_async_task_t tasks[COAP_ASYNC_MAX_TASKS];
+    size_t done_next;                   //!< slot of done overwritten next
+    coap_async_done_t done[COAP_ASYNC_DONE];
+};
+
+/**
+ * @brief Start a coroutine, or continue it at the last await
+ *
+ * The first statement of a handler of a COAP_RESOURCE_ASYNC resource.
+ */
+#define COAP_ASYNC_BEGIN(task) \
+    do { if ((task)->resume) { goto *(task)->resume; } } while (0)
+
+#define _COAP_ASYNC_LABEL2(line)    _coap_async_resume_##line
+#define _COAP_ASYNC_LABEL(line)     _COAP_ASYNC_LABEL2(line)
+
+/**
+ * @brief Suspend the coroutine until \p cond holds
+ *
+ * \p cond is evaluated again whenever an event of the task happens.
+ */
+#define COAP_ASYNC_AWAIT(task, cond) \
+    do { \
+        _COAP_ASYNC_LABEL(__LINE__): \
+        (task)->resume = &&_COAP_ASYNC_LABEL(__LINE__); \
+        if (!(cond)) { \
+            return COAP_STATE_RSP_WAIT; \
+        } \
+        (task)->resume = NULL; \
+    } while (0)
+
+/**
+ * @brief Send a request with the client of the engine and await its outcome
+ *
+ * Afterwards task->status is 0 and task->response holds the response, or
+ * task->status tells the error, e.g. COAP_ERR_TIMEOUT.
+ */
+#define COAP_ASYNC_REQUEST(task, ep, req) \
+    do { \
+        (task)->status = coap_async_request((task), (ep), (req)); \
+        COAP_ASYNC_AWAIT((task), !(task)->waiting); \
+    } while (0)
+
+/**
+ * @brief Suspend the coroutine for \p ms milliseconds
+ */
+#define COAP_ASYNC_SLEEP(task, ms) \
+    do { \
+        (task)->deadline = coap_clock_now() + (ms); \
+        COAP_ASYNC_AWAIT((task), coap_clock_now() >= (task)->deadline); \
+        (task)->deadline = COAP_TICK_NEVER; \
+    } while (0)
+
+/**
+ * @brief State kept across awaits, as pointer to \p type
+ */
+#define COAP_ASYNC_LOCALS(task, type) ((type *)(task)->locals.bytes)
+
+/**
+ * @brief Initialize engine
+ *
+ * @param[out] a The engine
+ * @param[in] send Callback sending datagrams, responses and client requests
+ * @param[in] ctx Context passed to \p send
+ */
+void coap_async_init(coap_async_t *a, coap_transport_send send, void *ctx);
+
+/**
+ * @brief Handle a request datagram
+ *
+ * coap_handle_packet_offload() with requests of COAP_RESOURCE_ASYNC
+ * resources started in a task, while all others are answered inline.
+ * Requests of COAP_RESOURCE_BLOCKING resources are refused with 5.03. A
+ * retransmission of a request in progress is acknowledged again, one of a
+ * completed request is acknowledged and answered with the response kept.
+ *
+ * @param[in,out] a The engine
+ * @param[in] from Sender of the request, receives the separate response
+ *
+ * @return as coap_handle_packet_offload()
+ */
+int coap_async_handle_packet(coap_async_t *a, coap_resource_t *resources,
+                             const coap_endpoint_t *from,
+                             const uint8_t *inbuf, const size_t inlen,
+                             uint8_t *outbuf, size_t *outlen);
+
+/**
+ * @brief Handle a response to a request of a task, and resume the task
+ *
+ * @return 0 if the packet belonged to a request of a task, or
+ * COAP_ERR_REQUEST_NOT_FOUND otherwise.
+ */
+int coap_async_handle_response(coap_async_t *a, const coap_endpoint_t *from,
+                               const coap_packet_t *pkt);
+
+/**
+ * @brief Retransmit and time out client requests, resume tasks whose timer
+ * expired
+ *
+ * @return time of the next deadline, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_async_poll(coap_async_t *a);
+
+/**
+ * @brief Task of the handler running on the calling thread
+ *
+ * @return the task, NULL outside of a handler started by
+ * coap_async_handle_packet()
+ */
+coap_async_task_t *coap_async_current(void);
+
+/**
+ * @brief Send a request for a task, see COAP_ASYNC_REQUEST()
+ *
+ * @return 0 if the request was sent and the task waits for it, or an error
+ * of coap_client_request()
+ */
+int coap_async_request(coap_async_task_t *task, const coap_endpoint_t *ep,
+                       coap_packet_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_ASYNC_H
@@ -0,0 +1,430 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "coap_cbor.h"
+
+#ifndef COAP_CBOR_MAX_DEPTH
+#define COAP_CBOR_MAX_DEPTH 16  //!< nesting limit when skipping items
+#endif
+
+/* --- PRIVATE -------------------------------------------------------------- */
+static int _put_head(coap_cbor_writer_t *w, const uint8_t major,
+                     const uint64_t arg);
+static int _put_raw(coap_cbor_writer_t *w, const uint8_t *buf,
+                    const size_t len);
+static int _read_item(const coap_cbor_reader_t *r, size_t *pos,
+                      coap_cbor_item_t *item);
+static int _skip_item(const coap_cbor_reader_t *r, size_t *pos, int depth);
+static double _half_to_double(const uint16_t half);
+
+static int _put_raw(coap_cbor_writer_t *w, const uint8_t *buf,
+                    const size_t len)
+{
+    if (w->err) {
+        return w->err;
+    }
+    if (len > w->len - w->pos) {
+        w->err = COAP_ERR_BUFFER_TOO_SMALL;
+        return w->err;
+    }
+    memcpy(w->p + w->pos, buf, len);
+    w->pos += len;
+    return COAP_SUCCESS;
+}
+
+/* https://tools.ietf.org/html/rfc7049#section-2.1 */
+static int _put_head(coap_cbor_writer_t *w, const uint8_t major,
+                     const uint64_t arg)
+{
+    uint8_t head[9];
+    size_t len;
+    head[0] = major << 5;
+    if (arg < 24) {
+        head[0] |= arg;
+        len = 1;
+    }
+    else if (arg <= 0xFF) {
+        head[0] |= 24;
+        head[1] = arg;
+        len = 2;
+    }
+    else if (arg <= 0xFFFF) {
+        head[0] |= 25;
+        head[1] = arg >> 8;
+        head[2] = arg;
+        len = 3;
+    }
+    else if (arg <= 0xFFFFFFFF) {
+        head[0] |= 26;
+        for (int i = 0; i < 4; ++i) {
+            head[1 + i] = arg >> (24 - 8 * i);
+        }
+        len = 5;
+    }
+    else {
+        head[0] |= 27;
+        for (int i = 0; i < 8; ++i) {
+            head[1 + i] = arg >> (56 - 8 * i);
+        }
+        len = 9;
+    }
+    return _put_raw(w, head, len);
+}
+
+/* https://tools.ietf.org/html/rfc7049#appendix-D, without libm */
+static double _half_to_double(const uint16_t half)
+{
+    const uint32_t exp = (half >> 10) & 0x1F;
+    const uint32_t mant = half & 0x3FF;
+    uint32_t bits = (uint32_t)(half & 0x8000) << 16;
+    float f;
+    if (exp == 0) {
+        // subnormal, mant * 2^-24
+        f = (float)mant / 16777216.0f;
+        return (half & 0x8000) ? -f : f;
+    }
+    if (exp == 31) {
+        bits |= 0x7F800000 | (mant << 13);
+    }
+    else {
+        bits |= ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/* decode one item starting at *pos, advance *pos on success only */
+static int _read_item(const coap_cbor_reader_t *r, size_t *pos,
+                      coap_cbor_item_t *item)
+{
+    size_t p = *pos;
+    if (p >= r->len) {
+        return COAP_ERR_INCOMPLETE;
+    }
+    const uint8_t major = r->p[p] >> 5;
+    const uint8_t info = r->p[p] & 0x1F;
+    uint64_t arg = 0;
+    p++;
+    item->indefinite = false;
+    if (info < 24) {
+        arg = info;
+    }
+    else if (info <= 27) {
+        const size_t n = (size_t)1 << (info - 24);
+        if (n > r->len - p) {
+            return COAP_ERR_INCOMPLETE;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            arg = (arg << 8) | r->p[p++];
+        }
+    }
+    else if (info == 31) {
+        // indefinite length only for containers, or break
+        if ((major != COAP_CBOR_ARRAY) && (major != COAP_CBOR_MAP) && (major != 7)) {
+            return (major == COAP_CBOR_BYTES || major == COAP_CBOR_TEXT) ?
+                   COAP_ERR_UNSUPPORTED : COAP_ERR_MALFORMED;
+        }
+        item->indefinite = true;
+    }
+    else {
+        return COAP_ERR_MALFORMED;
+    }
+
+    switch (major) {
+    case COAP_CBOR_UINT:
+    case COAP_CBOR_NEGINT:
+    case COAP_CBOR_TAG:
+        item->type = major;
+        item->val.u = arg;
+        break;
+    case COAP_CBOR_BYTES:
+    case COAP_CBOR_TEXT:
+        if (arg > r->len - p) {
+            return COAP_ERR_INCOMPLETE;
+        }
+        item->type = major;
+        item->val.str.p = r->p + p;
+        item->val.str.len = arg;
+        p += arg;
+        break;
+    case COAP_CBOR_ARRAY:
+    case COAP_CBOR_MAP:
+        item->type = major;
+        item->val.count = arg;
+        break;
+    default: // major type 7
+        if (info == 31) {
+            item->type = COAP_CBOR_BREAK;
+            item->indefinite = false;
+        }
+        else if (info == 25) {
+            item->type = COAP_CBOR_FLOAT;
+            item->val.f = _half_to_double(arg);
+        }
+        else if (info == 26) {
+            const uint32_t bits = arg;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            item->type = COAP_CBOR_FLOAT;
+            item->val.f = f;
+        }
+        else if (info == 27) {
+            item->type = COAP_CBOR_FLOAT;
+            memcpy(&item->val.f, &arg, sizeof(item->val.f));
+        }
+        else if ((arg >= 20) && (arg <= 23)) {
+            item->type = COAP_CBOR_FALSE + (arg - 20);
+        }
+        else {
+            item->type = COAP_CBOR_SIMPLE;
+            item->val.u = arg;
+        }
+        break;
+    }
+    *pos = p;
+    return COAP_SUCCESS;
+}
+
+static int _skip_item(const coap_cbor_reader_t *r, size_t *pos, int depth)
+{
+    coap_cbor_item_t item;
+    size_t p = *pos;
+    int rc;
+    if (depth > COAP_CBOR_MAX_DEPTH) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    if ((rc = _read_item(r, &p, &item))) {
+        return rc;
+    }
+    if (item.type == COAP_CBOR_BREAK) {
+        return COAP_ERR_MALFORMED;
+    }
+    if (item.type == COAP_CBOR_TAG) {
+        rc = _skip_item(r, &p, depth + 1);
+    }
+    else if ((item.type == COAP_CBOR_ARRAY) || (item.type == COAP_CBOR_MAP)) {
+        const uint64_t mult = (item.type == COAP_CBOR_MAP) ? 2 : 1;
+        if (item.indefinite) {
+            for (;;) {
+                // peek for break
+                if (p >= r->len) {
+                    return COAP_ERR_INCOMPLETE;
+                }
+                if (r->p[p] == 0xFF) {
+                    p++;
+                    break;
+                }
+                if ((rc = _skip_item(r, &p, depth + 1))) {
+                    return rc;
+                }
+            }
+        }
+        else {
+            // every item takes a byte at least, which also keeps the
+            // product below from overflowing
+            const uint64_t left = r->len - p;
+            if ((item.val.count > left) || (item.val.count * mult > left)) {
+                return COAP_ERR_INCOMPLETE;
+            }
+            for (uint64_t i = 0; (i < item.val.count * mult) && !rc; ++i) {
+                rc = _skip_item(r, &p, depth + 1);
+            }
+        }
+    }
+    if (rc) {
+        return rc;
+    }
+    *pos = p;
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_cbor_writer_init(coap_cbor_writer_t *w, uint8_t *buf, size_t buflen)
+{
+    w->p = buf;
+    w->len = buflen;
+    w->pos = 0;
+    w->err = COAP_SUCCESS;
+}
+
+int coap_cbor_put_uint(coap_cbor_writer_t *w, uint64_t value)
+{
+    return _put_head(w, COAP_CBOR_UINT, value);
+}
+
+int coap_cbor_put_int(coap_cbor_writer_t *w, int64_t value)
+{
+    if (value < 0) {
+        // -1 - value, without overflow for INT64_MIN
+        return _put_head(w, COAP_CBOR_NEGINT, ~(uint64_t)value);
+    }
+    return _put_head(w, COAP_CBOR_UINT, value);
+}
+
+int coap_cbor_put_bytes(coap_cbor_writer_t *w, const uint8_t *buf, size_t len)
+{
+    _put_head(w, COAP_CBOR_BYTES, len);
+    return _put_raw(w, buf, len);
+}
+
+int coap_cbor_put_text(coap_cbor_writer_t *w, const char *str, size_t len)
+{
+    _put_head(w, COAP_CBOR_TEXT, len);
+    return _put_raw(w, (const uint8_t *)str, len);
+}
+
+int coap_cbor_put_array(coap_cbor_writer_t *w, size_t count)
+{
+    return _put_head(w, COAP_CBOR_ARRAY, count);
+}
+
+int coap_cbor_put_map(coap_cbor_writer_t *w, size_t count)
+{
+    return _put_head(w, COAP_CBOR_MAP, count);
+}
+
+int coap_cbor_put_array_indef(coap_cbor_writer_t *w)
+{
+    const uint8_t head = (COAP_CBOR_ARRAY << 5) | 31;
+    return _put_raw(w, &head, 1);
+}
+
+int coap_cbor_put_map_indef(coap_cbor_writer_t *w)
+{
+    const uint8_t head = (COAP_CBOR_MAP << 5) | 31;
+    return _put_raw(w, &head, 1);
+}
+
+int coap_cbor_put_break(coap_cbor_writer_t *w)
+{
+    const uint8_t head = 0xFF;
+    return _put_raw(w, &head, 1);
+}
+
+int coap_cbor_put_tag(coap_cbor_writer_t *w, uint64_t tag)
+{
+    return _put_head(w, COAP_CBOR_TAG, tag);
+}
+
+int coap_cbor_put_bool(coap_cbor_writer_t *w, bool value)
+{
+    const uint8_t head = 0xF4 | (value ? 1 : 0);
+    return _put_raw(w, &head, 1);
+}
+
+int coap_cbor_put_null(coap_cbor_writer_t *w)
+{
+    const uint8_t head = 0xF6;
+    return _put_raw(w, &head, 1);
+}
+
+int coap_cbor_put_float(coap_cbor_writer_t *w, double value)
+{
+    uint8_t buf[9];
+    const float f = (float)value;
+    // NaN never compares equal, single precision NaN is just as good
+    if (((double)f == value) || (value != value)) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        buf[0] = 0xFA;
+        for (int i = 0; i < 4; ++i) {
+            buf[1 + i] = bits >> (24 - 8 * i);
+        }
+        return _put_raw(w, buf, 5);
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buf[0] = 0xFB;
+    for (int i = 0; i < 8; ++i) {
+        buf[1 + i] = bits >> (56 - 8 * i);
+    }
+    return _put_raw(w, buf, 9);
+}
+
+int coap_cbor_writer_finish(const coap_cbor_writer_t *w, size_t *buflen)
+{
+    *buflen = w->pos;
+    return w->err;
+}
+
+void coap_cbor_reader_init(coap_cbor_reader_t *r, const uint8_t *buf, size_t buflen)
+{
+    r->p = buf;
+    r->len = buflen;
+    r->pos = 0;
+}
+
+int coap_cbor_next(coap_cbor_reader_t *r, coap_cbor_item_t *item)
+{
+    return _read_item(r, &r->pos, item);
+}
+
+int coap_cbor_skip(coap_cbor_reader_t *r)
+{
+    return _skip_item(r, &r->pos, 0);
+}
+
+int coap_cbor_get_int(coap_cbor_reader_t *r, int64_t *value)
+{
+    coap_cbor_item_t item;
+    size_t pos = r->pos;
+    int rc = _read_item(r, &pos, &item);
+    if (rc) {
+        return rc;
+    }
+    if (((item.type != COAP_CBOR_UINT) && (item.type != COAP_CBOR_NEGINT)) ||
+        (item.val.u > INT64_MAX)) {
+        return COAP_ERR_TYPE_MISMATCH;
+    }
+    *value = (item.type == COAP_CBOR_UINT) ? (int64_t)item.val.u
+                                           : -1 - (int64_t)item.val.u;
+    r->pos = pos;
+    return COAP_SUCCESS;
+}
+
+int coap_cbor_get_float(coap_cbor_reader_t *r, double *value)
+{
+    coap_cbor_item_t item;
+    size_t pos = r->pos;
+    int rc = _read_item(r, &pos, &item);
+    if (rc) {
+        return rc;
+    }
+    switch (item.type) {
+    case COAP_CBOR_FLOAT:
+        *value = item.val.f;
+        break;
+    case COAP_CBOR_UINT:
+        *value = (double)item.val.u;
+        break;
+    case COAP_CBOR_NEGINT:
+        *value = -1.0 - (double)item.val.u;
+        break;
+    default:
+        return COAP_ERR_TYPE_MISMATCH;
+    }
+    r->pos = pos;
+    return COAP_SUCCESS;
+}
+
+int coap_cbor_get_text(coap_cbor_reader_t *r, coap_buffer_t *str)
+{
+    coap_cbor_item_t item;
+    size_t pos = r->pos;
+    int rc = _read_item(r, &pos, &item);
+    if (rc) {
+        return rc;
+    }
+    if (item.type != COAP_CBOR_TEXT) {
+        return COAP_ERR_TYPE_MISMATCH;
+    }
+    *str = item.val.str;
+    r->pos = pos;
+    return COAP_SUCCESS;
+}
+
+bool coap_cbor_at_end(const coap_cbor_reader_t *r)
+{
+    return (r->pos >= r->len);
+}
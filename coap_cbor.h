@@ -0,0 +1,191 @@
+#ifndef COAP_CBOR_H
+#define COAP_CBOR_H 1
+
+/**
+ * @file coap_cbor.h
+ *
+ * Streaming CBOR encoder and decoder for CoAP payloads,
+ * see https://tools.ietf.org/html/rfc7049
+ *
+ * Neither side allocates memory. The writer encodes into a caller provided
+ * buffer, which may be the payload region of the outgoing datagram as
+ * returned by coap_build_payload_buffer(). The reader pulls one data item at a
+ * time from a buffer such as coap_packet_t::payload, strings are returned as
+ * buffers pointing into the payload.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "coap.h"
+
+/**
+ * Types of CBOR data items as returned by the reader
+ */
+typedef enum
+{
+    COAP_CBOR_UINT              = 0,    //!< unsigned integer, major type 0
+    COAP_CBOR_NEGINT            = 1,    //!< negative integer, major type 1
+    COAP_CBOR_BYTES             = 2,    //!< byte string, major type 2
+    COAP_CBOR_TEXT              = 3,    //!< UTF-8 text string, major type 3
+    COAP_CBOR_ARRAY             = 4,    //!< array header, major type 4
+    COAP_CBOR_MAP               = 5,    //!< map header, major type 5
+    COAP_CBOR_TAG               = 6,    //!< semantic tag, major type 6
+    COAP_CBOR_SIMPLE            = 7,    //!< unassigned simple value
+    COAP_CBOR_FALSE,
+    COAP_CBOR_TRUE,
+    COAP_CBOR_NULL,
+    COAP_CBOR_UNDEFINED,
+    COAP_CBOR_FLOAT,                    //!< half, single or double float
+    COAP_CBOR_BREAK,                    //!< end of indefinite array or map
+} coap_cbor_type_t;
+
+/**
+ * A decoded CBOR data item
+ *
+ * For arrays and maps only the header is decoded, \p count holds the number
+ * of elements (map: pairs) that follow, unless \p indefinite is set.
+ */
+typedef struct coap_cbor_item
+{
+    coap_cbor_type_t type;      //!< type of the data item
+    bool indefinite;            //!< array or map terminated by COAP_CBOR_BREAK
+    union {
+        uint64_t u;             //!< COAP_CBOR_UINT, TAG, SIMPLE; NEGINT is -1-u
+        uint64_t count;         //!< COAP_CBOR_ARRAY and MAP
+        double f;               //!< COAP_CBOR_FLOAT
+        coap_buffer_t str;      //!< COAP_CBOR_BYTES and TEXT, zero-copy
+    } val;
+} coap_cbor_item_t;
+
+/**
+ * CBOR encoder state, errors are sticky
+ */
+typedef struct coap_cbor_writer
+{
+    uint8_t *p;                 //!< output buffer
+    size_t len;                 //!< size of output buffer
+    size_t pos;                 //!< number of bytes written
+    int err;                    //!< first error occurred, 0 if none
+} coap_cbor_writer_t;
+
+/**
+ * CBOR decoder state
+ */
+typedef struct coap_cbor_reader
+{
+    const uint8_t *p;           //!< input buffer
+    size_t len;                 //!< size of input buffer
+    size_t pos;                 //!< number of bytes consumed
+} coap_cbor_reader_t;
+
+/**
+ * @brief Initialize CBOR writer
+ *
+ * @param[out] w Writer to be initialized
+ * @param[in] buf Buffer receiving the encoded items
+ * @param[in] buflen Size of \p buf in bytes
+ */
+void coap_cbor_writer_init(coap_cbor_writer_t *w, uint8_t *buf, size_t buflen);
+
+/**
+ * @brief Encode an unsigned integer
+ *
+ * All coap_cbor_put_*() functions append one item (or the header of a
+ * container) and return 0 on success or COAP_ERR_BUFFER_TOO_SMALL once the
+ * buffer is exhausted. After an error further puts are ignored.
+ */
+int coap_cbor_put_uint(coap_cbor_writer_t *w, uint64_t value);
+int coap_cbor_put_int(coap_cbor_writer_t *w, int64_t value);     //!< @see coap_cbor_put_uint()
+int coap_cbor_put_bytes(coap_cbor_writer_t *w, const uint8_t *buf, size_t len); //!< @see coap_cbor_put_uint()
+int coap_cbor_put_text(coap_cbor_writer_t *w, const char *str, size_t len); //!< @see coap_cbor_put_uint()
+int coap_cbor_put_array(coap_cbor_writer_t *w, size_t count);    //!< @see coap_cbor_put_uint()
+int coap_cbor_put_map(coap_cbor_writer_t *w, size_t count);      //!< @see coap_cbor_put_uint()
+int coap_cbor_put_array_indef(coap_cbor_writer_t *w);            //!< @see coap_cbor_put_uint()
+int coap_cbor_put_map_indef(coap_cbor_writer_t *w);              //!< @see coap_cbor_put_uint()
+int coap_cbor_put_break(coap_cbor_writer_t *w);                  //!< @see coap_cbor_put_uint()
+int coap_cbor_put_tag(coap_cbor_writer_t *w, uint64_t tag);      //!< @see coap_cbor_put_uint()
+int coap_cbor_put_bool(coap_cbor_writer_t *w, bool value);       //!< @see coap_cbor_put_uint()
+int coap_cbor_put_null(coap_cbor_writer_t *w);                   //!< @see coap_cbor_put_uint()
+
+/**
+ * @brief Encode a floating point number
+ *
+ * Uses single precision if \p value converts without loss, else double.
+ */
+int coap_cbor_put_float(coap_cbor_writer_t *w, double value);
+
+/**
+ * @brief Finish encoding
+ *
+ * @param[in] w The writer
+ * @param[out] buflen Number of bytes encoded
+ *
+ * @return 0 on success, or the first error that occurred while encoding
+ */
+int coap_cbor_writer_finish(const coap_cbor_writer_t *w, size_t *buflen);
+
+/**
+ * @brief Initialize CBOR reader
+ *
+ * @param[out] r Reader to be initialized
+ * @param[in] buf Buffer holding encoded items, e.g. a packet payload
+ * @param[in] buflen Size of \p buf in bytes
+ */
+void coap_cbor_reader_init(coap_cbor_reader_t *r, const uint8_t *buf, size_t buflen);
+
+/**
+ * @brief Decode next data item
+ *
+ * Strings are returned as a whole, container items only by their header.
+ * Indefinite length strings are not supported.
+ *
+ * @param[in,out] r The reader
+ * @param[out] item The decoded item
+ *
+ * @return 0 on success, COAP_ERR_INCOMPLETE if the input ends within the
+ * item, or COAP_ERR_MALFORMED on invalid encoding. On error the reader is
+ * not advanced.
+ */
+int coap_cbor_next(coap_cbor_reader_t *r, coap_cbor_item_t *item);
+
+/**
+ * @brief Skip next data item including all nested items
+ *
+ * @return as coap_cbor_next(), the reader is not advanced on error.
+ */
+int coap_cbor_skip(coap_cbor_reader_t *r);
+
+/**
+ * @brief Decode next data item as integer
+ *
+ * @return as coap_cbor_next(), or COAP_ERR_TYPE_MISMATCH if the item is no
+ * integer fitting into int64_t. The reader is not advanced on error.
+ */
+int coap_cbor_get_int(coap_cbor_reader_t *r, int64_t *value);
+
+/**
+ * @brief Decode next data item as number, integers are converted
+ *
+ * @return as coap_cbor_get_int()
+ */
+int coap_cbor_get_float(coap_cbor_reader_t *r, double *value);
+
+/**
+ * @brief Decode next data item as text string
+ *
+ * @return as coap_cbor_get_int()
+ */
+int coap_cbor_get_text(coap_cbor_reader_t *r, coap_buffer_t *str);
+
+/**
+ * @brief Check if all input has been consumed
+ */
+bool coap_cbor_at_end(const coap_cbor_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_CBOR_H
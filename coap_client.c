@@ -0,0 +1,230 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "inet.h"
+#include "coap_client.h"
+#include "coap_trace.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _INDEX_MASK     (COAP_CLIENT_INDEX_SIZE - 1)
+
+static void _release(coap_client_t *c, coap_client_exchange_t *ex);
+static void _complete(coap_client_t *c, coap_client_exchange_t *ex,
+                      const int status, const coap_packet_t *rsppkt,
+                      const coap_endpoint_t *from);
+static int _request(coap_client_t *c, const coap_endpoint_t *ep,
+                    coap_packet_t *req, const bool multicast,
+                    const coap_tick_t wait,
+                    coap_client_handler handler, void *arg);
+static void _send_empty(coap_client_t *c, const coap_endpoint_t *ep,
+                        const coap_msgtype_t type, const uint16_t msgid);
+
+/* slot and index entries */
+static void _release(coap_client_t *c, coap_client_exchange_t *ex)
+{
+    ex->active = false;
+    c->by_token[coap_token_key(ex->token, ex->tkl) & _INDEX_MASK] = 0;
+    c->by_msgid[ex->msgid & _INDEX_MASK] = 0;
+}
+
+/*
+ * release slot before the callback, it may start new requests; requests to
+ * a group stay active for further responses until their deadline
+ */
+static void _complete(coap_client_t *c, coap_client_exchange_t *ex,
+                      const int status, const coap_packet_t *rsppkt,
+                      const coap_endpoint_t *from)
+{
+    coap_client_handler handler = ex->handler;
+    void *arg = ex->arg;
+    if (!ex->multicast || status) {
+        _release(c, ex);
+    }
+    if (handler) {
+        c->from = from;
+        handler(arg, status, rsppkt);
+        c->from = NULL;
+    }
+}
+
+static void _send_empty(coap_client_t *c, const coap_endpoint_t *ep,
+                        const coap_msgtype_t type, const uint16_t msgid)
+{
+    coap_raw_header_t r;
+    r.hdr.ver = COAP_VERSION;
+    r.hdr.t = type;
+    r.hdr.tkl = 0;
+    r.hdr.code = COAP_RSPCODE_EMPTY;
+    r.hdr.id = htons(msgid);
+    c->send(c->ctx, ep, (const uint8_t *)&r, sizeof(r));
+}
+
+static int _request(coap_client_t *c, const coap_endpoint_t *ep,
+                    coap_packet_t *req, const bool multicast,
+                    const coap_tick_t wait,
+                    coap_client_handler handler, void *arg)
+{
+    coap_client_exchange_t *ex = NULL;
+    for (size_t i = 0; i < COAP_CLIENT_MAX_EXCHANGES; ++i) {
+        if (!c->exchanges[i].active) {
+            ex = &c->exchanges[i];
+            break;
+        }
+    }
+    if (!ex) {
+        return COAP_ERR_BUSY;
+    }
+    // the index is at most half full, a free entry takes two draws on average
+    ex->tkl = COAP_CLIENT_TOKLEN;
+    do {
+        coap_token_next(ex->token, ex->tkl);
+    } while (c->by_token[coap_token_key(ex->token, ex->tkl) & _INDEX_MASK]);
+    do {
+        ex->msgid = coap_msgid_next();
+    } while (c->by_msgid[ex->msgid & _INDEX_MASK]);
+    req->hdr.id = ex->msgid;
+    req->hdr.tkl = ex->tkl;
+    req->tok.p = ex->token;
+    req->tok.len = ex->tkl;
+    ex->len = sizeof(ex->pdu);
+    int rc = coap_build(req, ex->pdu, &ex->len);
+    if (rc) {
+        return rc;
+    }
+    const coap_tick_t now = coap_clock_now();
+    ex->ep = *ep;
+    ex->handler = handler;
+    ex->arg = arg;
+    ex->multicast = multicast;
+    ex->acked = (req->hdr.t != COAP_TYPE_CON);
+    ex->retransmits = 0;
+    // initial timeout randomly between ACK_TIMEOUT and ACK_TIMEOUT * factor
+    ex->timeout = COAP_ACK_TIMEOUT + coap_random_next() %
+                  (COAP_ACK_TIMEOUT * (COAP_ACK_RANDOM_FACTOR - 100) / 100 + 1);
+    ex->deadline = now + (multicast ? wait :
+                          ex->acked ? COAP_MAX_TRANSMIT_WAIT : ex->timeout);
+    rc = c->send(c->ctx, ep, ex->pdu, ex->len);
+    if (rc) {
+        return rc;
+    }
+    const uint8_t slot = (uint8_t)(ex - c->exchanges + 1);
+    c->by_token[coap_token_key(ex->token, ex->tkl) & _INDEX_MASK] = slot;
+    c->by_msgid[ex->msgid & _INDEX_MASK] = slot;
+    ex->active = true;
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_client_init(coap_client_t *c, coap_transport_send send, void *ctx)
+{
+    memset(c, 0, sizeof(*c));
+    c->send = send;
+    c->ctx = ctx;
+}
+
+int coap_client_request(coap_client_t *c, const coap_endpoint_t *ep,
+                        coap_packet_t *req,
+                        coap_client_handler handler, void *arg)
+{
+    return _request(c, ep, req, false, 0, handler, arg);
+}
+
+int coap_client_request_multicast(coap_client_t *c, const coap_endpoint_t *ep,
+                                  coap_packet_t *req, const coap_tick_t wait,
+                                  coap_client_handler handler, void *arg)
+{
+    // https://tools.ietf.org/html/rfc7252#section-8.1
+    if (req->hdr.t == COAP_TYPE_CON) {
+        return COAP_ERR_TYPE_MISMATCH;
+    }
+    return _request(c, ep, req, true, wait, handler, arg);
+}
+
+int coap_client_handle_packet(coap_client_t *c, const coap_endpoint_t *from,
+                              const coap_packet_t *pkt)
+{
+    const bool is_empty = (pkt->hdr.code == COAP_RSPCODE_EMPTY);
+    const bool by_msgid = (pkt->hdr.t == COAP_TYPE_ACK) || (pkt->hdr.t == COAP_TYPE_RESET);
+    // requests are not for the client
+    if (!is_empty && (pkt->hdr.code < MAKE_RSPCODE(2, 0))) {
+        return COAP_ERR_REQUEST_NOT_FOUND;
+    }
+    // ACK and RST refer to the message ID, responses to the token
+    const uint8_t slot = by_msgid ? c->by_msgid[pkt->hdr.id & _INDEX_MASK] :
+                         is_empty ? 0 :
+                         c->by_token[coap_token_key(pkt->tok.p, pkt->hdr.tkl) & _INDEX_MASK];
+    coap_client_exchange_t *ex = slot ? &c->exchanges[slot - 1] : NULL;
+    // responses to a group come from its members, ACK and RST never
+    if (ex && (ex->multicast ? by_msgid : !coap_endpoint_equal(&ex->ep, from))) {
+        ex = NULL;
+    }
+    // a piggybacked response must carry the token of the request as well,
+    // https://tools.ietf.org/html/rfc7252#section-5.3.2
+    if (ex && by_msgid && !is_empty &&
+        ((pkt->hdr.tkl != ex->tkl) || memcmp(pkt->tok.p, ex->token, ex->tkl))) {
+        ex = NULL;
+    }
+    if (ex && by_msgid && (pkt->hdr.id == ex->msgid)) {
+        if (pkt->hdr.t == COAP_TYPE_RESET) {
+            _complete(c, ex, COAP_ERR_RESET, NULL, from);
+        }
+        else if (is_empty) {
+            // separate response follows
+            ex->acked = true;
+            ex->deadline = coap_clock_now() + COAP_MAX_TRANSMIT_WAIT;
+        }
+        else {
+            _complete(c, ex, COAP_SUCCESS, pkt, from);
+        }
+        return COAP_SUCCESS;
+    }
+    // separate response, matched by token
+    if (ex && !by_msgid && (pkt->hdr.tkl == ex->tkl) &&
+        !memcmp(pkt->tok.p, ex->token, ex->tkl)) {
+        if (pkt->hdr.t == COAP_TYPE_CON) {
+            _send_empty(c, from, COAP_TYPE_ACK, pkt->hdr.id);
+        }
+        _complete(c, ex, COAP_SUCCESS, pkt, from);
+        return COAP_SUCCESS;
+    }
+    // reject unexpected confirmable responses
+    if (pkt->hdr.t == COAP_TYPE_CON) {
+        _send_empty(c, from, COAP_TYPE_RESET, pkt->hdr.id);
+    }
+    return COAP_ERR_REQUEST_NOT_FOUND;
+}
+
+coap_tick_t coap_client_poll(coap_client_t *c)
+{
+    const coap_tick_t now = coap_clock_now();
+    coap_tick_t next = COAP_TICK_NEVER;
+    for (size_t i = 0; i < COAP_CLIENT_MAX_EXCHANGES; ++i) {
+        coap_client_exchange_t *ex = &c->exchanges[i];
+        if (!ex->active) {
+            continue;
+        }
+        if (ex->deadline <= now) {
+            if (ex->acked || (ex->retransmits >= COAP_MAX_RETRANSMIT)) {
+                COAP_TRACE2(timeout, ex->msgid, ex->retransmits);
+                _complete(c, ex, COAP_ERR_TIMEOUT, NULL, NULL);
+                continue;
+            }
+            // exponential back-off
+            ex->retransmits++;
+            ex->timeout *= 2;
+            ex->deadline = now + ex->timeout;
+            COAP_TRACE3(retransmit, ex->msgid, ex->retransmits, ex->timeout);
+            c->send(c->ctx, &ex->ep, ex->pdu, ex->len);
+        }
+        if (ex->active && (ex->deadline < next)) {
+            next = ex->deadline;
+        }
+    }
+    return next;
+}
+
+bool coap_endpoint_equal(const coap_endpoint_t *a, const coap_endpoint_t *b)
+{
+    return (a->len == b->len) && !memcmp(a->addr, b->addr, a->len);
+}
@@ -0,0 +1,182 @@
+#ifndef COAP_CLIENT_H
+#define COAP_CLIENT_H 1
+
+/**
+ * @file coap_client.h
+ *
+ * Asynchronous CoAP client. Requests are sent through a transport callback
+ * and completed when coap_client_handle_packet() is fed the response.
+ * Confirmable requests are retransmitted by coap_client_poll() as per
+ * https://tools.ietf.org/html/rfc7252#section-4.2
+ *
+ * Requests to a multicast group collect the responses of all members until
+ * a deadline, see coap_client_request_multicast().
+ *
+ * Message IDs and tokens come from the generators of the calling thread,
+ * see coap_random.h. Pending requests are indexed by both, direct-mapped:
+ * a token or ID whose slot is taken is drawn again, so matching a response
+ * looks at one slot.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "coap.h"
+#include "coap_random.h"
+#include "coap_time.h"
+
+#ifndef COAP_CLIENT_MAX_EXCHANGES
+#define COAP_CLIENT_MAX_EXCHANGES   16      //!< concurrent requests
+#endif
+#ifndef COAP_CLIENT_MAX_PDU
+#define COAP_CLIENT_MAX_PDU         1152    //!< max. size of a request
+#endif
+#ifndef COAP_CLIENT_TOKLEN
+#define COAP_CLIENT_TOKLEN          4       //!< random bytes per token
+#endif
+#ifndef COAP_CLIENT_INDEX_SIZE
+#define COAP_CLIENT_INDEX_SIZE      32      //!< power of 2, twice the exchanges
+#endif
+#if (COAP_CLIENT_INDEX_SIZE & (COAP_CLIENT_INDEX_SIZE - 1)) || \
+    (COAP_CLIENT_INDEX_SIZE < 2 * COAP_CLIENT_MAX_EXCHANGES) || (COAP_CLIENT_MAX_EXCHANGES > 255)
+#error "COAP_CLIENT_INDEX_SIZE must be a power of 2 of at least twice COAP_CLIENT_MAX_EXCHANGES"
+#endif
+
+/* transmission parameters, https://tools.ietf.org/html/rfc7252#section-4.8 */
+#define COAP_ACK_TIMEOUT            2000    //!< initial retransmission timeout, ms
+#define COAP_ACK_RANDOM_FACTOR      150     //!< in percent
+#define COAP_MAX_RETRANSMIT         4       //!< retransmissions before timeout
+#define COAP_MAX_TRANSMIT_WAIT      93000   //!< ms until a response is overdue
+
+/**
+ * @brief callback function completing a request
+ *
+ * @param[in] arg Argument given along with the request
+ * @param[in] status 0 if a response was received, COAP_ERR_TIMEOUT or
+ * COAP_ERR_RESET otherwise
+ * @param[in] rsppkt The response, NULL unless \p status is 0
+ */
+typedef void (*coap_client_handler)(void *arg, const int status,
+                                    const coap_packet_t *rsppkt);
+
+/**
+ * A request awaiting its response
+ */
+typedef struct coap_client_exchange
+{
+    bool active;                        //!< slot in use
+    bool acked;                         //!< empty ACK received, no retransmission
+    bool multicast;                     //!< sent to a group, takes many responses
+    uint8_t retransmits;                //!< retransmissions so far
+    coap_tick_t timeout;                //!< current retransmission timeout
+    coap_tick_t deadline;               //!< next retransmission or timeout
+    coap_endpoint_t ep;                 //!< destination of the request
+    uint16_t msgid;                     //!< message ID of the request
+    uint8_t tkl;                        //!< token length
+    uint8_t token[COAP_MAX_TOKLEN];     //!< token of the request
+    coap_client_handler handler;        //!< completion callback
+    void *arg;                          //!< argument of completion callback
+    size_t len;                         //!< size of the encoded request
+    uint8_t pdu[COAP_CLIENT_MAX_PDU];   //!< encoded request, for retransmission
+} coap_client_exchange_t;
+
+/**
+ * Client state
+ */
+typedef struct coap_client
+{
+    coap_transport_send send;           //!< sends datagrams
+    void *ctx;                          //!< context of send
+    const coap_endpoint_t *from;        //!< sender of the response passed to a handler
+    coap_client_exchange_t exchanges[COAP_CLIENT_MAX_EXCHANGES];
+    uint8_t by_token[COAP_CLIENT_INDEX_SIZE];   //!< exchange + 1 by token key, 0 if free
+    uint8_t by_msgid[COAP_CLIENT_INDEX_SIZE];   //!< exchange + 1 by message ID, 0 if free
+} coap_client_t;
+
+/**
+ * @brief Initialize client
+ *
+ * @param[out] c The client
+ * @param[in] send Callback sending datagrams
+ * @param[in] ctx Context passed to \p send
+ */
+void coap_client_init(coap_client_t *c, coap_transport_send send, void *ctx);
+
+/**
+ * @brief Send a request
+ *
+ * Stamps message ID and token into \p req, builds and sends it. The type of
+ * \p req selects confirmable or non-confirmable transmission.
+ *
+ * @param[in,out] c The client
+ * @param[in] ep Destination of the request
+ * @param[in,out] req The request, e.g. from coap_make_request()
+ * @param[in] handler Callback invoked once on response or failure
+ * @param[in] arg Argument passed to \p handler
+ *
+ * @return 0 on success, COAP_ERR_BUSY if all exchanges are in use, or an
+ * error of coap_build() or the transport.
+ */
+int coap_client_request(coap_client_t *c, const coap_endpoint_t *ep,
+                        coap_packet_t *req,
+                        coap_client_handler handler, void *arg);
+
+/**
+ * @brief Send a request to a multicast group
+ *
+ * Like coap_client_request(), except that the exchange collects responses
+ * until \p wait has passed: \p handler is invoked for each response, with
+ * c->from telling its sender, and finally with COAP_ERR_TIMEOUT. See
+ * https://tools.ietf.org/html/rfc7252#section-8.1
+ *
+ * @param[in] wait Time in ms to collect responses for, at least the leisure
+ * of the group members
+ *
+ * @return as coap_client_request(), or COAP_ERR_TYPE_MISMATCH if \p req is
+ * confirmable.
+ */
+int coap_client_request_multicast(coap_client_t *c, const coap_endpoint_t *ep,
+                                  coap_packet_t *req, const coap_tick_t wait,
+                                  coap_client_handler handler, void *arg);
+
+/**
+ * @brief Process a received packet
+ *
+ * Matches ACK and RST by message ID, piggybacked responses by message ID
+ * and token, separate responses by token, of any sender
+ * for requests to a group. Separate confirmable responses are acknowledged.
+ *
+ * @param[in,out] c The client
+ * @param[in] from Sender of the packet
+ * @param[in] pkt The parsed packet
+ *
+ * @return 0 if the packet belonged to a request of \p c, or
+ * COAP_ERR_REQUEST_NOT_FOUND otherwise.
+ */
+int coap_client_handle_packet(coap_client_t *c, const coap_endpoint_t *from,
+                              const coap_packet_t *pkt);
+
+/**
+ * @brief Retransmit and time out requests
+ *
+ * Call at the latest at the returned deadline.
+ *
+ * @param[in,out] c The client
+ *
+ * @return time of the next deadline, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_client_poll(coap_client_t *c);
+
+/**
+ * @brief Compare endpoints
+ *
+ * @return true if \p a and \p b denote the same transport address
+ */
+bool coap_endpoint_equal(const coap_endpoint_t *a, const coap_endpoint_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_CLIENT_H
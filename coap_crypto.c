@@ -0,0 +1,551 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coap_crypto.h"
+
+#if !defined(COAP_CRYPTO_PORTABLE) && defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define _USE_AESNI 1
+#endif
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _ROR32(x, n)    (((x) >> (n)) | ((x) << (32 - (n))))
+#define _GETU32(p)      (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                         ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define _PUTU32(p, v)   do { (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); \
+                             (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); } while (0)
+
+/* CBC-MAC input ahead of the message: B0, then the associated data */
+#define _HEADER_SIZE    (COAP_AES_BLOCK_SIZE + \
+                         ((2 + COAP_CCM_MAX_AAD + COAP_AES_BLOCK_SIZE - 1) & ~(COAP_AES_BLOCK_SIZE - 1)))
+
+static const uint8_t _sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+/* S-box times (2, 1, 1, 3), MixColumns and SubBytes in one lookup */
+static const uint32_t _te0[256] =
+{
+    0xc66363a5, 0xf87c7c84, 0xee777799, 0xf67b7b8d, 0xfff2f20d, 0xd66b6bbd,
+    0xde6f6fb1, 0x91c5c554, 0x60303050, 0x02010103, 0xce6767a9, 0x562b2b7d,
+    0xe7fefe19, 0xb5d7d762, 0x4dababe6, 0xec76769a, 0x8fcaca45, 0x1f82829d,
+    0x89c9c940, 0xfa7d7d87, 0xeffafa15, 0xb25959eb, 0x8e4747c9, 0xfbf0f00b,
+    0x41adadec, 0xb3d4d467, 0x5fa2a2fd, 0x45afafea, 0x239c9cbf, 0x53a4a4f7,
+    0xe4727296, 0x9bc0c05b, 0x75b7b7c2, 0xe1fdfd1c, 0x3d9393ae, 0x4c26266a,
+    0x6c36365a, 0x7e3f3f41, 0xf5f7f702, 0x83cccc4f, 0x6834345c, 0x51a5a5f4,
+    0xd1e5e534, 0xf9f1f108, 0xe2717193, 0xabd8d873, 0x62313153, 0x2a15153f,
+    0x0804040c, 0x95c7c752, 0x46232365, 0x9dc3c35e, 0x30181828, 0x379696a1,
+    0x0a05050f, 0x2f9a9ab5, 0x0e070709, 0x24121236, 0x1b80809b, 0xdfe2e23d,
+    0xcdebeb26, 0x4e272769, 0x7fb2b2cd, 0xea75759f, 0x1209091b, 0x1d83839e,
+    0x582c2c74, 0x341a1a2e, 0x361b1b2d, 0xdc6e6eb2, 0xb45a5aee, 0x5ba0a0fb,
+    0xa45252f6, 0x763b3b4d, 0xb7d6d661, 0x7db3b3ce, 0x5229297b, 0xdde3e33e,
+    0x5e2f2f71, 0x13848497, 0xa65353f5, 0xb9d1d168, 0x00000000, 0xc1eded2c,
+    0x40202060, 0xe3fcfc1f, 0x79b1b1c8, 0xb65b5bed, 0xd46a6abe, 0x8dcbcb46,
+    0x67bebed9, 0x7239394b, 0x944a4ade, 0x984c4cd4, 0xb05858e8, 0x85cfcf4a,
+    0xbbd0d06b, 0xc5efef2a, 0x4faaaae5, 0xedfbfb16, 0x864343c5, 0x9a4d4dd7,
+    0x66333355, 0x11858594, 0x8a4545cf, 0xe9f9f910, 0x04020206, 0xfe7f7f81,
+    0xa05050f0, 0x783c3c44, 0x259f9fba, 0x4ba8a8e3, 0xa25151f3, 0x5da3a3fe,
+    0x804040c0, 0x058f8f8a, 0x3f9292ad, 0x219d9dbc, 0x70383848, 0xf1f5f504,
+    0x63bcbcdf, 0x77b6b6c1, 0xafdada75, 0x42212163, 0x20101030, 0xe5ffff1a,
+    0xfdf3f30e, 0xbfd2d26d, 0x81cdcd4c, 0x180c0c14, 0x26131335, 0xc3ecec2f,
+    0xbe5f5fe1, 0x359797a2, 0x884444cc, 0x2e171739, 0x93c4c457, 0x55a7a7f2,
+    0xfc7e7e82, 0x7a3d3d47, 0xc86464ac, 0xba5d5de7, 0x3219192b, 0xe6737395,
+    0xc06060a0, 0x19818198, 0x9e4f4fd1, 0xa3dcdc7f, 0x44222266, 0x542a2a7e,
+    0x3b9090ab, 0x0b888883, 0x8c4646ca, 0xc7eeee29, 0x6bb8b8d3, 0x2814143c,
+    0xa7dede79, 0xbc5e5ee2, 0x160b0b1d, 0xaddbdb76, 0xdbe0e03b, 0x64323256,
+    0x743a3a4e, 0x140a0a1e, 0x924949db, 0x0c06060a, 0x4824246c, 0xb85c5ce4,
+    0x9fc2c25d, 0xbdd3d36e, 0x43acacef, 0xc46262a6, 0x399191a8, 0x319595a4,
+    0xd3e4e437, 0xf279798b, 0xd5e7e732, 0x8bc8c843, 0x6e373759, 0xda6d6db7,
+    0x018d8d8c, 0xb1d5d564, 0x9c4e4ed2, 0x49a9a9e0, 0xd86c6cb4, 0xac5656fa,
+    0xf3f4f407, 0xcfeaea25, 0xca6565af, 0xf47a7a8e, 0x47aeaee9, 0x10080818,
+    0x6fbabad5, 0xf0787888, 0x4a25256f, 0x5c2e2e72, 0x381c1c24, 0x57a6a6f1,
+    0x73b4b4c7, 0x97c6c651, 0xcbe8e823, 0xa1dddd7c, 0xe874749c, 0x3e1f1f21,
+    0x964b4bdd, 0x61bdbddc, 0x0d8b8b86, 0x0f8a8a85, 0xe0707090, 0x7c3e3e42,
+    0x71b5b5c4, 0xcc6666aa, 0x904848d8, 0x06030305, 0xf7f6f601, 0x1c0e0e12,
+    0xc26161a3, 0x6a35355f, 0xae5757f9, 0x69b9b9d0, 0x17868691, 0x99c1c158,
+    0x3a1d1d27, 0x279e9eb9, 0xd9e1e138, 0xebf8f813, 0x2b9898b3, 0x22111133,
+    0xd26969bb, 0xa9d9d970, 0x078e8e89, 0x339494a7, 0x2d9b9bb6, 0x3c1e1e22,
+    0x15878792, 0xc9e9e920, 0x87cece49, 0xaa5555ff, 0x50282878, 0xa5dfdf7a,
+    0x038c8c8f, 0x59a1a1f8, 0x09898980, 0x1a0d0d17, 0x65bfbfda, 0xd7e6e631,
+    0x844242c6, 0xd06868b8, 0x824141c3, 0x299999b0, 0x5a2d2d77, 0x1e0f0f11,
+    0x7bb0b0cb, 0xa85454fc, 0x6dbbbbd6, 0x2c16163a,
+};
+
+static int _accel = -1;                 //!< use AES-NI, -1 until detected
+
+static bool _has_aesni(void);
+static void _encrypt_block(const coap_aes_t *aes, const uint8_t *in, uint8_t *out);
+static size_t _ccm_header(const uint8_t *nonce, const uint8_t *aad,
+                          const size_t aadlen, const size_t len, uint8_t *hdr);
+static void _ccm_counter(const uint8_t *nonce, const uint16_t i, uint8_t *a);
+static void _ccm_portable(const coap_aes_t *aes, const uint8_t *nonce,
+                          const uint8_t *hdr, const size_t hdrlen,
+                          const uint8_t *in, const size_t len, uint8_t *out,
+                          const bool encrypt, uint8_t *tag);
+static bool _equal(const uint8_t *a, const uint8_t *b, const size_t len);
+static int _ccm(const coap_aes_t *aes, const uint8_t *nonce,
+                const uint8_t *aad, const size_t aadlen,
+                const uint8_t *in, const size_t len, uint8_t *out,
+                const bool encrypt, uint8_t *tag);
+
+static bool _has_aesni(void)
+{
+#ifdef _USE_AESNI
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return (ecx & bit_AES) && (edx & bit_SSE2);
+    }
+#endif
+    return false;
+}
+
+static void _encrypt_block(const coap_aes_t *aes, const uint8_t *in, uint8_t *out)
+{
+    const uint32_t *rk = aes->ek;
+    uint32_t s0 = _GETU32(in) ^ rk[0];
+    uint32_t s1 = _GETU32(in + 4) ^ rk[1];
+    uint32_t s2 = _GETU32(in + 8) ^ rk[2];
+    uint32_t s3 = _GETU32(in + 12) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+    for (int r = 1; r < 10; ++r) {
+        rk += 4;
+        t0 = _te0[s0 >> 24] ^ _ROR32(_te0[(s1 >> 16) & 0xff], 8) ^
+             _ROR32(_te0[(s2 >> 8) & 0xff], 16) ^ _ROR32(_te0[s3 & 0xff], 24) ^ rk[0];
+        t1 = _te0[s1 >> 24] ^ _ROR32(_te0[(s2 >> 16) & 0xff], 8) ^
+             _ROR32(_te0[(s3 >> 8) & 0xff], 16) ^ _ROR32(_te0[s0 & 0xff], 24) ^ rk[1];
+        t2 = _te0[s2 >> 24] ^ _ROR32(_te0[(s3 >> 16) & 0xff], 8) ^
+             _ROR32(_te0[(s0 >> 8) & 0xff], 16) ^ _ROR32(_te0[s1 & 0xff], 24) ^ rk[2];
+        t3 = _te0[s3 >> 24] ^ _ROR32(_te0[(s0 >> 16) & 0xff], 8) ^
+             _ROR32(_te0[(s1 >> 8) & 0xff], 16) ^ _ROR32(_te0[s2 & 0xff], 24) ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    // last round without MixColumns
+    rk += 4;
+    t0 = ((uint32_t)_sbox[s0 >> 24] << 24) ^ ((uint32_t)_sbox[(s1 >> 16) & 0xff] << 16) ^
+         ((uint32_t)_sbox[(s2 >> 8) & 0xff] << 8) ^ _sbox[s3 & 0xff] ^ rk[0];
+    t1 = ((uint32_t)_sbox[s1 >> 24] << 24) ^ ((uint32_t)_sbox[(s2 >> 16) & 0xff] << 16) ^
+         ((uint32_t)_sbox[(s3 >> 8) & 0xff] << 8) ^ _sbox[s0 & 0xff] ^ rk[1];
+    t2 = ((uint32_t)_sbox[s2 >> 24] << 24) ^ ((uint32_t)_sbox[(s3 >> 16) & 0xff] << 16) ^
+         ((uint32_t)_sbox[(s0 >> 8) & 0xff] << 8) ^ _sbox[s1 & 0xff] ^ rk[2];
+    t3 = ((uint32_t)_sbox[s3 >> 24] << 24) ^ ((uint32_t)_sbox[(s0 >> 16) & 0xff] << 16) ^
+         ((uint32_t)_sbox[(s1 >> 8) & 0xff] << 8) ^ _sbox[s2 & 0xff] ^ rk[3];
+    _PUTU32(out, t0);
+    _PUTU32(out + 4, t1);
+    _PUTU32(out + 8, t2);
+    _PUTU32(out + 12, t3);
+}
+
+/* https://tools.ietf.org/html/rfc3610#section-2.2, M = 8, L = 2 */
+static size_t _ccm_header(const uint8_t *nonce, const uint8_t *aad,
+                          const size_t aadlen, const size_t len, uint8_t *hdr)
+{
+    hdr[0] = (aadlen ? 0x40 : 0) | (((COAP_CCM_TAG_SIZE - 2) / 2) << 3) | (2 - 1);
+    memcpy(hdr + 1, nonce, COAP_CCM_NONCE_SIZE);
+    hdr[14] = (uint8_t)(len >> 8);
+    hdr[15] = (uint8_t)len;
+    if (!aadlen) {
+        return COAP_AES_BLOCK_SIZE;
+    }
+    // aadlen < 2^16 - 2^8, length in two bytes, zero padded to a block
+    hdr[16] = (uint8_t)(aadlen >> 8);
+    hdr[17] = (uint8_t)aadlen;
+    memcpy(hdr + 18, aad, aadlen);
+    const size_t hdrlen = (18 + aadlen + COAP_AES_BLOCK_SIZE - 1) & ~(COAP_AES_BLOCK_SIZE - 1);
+    memset(hdr + 18 + aadlen, 0, hdrlen - 18 - aadlen);
+    return hdrlen;
+}
+
+static void _ccm_counter(const uint8_t *nonce, const uint16_t i, uint8_t *a)
+{
+    a[0] = 2 - 1;
+    memcpy(a + 1, nonce, COAP_CCM_NONCE_SIZE);
+    a[14] = (uint8_t)(i >> 8);
+    a[15] = (uint8_t)i;
+}
+
+/* CBC-MAC over the plaintext, counter mode with blocks 1.. */
+static void _ccm_portable(const coap_aes_t *aes, const uint8_t *nonce,
+                          const uint8_t *hdr, const size_t hdrlen,
+                          const uint8_t *in, const size_t len, uint8_t *out,
+                          const bool encrypt, uint8_t *tag)
+{
+    uint8_t mac[COAP_AES_BLOCK_SIZE] = {0};
+    uint8_t a[COAP_AES_BLOCK_SIZE], s[COAP_AES_BLOCK_SIZE];
+    for (size_t off = 0; off < hdrlen; off += COAP_AES_BLOCK_SIZE) {
+        for (size_t j = 0; j < COAP_AES_BLOCK_SIZE; ++j) {
+            mac[j] ^= hdr[off + j];
+        }
+        _encrypt_block(aes, mac, mac);
+    }
+    uint16_t i = 1;
+    for (size_t off = 0; off < len; off += COAP_AES_BLOCK_SIZE, ++i) {
+        const size_t n = (len - off < COAP_AES_BLOCK_SIZE) ? len - off : COAP_AES_BLOCK_SIZE;
+        _ccm_counter(nonce, i, a);
+        _encrypt_block(aes, a, s);
+        for (size_t j = 0; j < n; ++j) {
+            const uint8_t p = encrypt ? in[off + j] : (uint8_t)(in[off + j] ^ s[j]);
+            out[off + j] = in[off + j] ^ s[j];
+            mac[j] ^= p;
+        }
+        _encrypt_block(aes, mac, mac);
+    }
+    _ccm_counter(nonce, 0, a);
+    _encrypt_block(aes, a, s);
+    for (size_t j = 0; j < COAP_CCM_TAG_SIZE; ++j) {
+        tag[j] = mac[j] ^ s[j];
+    }
+}
+
+#ifdef _USE_AESNI
+/* keystream blocks wait this long for their message block, see below */
+#define _RING   32
+
+__attribute__((target("aes,sse2")))
+static void _ccm_aesni(const coap_aes_t *aes, const uint8_t *nonce,
+                       const uint8_t *hdr, const size_t hdrlen,
+                       const uint8_t *in, const size_t len, uint8_t *out,
+                       const bool encrypt, uint8_t *tag)
+{
+    __m128i rk[11], ring[_RING], s0 = _mm_setzero_si128();
+    uint8_t a[COAP_AES_BLOCK_SIZE], p[COAP_AES_BLOCK_SIZE], s[COAP_AES_BLOCK_SIZE];
+    for (int r = 0; r < 11; ++r) {
+        rk[r] = _mm_loadu_si128((const __m128i *)(aes->rk + 16 * r));
+    }
+    _ccm_counter(nonce, 0, a);
+    const __m128i a0 = _mm_loadu_si128((const __m128i *)a);
+    const size_t hblocks = hdrlen / COAP_AES_BLOCK_SIZE;
+    const size_t mblocks = (len + COAP_AES_BLOCK_SIZE - 1) / COAP_AES_BLOCK_SIZE;
+    // CBC-MAC is one serial chain over header and message blocks. The
+    // counter blocks run beside it, one step ahead: step t MACs block t and
+    // encrypts counter t + 1, then counter 0 once the message is covered.
+    __m128i mac = _mm_setzero_si128();
+    for (size_t t = 0; t < hblocks + mblocks; ++t) {
+        if (t < hblocks) {
+            mac = _mm_xor_si128(mac, _mm_loadu_si128((const __m128i *)(hdr + COAP_AES_BLOCK_SIZE * t)));
+        }
+        else {
+            // keystream of counter m + 1 was made at step m
+            const size_t m = t - hblocks, off = COAP_AES_BLOCK_SIZE * m;
+            const size_t n = (len - off < COAP_AES_BLOCK_SIZE) ? len - off : COAP_AES_BLOCK_SIZE;
+            const __m128i k = ring[(m + 1) % _RING];
+            if (n == COAP_AES_BLOCK_SIZE) {
+                const __m128i x = _mm_loadu_si128((const __m128i *)(in + off));
+                const __m128i c = _mm_xor_si128(x, k);
+                _mm_storeu_si128((__m128i *)(out + off), c);
+                mac = _mm_xor_si128(mac, encrypt ? x : c);
+            }
+            else {
+                // last partial block, zero padded for the MAC
+                _mm_storeu_si128((__m128i *)s, k);
+                memset(p, 0, sizeof(p));
+                for (size_t j = 0; j < n; ++j) {
+                    const uint8_t c = in[off + j] ^ s[j];
+                    p[j] = encrypt ? in[off + j] : c;
+                    out[off + j] = c;
+                }
+                mac = _mm_xor_si128(mac, _mm_loadu_si128((const __m128i *)p));
+            }
+        }
+        const uint16_t i = (t < mblocks) ? (uint16_t)(t + 1) : 0;
+        __m128i ks = _mm_insert_epi16(a0, (uint16_t)((i >> 8) | (i << 8)), 7);
+        mac = _mm_xor_si128(mac, rk[0]);
+        ks = _mm_xor_si128(ks, rk[0]);
+        for (int r = 1; r < 10; ++r) {
+            mac = _mm_aesenc_si128(mac, rk[r]);
+            ks = _mm_aesenc_si128(ks, rk[r]);
+        }
+        mac = _mm_aesenclast_si128(mac, rk[10]);
+        ks = _mm_aesenclast_si128(ks, rk[10]);
+        if (i) {
+            ring[i % _RING] = ks;
+        }
+        else if (t == mblocks) {
+            s0 = ks;
+        }
+    }
+    _mm_storeu_si128((__m128i *)s, _mm_xor_si128(mac, s0));
+    memcpy(tag, s, COAP_CCM_TAG_SIZE);
+}
+#endif
+
+/* constant time */
+static bool _equal(const uint8_t *a, const uint8_t *b, const size_t len)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return !diff;
+}
+
+static int _ccm(const coap_aes_t *aes, const uint8_t *nonce,
+                const uint8_t *aad, const size_t aadlen,
+                const uint8_t *in, const size_t len, uint8_t *out,
+                const bool encrypt, uint8_t *tag)
+{
+    uint8_t hdr[_HEADER_SIZE];
+    if ((aadlen > COAP_CCM_MAX_AAD) || (len > COAP_CCM_MAX_LEN)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    const size_t hdrlen = _ccm_header(nonce, aad, aadlen, len, hdr);
+#ifdef _USE_AESNI
+    if (coap_crypto_accelerated()) {
+        _ccm_aesni(aes, nonce, hdr, hdrlen, in, len, out, encrypt, tag);
+        return COAP_SUCCESS;
+    }
+#endif
+    _ccm_portable(aes, nonce, hdr, hdrlen, in, len, out, encrypt, tag);
+    return COAP_SUCCESS;
+}
+
+/* https://tools.ietf.org/html/rfc6234 */
+typedef struct
+{
+    uint32_t h[8];
+    uint8_t block[64];
+    size_t fill;                        //!< bytes in block
+    uint64_t total;                     //!< bytes hashed
+} _sha256_t;
+
+static const uint32_t _k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void _sha256_init(_sha256_t *c)
+{
+    static const uint32_t h0[8] =
+    {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(c->h, h0, sizeof(h0));
+    c->fill = 0;
+    c->total = 0;
+}
+
+#define _S0(x)  (_ROR32(x, 2) ^ _ROR32(x, 13) ^ _ROR32(x, 22))
+#define _S1(x)  (_ROR32(x, 6) ^ _ROR32(x, 11) ^ _ROR32(x, 25))
+#define _s0(x)  (_ROR32(x, 7) ^ _ROR32(x, 18) ^ ((x) >> 3))
+#define _s1(x)  (_ROR32(x, 17) ^ _ROR32(x, 19) ^ ((x) >> 10))
+
+static void _sha256_block(_sha256_t *c, const uint8_t *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = _GETU32(p + 4 * i);
+    }
+    for (int i = 16; i < 64; ++i) {
+        w[i] = _s1(w[i - 2]) + w[i - 7] + _s0(w[i - 15]) + w[i - 16];
+    }
+    uint32_t a = c->h[0], b = c->h[1], cc = c->h[2], d = c->h[3];
+    uint32_t e = c->h[4], f = c->h[5], g = c->h[6], h = c->h[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t t1 = h + _S1(e) + ((e & f) ^ (~e & g)) + _k[i] + w[i];
+        const uint32_t t2 = _S0(a) + ((a & b) ^ (a & cc) ^ (b & cc));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = cc;
+        cc = b;
+        b = a;
+        a = t1 + t2;
+    }
+    c->h[0] += a;
+    c->h[1] += b;
+    c->h[2] += cc;
+    c->h[3] += d;
+    c->h[4] += e;
+    c->h[5] += f;
+    c->h[6] += g;
+    c->h[7] += h;
+}
+
+static void _sha256_update(_sha256_t *c, const uint8_t *buf, size_t len)
+{
+    c->total += len;
+    while (len) {
+        const size_t n = (64 - c->fill < len) ? 64 - c->fill : len;
+        memcpy(c->block + c->fill, buf, n);
+        c->fill += n;
+        buf += n;
+        len -= n;
+        if (c->fill == 64) {
+            _sha256_block(c, c->block);
+            c->fill = 0;
+        }
+    }
+}
+
+static void _sha256_final(_sha256_t *c, uint8_t *digest)
+{
+    const uint64_t bits = c->total * 8;
+    uint8_t pad[72] = {0x80};
+    // 0x80, zeros up to 56 mod 64, then the length in bits
+    const size_t padlen = ((c->fill < 56) ? 56 : 120) - c->fill;
+    for (int i = 0; i < 8; ++i) {
+        pad[padlen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    _sha256_update(c, pad, padlen + 8);
+    for (int i = 0; i < 8; ++i) {
+        _PUTU32(digest + 4 * i, c->h[i]);
+    }
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+bool coap_crypto_accelerated(void)
+{
+    int accel = __atomic_load_n(&_accel, __ATOMIC_RELAXED);
+    if (accel < 0) {
+        accel = _has_aesni();
+        __atomic_store_n(&_accel, accel, __ATOMIC_RELAXED);
+    }
+    return accel;
+}
+
+bool coap_crypto_set_accelerated(const bool on)
+{
+    __atomic_store_n(&_accel, on && _has_aesni(), __ATOMIC_RELAXED);
+    return coap_crypto_accelerated();
+}
+
+void coap_aes_init(coap_aes_t *aes, const uint8_t *key)
+{
+    static const uint8_t rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+    uint32_t *w = aes->ek;
+    for (int i = 0; i < 4; ++i) {
+        w[i] = _GETU32(key + 4 * i);
+    }
+    for (int i = 4; i < 44; ++i) {
+        uint32_t t = w[i - 1];
+        if (!(i % 4)) {
+            // RotWord, SubWord, Rcon
+            t = ((uint32_t)_sbox[(t >> 16) & 0xff] << 24) ^ ((uint32_t)_sbox[(t >> 8) & 0xff] << 16) ^
+                ((uint32_t)_sbox[t & 0xff] << 8) ^ _sbox[t >> 24] ^ ((uint32_t)rcon[i / 4 - 1] << 24);
+        }
+        w[i] = w[i - 4] ^ t;
+    }
+    for (int i = 0; i < 44; ++i) {
+        _PUTU32(aes->rk + 4 * i, w[i]);
+    }
+}
+
+void coap_aes_encrypt(const coap_aes_t *aes, const uint8_t *in, uint8_t *out)
+{
+    _encrypt_block(aes, in, out);
+}
+
+int coap_aes_ccm_encrypt(const coap_aes_t *aes, const uint8_t *nonce,
+                         const uint8_t *aad, const size_t aadlen,
+                         const uint8_t *in, const size_t len, uint8_t *out)
+{
+    return _ccm(aes, nonce, aad, aadlen, in, len, out, true, out + len);
+}
+
+int coap_aes_ccm_decrypt(const coap_aes_t *aes, const uint8_t *nonce,
+                         const uint8_t *aad, const size_t aadlen,
+                         const uint8_t *in, const size_t len, uint8_t *out)
+{
+    uint8_t tag[COAP_CCM_TAG_SIZE], expected[COAP_CCM_TAG_SIZE];
+    if (len < COAP_CCM_TAG_SIZE) {
+        return COAP_ERR_DECRYPT;
+    }
+    const size_t n = len - COAP_CCM_TAG_SIZE;
+    // out may be in, keep the tag
+    memcpy(expected, in + n, COAP_CCM_TAG_SIZE);
+    int rc = _ccm(aes, nonce, aad, aadlen, in, n, out, false, tag);
+    if (!rc && !_equal(tag, expected, COAP_CCM_TAG_SIZE)) {
+        memset(out, 0, n);
+        rc = COAP_ERR_DECRYPT;
+    }
+    return rc;
+}
+
+void coap_sha256(const uint8_t *buf, const size_t len, uint8_t *digest)
+{
+    _sha256_t c;
+    _sha256_init(&c);
+    _sha256_update(&c, buf, len);
+    _sha256_final(&c, digest);
+}
+
+void coap_hmac_sha256(const uint8_t *key, const size_t keylen,
+                      const uint8_t *buf, const size_t len, uint8_t *mac)
+{
+    uint8_t k[64] = {0}, pad[64], inner[COAP_SHA256_SIZE];
+    _sha256_t c;
+    if (keylen > sizeof(k)) {
+        coap_sha256(key, keylen, k);
+    }
+    else if (keylen) {
+        memcpy(k, key, keylen);
+    }
+    for (size_t i = 0; i < sizeof(k); ++i) {
+        pad[i] = k[i] ^ 0x36;
+    }
+    _sha256_init(&c);
+    _sha256_update(&c, pad, sizeof(pad));
+    _sha256_update(&c, buf, len);
+    _sha256_final(&c, inner);
+    for (size_t i = 0; i < sizeof(k); ++i) {
+        pad[i] = k[i] ^ 0x5c;
+    }
+    _sha256_init(&c);
+    _sha256_update(&c, pad, sizeof(pad));
+    _sha256_update(&c, inner, sizeof(inner));
+    _sha256_final(&c, mac);
+}
+
+int coap_hkdf_sha256(const uint8_t *salt, const size_t saltlen,
+                     const uint8_t *ikm, const size_t ikmlen,
+                     const uint8_t *info, const size_t infolen,
+                     uint8_t *okm, const size_t okmlen)
+{
+    uint8_t prk[COAP_SHA256_SIZE], t[COAP_SHA256_SIZE + COAP_CCM_MAX_AAD + 1];
+    if ((okmlen > 255 * COAP_SHA256_SIZE) || (infolen > COAP_CCM_MAX_AAD)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    // extract, then expand T(i) = HMAC(PRK, T(i - 1) | info | i)
+    coap_hmac_sha256(salt, saltlen, ikm, ikmlen, prk);
+    size_t tlen = 0;
+    for (size_t off = 0, i = 1; off < okmlen; off += COAP_SHA256_SIZE, ++i) {
+        memcpy(t + tlen, info, infolen);
+        t[tlen + infolen] = (uint8_t)i;
+        coap_hmac_sha256(prk, sizeof(prk), t, tlen + infolen + 1, t);
+        tlen = COAP_SHA256_SIZE;
+        memcpy(okm + off, t, (okmlen - off < COAP_SHA256_SIZE) ? okmlen - off : COAP_SHA256_SIZE);
+    }
+    return COAP_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#ifndef COAP_CRYPTO_H
+#define COAP_CRYPTO_H 1
+
+/**
+ * @file coap_crypto.h
+ *
+ * Cryptographic primitives of OSCORE, see coap_oscore.h: AES-128 in CCM
+ * mode with 8 byte tags and 13 byte nonces (AES-CCM-16-64-128,
+ * https://tools.ietf.org/html/rfc8152#section-10.2), SHA-256, HMAC and HKDF
+ * (https://tools.ietf.org/html/rfc5869).
+ *
+ * On x86-64 AES runs on AES-NI if the CPU has it, detected at run time,
+ * with CBC-MAC and counter blocks interleaved. Elsewhere, or built with
+ * COAP_CRYPTO_PORTABLE, a table based implementation is used, which is not
+ * constant time with regard to cache timing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "coap.h"
+
+#define COAP_AES_KEY_SIZE       16      //!< AES-128
+#define COAP_AES_BLOCK_SIZE     16
+#define COAP_CCM_NONCE_SIZE     13      //!< 15 - L, L = 2
+#define COAP_CCM_TAG_SIZE       8       //!< M
+#define COAP_CCM_MAX_LEN        65535   //!< max. message size, L = 2
+#ifndef COAP_CCM_MAX_AAD
+#define COAP_CCM_MAX_AAD        256     //!< max. size of associated data
+#endif
+#define COAP_SHA256_SIZE        32
+
+/**
+ * Expanded AES-128 key
+ */
+typedef struct coap_aes
+{
+    uint32_t ek[44];                    //!< round keys, as words
+    uint8_t rk[176];                    //!< round keys, as bytes for AES-NI
+} coap_aes_t;
+
+/**
+ * @brief Check whether AES runs on AES-NI
+ */
+bool coap_crypto_accelerated(void);
+
+/**
+ * @brief Use AES-NI if available, or not, e.g. for comparison
+ *
+ * @return whether AES-NI is used from now on
+ */
+bool coap_crypto_set_accelerated(const bool on);
+
+/**
+ * @brief Expand an AES-128 key
+ *
+ * @param[out] aes The expanded key
+ * @param[in] key COAP_AES_KEY_SIZE bytes
+ */
+void coap_aes_init(coap_aes_t *aes, const uint8_t *key);
+
+/**
+ * @brief Encrypt one block
+ *
+ * @param[in] aes The expanded key
+ * @param[in] in COAP_AES_BLOCK_SIZE bytes
+ * @param[out] out COAP_AES_BLOCK_SIZE bytes, may be \p in
+ */
+void coap_aes_encrypt(const coap_aes_t *aes, const uint8_t *in, uint8_t *out);
+
+/**
+ * @brief Encrypt and authenticate with AES-CCM, see
+ * https://tools.ietf.org/html/rfc3610
+ *
+ * @param[in] aes The expanded key
+ * @param[in] nonce COAP_CCM_NONCE_SIZE bytes
+ * @param[in] aad Associated data, authenticated only
+ * @param[in] aadlen Size of \p aad, up to COAP_CCM_MAX_AAD
+ * @param[in] in The plaintext
+ * @param[in] len Size of \p in, up to COAP_CCM_MAX_LEN
+ * @param[out] out Ciphertext followed by the tag, \p len +
+ * COAP_CCM_TAG_SIZE bytes; may be \p in
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED if \p aadlen or \p len are
+ * too large
+ */
+int coap_aes_ccm_encrypt(const coap_aes_t *aes, const uint8_t *nonce,
+                         const uint8_t *aad, const size_t aadlen,
+                         const uint8_t *in, const size_t len, uint8_t *out);
+
+/**
+ * @brief Verify and decrypt with AES-CCM
+ *
+ * @param[in] in Ciphertext followed by the tag
+ * @param[in] len Size of \p in, including the tag
+ * @param[out] out The plaintext, \p len - COAP_CCM_TAG_SIZE bytes; may be
+ * \p in. Zeroed if verification fails.
+ *
+ * @return 0 on success, COAP_ERR_DECRYPT if \p in is not authentic, or
+ * COAP_ERR_UNSUPPORTED as coap_aes_ccm_encrypt()
+ */
+int coap_aes_ccm_decrypt(const coap_aes_t *aes, const uint8_t *nonce,
+                         const uint8_t *aad, const size_t aadlen,
+                         const uint8_t *in, const size_t len, uint8_t *out);
+
+/**
+ * @brief Compute SHA-256 of a buffer
+ *
+ * @param[out] digest COAP_SHA256_SIZE bytes
+ */
+void coap_sha256(const uint8_t *buf, const size_t len, uint8_t *digest);
+
+/**
+ * @brief Compute HMAC-SHA-256 of a buffer
+ *
+ * @param[out] mac COAP_SHA256_SIZE bytes
+ */
+void coap_hmac_sha256(const uint8_t *key, const size_t keylen,
+                      const uint8_t *buf, const size_t len, uint8_t *mac);
+
+/**
+ * @brief Derive a key with HKDF-SHA-256
+ *
+ * @param[in] salt Salt, may be empty
+ * @param[in] ikm Input keying material
+ * @param[in] info Context of the key
+ * @param[out] okm Output keying material
+ * @param[in] okmlen Size of \p okm, up to 255 * COAP_SHA256_SIZE
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED if \p okmlen is too large
+ */
+int coap_hkdf_sha256(const uint8_t *salt, const size_t saltlen,
+                     const uint8_t *ikm, const size_t ikmlen,
+                     const uint8_t *info, const size_t infolen,
+                     uint8_t *okm, const size_t okmlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_CRYPTO_H
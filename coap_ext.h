@@ -21,12 +21,13 @@ inline void coap_set_content_type(coap_resource_ext_t *resource, coap_content_ty
 }
 
 inline coap_resource_t coap_convert_resource_ext(coap_resource_ext_t *resource) {
-    return (coap_resource_t) { COAP_STATE_RDY, resource->method, COAP_TYPE_ACK, NULL, resource->path, 
-        COAP_SET_CONTENTTYPE(COAP_GET_CONTENTTYPE(resource->content_type))};
+    return (coap_resource_t) { .state = COAP_STATE_RDY, .method = resource->method, .msg_type = COAP_TYPE_ACK,
+        .path = resource->path, .content_type = COAP_SET_CONTENTTYPE(COAP_GET_CONTENTTYPE(resource->content_type)) };
 }
 
 inline coap_resource_t coap_make_request_resource(const coap_method_t method, const coap_resource_path_t* resource_path) {
-    return (coap_resource_t) { COAP_STATE_RDY, method, COAP_TYPE_CON, NULL, resource_path, COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE) };
+    return (coap_resource_t) { .state = COAP_STATE_RDY, .method = method, .msg_type = COAP_TYPE_CON,
+        .path = resource_path, .content_type = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE) };
 }
 
 int coap_build_resource_path(coap_resource_path_t* resource_path, char* path);
@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coap_group.h"
+#include "coap_random.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+static bool _is_suppressed(const uint8_t *buf, const size_t buflen);
+
+/* errors, empty messages and resets, https://tools.ietf.org/html/rfc7252#section-8.2 */
+static bool _is_suppressed(const uint8_t *buf, const size_t buflen)
+{
+    if (buflen < sizeof(coap_raw_header_t)) {
+        return true;
+    }
+    const coap_raw_header_t *r = (const coap_raw_header_t *)buf;
+    return (r->hdr.t == COAP_TYPE_RESET) ||
+           (r->hdr.code == COAP_RSPCODE_EMPTY) ||
+           (r->hdr.code >= COAP_RSPCODE_BAD_REQUEST);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_group_init(coap_group_t *g, coap_transport_send send, void *ctx,
+                     const coap_tick_t leisure)
+{
+    memset(g, 0, sizeof(*g));
+    g->send = send;
+    g->ctx = ctx;
+    g->leisure = leisure;
+}
+
+coap_tick_t coap_group_leisure(const size_t size, const unsigned members,
+                               const uint32_t rate)
+{
+    if (!rate) {
+        return COAP_GROUP_DEFAULT_LEISURE;
+    }
+    return (coap_tick_t)size * members * COAP_TICKS_PER_SEC / rate;
+}
+
+bool coap_group_accepts(const uint8_t *buf, const size_t buflen)
+{
+    if (buflen < sizeof(coap_raw_header_t)) {
+        return false;
+    }
+    return ((const coap_raw_header_t *)buf)->hdr.t == COAP_TYPE_NONCON;
+}
+
+int coap_group_send(void *ctx, const coap_endpoint_t *ep,
+                    const uint8_t *buf, const size_t buflen)
+{
+    coap_group_t *g = ctx;
+    if (_is_suppressed(buf, buflen)) {
+        g->suppressed++;
+        return COAP_SUCCESS;
+    }
+    if (!g->leisure) {
+        return g->send(g->ctx, ep, buf, buflen);
+    }
+    if (buflen > COAP_GROUP_MAX_PDU) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    if (g->count == COAP_GROUP_MAX_DELAYED) {
+        g->dropped++;
+        return COAP_ERR_BUSY;
+    }
+    // random point of time within the leisure period
+    coap_group_response_t *r = &g->responses[g->count++];
+    r->due = coap_clock_now() + coap_random_next() % g->leisure;
+    r->ep = *ep;
+    r->len = buflen;
+    memcpy(r->pdu, buf, buflen);
+    return COAP_SUCCESS;
+}
+
+coap_tick_t coap_group_poll(coap_group_t *g)
+{
+    const coap_tick_t now = coap_clock_now();
+    coap_tick_t next = COAP_TICK_NEVER;
+    size_t i = 0;
+    while (i < g->count) {
+        coap_group_response_t *r = &g->responses[i];
+        if (r->due > now) {
+            if (r->due < next) {
+                next = r->due;
+            }
+            i++;
+            continue;
+        }
+        g->send(g->ctx, &r->ep, r->pdu, r->len);
+        g->delayed++;
+        // the last one takes the slot, it is looked at next
+        if (i != --g->count) {
+            memcpy(r, &g->responses[g->count], sizeof(*r));
+        }
+    }
+    return next;
+}
@@ -0,0 +1,133 @@
+#ifndef COAP_GROUP_H
+#define COAP_GROUP_H 1
+
+/**
+ * @file coap_group.h
+ *
+ * Responding to requests received via multicast, see
+ * https://tools.ietf.org/html/rfc7252#section-8.2
+ *
+ * Requests to a group must be non-confirmable, others are not to be
+ * processed. Error responses, empty ACKs and resets are suppressed, they
+ * tell a client that asked a whole group nothing of use. Other responses
+ * are held back until a random point of time within the leisure period, so
+ * that the members of a group do not all answer at once, and sent by
+ * coap_group_poll().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "coap.h"
+#include "coap_time.h"
+
+#ifndef COAP_GROUP_MAX_DELAYED
+#define COAP_GROUP_MAX_DELAYED      32      //!< responses held back at once
+#endif
+#ifndef COAP_GROUP_MAX_PDU
+#define COAP_GROUP_MAX_PDU          1152    //!< max. size of a response
+#endif
+
+#define COAP_GROUP_DEFAULT_LEISURE  5000    //!< ms, DEFAULT_LEISURE
+
+/* All-CoAP-Nodes, https://tools.ietf.org/html/rfc7252#section-12.8 */
+#define COAP_GROUP_ALL_NODES_IPV4       "224.0.1.187"
+#define COAP_GROUP_ALL_NODES_IPV6_LINK  "ff02::fd"
+#define COAP_GROUP_ALL_NODES_IPV6_SITE  "ff05::fd"
+
+/**
+ * Response waiting for its point of time
+ */
+typedef struct coap_group_response
+{
+    coap_tick_t due;                    //!< time to send
+    coap_endpoint_t ep;                 //!< the requesting client
+    size_t len;                         //!< size of pdu
+    uint8_t pdu[COAP_GROUP_MAX_PDU];    //!< the response
+} coap_group_response_t;
+
+/**
+ * Responses to group requests of a server
+ */
+typedef struct coap_group
+{
+    coap_transport_send send;           //!< sends datagrams
+    void *ctx;                          //!< context of send
+    coap_tick_t leisure;                //!< ms, responses are spread over
+    size_t count;                       //!< responses held back
+    uint64_t suppressed;                //!< responses not sent
+    uint64_t delayed;                   //!< responses sent after their leisure
+    uint64_t dropped;                   //!< responses not sent, all slots in use
+    coap_group_response_t responses[COAP_GROUP_MAX_DELAYED];
+} coap_group_t;
+
+/**
+ * @brief Initialize group response state
+ *
+ * @param[out] g The group state
+ * @param[in] send Callback sending datagrams
+ * @param[in] ctx Context passed to \p send
+ * @param[in] leisure Period in ms to spread responses over, e.g.
+ * COAP_GROUP_DEFAULT_LEISURE or from coap_group_leisure(), 0 to send at once
+ */
+void coap_group_init(coap_group_t *g, coap_transport_send send, void *ctx,
+                     const coap_tick_t leisure);
+
+/**
+ * @brief Estimate the leisure period
+ *
+ * Lower bound S * G / R of https://tools.ietf.org/html/rfc7252#section-8.2.1
+ *
+ * @param[in] size Estimated size of a response in bytes
+ * @param[in] members Estimated number of group members responding
+ * @param[in] rate Data rate the responses may take, bytes per second
+ *
+ * @return leisure in ms
+ */
+coap_tick_t coap_group_leisure(const size_t size, const unsigned members,
+                               const uint32_t rate);
+
+/**
+ * @brief Check whether a request received via multicast is to be processed
+ *
+ * @param[in] buf The request datagram
+ * @param[in] buflen Size of \p buf
+ *
+ * @return true for non-confirmable requests
+ */
+bool coap_group_accepts(const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief Send the response to a request received via multicast
+ *
+ * Matches coap_transport_send, pass the group state as \p ctx. Suppresses
+ * the response, or holds it back until coap_group_poll() sends it.
+ *
+ * @return 0 on success, also if the response was suppressed,
+ * COAP_ERR_BUFFER_TOO_SMALL if \p buflen exceeds COAP_GROUP_MAX_PDU, or
+ * COAP_ERR_BUSY if too many responses are held back
+ */
+int coap_group_send(void *ctx, const coap_endpoint_t *ep,
+                    const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief Send responses whose time has come
+ *
+ * Call at the latest at the returned time.
+ *
+ * @param[in,out] g The group state
+ *
+ * @return time the next response is due, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_group_poll(coap_group_t *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_GROUP_H
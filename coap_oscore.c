@@ -0,0 +1,632 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coap_cbor.h"
+#include "coap_oscore.h"
+#include "coap_random.h"
+#include "coap_time.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _CLASS_E        0x01    //!< encrypted, inner option
+#define _CLASS_U        0x02    //!< unprotected, outer option
+#define _ALG_AEAD       10      //!< AES-CCM-16-64-128
+#define _FLAG_KID       0x08
+#define _FLAG_CONTEXT   0x10
+#define _FLAG_RESERVED  0xe0
+#define _MAX_OPTION     (1 + COAP_OSCORE_MAX_PIV + COAP_OSCORE_MAX_ID)
+#define _MAX_AAD        64
+
+static unsigned _class(const uint8_t num);
+static size_t _ext_len(const size_t value);
+static size_t _encoded_len(const coap_packet_t *pkt);
+static int _derive(const coap_oscore_params_t *params, const coap_buffer_t *id,
+                   const char *type, uint8_t *out, const size_t len);
+static void _nonce(const coap_oscore_t *ctx, const uint8_t *id, const size_t id_len,
+                   const uint8_t *piv, const size_t piv_len, uint8_t *nonce);
+static size_t _aad(const coap_oscore_request_t *req, uint8_t *aad);
+static int _parse_option(const coap_option_t *opt, coap_oscore_request_t *value,
+                         bool *has_piv, bool *has_kid);
+static uint64_t _seq(const uint8_t *piv, const size_t len);
+static bool _replayed(const coap_oscore_t *ctx, const uint64_t seq);
+static void _replay_update(coap_oscore_t *ctx, const uint64_t seq);
+static bool _echoed(coap_oscore_t *ctx, const uint8_t *buf, const size_t len);
+static bool _requires_oscore(const coap_resource_t *resources, const coap_packet_t *pkt);
+static int _make_error(const coap_packet_t *inpkt, const int err,
+                       uint8_t *buf, size_t *buflen);
+static int _make_challenge(coap_oscore_t *ctx, const coap_packet_t *inpkt,
+                           coap_oscore_request_t *req, uint8_t *buf, size_t *buflen);
+static int _take_piv(coap_oscore_t *ctx, uint8_t *piv, size_t *piv_len);
+static int _protect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                    coap_oscore_request_t *req, const bool own_piv,
+                    uint8_t *buf, size_t *buflen);
+
+/* https://tools.ietf.org/html/rfc8613#section-4.1 */
+static unsigned _class(const uint8_t num)
+{
+    switch (num) {
+        case COAP_OPTION_URI_HOST:
+        case COAP_OPTION_URI_PORT:
+        case COAP_OPTION_PROXY_SCHEME:
+        case COAP_OPTION_PROXY_URI:
+        case COAP_OPTION_OSCORE:
+            return _CLASS_U;
+        case COAP_OPTION_OBSERVE:
+            return _CLASS_E | _CLASS_U;
+        default:
+            return _CLASS_E;
+    }
+}
+
+/* extended delta or length bytes of an option header */
+static size_t _ext_len(const size_t value)
+{
+    return (value < 13) ? 0 : ((value < 269) ? 1 : 2);
+}
+
+/* exact size coap_build() writes, it does not check options against the buffer */
+static size_t _encoded_len(const coap_packet_t *pkt)
+{
+    size_t len = sizeof(coap_raw_header_t) + pkt->hdr.tkl;
+    uint8_t num = 0;
+    for (size_t i = 0; i < pkt->numopts; ++i) {
+        len += 1 + _ext_len(pkt->opts[i].num - num) + _ext_len(pkt->opts[i].buf.len) +
+               pkt->opts[i].buf.len;
+        num = pkt->opts[i].num;
+    }
+    if (pkt->payload.len) {
+        len += 1 + pkt->payload.len;
+    }
+    return len;
+}
+
+/* info = [id, id_context, alg_aead, type, L], https://tools.ietf.org/html/rfc8613#section-3.2.1 */
+static int _derive(const coap_oscore_params_t *params, const coap_buffer_t *id,
+                   const char *type, uint8_t *out, const size_t len)
+{
+    static const uint8_t none[1] = {0};
+    uint8_t info[64];
+    size_t infolen;
+    coap_cbor_writer_t w;
+    coap_cbor_writer_init(&w, info, sizeof(info));
+    coap_cbor_put_array(&w, 5);
+    // an empty ID may come without buffer
+    coap_cbor_put_bytes(&w, id->len ? id->p : none, id->len);
+    if (params->id_context.len) {
+        coap_cbor_put_bytes(&w, params->id_context.p, params->id_context.len);
+    }
+    else {
+        coap_cbor_put_null(&w);
+    }
+    coap_cbor_put_uint(&w, _ALG_AEAD);
+    coap_cbor_put_text(&w, type, strlen(type));
+    coap_cbor_put_uint(&w, len);
+    int rc = coap_cbor_writer_finish(&w, &infolen);
+    if (!rc) {
+        rc = coap_hkdf_sha256(params->salt.p, params->salt.len,
+                              params->secret.p, params->secret.len,
+                              info, infolen, out, len);
+    }
+    return rc;
+}
+
+/* https://tools.ietf.org/html/rfc8613#section-5.2 */
+static void _nonce(const coap_oscore_t *ctx, const uint8_t *id, const size_t id_len,
+                   const uint8_t *piv, const size_t piv_len, uint8_t *nonce)
+{
+    // size of ID, ID and partial IV left-padded, XOR common IV
+    memset(nonce, 0, COAP_CCM_NONCE_SIZE);
+    nonce[0] = (uint8_t)id_len;
+    memcpy(nonce + 1 + COAP_OSCORE_MAX_ID - id_len, id, id_len);
+    memcpy(nonce + COAP_CCM_NONCE_SIZE - piv_len, piv, piv_len);
+    for (size_t i = 0; i < COAP_CCM_NONCE_SIZE; ++i) {
+        nonce[i] ^= ctx->common_iv[i];
+    }
+}
+
+/* Enc_structure of https://tools.ietf.org/html/rfc8613#section-5.4; IDs are
+ * short enough for one byte CBOR heads, so it is written directly instead of
+ * through the coap_cbor writer, which costs as much as the AES-CCM itself */
+static size_t _aad(const coap_oscore_request_t *req, uint8_t *aad)
+{
+    // external_aad = [oscore_version, [alg_aead], request_kid, request_piv, options]
+    const size_t extlen = 7 + req->kid_len + req->piv_len;
+    uint8_t *p = aad;
+    // ["Encrypt0", h'', bstr(external_aad)]
+    *p++ = 0x83;
+    *p++ = 0x68;
+    memcpy(p, "Encrypt0", 8);
+    p += 8;
+    *p++ = 0x40;
+    *p++ = (uint8_t)(0x40 | extlen);
+    *p++ = 0x85;
+    *p++ = 0x01;
+    *p++ = 0x81;
+    *p++ = _ALG_AEAD;
+    *p++ = (uint8_t)(0x40 | req->kid_len);
+    memcpy(p, req->kid, req->kid_len);
+    p += req->kid_len;
+    *p++ = (uint8_t)(0x40 | req->piv_len);
+    memcpy(p, req->piv, req->piv_len);
+    p += req->piv_len;
+    *p++ = 0x40;
+    return p - aad;
+}
+
+/* flags, partial IV, kid context, kid, https://tools.ietf.org/html/rfc8613#section-6.1 */
+static int _parse_option(const coap_option_t *opt, coap_oscore_request_t *value,
+                         bool *has_piv, bool *has_kid)
+{
+    const uint8_t *p = opt->buf.p, *end = opt->buf.p + opt->buf.len;
+    *has_piv = *has_kid = false;
+    value->piv_len = value->kid_len = 0;
+    if (!opt->buf.len) {
+        return COAP_SUCCESS;
+    }
+    const uint8_t flags = *p++;
+    value->piv_len = flags & 0x07;
+    if ((flags & _FLAG_RESERVED) || (value->piv_len > COAP_OSCORE_MAX_PIV) ||
+        ((size_t)(end - p) < value->piv_len)) {
+        return COAP_ERR_MALFORMED;
+    }
+    memcpy(value->piv, p, value->piv_len);
+    p += value->piv_len;
+    *has_piv = value->piv_len > 0;
+    if (flags & _FLAG_CONTEXT) {
+        // only derivation depends on it
+        if ((p == end) || ((size_t)(end - p - 1) < *p)) {
+            return COAP_ERR_MALFORMED;
+        }
+        p += 1 + *p;
+    }
+    if (flags & _FLAG_KID) {
+        if ((size_t)(end - p) > COAP_OSCORE_MAX_ID) {
+            return COAP_ERR_MALFORMED;
+        }
+        value->kid_len = end - p;
+        memcpy(value->kid, p, value->kid_len);
+        *has_kid = true;
+    }
+    else if (p != end) {
+        return COAP_ERR_MALFORMED;
+    }
+    return COAP_SUCCESS;
+}
+
+static uint64_t _seq(const uint8_t *piv, const size_t len)
+{
+    uint64_t seq = 0;
+    for (size_t i = 0; i < len; ++i) {
+        seq = (seq << 8) | piv[i];
+    }
+    return seq;
+}
+
+/* https://tools.ietf.org/html/rfc8613#section-7.4 */
+static bool _replayed(const coap_oscore_t *ctx, const uint64_t seq)
+{
+    if (!ctx->replay_valid || (seq > ctx->replay_max)) {
+        return false;
+    }
+    const uint64_t age = ctx->replay_max - seq;
+    return (age >= COAP_OSCORE_REPLAY_WINDOW) || (ctx->replay_seen & (1ULL << age));
+}
+
+static void _replay_update(coap_oscore_t *ctx, const uint64_t seq)
+{
+    if (!ctx->replay_valid || (seq > ctx->replay_max)) {
+        const uint64_t shift = ctx->replay_valid ? seq - ctx->replay_max : 64;
+        ctx->replay_seen = ((shift < 64) ? ctx->replay_seen << shift : 0) | 1;
+        ctx->replay_max = seq;
+        ctx->replay_valid = true;
+    }
+    else {
+        ctx->replay_seen |= 1ULL << (ctx->replay_max - seq);
+    }
+}
+
+/*
+ * the unprotected request answers the outstanding challenge, the window
+ * starts at its sequence number, https://tools.ietf.org/html/rfc8613#appendix-B.1.2
+ */
+static bool _echoed(coap_oscore_t *ctx, const uint8_t *buf, const size_t len)
+{
+    coap_packet_t pkt;
+    if (!ctx->echo_valid || (coap_clock_now() >= ctx->echo_expires) ||
+        coap_parse(buf, len, &pkt)) {
+        return false;
+    }
+    const coap_option_t *echo = coap_find_option(&pkt, COAP_OPTION_ECHO);
+    return echo && (echo->buf.len == sizeof(ctx->echo)) &&
+           !memcmp(echo->buf.p, ctx->echo, sizeof(ctx->echo));
+}
+
+/* some resource of the path takes protected requests only */
+static bool _requires_oscore(const coap_resource_t *resources, const coap_packet_t *pkt)
+{
+    uint8_t count;
+    if ((pkt->hdr.code == COAP_RSPCODE_EMPTY) || (pkt->hdr.code >> 5)) {
+        return false;
+    }
+    const coap_option_t *opt = coap_find_uri_path(pkt, &count);
+    for (const coap_resource_t *rs = resources; rs->handler; ++rs) {
+        if ((rs->flags & COAP_RESOURCE_OSCORE) && rs->path &&
+            coap_match_path(rs->path, opt, count)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* unprotected, https://tools.ietf.org/html/rfc8613#section-8.2 */
+static int _make_error(const coap_packet_t *inpkt, const int err,
+                       uint8_t *buf, size_t *buflen)
+{
+    const coap_msgtype_t t = (inpkt->hdr.t == COAP_TYPE_CON) ?
+                             COAP_TYPE_ACK : COAP_TYPE_NONCON;
+    coap_responsecode_t code = COAP_RSPCODE_UNAUTHORIZED;
+    const char *diagnostic = "Security context not found";
+    if (err == COAP_ERR_REPLAY) {
+        diagnostic = "Replay detected";
+    }
+    else if (err == COAP_ERR_OPTION_NOT_FOUND) {
+        diagnostic = "OSCORE required";
+    }
+    else if (err == COAP_ERR_DECRYPT) {
+        code = COAP_RSPCODE_BAD_REQUEST;
+        diagnostic = "Decryption failed";
+    }
+    else if (err != COAP_ERR_NO_CONTEXT) {
+        code = COAP_RSPCODE_BAD_OPTION;
+        diagnostic = NULL;
+    }
+    coap_packet_t pkt;
+    coap_make_response(inpkt->hdr.id, &inpkt->tok, t, code, NULL,
+                       (const uint8_t *)diagnostic, diagnostic ? strlen(diagnostic) : 0,
+                       &pkt);
+    return coap_build(&pkt, buf, buflen);
+}
+
+/*
+ * protected 4.01 with the outstanding Echo value, a new one only once that
+ * expired, so replayed requests cannot void the value the peer is about to
+ * return, https://tools.ietf.org/html/rfc9175#section-2.4; the request may
+ * be a replay, the response takes a partial IV of its own
+ */
+static int _make_challenge(coap_oscore_t *ctx, const coap_packet_t *inpkt,
+                           coap_oscore_request_t *req, uint8_t *buf, size_t *buflen)
+{
+    const coap_msgtype_t t = (inpkt->hdr.t == COAP_TYPE_CON) ?
+                             COAP_TYPE_ACK : COAP_TYPE_NONCON;
+    const coap_tick_t now = coap_clock_now();
+    coap_packet_t pkt;
+    if (!ctx->echo_valid || (now >= ctx->echo_expires)) {
+        coap_random_bytes(ctx->echo, sizeof(ctx->echo));
+        ctx->echo_expires = now + COAP_OSCORE_ECHO_MS;
+        ctx->echo_valid = true;
+    }
+    coap_make_response(inpkt->hdr.id, &inpkt->tok, t, COAP_RSPCODE_UNAUTHORIZED,
+                       NULL, NULL, 0, &pkt);
+    coap_add_option(&pkt, COAP_OPTION_ECHO, ctx->echo, sizeof(ctx->echo));
+    return coap_oscore_protect_fresh(ctx, &pkt, req, buf, buflen);
+}
+
+/* next sequence number as partial IV, at least one byte, persisted ahead of use */
+static int _take_piv(coap_oscore_t *ctx, uint8_t *piv, size_t *piv_len)
+{
+    if (ctx->seq > COAP_OSCORE_MAX_SEQ) {
+        return COAP_ERR_NO_CONTEXT;
+    }
+    // https://tools.ietf.org/html/rfc8613#appendix-B.1.1
+    if (ctx->seq >= ctx->seq_stored) {
+        const uint64_t stored = ctx->seq + COAP_OSCORE_SSN_WINDOW;
+        const int rc = ctx->store(ctx->store_ctx, stored);
+        if (rc) {
+            return rc;
+        }
+        ctx->seq_stored = stored;
+    }
+    *piv_len = 1;
+    while ((*piv_len < COAP_OSCORE_MAX_PIV) && (ctx->seq >> (8 * *piv_len))) {
+        (*piv_len)++;
+    }
+    for (size_t i = 0; i < *piv_len; ++i) {
+        piv[i] = (uint8_t)(ctx->seq >> (8 * (*piv_len - 1 - i)));
+    }
+    return COAP_SUCCESS;
+}
+
+/* requests always take a partial IV of their own, responses if own_piv is set */
+static int _protect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                    coap_oscore_request_t *req, const bool own_piv,
+                    uint8_t *buf, size_t *buflen)
+{
+    const bool request = !(pkt->hdr.code >> 5);
+    uint8_t value[_MAX_OPTION], nonce[COAP_CCM_NONCE_SIZE], aad[_MAX_AAD];
+    size_t valuelen = 0;
+    coap_packet_t outer, inner;
+    coap_rw_buffer_t region;
+    int rc;
+    if (pkt->hdr.code == COAP_RSPCODE_EMPTY) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    // class E options go inside, class U outside, the OSCORE option joins them
+    outer.hdr = pkt->hdr;
+    outer.hdr.code = request ? COAP_METHOD_POST : COAP_RSPCODE_CHANGED;
+    outer.tok = pkt->tok;
+    outer.numopts = 0;
+    outer.payload.p = NULL;
+    outer.payload.len = 0;
+    inner.hdr.ver = COAP_VERSION;
+    inner.hdr.t = COAP_TYPE_CON;
+    inner.hdr.tkl = 0;
+    inner.hdr.code = pkt->hdr.code;
+    inner.hdr.id = 0;
+    inner.tok.p = NULL;
+    inner.tok.len = 0;
+    inner.numopts = 0;
+    inner.payload = pkt->payload;
+    for (size_t i = 0; i < pkt->numopts; ++i) {
+        const coap_option_t *opt = &pkt->opts[i];
+        const unsigned c = _class(opt->num);
+        if ((opt->num == COAP_OPTION_PROXY_URI) || (opt->num == COAP_OPTION_OSCORE)) {
+            return COAP_ERR_UNSUPPORTED;
+        }
+        if ((c & _CLASS_E) &&
+            (rc = coap_add_option(&inner, opt->num, opt->buf.p, opt->buf.len))) {
+            return rc;
+        }
+        if ((c & _CLASS_U) &&
+            (rc = coap_add_option(&outer, opt->num, opt->buf.p, opt->buf.len))) {
+            return rc;
+        }
+    }
+    if (request) {
+        if ((rc = _take_piv(ctx, req->piv, &req->piv_len))) {
+            return rc;
+        }
+        memcpy(req->kid, ctx->sender_id, ctx->sender_id_len);
+        req->kid_len = ctx->sender_id_len;
+        value[0] = _FLAG_KID | (uint8_t)req->piv_len;
+        memcpy(value + 1, req->piv, req->piv_len);
+        memcpy(value + 1 + req->piv_len, req->kid, req->kid_len);
+        valuelen = 1 + req->piv_len + req->kid_len;
+        _nonce(ctx, ctx->sender_id, ctx->sender_id_len, req->piv, req->piv_len, nonce);
+    }
+    else if (own_piv) {
+        // bound to the request by the AAD only, the partial IV goes along
+        uint8_t piv[COAP_OSCORE_MAX_PIV];
+        size_t piv_len;
+        if ((rc = _take_piv(ctx, piv, &piv_len))) {
+            return rc;
+        }
+        value[0] = (uint8_t)piv_len;
+        memcpy(value + 1, piv, piv_len);
+        valuelen = 1 + piv_len;
+        _nonce(ctx, ctx->sender_id, ctx->sender_id_len, piv, piv_len, nonce);
+    }
+    else {
+        // the nonce of the request, no partial IV of its own
+        _nonce(ctx, req->kid, req->kid_len, req->piv, req->piv_len, nonce);
+    }
+    if ((rc = coap_add_option(&outer, COAP_OPTION_OSCORE, value, valuelen)) ||
+        (rc = coap_build_payload_buffer(&outer, buf, *buflen, &region))) {
+        return rc;
+    }
+    // plaintext is code, options, payload: built as a datagram whose
+    // header ends with the code, encrypted from there into the payload region
+    uint8_t plain[COAP_OSCORE_MAX_PDU];
+    const size_t ptlen = _encoded_len(&inner) - (sizeof(coap_raw_header_t) - 1);
+    if ((ptlen + COAP_CCM_TAG_SIZE > region.len) ||
+        (ptlen + sizeof(coap_raw_header_t) - 1 > sizeof(plain))) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    size_t len = sizeof(plain);
+    if ((rc = coap_build(&inner, plain, &len))) {
+        return rc;
+    }
+    uint8_t *pt = plain + sizeof(coap_raw_header_t) - 1;
+    pt[0] = pkt->hdr.code;
+    if (own_piv) {
+        ctx->seq++;
+    }
+    rc = coap_aes_ccm_encrypt(&ctx->sender_key, nonce, aad, _aad(req, aad),
+                              pt, ptlen, region.p);
+    if (rc) {
+        return rc;
+    }
+    outer.payload.p = region.p;
+    outer.payload.len = ptlen + COAP_CCM_TAG_SIZE;
+    return coap_build(&outer, buf, buflen);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_oscore_init(coap_oscore_t *ctx, const coap_oscore_params_t *params)
+{
+    static const coap_buffer_t empty = {NULL, 0};
+    uint8_t key[COAP_AES_KEY_SIZE];
+    int rc;
+    // without persisted sequence number, a restart would reuse nonces
+    if ((params->sender_id.len > COAP_OSCORE_MAX_ID) ||
+        (params->recipient_id.len > COAP_OSCORE_MAX_ID) || !params->store) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->seq = ctx->seq_stored = params->seq;
+    ctx->store = params->store;
+    ctx->store_ctx = params->store_ctx;
+    if ((rc = _derive(params, &params->sender_id, "Key", key, sizeof(key)))) {
+        return rc;
+    }
+    coap_aes_init(&ctx->sender_key, key);
+    if ((rc = _derive(params, &params->recipient_id, "Key", key, sizeof(key)))) {
+        return rc;
+    }
+    coap_aes_init(&ctx->recipient_key, key);
+    if ((rc = _derive(params, &empty, "IV", ctx->common_iv, sizeof(ctx->common_iv)))) {
+        return rc;
+    }
+    memset(key, 0, sizeof(key));
+    if (params->sender_id.len) {
+        memcpy(ctx->sender_id, params->sender_id.p, params->sender_id.len);
+    }
+    ctx->sender_id_len = params->sender_id.len;
+    if (params->recipient_id.len) {
+        memcpy(ctx->recipient_id, params->recipient_id.p, params->recipient_id.len);
+    }
+    ctx->recipient_id_len = params->recipient_id.len;
+    return COAP_SUCCESS;
+}
+
+int coap_oscore_protect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                        coap_oscore_request_t *req,
+                        uint8_t *buf, size_t *buflen)
+{
+    return _protect(ctx, pkt, req, !(pkt->hdr.code >> 5), buf, buflen);
+}
+
+int coap_oscore_protect_fresh(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                              coap_oscore_request_t *req,
+                              uint8_t *buf, size_t *buflen)
+{
+    return _protect(ctx, pkt, req, true, buf, buflen);
+}
+
+int coap_oscore_unprotect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                          coap_oscore_request_t *req,
+                          uint8_t *buf, size_t *buflen)
+{
+    const bool request = !(pkt->hdr.code >> 5);
+    const coap_option_t *opt = coap_find_option(pkt, COAP_OPTION_OSCORE);
+    uint8_t nonce[COAP_CCM_NONCE_SIZE], aad[_MAX_AAD];
+    coap_oscore_request_t value;
+    bool has_piv, has_kid;
+    uint64_t seq = 0;
+    int rc;
+    if (!opt) {
+        return COAP_ERR_OPTION_NOT_FOUND;
+    }
+    if ((rc = _parse_option(opt, &value, &has_piv, &has_kid))) {
+        return rc;
+    }
+    if (request) {
+        if (!has_piv || !has_kid) {
+            return COAP_ERR_MALFORMED;
+        }
+        if ((value.kid_len != ctx->recipient_id_len) ||
+            memcmp(value.kid, ctx->recipient_id, value.kid_len)) {
+            return COAP_ERR_NO_CONTEXT;
+        }
+        seq = _seq(value.piv, value.piv_len);
+        if (_replayed(ctx, seq)) {
+            return COAP_ERR_REPLAY;
+        }
+        *req = value;
+        _nonce(ctx, req->kid, req->kid_len, req->piv, req->piv_len, nonce);
+    }
+    else if (has_piv) {
+        _nonce(ctx, ctx->recipient_id, ctx->recipient_id_len, value.piv, value.piv_len, nonce);
+    }
+    else {
+        _nonce(ctx, req->kid, req->kid_len, req->piv, req->piv_len, nonce);
+    }
+    // code and more, plus the tag
+    if (pkt->payload.len <= COAP_CCM_TAG_SIZE) {
+        return COAP_ERR_DECRYPT;
+    }
+    const size_t ptlen = pkt->payload.len - COAP_CCM_TAG_SIZE;
+    const size_t tkl = pkt->hdr.tkl;
+    if (sizeof(coap_raw_header_t) - 1 + tkl + ptlen > *buflen) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    // decrypted code lands where the header ends, header and token go ahead
+    uint8_t *pt = buf + sizeof(coap_raw_header_t) - 1 + tkl;
+    rc = coap_aes_ccm_decrypt(&ctx->recipient_key, nonce, aad, _aad(req, aad),
+                              pkt->payload.p, pkt->payload.len, pt);
+    if (rc) {
+        return rc;
+    }
+    const uint8_t code = pt[0];
+    buf[0] = (uint8_t)((COAP_VERSION << 6) | (pkt->hdr.t << 4) | tkl);
+    buf[1] = code;
+    buf[2] = (uint8_t)(pkt->hdr.id >> 8);
+    buf[3] = (uint8_t)pkt->hdr.id;
+    if (tkl) {
+        memcpy(buf + sizeof(coap_raw_header_t), pkt->tok.p, tkl);
+    }
+    *buflen = sizeof(coap_raw_header_t) - 1 + tkl + ptlen;
+    if (request && !ctx->replay_valid) {
+        if (!_echoed(ctx, buf, *buflen)) {
+            return COAP_ERR_FRESHNESS;
+        }
+        // anything older might be a replay
+        ctx->replay_max = seq;
+        ctx->replay_seen = ~0ULL;
+        ctx->replay_valid = true;
+        ctx->echo_valid = false;
+    }
+    else if (request) {
+        _replay_update(ctx, seq);
+    }
+    return COAP_SUCCESS;
+}
+
+coap_oscore_t *coap_oscore_find(coap_oscore_t *ctxs, const size_t count,
+                                const coap_packet_t *pkt)
+{
+    const coap_option_t *opt = coap_find_option(pkt, COAP_OPTION_OSCORE);
+    coap_oscore_request_t value;
+    bool has_piv, has_kid;
+    if (!opt || _parse_option(opt, &value, &has_piv, &has_kid) || !has_kid) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if ((ctxs[i].recipient_id_len == value.kid_len) &&
+            !memcmp(ctxs[i].recipient_id, value.kid, value.kid_len)) {
+            return &ctxs[i];
+        }
+    }
+    return NULL;
+}
+
+int coap_oscore_handle_packet(coap_oscore_t *ctxs, const size_t count,
+                              coap_resource_t *resources,
+                              const uint8_t *inbuf, const size_t inlen,
+                              uint8_t *outbuf, size_t *outlen)
+{
+    uint8_t inner[COAP_OSCORE_MAX_PDU], response[COAP_OSCORE_MAX_PDU];
+    size_t len = sizeof(inner), rsplen = sizeof(response);
+    coap_oscore_request_t req;
+    coap_packet_t pkt, rsp;
+    int rc = coap_parse(inbuf, inlen, &pkt);
+    if (rc) {
+        return rc;
+    }
+    if (!coap_find_option(&pkt, COAP_OPTION_OSCORE)) {
+        if (_requires_oscore(resources, &pkt)) {
+            return _make_error(&pkt, COAP_ERR_OPTION_NOT_FOUND, outbuf, outlen);
+        }
+        return coap_handle_packet(resources, inbuf, inlen, outbuf, outlen);
+    }
+    coap_oscore_t *ctx = coap_oscore_find(ctxs, count, &pkt);
+    rc = ctx ? coap_oscore_unprotect(ctx, &pkt, &req, inner, &len) : COAP_ERR_NO_CONTEXT;
+    if (rc == COAP_ERR_FRESHNESS) {
+        return _make_challenge(ctx, &pkt, &req, outbuf, outlen);
+    }
+    if (rc) {
+        return _make_error(&pkt, rc, outbuf, outlen);
+    }
+    if ((rc = coap_handle_packet(resources, inner, len, response, &rsplen)) ||
+        (rc = coap_parse(response, rsplen, &rsp))) {
+        return rc;
+    }
+    if (rsp.hdr.code == COAP_RSPCODE_EMPTY) {
+        if (rsplen > *outlen) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        memcpy(outbuf, response, rsplen);
+        *outlen = rsplen;
+        return COAP_SUCCESS;
+    }
+    return coap_oscore_protect(ctx, &rsp, &req, outbuf, outlen);
+}
@@ -0,0 +1,255 @@
+#ifndef COAP_OSCORE_H
+#define COAP_OSCORE_H 1
+
+/**
+ * @file coap_oscore.h
+ *
+ * Object Security for Constrained RESTful Environments (OSCORE), see
+ * https://tools.ietf.org/html/rfc8613
+ *
+ * Protects code, options and payload of a message end to end, so that
+ * proxies forward it without being able to read or alter it. A protected
+ * message carries the OSCORE option and, as payload, the inner code, options
+ * and payload encrypted with AES-CCM-16-64-128. Options a proxy needs, like
+ * Uri-Host and Proxy-Scheme, stay outside; Proxy-Uri has to be split into
+ * these by the client. The outer code is POST for requests and 2.04 for
+ * responses.
+ *
+ * A security context holds the keys derived from a master secret shared by
+ * two endpoints, the sequence number of the next request and the replay
+ * window of requests received. Contexts are not thread safe.
+ *
+ * Contexts survive restarts as RFC 8613 appendix B.1 describes. The
+ * sequence number is persisted COAP_OSCORE_SSN_WINDOW numbers ahead of the
+ * one in use, and continues from the stored value after a restart, so no
+ * nonce is used twice. The replay window is not persisted: until the peer
+ * has answered an Echo challenge, its requests are refused with a protected
+ * 4.01 carrying an Echo option, see https://tools.ietf.org/html/rfc9175.
+ * The peer repeats the request with the Echo value, and the window starts
+ * at the sequence number of that request. The challenge may answer a
+ * replayed request, so it takes a partial IV of its own instead of the
+ * nonce of the request, and all challenges carry the same Echo value until
+ * it is answered or COAP_OSCORE_ECHO_MS passed.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "coap.h"
+#include "coap_crypto.h"
+#include "coap_time.h"
+
+#define COAP_OSCORE_MAX_ID      7       //!< nonce size - 6
+#define COAP_OSCORE_MAX_PIV     5       //!< bytes of a partial IV
+#define COAP_OSCORE_MAX_SEQ     ((1ULL << 40) - 1)  //!< last sequence number
+#ifndef COAP_OSCORE_REPLAY_WINDOW
+#define COAP_OSCORE_REPLAY_WINDOW   32  //!< requests accepted out of order, up to 64
+#endif
+#ifndef COAP_OSCORE_MAX_PDU
+#define COAP_OSCORE_MAX_PDU     1152    //!< max. size of an unprotected message
+#endif
+#ifndef COAP_OSCORE_SSN_WINDOW
+#define COAP_OSCORE_SSN_WINDOW  1024    //!< sequence numbers used between stores
+#endif
+#define COAP_OSCORE_ECHO_SIZE   8       //!< bytes of an Echo value
+#ifndef COAP_OSCORE_ECHO_MS
+#define COAP_OSCORE_ECHO_MS     30000   //!< an Echo value is accepted for
+#endif
+
+/**
+ * @brief callback function persisting the sender sequence number
+ *
+ * Called before a request takes a sequence number not covered by the value
+ * stored last. After a restart, the value stored last is passed as
+ * coap_oscore_params_t::seq.
+ *
+ * @param[in] ctx Context given in coap_oscore_params_t
+ * @param[in] seq Sequence numbers from \p seq on are unused
+ *
+ * @return 0 once \p seq is stored, some error code otherwise
+ */
+typedef int (*coap_oscore_store_fn)(void *ctx, const uint64_t seq);
+
+/**
+ * Input of the key derivation, see
+ * https://tools.ietf.org/html/rfc8613#section-3.2
+ */
+typedef struct coap_oscore_params
+{
+    coap_buffer_t secret;               //!< Master Secret
+    coap_buffer_t salt;                 //!< Master Salt, may be empty
+    coap_buffer_t sender_id;            //!< own ID, up to COAP_OSCORE_MAX_ID bytes
+    coap_buffer_t recipient_id;         //!< ID of the peer
+    coap_buffer_t id_context;           //!< ID Context, may be empty
+    uint64_t seq;                       //!< value stored last, 0 for a new secret
+    coap_oscore_store_fn store;         //!< persists the sequence number
+    void *store_ctx;                    //!< context of store
+} coap_oscore_params_t;
+
+/**
+ * Security context of one peer
+ */
+typedef struct coap_oscore
+{
+    coap_aes_t sender_key;              //!< protects own messages
+    coap_aes_t recipient_key;           //!< verifies messages of the peer
+    uint8_t common_iv[COAP_CCM_NONCE_SIZE];
+    uint8_t sender_id[COAP_OSCORE_MAX_ID];
+    size_t sender_id_len;
+    uint8_t recipient_id[COAP_OSCORE_MAX_ID];
+    size_t recipient_id_len;
+    uint64_t seq;                       //!< sequence number of the next request
+    uint64_t seq_stored;                //!< sequence number persisted last
+    coap_oscore_store_fn store;         //!< persists seq_stored
+    void *store_ctx;                    //!< context of store
+    uint64_t replay_max;                //!< highest sequence number received
+    uint64_t replay_seen;               //!< bit n: replay_max - n received
+    bool replay_valid;                  //!< replay window established
+    uint8_t echo[COAP_OSCORE_ECHO_SIZE];    //!< Echo value of the outstanding challenge
+    bool echo_valid;                    //!< a challenge is outstanding
+    coap_tick_t echo_expires;           //!< echo is replaced by the next challenge afterwards
+} coap_oscore_t;
+
+/**
+ * The request a response is bound to
+ *
+ * Filled when protecting a request at the client, or unprotecting it at
+ * the server, and passed along for its response.
+ */
+typedef struct coap_oscore_request
+{
+    uint8_t kid[COAP_OSCORE_MAX_ID];    //!< sender ID of the requester
+    size_t kid_len;
+    uint8_t piv[COAP_OSCORE_MAX_PIV];   //!< sequence number of the request
+    size_t piv_len;
+} coap_oscore_request_t;
+
+/**
+ * @brief Derive a security context
+ *
+ * The replay window is established by the first request answering an Echo
+ * challenge, see coap_oscore_handle_packet().
+ *
+ * @param[out] ctx The context
+ * @param[in] params Master secret, salt, IDs and the persisted sequence number
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED if an ID is too long or the
+ * sequence number is not persisted
+ */
+int coap_oscore_init(coap_oscore_t *ctx, const coap_oscore_params_t *params);
+
+/**
+ * @brief Protect a message and write it to transmission buffer
+ *
+ * Like coap_build(), but writes the protected message. A request takes the
+ * next sequence number of \p ctx and is recorded in \p req, a response is
+ * protected for the request in \p req.
+ *
+ * @param[in,out] ctx The security context
+ * @param[in] pkt The unprotected message, must not point into \p buf
+ * @param[in,out] req The request, filled for requests
+ * @param[out] buf Buffer receiving the protected message
+ * @param[in,out] buflen Contains the size of \p buf, then stores how many
+ * bytes have been written to \p buf.
+ *
+ * @return 0 on success, COAP_ERR_BUFFER_TOO_SMALL, COAP_ERR_UNSUPPORTED for
+ * empty messages or Proxy-Uri, COAP_ERR_NO_CONTEXT if the sequence
+ * numbers are used up and a new context is needed, or the error of the
+ * store callback
+ */
+int coap_oscore_protect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                        coap_oscore_request_t *req,
+                        uint8_t *buf, size_t *buflen);
+
+/**
+ * @brief Protect a response with a partial IV of its own
+ *
+ * Like coap_oscore_protect(), but a response takes the next sequence number
+ * of \p ctx as partial IV, persisted as for requests, and carries it in the
+ * OSCORE option. Needed for responses to requests that were not checked
+ * against a replay window, whose nonce may have been used before, see
+ * https://tools.ietf.org/html/rfc8613#appendix-B.1.2.
+ *
+ * @return as coap_oscore_protect()
+ */
+int coap_oscore_protect_fresh(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                              coap_oscore_request_t *req,
+                              uint8_t *buf, size_t *buflen);
+
+/**
+ * @brief Verify a protected message and write the unprotected one
+ *
+ * The unprotected message has header and token of \p pkt, code, options and
+ * payload are decrypted; pass it to coap_parse() or coap_handle_packet().
+ * Outer options like Uri-Host are left in \p pkt. A request is checked
+ * against the replay window of \p ctx and recorded in \p req, a response
+ * is verified for the request in \p req. Without replay window, only a
+ * request carrying the Echo value of the last challenge is accepted, and
+ * establishes the window.
+ *
+ * @param[in,out] ctx The security context
+ * @param[in] pkt The protected message
+ * @param[in,out] req The request, filled for requests
+ * @param[out] buf Buffer receiving the unprotected message
+ * @param[in,out] buflen Contains the size of \p buf, then stores how many
+ * bytes have been written to \p buf.
+ *
+ * @return 0 on success, COAP_ERR_OPTION_NOT_FOUND if \p pkt is not
+ * protected, COAP_ERR_MALFORMED for an invalid OSCORE option,
+ * COAP_ERR_NO_CONTEXT if the request is from another sender,
+ * COAP_ERR_REPLAY if it has been received before, COAP_ERR_FRESHNESS if it
+ * is authentic but the replay window is not established yet, \p req is
+ * filled then, COAP_ERR_DECRYPT if the message is not authentic, or
+ * COAP_ERR_BUFFER_TOO_SMALL
+ */
+int coap_oscore_unprotect(coap_oscore_t *ctx, const coap_packet_t *pkt,
+                          coap_oscore_request_t *req,
+                          uint8_t *buf, size_t *buflen);
+
+/**
+ * @brief Find the security context of a protected request by its kid
+ *
+ * @param[in] ctxs Array of contexts, one per peer
+ * @param[in] count Number of contexts
+ * @param[in] pkt The protected request
+ *
+ * @return the context whose recipient ID is the kid, or NULL
+ */
+coap_oscore_t *coap_oscore_find(coap_oscore_t *ctxs, const size_t count,
+                                const coap_packet_t *pkt);
+
+/**
+ * @brief Handle a request datagram, protected or not
+ *
+ * Like coap_handle_packet(). A protected request is unprotected with the
+ * context of its sender, handled and its response protected; empty ACKs
+ * stay unprotected. Requests that fail verification are answered with
+ * unprotected 4.01 or 4.00, see https://tools.ietf.org/html/rfc8613#section-8.2.
+ * Authentic requests of a peer without replay window are answered with a
+ * 4.01 carrying the outstanding Echo value, protected with a partial IV of
+ * its own, see
+ * https://tools.ietf.org/html/rfc8613#appendix-B.1.2.
+ * Requests without OSCORE option are handled as by coap_handle_packet(),
+ * unless their path is served by a resource flagged COAP_RESOURCE_OSCORE:
+ * these are answered with unprotected 4.01.
+ *
+ * @param[in] ctxs Array of contexts, one per client
+ * @param[in] count Number of contexts
+ *
+ * @return as coap_handle_packet()
+ */
+int coap_oscore_handle_packet(coap_oscore_t *ctxs, const size_t count,
+                              coap_resource_t *resources,
+                              const uint8_t *inbuf, const size_t inlen,
+                              uint8_t *outbuf, size_t *outlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_OSCORE_H
@@ -4,6 +4,7 @@
 
 #include "inet.h"
 #include "coap.h"
+#include "coap_trace.h"
 
 /* --- PRIVATE -------------------------------------------------------------- */
 static int _parse_token(const uint8_t *buf, const size_t buflen,
@@ -12,8 +13,10 @@ static int _parse_header(const uint8_t *buf, const size_t buflen,
                          coap_header_t *hdr);
 static int _parse_options_payload(const uint8_t *buf, const size_t buflen,
                                   coap_packet_t *pkt);
-static int _parse_option(const uint8_t **buf, const size_t buflen,
-                         coap_option_t *option, uint16_t *running_delta);
+static inline int _parse_option(const uint8_t **buf, const size_t buflen,
+                                coap_option_t *option, uint16_t *running_delta);
+static int _parse_compact(const uint8_t *buf, const size_t buflen,
+                          coap_packet_compact_t *pkt);
 
 static int _parse_header(const uint8_t *buf, const size_t buflen,
                          coap_header_t *hdr)
@@ -53,8 +56,8 @@ static int _parse_token(const uint8_t *buf, const size_t buflen,
     return COAP_SUCCESS;
 }
 
-static int _parse_option(const uint8_t **buf, const size_t buflen,
-                         coap_option_t *option, uint16_t *running_delta)
+static inline int _parse_option(const uint8_t **buf, const size_t buflen,
+                                coap_option_t *option, uint16_t *running_delta)
 {
     const uint8_t *p = *buf;
     uint8_t headlen = 1;
@@ -154,23 +157,63 @@ static int _parse_options_payload(const uint8_t *buf, const size_t buflen,
     return COAP_SUCCESS;
 }
 
+/* token, options and payload as offsets, see _parse_options_payload() */
+static int _parse_compact(const uint8_t *buf, const size_t buflen,
+                          coap_packet_compact_t *pkt)
+{
+    coap_option_t opt;
+    size_t optionIndex = 0;
+    uint16_t delta = 0;
+    const uint8_t *p = buf + sizeof(coap_raw_header_t) + pkt->hdr.tkl;
+    const uint8_t *end = buf + buflen;
+    int rc;
+    if (p > end || pkt->hdr.tkl > 8) {
+        return COAP_ERR_TOKEN_TOO_SHORT;
+    }
+    while ((optionIndex < COAP_MAX_OPTIONS) && (p < end) && (*p != 0xFF)) {
+        rc = _parse_option(&p, end - p, &opt, &delta);
+        if(rc) {
+            return rc;
+        }
+        pkt->optnum[optionIndex] = opt.num;
+        pkt->optoff[optionIndex] = (uint16_t)(opt.buf.p - buf);
+        pkt->optlen[optionIndex] = (uint16_t)opt.buf.len;
+        optionIndex++;
+    }
+    pkt->numopts = optionIndex;
+    pkt->payload = ((p + 1) < end && *p == 0xFF) ? (uint16_t)(p + 1 - buf) : 0;
+    return COAP_SUCCESS;
+}
+
 /* --- PUBLIC --------------------------------------------------------------- */
 int coap_parse(const uint8_t *buf, const size_t buflen, coap_packet_t *pkt)
 {
     int rc;
+    COAP_TRACE2(parse_entry, buf, buflen);
     /* parse header, token, options, and payload */
     rc = _parse_header(buf, buflen, &pkt->hdr);
-    if(rc) {
-        return rc;
+    if(!rc) {
+        rc = _parse_token(buf, buflen, pkt);
     }
-    rc = _parse_token(buf, buflen, pkt);
-    if(rc) {
-        return rc;
+    if(!rc) {
+        pkt->numopts = COAP_MAX_OPTIONS;
+        rc = _parse_options_payload(buf, buflen, pkt);
     }
-    pkt->numopts = COAP_MAX_OPTIONS;
-    rc = _parse_options_payload(buf, buflen, pkt);
-    if(rc) {
-        return rc;
-    }
-    return COAP_SUCCESS;
+    COAP_TRACE2(parse_return, buf, rc);
+    return rc;
+}
+
+int coap_parse_compact(const uint8_t *buf, const size_t buflen,
+                       coap_packet_compact_t *pkt)
+{
+    int rc;
+    COAP_TRACE2(parse_entry, buf, buflen);
+    rc = (buflen > UINT16_MAX) ? COAP_ERR_UNSUPPORTED : _parse_header(buf, buflen, &pkt->hdr);
+    if(!rc) {
+        pkt->base = buf;
+        pkt->len = (uint16_t)buflen;
+        rc = _parse_compact(buf, buflen, pkt);
+    }
+    COAP_TRACE2(parse_return, buf, rc);
+    return rc;
 }
@@ -0,0 +1,449 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "coap_pcap.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _MAGIC              0xA1B2C3D4U
+#define _MAGIC_NSEC         0xA1B23C4DU
+#define _LINKTYPE_NULL      0
+#define _LINKTYPE_ETHERNET  1
+#define _LINKTYPE_RAW       101
+#define _LINKTYPE_LOOP      108
+#define _LINKTYPE_SLL       113
+#define _LINKTYPE_IPV4      228
+#define _LINKTYPE_IPV6      229
+#define _LINKTYPE_SLL2      276
+#define _IPV4_HDR           20
+#define _IPV6_HDR           40
+#define _UDP_HDR            8
+#define _FLUSH_MS           100     //!< max. delay of the writer
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} _file_header_t;
+
+typedef struct
+{
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} _record_header_t;
+
+struct coap_pcap_state
+{
+    FILE *file;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stop;
+    uint64_t head;                      //!< bytes appended, producers
+    uint64_t tail;                      //!< bytes written, writer
+    size_t size;
+    uint8_t ring[];
+};
+
+static void _ring_copy(coap_pcap_state_t *s, uint64_t pos,
+                       const void *data, size_t len);
+static void *_writer(void *arg);
+static size_t _ip_header(uint8_t *p, const bool outbound,
+                         const struct sockaddr *local, const struct sockaddr *peer,
+                         const uint8_t *payload, const size_t buflen);
+static uint32_t _sum(uint32_t sum, const uint8_t *p, size_t len);
+static uint16_t _get16(const uint8_t *p);
+static uint32_t _swap32(const uint32_t v, const bool swap);
+static int _parse_ip(const uint8_t *p, size_t len, coap_pcap_record_t *rec);
+
+static void _ring_copy(coap_pcap_state_t *s, uint64_t pos,
+                       const void *data, size_t len)
+{
+    const size_t off = pos % s->size;
+    const size_t first = (len < s->size - off) ? len : s->size - off;
+    memcpy(s->ring + off, data, first);
+    memcpy(s->ring, (const uint8_t *)data + first, len - first);
+}
+
+/* write out what producers appended, at least every _FLUSH_MS */
+static void *_writer(void *arg)
+{
+    coap_pcap_state_t *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        if ((s->head == s->tail) && !s->stop) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += _FLUSH_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&s->wake, &s->lock, &ts);
+        }
+        const uint64_t head = s->head;
+        const uint64_t tail = s->tail;
+        const bool stop = s->stop;
+        pthread_mutex_unlock(&s->lock);
+        // producers do not touch [tail, head) until released below
+        if (head != tail) {
+            const size_t off = tail % s->size;
+            const size_t len = head - tail;
+            const size_t first = (len < s->size - off) ? len : s->size - off;
+            fwrite(s->ring + off, 1, first, s->file);
+            fwrite(s->ring, 1, len - first, s->file);
+            fflush(s->file);
+        }
+        pthread_mutex_lock(&s->lock);
+        s->tail = head;
+        if (stop && (s->head == s->tail)) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static size_t _ip_header(uint8_t *p, const bool outbound,
+                         const struct sockaddr *local, const struct sockaddr *peer,
+                         const uint8_t *payload, const size_t buflen)
+{
+    const struct sockaddr *src = outbound ? local : peer;
+    const struct sockaddr *dst = outbound ? peer : local;
+    const size_t udplen = _UDP_HDR + buflen;
+    uint8_t *udp;
+    uint32_t sum;
+    if (src->sa_family == AF_INET) {
+        const struct sockaddr_in *s4 = (const struct sockaddr_in *)src;
+        const struct sockaddr_in *d4 = (const struct sockaddr_in *)dst;
+        const size_t total = _IPV4_HDR + udplen;
+        memset(p, 0, _IPV4_HDR + _UDP_HDR);
+        p[0] = 0x45;
+        p[2] = (uint8_t)(total >> 8);
+        p[3] = (uint8_t)total;
+        p[6] = 0x40;                    // don't fragment
+        p[8] = 64;
+        p[9] = IPPROTO_UDP;
+        memcpy(p + 12, &s4->sin_addr, 4);
+        memcpy(p + 16, &d4->sin_addr, 4);
+        const uint16_t csum = ~_sum(0, p, _IPV4_HDR);
+        p[10] = (uint8_t)(csum >> 8);
+        p[11] = (uint8_t)csum;
+        udp = p + _IPV4_HDR;
+        memcpy(udp, &s4->sin_port, 2);
+        memcpy(udp + 2, &d4->sin_port, 2);
+        udp[4] = (uint8_t)(udplen >> 8);
+        udp[5] = (uint8_t)udplen;
+        // checksum is optional with IPv4
+        return _IPV4_HDR + _UDP_HDR;
+    }
+    const struct sockaddr_in6 *s6 = (const struct sockaddr_in6 *)src;
+    const struct sockaddr_in6 *d6 = (const struct sockaddr_in6 *)dst;
+    memset(p, 0, _IPV6_HDR + _UDP_HDR);
+    p[0] = 0x60;
+    p[4] = (uint8_t)(udplen >> 8);
+    p[5] = (uint8_t)udplen;
+    p[6] = IPPROTO_UDP;
+    p[7] = 64;
+    memcpy(p + 8, &s6->sin6_addr, 16);
+    memcpy(p + 24, &d6->sin6_addr, 16);
+    udp = p + _IPV6_HDR;
+    memcpy(udp, &s6->sin6_port, 2);
+    memcpy(udp + 2, &d6->sin6_port, 2);
+    udp[4] = (uint8_t)(udplen >> 8);
+    udp[5] = (uint8_t)udplen;
+    // checksum is mandatory with IPv6, over pseudo header, header and payload
+    sum = _sum(udplen + IPPROTO_UDP, p + 8, 32);
+    sum = _sum(sum, udp, _UDP_HDR);
+    uint16_t csum = ~_sum(sum, payload, buflen);
+    if (!csum) {
+        csum = 0xFFFF;
+    }
+    udp[6] = (uint8_t)(csum >> 8);
+    udp[7] = (uint8_t)csum;
+    return _IPV6_HDR + _UDP_HDR;
+}
+
+/* one's complement sum of 16 bit words, folded */
+static uint32_t _sum(uint32_t sum, const uint8_t *p, size_t len)
+{
+    for (; len > 1; len -= 2, p += 2) {
+        sum += _get16(p);
+    }
+    if (len) {
+        sum += (uint32_t)p[0] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+static uint16_t _get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t _swap32(const uint32_t v, const bool swap)
+{
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+/* UDP in IPv4 or IPv6, 1 if it is something else */
+static int _parse_ip(const uint8_t *p, size_t len, coap_pcap_record_t *rec)
+{
+    struct sockaddr_in *s4 = (struct sockaddr_in *)rec->src.addr;
+    struct sockaddr_in *d4 = (struct sockaddr_in *)rec->dst.addr;
+    struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)rec->src.addr;
+    struct sockaddr_in6 *d6 = (struct sockaddr_in6 *)rec->dst.addr;
+    const uint8_t *udp;
+    if ((len >= _IPV4_HDR) && ((p[0] >> 4) == 4)) {
+        const size_t ihl = (p[0] & 0x0F) * 4;
+        // fragments are not reassembled
+        if ((p[9] != IPPROTO_UDP) || (ihl < _IPV4_HDR) ||
+            (len < ihl + _UDP_HDR) || (_get16(p + 6) & 0x3FFF)) {
+            return 1;
+        }
+        memset(rec->src.addr, 0, sizeof(rec->src.addr));
+        memset(rec->dst.addr, 0, sizeof(rec->dst.addr));
+        s4->sin_family = d4->sin_family = AF_INET;
+        memcpy(&s4->sin_addr, p + 12, 4);
+        memcpy(&d4->sin_addr, p + 16, 4);
+        rec->src.len = rec->dst.len = sizeof(struct sockaddr_in);
+        udp = p + ihl;
+        len -= ihl;
+        memcpy(&s4->sin_port, udp, 2);
+        memcpy(&d4->sin_port, udp + 2, 2);
+    }
+    else if ((len >= _IPV6_HDR) && ((p[0] >> 4) == 6)) {
+        if ((p[6] != IPPROTO_UDP) || (len < _IPV6_HDR + _UDP_HDR)) {
+            return 1;
+        }
+        memset(rec->src.addr, 0, sizeof(rec->src.addr));
+        memset(rec->dst.addr, 0, sizeof(rec->dst.addr));
+        s6->sin6_family = d6->sin6_family = AF_INET6;
+        memcpy(&s6->sin6_addr, p + 8, 16);
+        memcpy(&d6->sin6_addr, p + 24, 16);
+        rec->src.len = rec->dst.len = sizeof(struct sockaddr_in6);
+        udp = p + _IPV6_HDR;
+        len -= _IPV6_HDR;
+        memcpy(&s6->sin6_port, udp, 2);
+        memcpy(&d6->sin6_port, udp + 2, 2);
+    }
+    else {
+        return 1;
+    }
+    const size_t udplen = _get16(udp + 4);
+    if ((udplen < _UDP_HDR) || (udplen > len)) {
+        return 1;
+    }
+    rec->payload = udp + _UDP_HDR;
+    rec->len = udplen - _UDP_HDR;
+    return 0;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_pcap_open(coap_pcap_t *cap, const char *path, const size_t ring_size)
+{
+    const size_t size = ring_size ? ring_size : COAP_PCAP_RING_SIZE;
+    const _file_header_t hdr = {_MAGIC, 2, 4, 0, 0, COAP_PCAP_SNAPLEN, _LINKTYPE_RAW};
+    memset(cap, 0, sizeof(*cap));
+    coap_pcap_state_t *s = malloc(sizeof(*s) + size);
+    if (!s) {
+        return COAP_ERR_IO;
+    }
+    memset(s, 0, sizeof(*s));
+    s->size = size;
+    s->file = fopen(path, "wb");
+    if (!s->file) {
+        free(s);
+        return COAP_ERR_IO;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, s->file) != 1) {
+        goto fail;
+    }
+    fflush(s->file);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    if (pthread_create(&s->writer, NULL, _writer, s)) {
+        pthread_cond_destroy(&s->wake);
+        pthread_mutex_destroy(&s->lock);
+        goto fail;
+    }
+    cap->state = s;
+    return COAP_SUCCESS;
+fail:
+    fclose(s->file);
+    free(s);
+    return COAP_ERR_IO;
+}
+
+int coap_pcap_capture(coap_pcap_t *cap, const bool outbound,
+                      const coap_endpoint_t *local, const coap_endpoint_t *peer,
+                      const uint8_t *buf, const size_t buflen)
+{
+    coap_pcap_state_t *s = cap->state;
+    const struct sockaddr *l = (const struct sockaddr *)local->addr;
+    const struct sockaddr *p = (const struct sockaddr *)peer->addr;
+    uint8_t hdr[sizeof(_record_header_t) + _IPV6_HDR + _UDP_HDR];
+    struct timespec ts;
+    if ((l->sa_family != p->sa_family) ||
+        ((p->sa_family != AF_INET) && (p->sa_family != AF_INET6))) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    size_t hdrlen = _ip_header(hdr + sizeof(_record_header_t), outbound, l, p,
+                               buf, buflen);
+    const size_t len = (hdrlen + buflen < COAP_PCAP_SNAPLEN) ? buflen
+                                                               : COAP_PCAP_SNAPLEN - hdrlen;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const _record_header_t rh = {(uint32_t)ts.tv_sec, (uint32_t)(ts.tv_nsec / 1000),
+                                 (uint32_t)(hdrlen + len), (uint32_t)(hdrlen + buflen)};
+    memcpy(hdr, &rh, sizeof(rh));
+    hdrlen += sizeof(rh);
+    pthread_mutex_lock(&s->lock);
+    if (s->size - (s->head - s->tail) < hdrlen + len) {
+        cap->dropped++;
+        pthread_mutex_unlock(&s->lock);
+        return COAP_ERR_BUSY;
+    }
+    _ring_copy(s, s->head, hdr, hdrlen);
+    _ring_copy(s, s->head + hdrlen, buf, len);
+    s->head += hdrlen + len;
+    cap->records++;
+    // wake the writer early once half full, it flushes periodically anyway
+    if (s->head - s->tail > s->size / 2) {
+        pthread_cond_signal(&s->wake);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return COAP_SUCCESS;
+}
+
+void coap_pcap_close(coap_pcap_t *cap)
+{
+    coap_pcap_state_t *s = cap->state;
+    if (!s) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->writer, NULL);
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    fclose(s->file);
+    free(s);
+    cap->state = NULL;
+}
+
+int coap_pcap_reader_open(coap_pcap_reader_t *r, const char *path)
+{
+    _file_header_t hdr;
+    memset(r, 0, sizeof(*r));
+    r->file = fopen(path, "rb");
+    if (!r->file) {
+        return COAP_ERR_IO;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, r->file) != 1) {
+        coap_pcap_reader_close(r);
+        return COAP_ERR_MALFORMED;
+    }
+    const uint32_t magic = hdr.magic;
+    if ((magic == _MAGIC) || (magic == _MAGIC_NSEC)) {
+        r->swapped = false;
+    }
+    else if ((magic == __builtin_bswap32(_MAGIC)) ||
+             (magic == __builtin_bswap32(_MAGIC_NSEC))) {
+        r->swapped = true;
+    }
+    else {
+        coap_pcap_reader_close(r);
+        return COAP_ERR_MALFORMED;
+    }
+    r->nsec = (_swap32(magic, r->swapped) == _MAGIC_NSEC);
+    r->linktype = _swap32(hdr.network, r->swapped) & 0x0FFFFFFF;
+    switch (r->linktype) {
+    case _LINKTYPE_NULL:
+    case _LINKTYPE_ETHERNET:
+    case _LINKTYPE_RAW:
+    case _LINKTYPE_LOOP:
+    case _LINKTYPE_SLL:
+    case _LINKTYPE_IPV4:
+    case _LINKTYPE_IPV6:
+    case _LINKTYPE_SLL2:
+        return COAP_SUCCESS;
+    default:
+        coap_pcap_reader_close(r);
+        return COAP_ERR_UNSUPPORTED;
+    }
+}
+
+int coap_pcap_read(coap_pcap_reader_t *r, coap_pcap_record_t *rec)
+{
+    _record_header_t hdr;
+    for (;;) {
+        if (fread(&hdr, sizeof(hdr), 1, r->file) != 1) {
+            return COAP_ERR_INCOMPLETE;
+        }
+        const uint32_t len = _swap32(hdr.incl_len, r->swapped);
+        if (len > sizeof(r->buf)) {
+            return COAP_ERR_MALFORMED;
+        }
+        if (fread(r->buf, 1, len, r->file) != len) {
+            return COAP_ERR_INCOMPLETE;
+        }
+        const uint32_t frac = _swap32(hdr.ts_frac, r->swapped);
+        rec->ts_us = (uint64_t)_swap32(hdr.ts_sec, r->swapped) * 1000000 +
+                     (r->nsec ? frac / 1000 : frac);
+        // strip the link layer
+        const uint8_t *p = r->buf;
+        size_t n = len;
+        size_t skip = 0;
+        switch (r->linktype) {
+        case _LINKTYPE_NULL:
+        case _LINKTYPE_LOOP:
+            skip = 4;
+            break;
+        case _LINKTYPE_ETHERNET:
+            skip = 14;
+            // 802.1Q VLAN tags
+            while ((n >= skip + 4) && (_get16(p + skip - 2) == 0x8100)) {
+                skip += 4;
+            }
+            break;
+        case _LINKTYPE_SLL:
+            skip = 16;
+            break;
+        case _LINKTYPE_SLL2:
+            skip = 20;
+            break;
+        default:
+            break;
+        }
+        if ((n < skip) || _parse_ip(p + skip, n - skip, rec)) {
+            continue;
+        }
+        return COAP_SUCCESS;
+    }
+}
+
+void coap_pcap_reader_close(coap_pcap_reader_t *r)
+{
+    if (r->file) {
+        fclose(r->file);
+        r->file = NULL;
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef COAP_PCAP_H
+#define COAP_PCAP_H 1
+
+/**
+ * @file coap_pcap.h
+ *
+ * Capture of datagrams to pcap files, and reading them back.
+ *
+ * Captured datagrams are appended to a ring buffer in memory, a background
+ * thread writes it out, so that capturing can stay on under load; if the
+ * ring is full, datagrams are dropped from the capture and counted. Records
+ * carry synthesized IPv4 or IPv6 and UDP headers (LINKTYPE_RAW), so that
+ * Wireshark decodes them as CoAP.
+ *
+ * The reader accepts captures of this module as well as those of tcpdump on
+ * Ethernet, loopback, and Linux cooked interfaces, and yields UDP datagrams
+ * only.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "coap.h"
+
+#ifndef COAP_PCAP_RING_SIZE
+#define COAP_PCAP_RING_SIZE     (4 * 1024 * 1024)  //!< default ring buffer size
+#endif
+#define COAP_PCAP_SNAPLEN       65535   //!< max. size of a record
+
+typedef struct coap_pcap_state coap_pcap_state_t;
+
+/**
+ * Capture
+ */
+typedef struct coap_pcap
+{
+    coap_pcap_state_t *state;           //!< ring and writer thread
+    uint64_t records;                   //!< datagrams captured
+    uint64_t dropped;                   //!< datagrams dropped, ring full
+} coap_pcap_t;
+
+/**
+ * Datagram read from a capture
+ */
+typedef struct coap_pcap_record
+{
+    uint64_t ts_us;                     //!< timestamp in microseconds
+    coap_endpoint_t src;                //!< source address and port
+    coap_endpoint_t dst;                //!< destination address and port
+    const uint8_t *payload;             //!< UDP payload, valid until next read
+    size_t len;                         //!< size of payload
+} coap_pcap_record_t;
+
+/**
+ * Capture reader
+ */
+typedef struct coap_pcap_reader
+{
+    FILE *file;
+    bool swapped;                       //!< written with other byte order
+    bool nsec;                          //!< timestamps in nanoseconds
+    uint32_t linktype;                  //!< LINKTYPE_* of the capture
+    uint8_t buf[COAP_PCAP_SNAPLEN + 64];
+} coap_pcap_reader_t;
+
+/**
+ * @brief Create a capture file and start its writer thread
+ *
+ * @param[out] cap The capture
+ * @param[in] path File to write, truncated if it exists
+ * @param[in] ring_size Size of the ring buffer in bytes, 0 for the default
+ *
+ * @return 0 on success, or COAP_ERR_IO with errno set
+ */
+int coap_pcap_open(coap_pcap_t *cap, const char *path, const size_t ring_size);
+
+/**
+ * @brief Capture a datagram
+ *
+ * Thread-safe, copies the datagram into the ring buffer.
+ *
+ * @param[in,out] cap The capture
+ * @param[in] outbound true if sent by \p local, false if received
+ * @param[in] local Local address
+ * @param[in] peer Remote address
+ * @param[in] buf The datagram
+ * @param[in] buflen Size of \p buf
+ *
+ * @return 0 on success, COAP_ERR_BUSY if the ring is full, or
+ * COAP_ERR_UNSUPPORTED if the address families differ or are unknown
+ */
+int coap_pcap_capture(coap_pcap_t *cap, const bool outbound,
+                      const coap_endpoint_t *local, const coap_endpoint_t *peer,
+                      const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief Write out the ring buffer, stop the writer thread, close the file
+ */
+void coap_pcap_close(coap_pcap_t *cap);
+
+/**
+ * @brief Open a capture file for reading
+ *
+ * @return 0 on success, COAP_ERR_IO if it cannot be read, COAP_ERR_MALFORMED
+ * if it is no pcap file, or COAP_ERR_UNSUPPORTED for an unknown link type
+ */
+int coap_pcap_reader_open(coap_pcap_reader_t *r, const char *path);
+
+/**
+ * @brief Read the next UDP datagram, skipping other packets
+ *
+ * @return 0 on success, COAP_ERR_INCOMPLETE at the end of the file, or
+ * COAP_ERR_MALFORMED if a record header is corrupt
+ */
+int coap_pcap_read(coap_pcap_reader_t *r, coap_pcap_record_t *rec);
+
+/**
+ * @brief Close a capture file opened for reading
+ */
+void coap_pcap_reader_close(coap_pcap_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_PCAP_H
@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inet.h"
+#include "coap_client.h"
+#include "coap_pool.h"
+#include "coap_random.h"
+#include "coap_time.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _MASK           (COAP_POOL_QUEUE - 1)
+#define _SPINS          64      //!< rounds looking for work before sleeping
+#define _CACHELINE      64
+
+struct coap_pool_job
+{
+    coap_pool_job_t *next;              //!< in the completion stack, then unacknowledged
+    coap_pool_job_t *older;             //!< in the jobs in flight of the owner
+    coap_pool_job_t *newer;
+    coap_pool_owner_t *owner;           //!< submitted by
+    coap_resource_t *resource;          //!< resource requested
+    coap_endpoint_t from;               //!< sender of the request
+    size_t inlen;                       //!< size of the request
+    size_t outlen;                      //!< size of the response
+    int rc;                             //!< 0 if out holds the response
+    uint16_t msgid;                     //!< of the response, once sent
+    uint8_t retransmits;                //!< of a confirmable response
+    coap_tick_t timeout;                //!< until the next retransmission
+    coap_tick_t deadline;               //!< of the next retransmission
+    uint8_t in[COAP_POOL_MAX_PDU];      //!< the request
+    uint8_t out[COAP_POOL_MAX_PDU];     //!< the response, message ID 0
+};
+
+/*
+ * bounded queue, the owner pushes at the bottom, workers take from the top
+ * with a CAS; as the owner never takes, no more is needed
+ */
+struct coap_pool_queue
+{
+    uint64_t top;                       //!< next job to take
+    uint8_t pad1[_CACHELINE - sizeof(uint64_t)];
+    uint64_t bottom;                    //!< next free slot, written by the owner
+    uint8_t pad2[_CACHELINE - sizeof(uint64_t)];
+    coap_pool_job_t *jobs[COAP_POOL_QUEUE];
+};
+
+typedef struct
+{
+    coap_pool_state_t *state;
+    unsigned home;                      //!< owner to take from first
+} _worker_t;
+
+struct coap_pool_state
+{
+    pthread_t threads[COAP_POOL_MAX_WORKERS];
+    _worker_t workers[COAP_POOL_MAX_WORKERS];
+    coap_pool_owner_t *owners[COAP_POOL_MAX_OWNERS];
+    unsigned nowners;                   //!< published with release
+    unsigned sleepers;                  //!< workers waiting for wake
+    bool stop;
+    pthread_mutex_t lock;               //!< protects sleeping and attaching
+    pthread_cond_t wake;
+};
+
+/* the owner submitting, and the sender for the separate response */
+typedef struct
+{
+    coap_pool_owner_t *owner;
+    const coap_endpoint_t *from;
+} _submit_t;
+
+static bool _push(coap_pool_queue_t *q, coap_pool_job_t *job);
+static coap_pool_job_t *_steal(coap_pool_queue_t *q);
+static coap_pool_job_t *_find(coap_pool_state_t *s, const unsigned home);
+static void _run(coap_pool_job_t *job);
+static void _complete(coap_pool_owner_t *owner, coap_pool_job_t *job);
+static bool _acknowledge(coap_pool_owner_t *owner, const coap_endpoint_t *from,
+                         const uint8_t *inbuf, const size_t inlen);
+static bool _is_request(const coap_pool_job_t *job, const coap_endpoint_t *from,
+                        const uint8_t *inbuf, const size_t inlen);
+static void *_worker(void *arg);
+static int _offload(void *ctx, coap_resource_t *resource,
+                    const uint8_t *inbuf, const size_t inlen);
+
+static bool _push(coap_pool_queue_t *q, coap_pool_job_t *job)
+{
+    const uint64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+    const uint64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - t >= COAP_POOL_QUEUE) {
+        return false;
+    }
+    __atomic_store_n(&q->jobs[b & _MASK], job, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* the slot is not reused before top moved past it, so a won CAS owns the job */
+static coap_pool_job_t *_steal(coap_pool_queue_t *q)
+{
+    uint64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    for (;;) {
+        const uint64_t b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+        if (t >= b) {
+            return NULL;
+        }
+        coap_pool_job_t *job = __atomic_load_n(&q->jobs[t & _MASK], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&q->top, &t, t + 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+            return job;
+        }
+    }
+}
+
+/* home queue first, then steal from the others */
+static coap_pool_job_t *_find(coap_pool_state_t *s, const unsigned home)
+{
+    const unsigned n = __atomic_load_n(&s->nowners, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < n; ++i) {
+        coap_pool_job_t *job = _steal(s->owners[(home + i) % n]->queue);
+        if (job) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void _run(coap_pool_job_t *job)
+{
+    coap_packet_t inpkt;
+    coap_packet_t pkt;
+    coap_resource_t *rs = job->resource;
+    memset(&pkt, 0, sizeof(pkt));
+    job->outlen = sizeof(job->out);
+    // parsed by the receive thread before, cannot fail
+    job->rc = coap_parse(job->in, job->inlen, &inpkt);
+    if (job->rc) {
+        return;
+    }
+    // state of the resource belongs to the receive thread, not written here
+    int rc = rs->handler(rs, &inpkt, &pkt);
+    // separate response, confirmable to confirmable requests as these were
+    // acknowledged already, https://tools.ietf.org/html/rfc7252#section-5.2.2;
+    // the owner stamps the message ID
+    const coap_msgtype_t t = (inpkt.hdr.t == COAP_TYPE_CON) ? COAP_TYPE_CON : COAP_TYPE_NONCON;
+    if (rc == COAP_STATE_RSP_SEND) {
+        pkt.hdr.t = t;
+        pkt.hdr.id = 0;
+        rc = coap_build(&pkt, job->out, &job->outlen);
+    }
+    // the client waits for an answer, the handler failing is one
+    if (rc) {
+        coap_make_response(0, &inpkt.tok, t, COAP_RSPCODE_INTERNAL_SERVER_ERROR,
+                           NULL, NULL, 0, &pkt);
+        job->outlen = sizeof(job->out);
+        job->rc = coap_build(&pkt, job->out, &job->outlen);
+    }
+}
+
+/* Treiber stack, the owner takes all at once */
+static void _complete(coap_pool_owner_t *owner, coap_pool_job_t *job)
+{
+    coap_pool_job_t *head = __atomic_load_n(&owner->done, __ATOMIC_RELAXED);
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->done, &head, job, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* empty ACK or RST of a separate response, whether or not one is known */
+static bool _acknowledge(coap_pool_owner_t *owner, const coap_endpoint_t *from,
+                         const uint8_t *inbuf, const size_t inlen)
+{
+    if ((inlen < 4) || (inbuf[1] != COAP_RSPCODE_EMPTY)) {
+        return false;
+    }
+    const uint8_t t = (inbuf[0] >> 4) & 0x03;
+    const uint16_t id = (uint16_t)((inbuf[2] << 8) | inbuf[3]);
+    if ((t != COAP_TYPE_ACK) && (t != COAP_TYPE_RESET)) {
+        return false;
+    }
+    for (coap_pool_job_t **p = &owner->unacked; *p; p = &(*p)->next) {
+        coap_pool_job_t *job = *p;
+        if ((job->msgid == id) && (job->from.len == from->len) &&
+            !memcmp(job->from.addr, from->addr, from->len)) {
+            *p = job->next;
+            free(job);
+            break;
+        }
+    }
+    return true;
+}
+
+/* same message ID and token from the same sender, a retransmission */
+static bool _is_request(const coap_pool_job_t *job, const coap_endpoint_t *from,
+                        const uint8_t *inbuf, const size_t inlen)
+{
+    const size_t tkl = inbuf[0] & 0x0f;
+    return (inlen >= 4 + tkl) && (job->inlen >= 4 + tkl) &&
+           ((job->in[0] & 0x0f) == tkl) && !memcmp(job->in + 2, inbuf + 2, 2 + tkl) &&
+           (job->from.len == from->len) && !memcmp(job->from.addr, from->addr, from->len);
+}
+
+static void *_worker(void *arg)
+{
+    _worker_t *w = arg;
+    coap_pool_state_t *s = w->state;
+    unsigned idle = 0;
+    // the render cache belongs to the receive thread
+    coap_content_cache(false);
+    while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+        coap_pool_job_t *job = _find(s, w->home);
+        if (!job && (++idle < _SPINS)) {
+            sched_yield();
+            continue;
+        }
+        if (!job) {
+            // announce sleeping before looking again, owners check sleepers
+            // after pushing, so either sees the other
+            pthread_mutex_lock(&s->lock);
+            __atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+            while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE) &&
+                   !(job = _find(s, w->home))) {
+                pthread_cond_wait(&s->wake, &s->lock);
+            }
+            __atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&s->lock);
+        }
+        idle = 0;
+        if (job) {
+            _run(job);
+            _complete(job->owner, job);
+        }
+    }
+    return NULL;
+}
+
+static int _offload(void *ctx, coap_resource_t *resource,
+                    const uint8_t *inbuf, const size_t inlen)
+{
+    const _submit_t *sub = ctx;
+    coap_pool_owner_t *owner = sub->owner;
+    coap_pool_state_t *s = owner->pool->state;
+    if (inlen > COAP_POOL_MAX_PDU) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    // coroutines are resumed by coap_async.h, not run to the end by workers
+    if (resource->flags & COAP_RESOURCE_ASYNC) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    // retransmitted request, handled once: acknowledged again by the caller,
+    // and the response repeated if it was sent already
+    for (coap_pool_job_t *job = owner->inflight; job; job = job->older) {
+        if (_is_request(job, sub->from, inbuf, inlen)) {
+            return COAP_SUCCESS;
+        }
+    }
+    for (coap_pool_job_t *job = owner->unacked; job; job = job->next) {
+        if (_is_request(job, sub->from, inbuf, inlen)) {
+            owner->send(owner->ctx, &job->from, job->out, job->outlen);
+            return COAP_SUCCESS;
+        }
+    }
+    coap_pool_job_t *job = malloc(sizeof(*job));
+    if (!job) {
+        owner->rejected++;
+        return COAP_ERR_BUSY;
+    }
+    job->owner = owner;
+    job->resource = resource;
+    job->from = *sub->from;
+    job->inlen = inlen;
+    memcpy(job->in, inbuf, inlen);
+    if (!_push(owner->queue, job)) {
+        free(job);
+        owner->rejected++;
+        return COAP_ERR_BUSY;
+    }
+    job->newer = NULL;
+    job->older = owner->inflight;
+    if (job->older) {
+        job->older->newer = job;
+    }
+    owner->inflight = job;
+    owner->offloaded++;
+    owner->pending++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->sleepers, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_pool_init(coap_pool_t *pool, const unsigned workers)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (!workers || (workers > COAP_POOL_MAX_WORKERS)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    coap_pool_state_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return COAP_ERR_IO;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    pool->state = s;
+    for (unsigned i = 0; i < workers; ++i) {
+        s->workers[i].state = s;
+        s->workers[i].home = i;
+        int rc = pthread_create(&s->threads[i], NULL, _worker, &s->workers[i]);
+        if (rc) {
+            errno = rc;
+            coap_pool_close(pool);
+            return COAP_ERR_IO;
+        }
+        pool->workers++;
+    }
+    return COAP_SUCCESS;
+}
+
+void coap_pool_close(coap_pool_t *pool)
+{
+    coap_pool_state_t *s = pool->state;
+    if (!s) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    __atomic_store_n(&s->stop, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    for (unsigned i = 0; i < pool->workers; ++i) {
+        pthread_join(s->threads[i], NULL);
+    }
+    for (unsigned i = 0; i < s->nowners; ++i) {
+        coap_pool_owner_t *owner = s->owners[i];
+        coap_pool_queue_t *q = owner->queue;
+        for (uint64_t t = q->top; t < q->bottom; ++t) {
+            free(q->jobs[t & _MASK]);
+        }
+        while (owner->done) {
+            coap_pool_job_t *job = owner->done;
+            owner->done = job->next;
+            free(job);
+        }
+        while (owner->unacked) {
+            coap_pool_job_t *job = owner->unacked;
+            owner->unacked = job->next;
+            free(job);
+        }
+        free(q);
+        owner->queue = NULL;
+        owner->inflight = NULL;
+        owner->pending = 0;
+    }
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    pool->state = NULL;
+    pool->workers = 0;
+}
+
+int coap_pool_attach(coap_pool_t *pool, coap_pool_owner_t *owner,
+                     coap_transport_send send, void *ctx)
+{
+    coap_pool_state_t *s = pool->state;
+    memset(owner, 0, sizeof(*owner));
+    owner->pool = pool;
+    owner->send = send;
+    owner->ctx = ctx;
+    owner->queue = calloc(1, sizeof(*owner->queue));
+    if (!owner->queue) {
+        return COAP_ERR_BUSY;
+    }
+    pthread_mutex_lock(&s->lock);
+    const unsigned n = s->nowners;
+    if (n == COAP_POOL_MAX_OWNERS) {
+        pthread_mutex_unlock(&s->lock);
+        free(owner->queue);
+        owner->queue = NULL;
+        return COAP_ERR_BUSY;
+    }
+    s->owners[n] = owner;
+    __atomic_store_n(&s->nowners, n + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s->lock);
+    return COAP_SUCCESS;
+}
+
+int coap_pool_handle_packet(coap_pool_owner_t *owner, coap_resource_t *resources,
+                            const coap_endpoint_t *from,
+                            const uint8_t *inbuf, const size_t inlen,
+                            uint8_t *outbuf, size_t *outlen)
+{
+    _submit_t sub = {owner, from};
+    // acknowledgements of separate responses, nothing to answer
+    if (_acknowledge(owner, from, inbuf, inlen)) {
+        return COAP_STATE_RSP_WAIT;
+    }
+    return coap_handle_packet_offload(resources, inbuf, inlen, outbuf, outlen,
+                                      _offload, &sub);
+}
+
+unsigned coap_pool_complete(coap_pool_owner_t *owner)
+{
+    coap_pool_job_t *job = __atomic_exchange_n(&owner->done, NULL, __ATOMIC_ACQUIRE);
+    coap_pool_job_t *fifo = NULL;
+    unsigned n = 0;
+    // newest first on the stack, send in order of completion
+    while (job) {
+        coap_pool_job_t *next = job->next;
+        job->next = fifo;
+        fifo = job;
+        job = next;
+    }
+    while (fifo) {
+        job = fifo;
+        fifo = job->next;
+        owner->pending--;
+        if (job->newer) {
+            job->newer->older = job->older;
+        }
+        else {
+            owner->inflight = job->older;
+        }
+        if (job->older) {
+            job->older->newer = job->newer;
+        }
+        if (job->rc) {
+            free(job);
+            continue;
+        }
+        job->msgid = coap_msgid_next();
+        const uint16_t id = htons(job->msgid);
+        memcpy(job->out + 2, &id, sizeof(id));
+        owner->send(owner->ctx, &job->from, job->out, job->outlen);
+        n++;
+        if (((job->out[0] >> 4) & 0x03) != COAP_TYPE_CON) {
+            free(job);
+            continue;
+        }
+        // kept for retransmission until acknowledged
+        uint16_t r;
+        coap_random_bytes((uint8_t *)&r, sizeof(r));
+        job->retransmits = 0;
+        job->timeout = COAP_ACK_TIMEOUT +
+                       r % (COAP_ACK_TIMEOUT * (COAP_ACK_RANDOM_FACTOR - 100) / 100 + 1);
+        job->deadline = coap_clock_now() + job->timeout;
+        job->next = owner->unacked;
+        owner->unacked = job;
+    }
+    return n;
+}
+
+coap_tick_t coap_pool_poll(coap_pool_owner_t *owner)
+{
+    const coap_tick_t now = coap_clock_now();
+    coap_tick_t next = COAP_TICK_NEVER;
+    coap_pool_job_t **p = &owner->unacked;
+    while (*p) {
+        coap_pool_job_t *job = *p;
+        if (job->deadline <= now) {
+            if (job->retransmits >= COAP_MAX_RETRANSMIT) {
+                *p = job->next;
+                owner->expired++;
+                free(job);
+                continue;
+            }
+            // exponential back-off
+            job->retransmits++;
+            job->timeout *= 2;
+            job->deadline = now + job->timeout;
+            owner->send(owner->ctx, &job->from, job->out, job->outlen);
+        }
+        if (job->deadline < next) {
+            next = job->deadline;
+        }
+        p = &job->next;
+    }
+    return next;
+}
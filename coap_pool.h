@@ -0,0 +1,160 @@
+#ifndef COAP_POOL_H
+#define COAP_POOL_H 1
+
+/**
+ * @file coap_pool.h
+ *
+ * Worker pool running the handlers of blocking resources off the receive
+ * threads.
+ *
+ * Each receive thread is an owner with a queue of its own: requests for
+ * resources flagged COAP_RESOURCE_BLOCKING are pushed onto it, confirmable
+ * ones are acknowledged right away. Workers take from the queue of their
+ * home owner first and steal from the others when it runs dry, so one busy
+ * socket keeps all of them occupied. A worker builds the response into the
+ * job and pushes it onto a completion stack of the owner, which sends it as
+ * separate response from coap_pool_complete(), or 5.00 if the handler
+ * failed. Responses to confirmable requests are confirmable themselves and
+ * retransmitted by coap_pool_poll() until acknowledged, as the client has
+ * no other way to learn about their loss. A retransmitted request is
+ * handled once: while its job is in flight it is acknowledged again, once
+ * the response was sent and is not yet acknowledged, that response is
+ * repeated as well. Queue and stack are lock-free; a
+ * lock is only taken to wake sleeping workers.
+ *
+ * Handlers of blocking resources run concurrently with each other and with
+ * the receive threads, they must not rely on state shared with other
+ * handlers without synchronizing it, and must not write to the resource.
+ * Workers render content formats without the cache, see coap_content_cache().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "coap.h"
+#include "coap_time.h"
+
+#ifndef COAP_POOL_MAX_WORKERS
+#define COAP_POOL_MAX_WORKERS   64      //!< worker threads
+#endif
+#ifndef COAP_POOL_MAX_OWNERS
+#define COAP_POOL_MAX_OWNERS    64      //!< receive threads
+#endif
+#ifndef COAP_POOL_QUEUE
+#define COAP_POOL_QUEUE         256     //!< queued requests per owner, power of 2
+#endif
+#ifndef COAP_POOL_MAX_PDU
+#define COAP_POOL_MAX_PDU       1152    //!< max. size of request and response
+#endif
+
+typedef struct coap_pool_state coap_pool_state_t;
+typedef struct coap_pool_queue coap_pool_queue_t;
+typedef struct coap_pool_job coap_pool_job_t;
+
+/**
+ * Worker pool
+ */
+typedef struct coap_pool
+{
+    coap_pool_state_t *state;           //!< threads, owners, sleep and wakeup
+    unsigned workers;                   //!< worker threads running
+} coap_pool_t;
+
+/**
+ * Receive thread submitting to a pool, used by that thread only
+ */
+typedef struct coap_pool_owner
+{
+    coap_pool_t *pool;                  //!< pool attached to
+    coap_transport_send send;           //!< sends the separate responses
+    void *ctx;                          //!< context of send
+    coap_pool_queue_t *queue;           //!< requests for the workers
+    coap_pool_job_t *done;              //!< completed jobs, pushed by workers
+    coap_pool_job_t *inflight;          //!< jobs submitted, response not yet sent
+    coap_pool_job_t *unacked;           //!< confirmable responses sent, not acknowledged
+    unsigned pending;                   //!< jobs submitted, response not yet sent
+    uint64_t offloaded;                 //!< requests handed to the pool
+    uint64_t rejected;                  //!< requests refused, queue full
+    uint64_t expired;                   //!< responses never acknowledged
+} coap_pool_owner_t;
+
+/**
+ * @brief Start worker threads
+ *
+ * @param[out] pool The pool
+ * @param[in] workers Number of threads, at most COAP_POOL_MAX_WORKERS
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if \p workers is out of range,
+ * or COAP_ERR_IO with errno set
+ */
+int coap_pool_init(coap_pool_t *pool, const unsigned workers);
+
+/**
+ * @brief Stop and join the workers, drop jobs not completed
+ *
+ * Owners must not submit any longer.
+ */
+void coap_pool_close(coap_pool_t *pool);
+
+/**
+ * @brief Attach a receive thread
+ *
+ * @param[in,out] pool The pool
+ * @param[out] owner The owner, must stay valid until coap_pool_close()
+ * @param[in] send Callback sending the separate responses
+ * @param[in] ctx Context passed to \p send, e.g. the transport
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if COAP_POOL_MAX_OWNERS are
+ * attached or memory is short
+ */
+int coap_pool_attach(coap_pool_t *pool, coap_pool_owner_t *owner,
+                     coap_transport_send send, void *ctx);
+
+/**
+ * @brief Handle a request datagram on the receive thread of \p owner
+ *
+ * coap_handle_packet_offload() with the pool taking over requests of
+ * blocking resources, while all others are answered inline. Retransmissions
+ * of requests taken over are acknowledged again, not queued. Empty ACK and
+ * RST messages end the retransmission of a separate response and are not
+ * answered.
+ *
+ * @param[in,out] owner The owner
+ * @param[in] from Sender of the request, receives the separate response
+ *
+ * @return as coap_handle_packet_offload()
+ */
+int coap_pool_handle_packet(coap_pool_owner_t *owner, coap_resource_t *resources,
+                            const coap_endpoint_t *from,
+                            const uint8_t *inbuf, const size_t inlen,
+                            uint8_t *outbuf, size_t *outlen);
+
+/**
+ * @brief Send the responses completed by the workers
+ *
+ * Call from the receive thread of \p owner, regularly while owner->pending
+ * is not 0, e.g. by waiting for datagrams with a short timeout.
+ *
+ * @return number of responses sent
+ */
+unsigned coap_pool_complete(coap_pool_owner_t *owner);
+
+/**
+ * @brief Retransmit confirmable separate responses not yet acknowledged
+ *
+ * Call from the receive thread of \p owner, at the latest at the returned
+ * deadline. Responses are given up after COAP_MAX_RETRANSMIT
+ * retransmissions, counted in owner->expired.
+ *
+ * @return time of the next deadline, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_pool_poll(coap_pool_owner_t *owner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_POOL_H
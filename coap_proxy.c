@@ -0,0 +1,608 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "coap_proxy.h"
+#include "coap_random.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+typedef struct
+{
+    coap_buffer_t host;                 //!< host, without brackets
+    bool literal;                       //!< host is an IP address literal
+    uint16_t port;                      //!< port, default 5683
+    uint8_t numuri;                     //!< Uri-Path and Uri-Query options
+    coap_option_t uri[COAP_MAX_OPTIONS];
+} _target_t;
+
+static bool _scheme_is_coap(const uint8_t *s, const size_t len);
+static int _pct_decode(coap_proxy_t *p, size_t *pos,
+                       const uint8_t *s, const size_t len, coap_buffer_t *out);
+static int _parse_proxy_uri(coap_proxy_t *p, const coap_buffer_t *uri,
+                            _target_t *t);
+static int _add_segments(coap_proxy_t *p, size_t *pos, _target_t *t,
+                         const coap_option_num_t num, const uint8_t sep,
+                         const uint8_t *s, const uint8_t *end);
+static bool _is_forwarded(const coap_option_num_t num, const bool forward);
+static uint32_t _hash(const uint8_t *buf, const size_t len);
+static bool _make_key(const coap_endpoint_t *ep, const coap_packet_t *req,
+                      uint8_t *key, size_t *keylen);
+static coap_proxy_cache_entry_t *_cache_lookup(coap_proxy_t *p,
+                                               const uint32_t hash,
+                                               const uint8_t *key,
+                                               const size_t keylen);
+static void _cache_store(coap_proxy_t *p, const coap_proxy_exchange_t *ex,
+                         const coap_packet_t *rsp);
+static int _make_error(const coap_packet_t *inpkt,
+                       const coap_responsecode_t rspcode, coap_packet_t *pkt);
+static int _make_wait(const coap_packet_t *inpkt, coap_packet_t *pkt);
+static bool _add_waiter(coap_proxy_exchange_t *ex, const coap_endpoint_t *from,
+                        const coap_packet_t *inpkt);
+static void _upstream_done(void *arg, const int status,
+                           const coap_packet_t *rsppkt);
+
+static bool _scheme_is_coap(const uint8_t *s, const size_t len)
+{
+    static const char coap[] = "coap";
+    if (len != sizeof(coap) - 1) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if ((s[i] | 0x20) != coap[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int _hexval(const uint8_t c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+/* percent-decode into the scratch buffer, https://tools.ietf.org/html/rfc3986#section-2.1 */
+static int _pct_decode(coap_proxy_t *p, size_t *pos,
+                       const uint8_t *s, const size_t len, coap_buffer_t *out)
+{
+    uint8_t *dst = p->scratch + *pos;
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i, ++n) {
+        if (*pos + n >= sizeof(p->scratch)) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        if (s[i] != '%') {
+            dst[n] = s[i];
+            continue;
+        }
+        if ((i + 2 >= len) || (_hexval(s[i + 1]) < 0) ||
+            (_hexval(s[i + 2]) < 0)) {
+            return COAP_ERR_MALFORMED;
+        }
+        dst[n] = (uint8_t)((_hexval(s[i + 1]) << 4) | _hexval(s[i + 2]));
+        i += 2;
+    }
+    out->p = dst;
+    out->len = n;
+    *pos += n;
+    return COAP_SUCCESS;
+}
+
+static int _add_segments(coap_proxy_t *p, size_t *pos, _target_t *t,
+                         const coap_option_num_t num, const uint8_t sep,
+                         const uint8_t *s, const uint8_t *end)
+{
+    for (;;) {
+        const uint8_t *e = s;
+        while ((e < end) && (*e != sep)) {
+            ++e;
+        }
+        if (t->numuri >= COAP_MAX_OPTIONS) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        coap_option_t *opt = &t->uri[t->numuri];
+        opt->num = num;
+        int rc = _pct_decode(p, pos, s, (size_t)(e - s), &opt->buf);
+        if (rc) {
+            return rc;
+        }
+        t->numuri++;
+        if (e == end) {
+            return COAP_SUCCESS;
+        }
+        s = e + 1;
+    }
+}
+
+/* https://tools.ietf.org/html/rfc7252#section-6.4 */
+static int _parse_proxy_uri(coap_proxy_t *p, const coap_buffer_t *uri,
+                            _target_t *t)
+{
+    const uint8_t *s = uri->p;
+    const uint8_t *end = uri->p + uri->len;
+    // scheme
+    const uint8_t *colon = s;
+    while ((colon < end) && (*colon != ':')) {
+        ++colon;
+    }
+    if ((end - colon < 3) || (colon[1] != '/') || (colon[2] != '/')) {
+        return COAP_ERR_MALFORMED;
+    }
+    if (!_scheme_is_coap(s, (size_t)(colon - s))) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    s = colon + 3;
+    // authority
+    const uint8_t *auth_end = s;
+    while ((auth_end < end) && (*auth_end != '/') && (*auth_end != '?')) {
+        ++auth_end;
+    }
+    const uint8_t *host_end;
+    t->literal = true;
+    if ((s < auth_end) && (*s == '[')) {
+        host_end = ++s;
+        while ((host_end < auth_end) && (*host_end != ']')) {
+            ++host_end;
+        }
+        if (host_end == auth_end) {
+            return COAP_ERR_MALFORMED;
+        }
+        t->host.p = s;
+        t->host.len = (size_t)(host_end - s);
+        ++host_end;
+    }
+    else {
+        host_end = s;
+        while ((host_end < auth_end) && (*host_end != ':')) {
+            if (((*host_end < '0') || (*host_end > '9')) && (*host_end != '.')) {
+                t->literal = false;
+            }
+            ++host_end;
+        }
+        t->host.p = s;
+        t->host.len = (size_t)(host_end - s);
+    }
+    if (!t->host.len) {
+        return COAP_ERR_MALFORMED;
+    }
+    t->port = COAP_DEFAULT_PORT;
+    if (host_end < auth_end) {
+        if (*host_end != ':') {
+            return COAP_ERR_MALFORMED;
+        }
+        // empty port means default
+        uint32_t port = 0;
+        for (s = host_end + 1; s < auth_end; ++s) {
+            if ((*s < '0') || (*s > '9')) {
+                return COAP_ERR_MALFORMED;
+            }
+            port = port * 10 + (*s - '0');
+            if (port > 0xFFFF) {
+                return COAP_ERR_MALFORMED;
+            }
+        }
+        if (host_end + 1 < auth_end) {
+            t->port = (uint16_t)port;
+        }
+    }
+    // path, "/" and "" mean no Uri-Path
+    s = auth_end;
+    const uint8_t *path_end = s;
+    while ((path_end < end) && (*path_end != '?')) {
+        ++path_end;
+    }
+    size_t pos = 0;
+    t->numuri = 0;
+    if (path_end - s > 1) {
+        int rc = _add_segments(p, &pos, t, COAP_OPTION_URI_PATH, '/',
+                               s + 1, path_end);
+        if (rc) {
+            return rc;
+        }
+    }
+    // query
+    if (path_end < end) {
+        int rc = _add_segments(p, &pos, t, COAP_OPTION_URI_QUERY, '&',
+                               path_end + 1, end);
+        if (rc) {
+            return rc;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+/* options copied as they are to the upstream request */
+static bool _is_forwarded(const coap_option_num_t num, const bool forward)
+{
+    switch (num) {
+        case COAP_OPTION_URI_PATH:
+        case COAP_OPTION_PROXY_URI:
+        case COAP_OPTION_PROXY_SCHEME:
+            return false;
+        case COAP_OPTION_URI_HOST:
+        case COAP_OPTION_URI_PORT:
+            // addressed the proxy when reverse proxying
+            return false;
+        case COAP_OPTION_URI_QUERY:
+            return !forward;
+        default:
+            return true;
+    }
+}
+
+/* FNV-1a */
+static uint32_t _hash(const uint8_t *buf, const size_t len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ buf[i]) * 16777619U;
+    }
+    return h;
+}
+
+/* cache key: upstream endpoint, method and all options of the request */
+static bool _make_key(const coap_endpoint_t *ep, const coap_packet_t *req,
+                      uint8_t *key, size_t *keylen)
+{
+    size_t n = 0;
+    if (1 + ep->len + 1 > COAP_PROXY_MAX_KEY) {
+        return false;
+    }
+    key[n++] = ep->len;
+    memcpy(key + n, ep->addr, ep->len);
+    n += ep->len;
+    key[n++] = req->hdr.code;
+    for (size_t i = 0; i < req->numopts; ++i) {
+        const coap_option_t *opt = &req->opts[i];
+        if (n + 4 + opt->buf.len > COAP_PROXY_MAX_KEY) {
+            return false;
+        }
+        key[n++] = opt->num >> 8;
+        key[n++] = opt->num & 0xFF;
+        key[n++] = opt->buf.len >> 8;
+        key[n++] = opt->buf.len & 0xFF;
+        memcpy(key + n, opt->buf.p, opt->buf.len);
+        n += opt->buf.len;
+    }
+    *keylen = n;
+    return true;
+}
+
+static coap_proxy_cache_entry_t *_cache_lookup(coap_proxy_t *p,
+                                               const uint32_t hash,
+                                               const uint8_t *key,
+                                               const size_t keylen)
+{
+    const coap_tick_t now = coap_clock_now();
+    for (size_t i = 0; i < COAP_PROXY_CACHE_ENTRIES; ++i) {
+        coap_proxy_cache_entry_t *e = &p->cache[i];
+        if ((e->expires > now) && (e->hash == hash) &&
+            (e->keylen == keylen) && !memcmp(e->key, key, keylen)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* https://tools.ietf.org/html/rfc7252#section-5.6 */
+static void _cache_store(coap_proxy_t *p, const coap_proxy_exchange_t *ex,
+                         const coap_packet_t *rsp)
+{
+    uint32_t maxage = COAP_DEFAULT_MAX_AGE;
+    if (!ex->cacheable || (rsp->hdr.code != COAP_RSPCODE_CONTENT) ||
+        (coap_get_option_uint(rsp, COAP_OPTION_MAX_AGE, &maxage) ==
+         COAP_ERR_OPTION_LEN_INVALID) || !maxage) {
+        return;
+    }
+    // same key, else the entry expiring first, unused and stale ones included
+    const coap_tick_t now = coap_clock_now();
+    coap_proxy_cache_entry_t *e = &p->cache[0];
+    for (size_t i = 0; i < COAP_PROXY_CACHE_ENTRIES; ++i) {
+        coap_proxy_cache_entry_t *c = &p->cache[i];
+        if ((c->hash == ex->hash) && (c->keylen == ex->keylen) &&
+            !memcmp(c->key, ex->key, ex->keylen)) {
+            e = c;
+            break;
+        }
+        if (c->expires < e->expires) {
+            e = c;
+        }
+    }
+    // stored without token, stamped when served
+    coap_packet_t pkt = *rsp;
+    pkt.hdr.tkl = 0;
+    pkt.tok.p = NULL;
+    pkt.tok.len = 0;
+    e->len = sizeof(e->pdu);
+    if (coap_build(&pkt, e->pdu, &e->len)) {
+        e->expires = 0;
+        return;
+    }
+    e->hash = ex->hash;
+    e->keylen = ex->keylen;
+    memcpy(e->key, ex->key, ex->keylen);
+    e->expires = now + (coap_tick_t)maxage * COAP_TICKS_PER_SEC;
+}
+
+static int _make_error(const coap_packet_t *inpkt,
+                       const coap_responsecode_t rspcode, coap_packet_t *pkt)
+{
+    if (inpkt->hdr.t == COAP_TYPE_CON) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                                  rspcode, NULL, NULL, 0, pkt);
+    }
+    return coap_make_response(coap_msgid_next(), &inpkt->tok, COAP_TYPE_NONCON,
+                              rspcode, NULL, NULL, 0, pkt);
+}
+
+/* empty ACK for confirmable requests, nothing otherwise */
+static int _make_wait(const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    if (inpkt->hdr.t == COAP_TYPE_CON) {
+        return coap_make_response(inpkt->hdr.id, NULL, COAP_TYPE_ACK,
+                                  COAP_RSPCODE_EMPTY, NULL, NULL, 0, pkt);
+    }
+    return COAP_STATE_RSP_WAIT;
+}
+
+static bool _add_waiter(coap_proxy_exchange_t *ex, const coap_endpoint_t *from,
+                        const coap_packet_t *inpkt)
+{
+    if (inpkt->tok.len > COAP_MAX_TOKLEN) {
+        return false;
+    }
+    // retransmitted request, already waiting
+    for (size_t i = 0; i < ex->numwaiters; ++i) {
+        const coap_proxy_waiter_t *w = &ex->waiters[i];
+        if (coap_endpoint_equal(&w->ep, from) && (w->tkl == inpkt->tok.len) &&
+            !memcmp(w->token, inpkt->tok.p, w->tkl)) {
+            return true;
+        }
+    }
+    if (ex->numwaiters >= COAP_PROXY_MAX_WAITERS) {
+        return false;
+    }
+    coap_proxy_waiter_t *w = &ex->waiters[ex->numwaiters++];
+    w->ep = *from;
+    w->tkl = inpkt->tok.len;
+    memcpy(w->token, inpkt->tok.p, w->tkl);
+    return true;
+}
+
+/* relay the upstream response to every waiter as separate response */
+static void _upstream_done(void *arg, const int status,
+                           const coap_packet_t *rsppkt)
+{
+    coap_proxy_exchange_t *ex = arg;
+    coap_proxy_t *p = ex->proxy;
+    coap_packet_t pkt;
+    uint8_t buf[COAP_CLIENT_MAX_PDU];
+    if (!status) {
+        _cache_store(p, ex, rsppkt);
+        pkt = *rsppkt;
+    }
+    else {
+        coap_make_response(0, NULL, COAP_TYPE_NONCON,
+                           (status == COAP_ERR_TIMEOUT) ?
+                               COAP_RSPCODE_GATEWAY_TIMEOUT :
+                               COAP_RSPCODE_BAD_GATEWAY,
+                           NULL, NULL, 0, &pkt);
+    }
+    pkt.hdr.t = COAP_TYPE_NONCON;
+    for (size_t i = 0; i < ex->numwaiters; ++i) {
+        const coap_proxy_waiter_t *w = &ex->waiters[i];
+        pkt.hdr.id = coap_msgid_next();
+        pkt.hdr.tkl = w->tkl;
+        pkt.tok.p = w->token;
+        pkt.tok.len = w->tkl;
+        size_t buflen = sizeof(buf);
+        if (!coap_build(&pkt, buf, &buflen)) {
+            p->client.send(p->client.ctx, &w->ep, buf, buflen);
+        }
+    }
+    ex->active = false;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_proxy_init(coap_proxy_t *p, coap_transport_send send, void *ctx,
+                     coap_proxy_resolve resolve, void *resolve_ctx,
+                     const coap_proxy_route_t *routes)
+{
+    memset(p, 0, sizeof(*p));
+    coap_client_init(&p->client, send, ctx);
+    p->resolve = resolve;
+    p->resolve_ctx = resolve_ctx;
+    p->routes = routes;
+    for (size_t i = 0; i < COAP_PROXY_MAX_EXCHANGES; ++i) {
+        p->exchanges[i].proxy = p;
+    }
+}
+
+int coap_proxy_handle_request(coap_proxy_t *p, const coap_endpoint_t *from,
+                              const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    _target_t t;
+    coap_endpoint_t upstream;
+    bool forward = true;
+    const coap_option_t *opt;
+    uint8_t count;
+
+    if ((inpkt->hdr.code == COAP_RSPCODE_EMPTY) ||
+        (inpkt->hdr.code >= MAKE_RSPCODE(2, 0))) {
+        return COAP_ERR_REQUEST_NOT_FOUND;
+    }
+    // forward proxy, by Proxy-Uri
+    if (NULL != (opt = coap_find_option(inpkt, COAP_OPTION_PROXY_URI))) {
+        int rc = _parse_proxy_uri(p, &opt->buf, &t);
+        if (rc == COAP_ERR_UNSUPPORTED) {
+            return _make_error(inpkt, COAP_RSPCODE_NO_PROXY_SUPPORT, pkt);
+        }
+        if (rc) {
+            return _make_error(inpkt, COAP_RSPCODE_BAD_OPTION, pkt);
+        }
+    }
+    // forward proxy, by Proxy-Scheme and Uri-* options
+    else if (NULL != (opt = coap_find_option(inpkt, COAP_OPTION_PROXY_SCHEME))) {
+        if (!_scheme_is_coap(opt->buf.p, opt->buf.len)) {
+            return _make_error(inpkt, COAP_RSPCODE_NO_PROXY_SUPPORT, pkt);
+        }
+        if (NULL == (opt = coap_find_option(inpkt, COAP_OPTION_URI_HOST))) {
+            return _make_error(inpkt, COAP_RSPCODE_BAD_REQUEST, pkt);
+        }
+        t.host = opt->buf;
+        t.literal = false;
+        uint32_t port = COAP_DEFAULT_PORT;
+        coap_get_option_uint(inpkt, COAP_OPTION_URI_PORT, &port);
+        t.port = (uint16_t)port;
+        t.numuri = 0;
+        for (size_t i = 0; i < inpkt->numopts; ++i) {
+            if ((inpkt->opts[i].num == COAP_OPTION_URI_PATH) ||
+                (inpkt->opts[i].num == COAP_OPTION_URI_QUERY)) {
+                t.uri[t.numuri++] = inpkt->opts[i];
+            }
+        }
+    }
+    // reverse proxy, by route
+    else {
+        const coap_proxy_route_t *route = p->routes;
+        opt = coap_find_uri_path(inpkt, &count);
+        while (route && route->path &&
+               !coap_match_path(route->path, opt, count)) {
+            ++route;
+        }
+        if (!route || !route->path) {
+            return COAP_ERR_REQUEST_NOT_FOUND;
+        }
+        forward = false;
+        upstream = route->upstream;
+        t.literal = true;
+        t.numuri = 0;
+        for (uint8_t i = route->strip; i < count; ++i) {
+            t.uri[t.numuri++] = opt[i];
+        }
+    }
+    if (forward) {
+        if (!p->resolve) {
+            return _make_error(inpkt, COAP_RSPCODE_NO_PROXY_SUPPORT, pkt);
+        }
+        if (p->resolve(p->resolve_ctx, &t.host, t.port, &upstream)) {
+            return _make_error(inpkt, COAP_RSPCODE_BAD_GATEWAY, pkt);
+        }
+    }
+
+    // upstream request, always confirmable
+    coap_packet_t req;
+    req.hdr.ver = COAP_VERSION;
+    req.hdr.t = COAP_TYPE_CON;
+    req.hdr.tkl = 0;
+    req.hdr.code = inpkt->hdr.code;
+    req.hdr.id = 0;
+    req.numopts = 0;
+    req.payload = inpkt->payload;
+    int rc = COAP_SUCCESS;
+    for (size_t i = 0; !rc && (i < inpkt->numopts); ++i) {
+        if (_is_forwarded(inpkt->opts[i].num, forward)) {
+            rc = coap_add_option(&req, inpkt->opts[i].num,
+                                 inpkt->opts[i].buf.p, inpkt->opts[i].buf.len);
+        }
+    }
+    if (!rc && !t.literal) {
+        rc = coap_add_option(&req, COAP_OPTION_URI_HOST, t.host.p, t.host.len);
+    }
+    for (size_t i = 0; !rc && (i < t.numuri); ++i) {
+        rc = coap_add_option(&req, t.uri[i].num, t.uri[i].buf.p, t.uri[i].buf.len);
+    }
+    if (rc) {
+        return _make_error(inpkt, COAP_RSPCODE_INTERNAL_SERVER_ERROR, pkt);
+    }
+
+    // serve from cache, or join a request in flight
+    uint8_t key[COAP_PROXY_MAX_KEY];
+    size_t keylen = 0;
+    const bool cacheable = (inpkt->hdr.code == COAP_METHOD_GET) &&
+                           _make_key(&upstream, &req, key, &keylen);
+    const uint32_t hash = cacheable ? _hash(key, keylen) : 0;
+    if (cacheable) {
+        coap_proxy_cache_entry_t *e = _cache_lookup(p, hash, key, keylen);
+        if (e && !coap_parse(e->pdu, e->len, pkt)) {
+            const coap_tick_t now = coap_clock_now();
+            const uint32_t maxage = (uint32_t)((e->expires - now +
+                                    COAP_TICKS_PER_SEC - 1) / COAP_TICKS_PER_SEC);
+            const size_t len = coap_encode_option_uint(maxage, p->maxage);
+            coap_option_t *ma = (coap_option_t *)coap_find_option(pkt, COAP_OPTION_MAX_AGE);
+            if (ma) {
+                ma->buf.p = p->maxage;
+                ma->buf.len = len;
+                rc = COAP_SUCCESS;
+            }
+            else {
+                rc = coap_add_option(pkt, COAP_OPTION_MAX_AGE, p->maxage, len);
+            }
+            if (!rc) {
+                if (inpkt->hdr.t == COAP_TYPE_CON) {
+                    pkt->hdr.t = COAP_TYPE_ACK;
+                    pkt->hdr.id = inpkt->hdr.id;
+                }
+                else {
+                    pkt->hdr.t = COAP_TYPE_NONCON;
+                    pkt->hdr.id = coap_msgid_next();
+                }
+                pkt->hdr.tkl = inpkt->tok.len;
+                pkt->tok = inpkt->tok;
+                return COAP_STATE_RSP_SEND;
+            }
+        }
+        for (size_t i = 0; i < COAP_PROXY_MAX_EXCHANGES; ++i) {
+            coap_proxy_exchange_t *ex = &p->exchanges[i];
+            if (ex->active && ex->cacheable && (ex->hash == hash) &&
+                (ex->keylen == keylen) && !memcmp(ex->key, key, keylen)) {
+                if (!_add_waiter(ex, from, inpkt)) {
+                    return _make_error(inpkt, COAP_RSPCODE_SERVICE_UNAVAILABLE, pkt);
+                }
+                return _make_wait(inpkt, pkt);
+            }
+        }
+    }
+
+    // new upstream exchange
+    coap_proxy_exchange_t *ex = NULL;
+    for (size_t i = 0; i < COAP_PROXY_MAX_EXCHANGES; ++i) {
+        if (!p->exchanges[i].active) {
+            ex = &p->exchanges[i];
+            break;
+        }
+    }
+    if (!ex) {
+        return _make_error(inpkt, COAP_RSPCODE_SERVICE_UNAVAILABLE, pkt);
+    }
+    ex->cacheable = cacheable;
+    ex->hash = hash;
+    ex->keylen = keylen;
+    memcpy(ex->key, key, keylen);
+    ex->numwaiters = 0;
+    if (!_add_waiter(ex, from, inpkt)) {
+        return _make_error(inpkt, COAP_RSPCODE_BAD_REQUEST, pkt);
+    }
+    rc = coap_client_request(&p->client, &upstream, &req, _upstream_done, ex);
+    if (rc == COAP_ERR_BUSY) {
+        return _make_error(inpkt, COAP_RSPCODE_SERVICE_UNAVAILABLE, pkt);
+    }
+    if (rc) {
+        return _make_error(inpkt, COAP_RSPCODE_BAD_GATEWAY, pkt);
+    }
+    ex->active = true;
+    return _make_wait(inpkt, pkt);
+}
+
+int coap_proxy_handle_response(coap_proxy_t *p, const coap_endpoint_t *from,
+                               const coap_packet_t *pkt)
+{
+    return coap_client_handle_packet(&p->client, from, pkt);
+}
+
+coap_tick_t coap_proxy_poll(coap_proxy_t *p)
+{
+    return coap_client_poll(&p->client);
+}
@@ -0,0 +1,175 @@
+#ifndef COAP_PROXY_H
+#define COAP_PROXY_H 1
+
+/**
+ * @file coap_proxy.h
+ *
+ * CoAP forward and reverse proxy, see
+ * https://tools.ietf.org/html/rfc7252#section-5.7
+ *
+ * Forward proxying follows the Proxy-Uri or Proxy-Scheme option of a
+ * request, reverse proxying maps resource paths to upstream servers. The
+ * upstream leg uses the asynchronous client, downstream requests are
+ * acknowledged right away and answered with a separate response. Identical
+ * GET requests in flight are collapsed into one upstream exchange, and
+ * 2.05 responses are cached for their Max-Age.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "coap.h"
+#include "coap_client.h"
+
+#ifndef COAP_PROXY_MAX_EXCHANGES
+#define COAP_PROXY_MAX_EXCHANGES    COAP_CLIENT_MAX_EXCHANGES //!< upstream requests in flight
+#endif
+#ifndef COAP_PROXY_MAX_WAITERS
+#define COAP_PROXY_MAX_WAITERS      8       //!< downstream requests per upstream request
+#endif
+#ifndef COAP_PROXY_CACHE_ENTRIES
+#define COAP_PROXY_CACHE_ENTRIES    32      //!< cached responses
+#endif
+#ifndef COAP_PROXY_CACHE_PDU
+#define COAP_PROXY_CACHE_PDU        512     //!< max. size of a cached response
+#endif
+#ifndef COAP_PROXY_MAX_KEY
+#define COAP_PROXY_MAX_KEY          160     //!< max. size of a cache key
+#endif
+
+#define COAP_DEFAULT_MAX_AGE        60      //!< seconds, if Max-Age is absent
+
+/**
+ * @brief callback function resolving the host of a Proxy-Uri
+ *
+ * @param[in] ctx Context given to coap_proxy_init()
+ * @param[in] host Host name or address literal (without brackets)
+ * @param[in] port Port number
+ * @param[out] ep The resolved endpoint
+ *
+ * @return 0 on success, some error code otherwise
+ */
+typedef int (*coap_proxy_resolve)(void *ctx, const coap_buffer_t *host,
+                                  const uint16_t port, coap_endpoint_t *ep);
+
+/**
+ * Reverse proxy route, requests matching \p path are forwarded to
+ * \p upstream with the first \p strip path segments removed
+ */
+typedef struct coap_proxy_route
+{
+    const coap_resource_path_t *path;   //!< e.g. {2, {"dev", "*"}}
+    coap_endpoint_t upstream;           //!< server the requests go to
+    uint8_t strip;                      //!< leading segments to remove
+} coap_proxy_route_t;
+
+/**
+ * Downstream client waiting for an upstream response
+ */
+typedef struct coap_proxy_waiter
+{
+    coap_endpoint_t ep;                 //!< downstream client
+    uint8_t tkl;                        //!< token length
+    uint8_t token[COAP_MAX_TOKLEN];     //!< token of the downstream request
+} coap_proxy_waiter_t;
+
+typedef struct coap_proxy coap_proxy_t;
+
+/**
+ * Upstream exchange and the downstream requests it serves
+ */
+typedef struct coap_proxy_exchange
+{
+    bool active;                        //!< slot in use
+    bool cacheable;                     //!< GET, may be collapsed and cached
+    coap_proxy_t *proxy;                //!< owning proxy
+    uint32_t hash;                      //!< hash of key
+    size_t keylen;                      //!< size of key
+    uint8_t key[COAP_PROXY_MAX_KEY];    //!< endpoint, method and options
+    uint8_t numwaiters;                 //!< number of waiters
+    coap_proxy_waiter_t waiters[COAP_PROXY_MAX_WAITERS];
+} coap_proxy_exchange_t;
+
+/**
+ * Cached upstream response, stored encoded without token
+ */
+typedef struct coap_proxy_cache_entry
+{
+    coap_tick_t expires;                //!< end of freshness, 0 if unused
+    uint32_t hash;                      //!< hash of key
+    size_t keylen;                      //!< size of key
+    uint8_t key[COAP_PROXY_MAX_KEY];    //!< endpoint, method and options
+    size_t len;                         //!< size of pdu
+    uint8_t pdu[COAP_PROXY_CACHE_PDU];  //!< encoded response
+} coap_proxy_cache_entry_t;
+
+/**
+ * Proxy state
+ */
+struct coap_proxy
+{
+    coap_client_t client;               //!< upstream leg
+    coap_proxy_resolve resolve;         //!< resolves Proxy-Uri hosts
+    void *resolve_ctx;                  //!< context of resolve
+    const coap_proxy_route_t *routes;   //!< reverse routes, terminated by path NULL
+    uint8_t maxage[4];                  //!< Max-Age of last cached response served
+    uint8_t scratch[256];               //!< percent-decoded Proxy-Uri
+    coap_proxy_exchange_t exchanges[COAP_PROXY_MAX_EXCHANGES];
+    coap_proxy_cache_entry_t cache[COAP_PROXY_CACHE_ENTRIES];
+};
+
+/**
+ * @brief Initialize proxy
+ *
+ * @param[out] p The proxy
+ * @param[in] send Callback sending datagrams, upstream and downstream
+ * @param[in] ctx Context passed to \p send
+ * @param[in] resolve Callback resolving Proxy-Uri hosts, NULL to disable
+ * forward proxying
+ * @param[in] resolve_ctx Context passed to \p resolve
+ * @param[in] routes Reverse proxy routes, may be NULL
+ */
+void coap_proxy_init(coap_proxy_t *p, coap_transport_send send, void *ctx,
+                     coap_proxy_resolve resolve, void *resolve_ctx,
+                     const coap_proxy_route_t *routes);
+
+/**
+ * @brief Handle a request addressed to the proxy
+ *
+ * @param[in,out] p The proxy
+ * @param[in] from Downstream client
+ * @param[in] inpkt The request
+ * @param[out] pkt Packet to send to \p from, unless COAP_STATE_RSP_WAIT is
+ * returned. It may refer to the cache and must be built right away.
+ *
+ * @return COAP_STATE_RSP_SEND if \p pkt holds the response (from cache or an
+ * error), COAP_STATE_ACK_SEND if \p pkt holds an empty ACK and the response
+ * follows, COAP_STATE_RSP_WAIT if the response follows and nothing is to be
+ * sent now, or COAP_ERR_REQUEST_NOT_FOUND if \p inpkt is no proxy request
+ * and should be handled locally.
+ */
+int coap_proxy_handle_request(coap_proxy_t *p, const coap_endpoint_t *from,
+                              const coap_packet_t *inpkt, coap_packet_t *pkt);
+
+/**
+ * @brief Handle a packet from an upstream server
+ *
+ * @return 0 if the packet belonged to an upstream exchange, or
+ * COAP_ERR_REQUEST_NOT_FOUND otherwise.
+ */
+int coap_proxy_handle_response(coap_proxy_t *p, const coap_endpoint_t *from,
+                               const coap_packet_t *pkt);
+
+/**
+ * @brief Retransmit and time out upstream requests
+ *
+ * @return time of the next deadline, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_proxy_poll(coap_proxy_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_PROXY_H
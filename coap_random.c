@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "coap_random.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _BLOCK_SIZE     64
+#define _KEY_SIZE       32
+#define _BUFFER_SIZE    (COAP_RANDOM_BATCH * _BLOCK_SIZE)
+
+#define _ROTL32(v, n)   (((v) << (n)) | ((v) >> (32 - (n))))
+#define _QUARTER(a, b, c, d) do { \
+    a += b; d ^= a; d = _ROTL32(d, 16); \
+    c += d; b ^= c; b = _ROTL32(b, 12); \
+    a += b; d ^= a; d = _ROTL32(d, 8);  \
+    c += d; b ^= c; b = _ROTL32(b, 7); } while (0)
+
+/* generator of one thread */
+typedef struct
+{
+    uint32_t key[_KEY_SIZE / 4];
+    uint64_t counter;                   //!< next block under key
+    uint8_t buf[_BUFFER_SIZE];          //!< keystream, used bytes are zeroed
+    size_t avail;                       //!< unused bytes at the end of buf
+    unsigned generation;                //!< _generation when keyed, 0 before
+    uint16_t msgid;                     //!< next message ID
+} _state_t;
+
+static __thread _state_t _local;
+static unsigned _generation = 1;        //!< advanced in forked children
+static pthread_once_t _once = PTHREAD_ONCE_INIT;
+
+static void _forked(void);
+static void _register(void);
+static void _chacha20_block(const uint32_t in[16], uint8_t *out);
+static void _refill(_state_t *s);
+static void _entropy(uint8_t *buf, const size_t len);
+static void _key(_state_t *s, const uint8_t *key);
+static _state_t *_state(void);
+
+/* the child must not repeat the keystream of its parent */
+static void _forked(void)
+{
+    __atomic_add_fetch(&_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void _register(void)
+{
+    pthread_atfork(NULL, NULL, _forked);
+}
+
+/* https://cr.yp.to/chacha.html, 64 bit counter in words 12 and 13 */
+static void _chacha20_block(const uint32_t in[16], uint8_t *out)
+{
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+        _QUARTER(x[0], x[4], x[8], x[12]);
+        _QUARTER(x[1], x[5], x[9], x[13]);
+        _QUARTER(x[2], x[6], x[10], x[14]);
+        _QUARTER(x[3], x[7], x[11], x[15]);
+        _QUARTER(x[0], x[5], x[10], x[15]);
+        _QUARTER(x[1], x[6], x[11], x[12]);
+        _QUARTER(x[2], x[7], x[8], x[13]);
+        _QUARTER(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        const uint32_t v = x[i] + in[i];
+        out[4 * i] = (uint8_t)v;
+        out[4 * i + 1] = (uint8_t)(v >> 8);
+        out[4 * i + 2] = (uint8_t)(v >> 16);
+        out[4 * i + 3] = (uint8_t)(v >> 24);
+    }
+}
+
+/* a batch of blocks, whose first bytes replace the key */
+static void _refill(_state_t *s)
+{
+    uint32_t in[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    memcpy(in + 4, s->key, sizeof(s->key));
+    for (size_t b = 0; b < COAP_RANDOM_BATCH; ++b, ++s->counter) {
+        in[12] = (uint32_t)s->counter;
+        in[13] = (uint32_t)(s->counter >> 32);
+        _chacha20_block(in, s->buf + _BLOCK_SIZE * b);
+    }
+    _key(s, s->buf);
+    memset(s->buf, 0, _KEY_SIZE);
+    memset(in, 0, sizeof(in));
+    s->avail = _BUFFER_SIZE - _KEY_SIZE;
+}
+
+/* never blocks, the clock is the last resort if the kernel has nothing */
+static void _entropy(uint8_t *buf, const size_t len)
+{
+    if (getrandom(buf, len, GRND_NONBLOCK) == (ssize_t)len) {
+        return;
+    }
+    const int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        const ssize_t n = read(fd, buf, len);
+        close(fd);
+        if (n == (ssize_t)len) {
+            return;
+        }
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] ^= (uint8_t)((ts.tv_nsec >> (i % 4)) ^ ((uintptr_t)buf >> (i % 8)) ^ i);
+    }
+}
+
+static void _key(_state_t *s, const uint8_t *key)
+{
+    for (size_t i = 0; i < _KEY_SIZE / 4; ++i) {
+        s->key[i] = (uint32_t)key[4 * i] | ((uint32_t)key[4 * i + 1] << 8) |
+                    ((uint32_t)key[4 * i + 2] << 16) | ((uint32_t)key[4 * i + 3] << 24);
+    }
+    s->counter = 0;
+}
+
+static _state_t *_state(void)
+{
+    _state_t *s = &_local;
+    const unsigned generation = __atomic_load_n(&_generation, __ATOMIC_RELAXED);
+    if (s->generation != generation) {
+        uint8_t key[_KEY_SIZE];
+        pthread_once(&_once, _register);
+        _entropy(key, sizeof(key));
+        _key(s, key);
+        memset(key, 0, sizeof(key));
+        s->avail = 0;
+        s->generation = generation;
+        // random initial message ID, https://tools.ietf.org/html/rfc7252#section-4.4
+        coap_random_bytes((uint8_t *)&s->msgid, sizeof(s->msgid));
+    }
+    return s;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_random_bytes(uint8_t *buf, const size_t len)
+{
+    _state_t *s = _state();
+    size_t done = 0;
+    while (done < len) {
+        if (!s->avail) {
+            _refill(s);
+        }
+        const size_t n = (len - done < s->avail) ? len - done : s->avail;
+        uint8_t *p = s->buf + _BUFFER_SIZE - s->avail;
+        memcpy(buf + done, p, n);
+        memset(p, 0, n);
+        s->avail -= n;
+        done += n;
+    }
+}
+
+uint32_t coap_random_next(void)
+{
+    uint32_t value;
+    coap_random_bytes((uint8_t *)&value, sizeof(value));
+    return value;
+}
+
+void coap_token_next(uint8_t *token, const size_t len)
+{
+    coap_random_bytes(token, len);
+}
+
+uint16_t coap_msgid_next(void)
+{
+    return _state()->msgid++;
+}
+
+void coap_random_seed(const uint64_t seed)
+{
+    _state_t *s = _state();
+    uint8_t key[_KEY_SIZE] = {0};
+    for (size_t i = 0; i < sizeof(seed); ++i) {
+        key[i] = (uint8_t)(seed >> (8 * i));
+    }
+    _key(s, key);
+    s->avail = 0;
+    coap_random_bytes((uint8_t *)&s->msgid, sizeof(s->msgid));
+}
@@ -0,0 +1,86 @@
+#ifndef COAP_RANDOM_H
+#define COAP_RANDOM_H 1
+
+/**
+ * @file coap_random.h
+ *
+ * Per-thread generators of message IDs and tokens, see
+ * https://tools.ietf.org/html/rfc7252#section-4.4 and
+ * https://tools.ietf.org/html/rfc7252#section-5.3.1
+ *
+ * Tokens come from ChaCha20 keyed by getrandom(), never blocking: the
+ * keystream is generated COAP_RANDOM_BATCH blocks at a time, and the key
+ * replaced by the first bytes of each batch, so that earlier output cannot
+ * be recovered from the state. Message IDs start at a random value and
+ * increase by one. Each thread has its own state, no locks are taken; a
+ * forked child draws fresh keys.
+ *
+ * Tokens are uniformly random, so their leading bytes serve as hash key
+ * as they are, see coap_token_key().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef COAP_RANDOM_BATCH
+#define COAP_RANDOM_BATCH   4       //!< ChaCha20 blocks of 64 bytes per refill
+#endif
+
+/**
+ * @brief Fill a buffer with random bytes of the calling thread
+ */
+void coap_random_bytes(uint8_t *buf, const size_t len);
+
+/**
+ * @brief Draw a uniformly random number, e.g. for jitter
+ */
+uint32_t coap_random_next(void);
+
+/**
+ * @brief Draw a token
+ *
+ * @param[out] token \p len random bytes
+ * @param[in] len Token length, up to COAP_MAX_TOKLEN
+ */
+void coap_token_next(uint8_t *token, const size_t len);
+
+/**
+ * @brief Next message ID of the calling thread
+ *
+ * Starts at a random value, then increases by one per call.
+ */
+uint16_t coap_msgid_next(void);
+
+/**
+ * @brief Make the generators of the calling thread deterministic
+ *
+ * For simulations and tests that have to be reproducible; tokens and
+ * random numbers are predictable afterwards.
+ *
+ * @param[in] seed Seed of keystream and first message ID
+ */
+void coap_random_seed(const uint64_t seed);
+
+/**
+ * @brief Hash key of a token drawn by coap_token_next()
+ *
+ * The leading bytes, up to four, as they are random already.
+ */
+static inline uint32_t coap_token_key(const uint8_t *token, const size_t len)
+{
+    uint32_t key = 0;
+    for (size_t i = 0; (i < len) && (i < 4); ++i) {
+        key |= (uint32_t)token[i] << (8 * i);
+    }
+    return key;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_RANDOM_H
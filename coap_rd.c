@@ -0,0 +1,1036 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coap_rd.h"
+#include "coap_random.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+
+typedef struct _link _link_t;
+
+typedef struct
+{
+    const char *p;
+    size_t len;
+} _str_t;
+
+/* entry of a link in the list of one rt or if value */
+typedef struct coap_rd_posting
+{
+    coap_rd_term_t *term;               //!< value indexed
+    struct coap_rd_posting *prev, *next;    //!< in the list of term
+    _link_t *link;                      //!< link carrying the value
+} _posting_t;
+
+struct _link
+{
+    coap_rd_registration_t *reg;        //!< registration of the link
+    size_t target, targetlen;           //!< URI in payload, without <>
+    size_t attrs, attrslen;             //!< ";attr=..." in payload
+    uint8_t npostings;                  //!< used entries of postings
+    _posting_t postings[2 * COAP_RD_MAX_VALUES];
+};
+
+/* an rt or if value, with all links carrying it */
+struct coap_rd_term
+{
+    coap_rd_term_t *next;               //!< in hash bucket
+    coap_rd_index_t *index;             //!< index holding it
+    uint32_t hash;                      //!< hash of value
+    size_t count;                       //!< links in postings
+    _posting_t *postings;               //!< links carrying the value
+    size_t len;                         //!< length of value
+    char value[];
+};
+
+struct coap_rd_registration
+{
+    coap_rd_registration_t *next_ep;    //!< in bucket of by_ep
+    coap_rd_registration_t *next_id;    //!< in bucket of by_id
+    uint32_t id;                        //!< location is /rd/{id}
+    uint32_t hash;                      //!< hash of ep
+    uint32_t lifetime;                  //!< seconds
+    uint32_t visit;                     //!< last lookup listing it
+    size_t heap;                        //!< position in expiry heap
+    coap_tick_t expires;                //!< end of lifetime
+    char ep[COAP_RD_MAX_EP + 1];        //!< endpoint name
+    char base[COAP_RD_MAX_BASE + 1];    //!< base URI of relative links
+    char *payload;                      //!< links as registered
+    size_t nlinks;                      //!< number of links
+    _link_t *links;                     //!< links parsed from payload
+};
+
+/* parameters of a request */
+typedef struct
+{
+    _str_t ep, base, rt, ifs;           //!< p is NULL if absent
+    bool has_lt;                        //!< lt present
+    uint32_t lt;                        //!< lifetime in seconds
+    bool other;                         //!< other parameters present
+} _query_t;
+
+/* lookup filter */
+typedef struct
+{
+    coap_rd_registration_t *reg;        //!< endpoint, NULL for all
+    coap_rd_term_t *rt, *ifs;           //!< values, NULL for any
+    bool none;                          //!< some filter matches nothing
+} _filter_t;
+
+/* range of the rendered result going into a block */
+typedef struct
+{
+    uint8_t *buf;                       //!< the block
+    size_t size;                        //!< block size
+    size_t skip;                        //!< offset of the block
+    size_t total;                       //!< bytes rendered so far
+} _window_t;
+
+static const uint8_t _ct_link_format[2] =
+    COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT);
+
+static uint32_t _hash(const char *s, const size_t len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t)s[i]) * 16777619U;
+    }
+    return h;
+}
+
+static bool _str_is(const _str_t *s, const char *value)
+{
+    return (s->len == strlen(value)) && !memcmp(s->p, value, s->len);
+}
+
+static bool _parse_uint(const char *s, const size_t len, uint32_t *value)
+{
+    uint64_t v = 0;
+    if (!len || (len > 10)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if ((s[i] < '0') || (s[i] > '9')) {
+            return false;
+        }
+        v = v * 10 + (uint64_t)(s[i] - '0');
+    }
+    if (v > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)v;
+    return true;
+}
+
+static int _parse_query(const coap_packet_t *inpkt, _query_t *q)
+{
+    memset(q, 0, sizeof(*q));
+    for (size_t i = 0; i < inpkt->numopts; ++i) {
+        const coap_option_t *opt = &inpkt->opts[i];
+        if (opt->num != COAP_OPTION_URI_QUERY) {
+            continue;
+        }
+        const char *s = (const char *)opt->buf.p;
+        const char *eq = memchr(s, '=', opt->buf.len);
+        const _str_t name = {s, eq ? (size_t)(eq - s) : opt->buf.len};
+        const _str_t value = {eq ? eq + 1 : s + opt->buf.len,
+                              eq ? opt->buf.len - name.len - 1 : 0};
+        if (_str_is(&name, "ep")) {
+            q->ep = value;
+        }
+        else if (_str_is(&name, "base")) {
+            q->base = value;
+        }
+        else if (_str_is(&name, "rt")) {
+            q->rt = value;
+        }
+        else if (_str_is(&name, "if")) {
+            q->ifs = value;
+        }
+        else if (_str_is(&name, "lt")) {
+            if (!_parse_uint(value.p, value.len, &q->lt) || !q->lt) {
+                return COAP_ERR_MALFORMED;
+            }
+            q->has_lt = true;
+        }
+        else {
+            q->other = true;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+/* absent, or fit for rendering */
+static bool _valid_base(const _str_t *base)
+{
+    return !base->p || (base->len && (base->len <= COAP_RD_MAX_BASE) &&
+                        !memchr(base->p, '"', base->len));
+}
+
+/*
+ * one pass over a link-format payload, https://tools.ietf.org/html/rfc6690#section-2,
+ * counts the links and fills links unless NULL
+ */
+static int _parse_links(const char *s, const size_t len, _link_t *links,
+                        size_t *count)
+{
+    size_t i = 0, n = 0;
+    while (i < len) {
+        if (s[i] != '<') {
+            return COAP_ERR_MALFORMED;
+        }
+        const size_t target = ++i;
+        while ((i < len) && (s[i] != '>')) {
+            ++i;
+        }
+        if ((i == len) || (i == target)) {
+            return COAP_ERR_MALFORMED;
+        }
+        const size_t attrs = ++i;
+        bool quoted = false;
+        while ((i < len) && (quoted || (s[i] != ','))) {
+            quoted ^= (s[i] == '"');
+            ++i;
+        }
+        if (quoted || ((attrs < i) && (s[attrs] != ';'))) {
+            return COAP_ERR_MALFORMED;
+        }
+        if (links) {
+            links[n].target = target;
+            links[n].targetlen = attrs - 1 - target;
+            links[n].attrs = attrs;
+            links[n].attrslen = i - attrs;
+        }
+        n++;
+        // a comma separates, it does not terminate
+        if ((i < len) && (++i == len)) {
+            return COAP_ERR_MALFORMED;
+        }
+    }
+    *count = n;
+    return COAP_SUCCESS;
+}
+
+/* next ";name=value" of link attributes, value unquoted */
+static bool _next_attr(const char *s, const size_t len, size_t *pos,
+                       _str_t *name, _str_t *value)
+{
+    size_t i = *pos;
+    if ((i >= len) || (s[i] != ';')) {
+        return false;
+    }
+    const size_t n = ++i;
+    while ((i < len) && (s[i] != '=') && (s[i] != ';')) {
+        ++i;
+    }
+    name->p = s + n;
+    name->len = i - n;
+    value->p = s + i;
+    value->len = 0;
+    if ((i < len) && (s[i] == '=')) {
+        const bool quoted = (++i < len) && (s[i] == '"');
+        const size_t v = quoted ? ++i : i;
+        while ((i < len) && (quoted ? (s[i] != '"') : (s[i] != ';'))) {
+            ++i;
+        }
+        value->p = s + v;
+        value->len = i - v;
+        if (quoted && (i < len)) {
+            ++i;
+        }
+    }
+    *pos = i;
+    return true;
+}
+
+static bool _has_attr(const char *s, const size_t len, const char *attr)
+{
+    size_t pos = 0;
+    _str_t name, value;
+    while (_next_attr(s, len, &pos, &name, &value)) {
+        if (_str_is(&name, attr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static coap_rd_term_t *_term_find(const coap_rd_index_t *index, const char *value,
+                                  const size_t len, const uint32_t hash)
+{
+    for (coap_rd_term_t *t = index->buckets[hash & (index->size - 1)]; t; t = t->next) {
+        if ((t->hash == hash) && (t->len == len) && !memcmp(t->value, value, len)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/* keep chains short, rehashing keeps the order within each chain */
+static void _index_grow(coap_rd_index_t *index)
+{
+    const size_t size = 2 * index->size;
+    coap_rd_term_t **buckets = calloc(size, sizeof(*buckets));
+    if (!buckets) {
+        return;     // longer chains, still correct
+    }
+    for (size_t b = 0; b < index->size; ++b) {
+        coap_rd_term_t *t = index->buckets[b];
+        while (t) {
+            coap_rd_term_t *next = t->next;
+            coap_rd_term_t **pt = &buckets[t->hash & (size - 1)];
+            while (*pt) {
+                pt = &(*pt)->next;
+            }
+            t->next = NULL;
+            *pt = t;
+            t = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->size = size;
+}
+
+static int _post(coap_rd_index_t *index, _link_t *link,
+                 const char *value, const size_t len)
+{
+    const uint32_t hash = _hash(value, len);
+    coap_rd_term_t *t = _term_find(index, value, len, hash);
+    // repeated value, the link was just added
+    if (t && (t->postings->link == link)) {
+        return COAP_SUCCESS;
+    }
+    if (link->npostings == sizeof(link->postings) / sizeof(link->postings[0])) {
+        return COAP_SUCCESS;
+    }
+    if (!t) {
+        if (!(t = malloc(sizeof(*t) + len + 1))) {
+            return COAP_ERR_BUSY;
+        }
+        if (index->count >= index->size) {
+            _index_grow(index);
+        }
+        t->index = index;
+        t->hash = hash;
+        t->count = 0;
+        t->postings = NULL;
+        t->len = len;
+        memcpy(t->value, value, len);
+        t->value[len] = '\0';
+        t->next = index->buckets[hash & (index->size - 1)];
+        index->buckets[hash & (index->size - 1)] = t;
+        index->count++;
+    }
+    _posting_t *p = &link->postings[link->npostings++];
+    p->term = t;
+    p->link = link;
+    p->prev = NULL;
+    p->next = t->postings;
+    if (t->postings) {
+        t->postings->prev = p;
+    }
+    t->postings = p;
+    t->count++;
+    return COAP_SUCCESS;
+}
+
+static void _unpost(_posting_t *p)
+{
+    coap_rd_term_t *t = p->term;
+    if (p->prev) {
+        p->prev->next = p->next;
+    }
+    else {
+        t->postings = p->next;
+    }
+    if (p->next) {
+        p->next->prev = p->prev;
+    }
+    if (--t->count) {
+        return;
+    }
+    // last link gone, drop the value
+    coap_rd_term_t **pt = &t->index->buckets[t->hash & (t->index->size - 1)];
+    while (*pt != t) {
+        pt = &(*pt)->next;
+    }
+    *pt = t->next;
+    t->index->count--;
+    free(t);
+}
+
+/* index each space separated value of rt and if attributes */
+static int _index_link(coap_rd_t *rd, _link_t *link)
+{
+    const char *attrs = link->reg->payload + link->attrs;
+    size_t pos = 0;
+    _str_t name, value;
+    while (_next_attr(attrs, link->attrslen, &pos, &name, &value)) {
+        coap_rd_index_t *index = _str_is(&name, "rt") ? &rd->by_rt :
+                                 _str_is(&name, "if") ? &rd->by_if : NULL;
+        unsigned n = 0;
+        for (size_t i = 0; index && (i < value.len) && (n < COAP_RD_MAX_VALUES); ) {
+            size_t e = i;
+            while ((e < value.len) && (value.p[e] != ' ')) {
+                ++e;
+            }
+            if (e > i) {
+                int rc = _post(index, link, value.p + i, e - i);
+                if (rc) {
+                    return rc;
+                }
+                n++;
+            }
+            i = e + 1;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+static void _unindex_links(coap_rd_registration_t *reg)
+{
+    for (size_t i = 0; i < reg->nlinks; ++i) {
+        _link_t *link = &reg->links[i];
+        while (link->npostings) {
+            _unpost(&link->postings[--link->npostings]);
+        }
+    }
+}
+
+/* replace the links of a registration, payload is valid with count links */
+static int _set_links(coap_rd_t *rd, coap_rd_registration_t *reg,
+                      const coap_buffer_t *payload, size_t count)
+{
+    char *copy = malloc(payload->len + 1);
+    _link_t *links = calloc(count ? count : 1, sizeof(_link_t));
+    if (!copy || !links) {
+        free(copy);
+        free(links);
+        return COAP_ERR_BUSY;
+    }
+    memcpy(copy, payload->p, payload->len);
+    copy[payload->len] = '\0';
+    _parse_links(copy, payload->len, links, &count);
+
+    _unindex_links(reg);
+    free(reg->payload);
+    free(reg->links);
+    rd->links -= reg->nlinks;
+    reg->payload = copy;
+    reg->links = links;
+    reg->nlinks = count;
+    rd->links += count;
+    for (size_t i = 0; i < count; ++i) {
+        links[i].reg = reg;
+        int rc = _index_link(rd, &links[i]);
+        if (rc) {
+            return rc;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+/* min-heap on expiry, the registrations are its entries */
+static void _heap_set(coap_rd_t *rd, const size_t i, coap_rd_registration_t *reg)
+{
+    rd->expiry[i] = reg;
+    reg->heap = i;
+}
+
+static void _heap_fix(coap_rd_t *rd, size_t i)
+{
+    coap_rd_registration_t *reg = rd->expiry[i];
+    while (i && (rd->expiry[(i - 1) / 2]->expires > reg->expires)) {
+        _heap_set(rd, i, rd->expiry[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= rd->registrations) {
+            break;
+        }
+        if ((c + 1 < rd->registrations) &&
+            (rd->expiry[c + 1]->expires < rd->expiry[c]->expires)) {
+            c++;
+        }
+        if (rd->expiry[c]->expires >= reg->expires) {
+            break;
+        }
+        _heap_set(rd, i, rd->expiry[c]);
+        i = c;
+    }
+    _heap_set(rd, i, reg);
+}
+
+static int _heap_push(coap_rd_t *rd, coap_rd_registration_t *reg)
+{
+    if (rd->registrations == rd->expiry_size) {
+        const size_t size = rd->expiry_size ? 2 * rd->expiry_size : 64;
+        coap_rd_registration_t **expiry = realloc(rd->expiry, size * sizeof(*expiry));
+        if (!expiry) {
+            return COAP_ERR_BUSY;
+        }
+        rd->expiry = expiry;
+        rd->expiry_size = size;
+    }
+    _heap_set(rd, rd->registrations++, reg);
+    _heap_fix(rd, reg->heap);
+    return COAP_SUCCESS;
+}
+
+static void _heap_remove(coap_rd_t *rd, coap_rd_registration_t *reg)
+{
+    coap_rd_registration_t *last = rd->expiry[--rd->registrations];
+    if (last != reg) {
+        _heap_set(rd, reg->heap, last);
+        _heap_fix(rd, last->heap);
+    }
+}
+
+static coap_rd_registration_t *_find_ep(coap_rd_t *rd, const char *ep,
+                                        const size_t len)
+{
+    const uint32_t hash = _hash(ep, len);
+    for (coap_rd_registration_t *reg = rd->by_ep[hash & (rd->buckets - 1)]; reg; reg = reg->next_ep) {
+        if ((reg->hash == hash) && !strncmp(reg->ep, ep, len) && !reg->ep[len]) {
+            return reg;
+        }
+    }
+    return NULL;
+}
+
+static coap_rd_registration_t *_find_id(coap_rd_t *rd, const uint32_t id)
+{
+    for (coap_rd_registration_t *reg = rd->by_id[id & (rd->buckets - 1)]; reg; reg = reg->next_id) {
+        if (reg->id == id) {
+            return reg;
+        }
+    }
+    return NULL;
+}
+
+static void _link_reg(coap_rd_t *rd, coap_rd_registration_t *reg)
+{
+    const size_t mask = rd->buckets - 1;
+    reg->next_ep = rd->by_ep[reg->hash & mask];
+    rd->by_ep[reg->hash & mask] = reg;
+    reg->next_id = rd->by_id[reg->id & mask];
+    rd->by_id[reg->id & mask] = reg;
+}
+
+/* double the buckets of by_ep and by_id, called before adding to the heap */
+static void _grow(coap_rd_t *rd)
+{
+    const size_t size = 2 * rd->buckets;
+    coap_rd_registration_t **by_ep = calloc(size, sizeof(*by_ep));
+    coap_rd_registration_t **by_id = calloc(size, sizeof(*by_id));
+    if (!by_ep || !by_id) {
+        free(by_ep);
+        free(by_id);
+        return;     // longer chains, still correct
+    }
+    free(rd->by_ep);
+    free(rd->by_id);
+    rd->by_ep = by_ep;
+    rd->by_id = by_id;
+    rd->buckets = size;
+    for (size_t i = 0; i < rd->registrations; ++i) {
+        _link_reg(rd, rd->expiry[i]);
+    }
+}
+
+static void _remove(coap_rd_t *rd, coap_rd_registration_t *reg)
+{
+    coap_rd_registration_t **pr = &rd->by_ep[reg->hash & (rd->buckets - 1)];
+    while (*pr != reg) {
+        pr = &(*pr)->next_ep;
+    }
+    *pr = reg->next_ep;
+    pr = &rd->by_id[reg->id & (rd->buckets - 1)];
+    while (*pr != reg) {
+        pr = &(*pr)->next_id;
+    }
+    *pr = reg->next_id;
+    _heap_remove(rd, reg);
+    _unindex_links(reg);
+    rd->links -= reg->nlinks;
+    rd->generation++;
+    free(reg->payload);
+    free(reg->links);
+    free(reg);
+}
+
+/* copy the part of the result falling into the block */
+static void _put(_window_t *w, const char *s, const size_t len)
+{
+    const size_t end = w->skip + w->size;
+    if ((w->total < end) && (w->total + len > w->skip)) {
+        const size_t from = (w->total > w->skip) ? w->total : w->skip;
+        const size_t to = (w->total + len < end) ? w->total + len : end;
+        memcpy(w->buf + (from - w->skip), s + (from - w->total), to - from);
+    }
+    w->total += len;
+}
+
+static void _puts(_window_t *w, const char *s)
+{
+    _put(w, s, strlen(s));
+}
+
+/* rendered past the block, whether more follows is known */
+static bool _full(const _window_t *w)
+{
+    return w->total > w->skip + w->size;
+}
+
+static bool _is_absolute(const char *uri, const size_t len)
+{
+    for (size_t i = 0; (i < len) && (uri[i] != '/'); ++i) {
+        if (uri[i] == ':') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* link with absolute target and anchor, https://tools.ietf.org/html/rfc9176#section-7.2 */
+static void _put_link(_window_t *w, const _link_t *link)
+{
+    const coap_rd_registration_t *reg = link->reg;
+    const char *target = reg->payload + link->target;
+    const char *attrs = reg->payload + link->attrs;
+    _puts(w, w->total ? ",<" : "<");
+    if (!_is_absolute(target, link->targetlen)) {
+        _puts(w, reg->base);
+        if (target[0] != '/') {
+            _put(w, "/", 1);
+        }
+    }
+    _put(w, target, link->targetlen);
+    _put(w, ">", 1);
+    _put(w, attrs, link->attrslen);
+    if (!_has_attr(attrs, link->attrslen, "anchor")) {
+        _puts(w, ";anchor=\"");
+        _puts(w, reg->base);
+        _put(w, "\"", 1);
+    }
+}
+
+static void _put_ep(_window_t *w, const coap_rd_registration_t *reg)
+{
+    char buf[COAP_RD_MAX_EP + COAP_RD_MAX_BASE + 64];
+    const int n = snprintf(buf, sizeof(buf), "%s</rd/%u>;ep=\"%s\";base=\"%s\";lt=%u",
+                           w->total ? "," : "", (unsigned)reg->id, reg->ep,
+                           reg->base, (unsigned)reg->lifetime);
+    _put(w, buf, (size_t)n);
+}
+
+static bool _has_term(const _link_t *link, const coap_rd_term_t *t)
+{
+    for (uint8_t i = 0; i < link->npostings; ++i) {
+        if (link->postings[i].term == t) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _match(const _link_t *link, const _filter_t *f)
+{
+    return (!f->rt || _has_term(link, f->rt)) && (!f->ifs || _has_term(link, f->ifs));
+}
+
+/*
+ * remember the item about to be rendered, the last one starting within the
+ * block is where the next block resumes
+ */
+static void _save(coap_rd_t *rd, const _window_t *w, const size_t bucket,
+                  const coap_rd_registration_t *reg, const size_t link,
+                  const _posting_t *posting)
+{
+    coap_rd_cursor_t *c = &rd->cursor;
+    if (w->total <= w->skip + w->size) {
+        c->offset = w->total;
+        c->bucket = bucket;
+        c->reg = reg;
+        c->link = link;
+        c->posting = posting;
+        c->seen = reg->visit == rd->visit;
+    }
+}
+
+/* links, or endpoints with a link, of one registration from link on */
+static void _render_reg(coap_rd_t *rd, const _filter_t *f, const bool endpoints,
+                        const size_t bucket, const coap_rd_registration_t *reg,
+                        const size_t link, _window_t *w)
+{
+    for (size_t i = link; (i < reg->nlinks) && !_full(w); ++i) {
+        if (!_match(&reg->links[i], f)) {
+            continue;
+        }
+        _save(rd, w, bucket, reg, i, NULL);
+        if (endpoints) {
+            _put_ep(w, reg);
+            return;
+        }
+        _put_link(w, &reg->links[i]);
+    }
+    if (endpoints && !reg->nlinks && !f->rt && !f->ifs) {
+        _save(rd, w, bucket, reg, 0, NULL);
+        _put_ep(w, reg);
+    }
+}
+
+/* the cursor points into the result asked for, at or before the block */
+static bool _resumable(const coap_rd_t *rd, const _filter_t *f, const bool endpoints,
+                       const _window_t *w)
+{
+    const coap_rd_cursor_t *c = &rd->cursor;
+    return c->valid && (c->generation == rd->generation) && (c->visit == rd->visit) &&
+           (c->endpoints == endpoints) && (c->ep == f->reg) && (c->rt == f->rt) &&
+           (c->ifs == f->ifs) && (c->offset <= w->skip);
+}
+
+/*
+ * render the result up to the end of the block, from the indexes, or from
+ * where the last block of the same result stopped
+ */
+static void _render(coap_rd_t *rd, const _filter_t *f, const bool endpoints,
+                    _window_t *w)
+{
+    coap_rd_cursor_t *c = &rd->cursor;
+    if (f->none) {
+        return;
+    }
+    const coap_rd_term_t *by = (f->rt && (!f->ifs || (f->rt->count <= f->ifs->count))) ?
+                               f->rt : f->ifs;
+    const bool resume = _resumable(rd, f, endpoints, w);
+    if (resume) {
+        w->total = c->offset;
+    }
+    else {
+        if (!f->reg && by) {
+            rd->visit++;
+        }
+        memset(c, 0, sizeof(*c));
+        c->valid = true;
+        c->endpoints = endpoints;
+        c->generation = rd->generation;
+        c->visit = rd->visit;
+        c->ep = f->reg;
+        c->rt = f->rt;
+        c->ifs = f->ifs;
+        c->reg = f->reg;
+        c->posting = (!f->reg && by) ? by->postings : NULL;
+    }
+    if (f->reg) {
+        _render_reg(rd, f, endpoints, 0, f->reg, c->link, w);
+    }
+    else if (by) {
+        // walk the shorter list, check the other value on the way
+        const _posting_t *p = c->posting;
+        if (resume && p && endpoints) {
+            // listed by the block before only if it was before the cursor
+            p->link->reg->visit = c->seen ? rd->visit : rd->visit - 1;
+        }
+        for (; p && !_full(w); p = p->next) {
+            coap_rd_registration_t *reg = p->link->reg;
+            if (!_match(p->link, f)) {
+                continue;
+            }
+            _save(rd, w, 0, reg, 0, p);
+            if (!endpoints) {
+                _put_link(w, p->link);
+            }
+            else if (reg->visit != rd->visit) {
+                reg->visit = rd->visit;
+                _put_ep(w, reg);
+            }
+        }
+    }
+    else {
+        const coap_rd_registration_t *reg = c->reg;
+        size_t link = c->link;
+        for (size_t b = c->bucket; (b < rd->buckets) && !_full(w); ++b) {
+            for (reg = reg ? reg : rd->by_id[b]; reg && !_full(w); reg = reg->next_id) {
+                _render_reg(rd, f, endpoints, b, reg, link, w);
+                link = 0;
+            }
+        }
+    }
+}
+
+static int _make_response(const coap_packet_t *inpkt,
+                          const coap_responsecode_t rspcode,
+                          const uint8_t *content_type,
+                          const uint8_t *content, const size_t content_len,
+                          coap_packet_t *pkt)
+{
+    if (inpkt->hdr.t == COAP_TYPE_CON) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                                  rspcode, content_type, content, content_len, pkt);
+    }
+    return coap_make_response(coap_msgid_next(), &inpkt->tok, COAP_TYPE_NONCON,
+                              rspcode, content_type, content, content_len, pkt);
+}
+
+static uint8_t _max_szx(void)
+{
+    uint8_t szx = 0;
+    while ((szx < 6) && ((32u << szx) <= COAP_RD_MAX_BLOCK)) {
+        szx++;
+    }
+    return szx;
+}
+
+/* the block of the result asked for, https://tools.ietf.org/html/rfc7959#section-2.4 */
+static int _respond_result(coap_rd_t *rd, const coap_packet_t *inpkt,
+                           const _filter_t *f, const bool endpoints,
+                           coap_packet_t *pkt)
+{
+    coap_block_t block = {0, false, _max_szx()};
+    const bool blockwise = !coap_get_block_option(inpkt, COAP_OPTION_BLOCK2, &block);
+    if (blockwise && (block.szx > _max_szx())) {
+        // smaller blocks than asked for, same offset
+        block.num <<= block.szx - _max_szx();
+        block.szx = _max_szx();
+    }
+    _window_t w = {rd->block, (size_t)16 << block.szx,
+                   (size_t)block.num << (block.szx + 4), 0};
+    _render(rd, f, endpoints, &w);
+    if (w.skip && (w.total <= w.skip)) {
+        return _make_response(inpkt, COAP_RSPCODE_BAD_OPTION, NULL, NULL, 0, pkt);
+    }
+    block.more = _full(&w);
+    const size_t len = block.more ? w.size : w.total - w.skip;
+    int rc = _make_response(inpkt, COAP_RSPCODE_CONTENT, _ct_link_format,
+                            rd->block, len, pkt);
+    for (size_t i = 0; i < sizeof(rd->etag); ++i) {
+        rd->etag[i] = (uint8_t)(rd->generation >> (24 - 8 * i));
+    }
+    coap_add_option(pkt, COAP_OPTION_ETAG, rd->etag, sizeof(rd->etag));
+    if (blockwise || block.more) {
+        coap_add_option(pkt, COAP_OPTION_BLOCK2, rd->block2,
+                        coap_encode_block_option(&block, rd->block2));
+    }
+    return rc;
+}
+
+/* https://tools.ietf.org/html/rfc9176#section-5.3 */
+static int _register(coap_rd_t *rd, const coap_endpoint_t *from,
+                     const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    static const uint8_t rd_path[] = {'r', 'd'};
+    _query_t q;
+    uint32_t ct;
+    size_t count;
+    char base[COAP_RD_MAX_BASE + 1];
+
+    if (inpkt->hdr.code != COAP_METHOD_POST) {
+        return _make_response(inpkt, COAP_RSPCODE_METHOD_NOT_ALLOWED, NULL, NULL, 0, pkt);
+    }
+    if (!coap_get_option_uint(inpkt, COAP_OPTION_CONTENT_FORMAT, &ct) &&
+        (ct != COAP_CONTENTTYPE_APP_LINKFORMAT)) {
+        return _make_response(inpkt, COAP_RSPCODE_UNSUPPORTED_CONTENT_FMT, NULL, NULL, 0, pkt);
+    }
+    if (_parse_query(inpkt, &q) || !q.ep.p || !q.ep.len || (q.ep.len > COAP_RD_MAX_EP) ||
+        memchr(q.ep.p, '"', q.ep.len) ||
+        !_valid_base(&q.base) ||
+        _parse_links((const char *)inpkt->payload.p, inpkt->payload.len, NULL, &count)) {
+        return _make_response(inpkt, COAP_RSPCODE_BAD_REQUEST, NULL, NULL, 0, pkt);
+    }
+    if (q.base.p) {
+        memcpy(base, q.base.p, q.base.len);
+        base[q.base.len] = '\0';
+    }
+    else if (!rd->base || rd->base(rd->base_ctx, from, base, sizeof(base))) {
+        return _make_response(inpkt, COAP_RSPCODE_BAD_REQUEST, NULL, NULL, 0, pkt);
+    }
+
+    // a new registration, or one replacing that of the same endpoint
+    coap_rd_registration_t *reg = _find_ep(rd, q.ep.p, q.ep.len);
+    if (!reg) {
+        if (rd->registrations >= rd->buckets) {
+            _grow(rd);
+        }
+        if (!(reg = calloc(1, sizeof(*reg))) || _heap_push(rd, reg)) {
+            free(reg);
+            return _make_response(inpkt, COAP_RSPCODE_SERVICE_UNAVAILABLE, NULL, NULL, 0, pkt);
+        }
+        do {
+            reg->id = ++rd->next_id;
+        } while (!reg->id || _find_id(rd, reg->id));
+        memcpy(reg->ep, q.ep.p, q.ep.len);
+        reg->hash = _hash(q.ep.p, q.ep.len);
+        _link_reg(rd, reg);
+    }
+    rd->generation++;
+    if (_set_links(rd, reg, &inpkt->payload, count)) {
+        _remove(rd, reg);
+        return _make_response(inpkt, COAP_RSPCODE_SERVICE_UNAVAILABLE, NULL, NULL, 0, pkt);
+    }
+    strcpy(reg->base, base);
+    reg->lifetime = q.has_lt ? q.lt : COAP_RD_DEFAULT_LIFETIME;
+    reg->expires = coap_clock_now() + (coap_tick_t)reg->lifetime * COAP_TICKS_PER_SEC;
+    _heap_fix(rd, reg->heap);
+
+    int rc = _make_response(inpkt, COAP_RSPCODE_CREATED, NULL, NULL, 0, pkt);
+    const int n = snprintf((char *)rd->location, sizeof(rd->location), "%u",
+                           (unsigned)reg->id);
+    coap_add_option(pkt, COAP_OPTION_LOCATION_PATH, rd_path, sizeof(rd_path));
+    coap_add_option(pkt, COAP_OPTION_LOCATION_PATH, rd->location, (size_t)n);
+    return rc;
+}
+
+/* https://tools.ietf.org/html/rfc9176#section-5.3.1 and following */
+static int _registration(coap_rd_t *rd, const coap_buffer_t *id,
+                         const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    _query_t q;
+    uint32_t value;
+    coap_rd_registration_t *reg = NULL;
+
+    if (_parse_uint((const char *)id->p, id->len, &value)) {
+        reg = _find_id(rd, value);
+    }
+    if (!reg) {
+        return _make_response(inpkt, COAP_RSPCODE_NOT_FOUND, NULL, NULL, 0, pkt);
+    }
+    switch (inpkt->hdr.code) {
+    case COAP_METHOD_GET: {
+        const _filter_t f = {reg, NULL, NULL, false};
+        return _respond_result(rd, inpkt, &f, false, pkt);
+    }
+    case COAP_METHOD_POST:
+        // update, lifetime and base only
+        if (_parse_query(inpkt, &q) || inpkt->payload.len || !_valid_base(&q.base)) {
+            return _make_response(inpkt, COAP_RSPCODE_BAD_REQUEST, NULL, NULL, 0, pkt);
+        }
+        if (q.base.p) {
+            memcpy(reg->base, q.base.p, q.base.len);
+            reg->base[q.base.len] = '\0';
+        }
+        if (q.has_lt) {
+            reg->lifetime = q.lt;
+        }
+        reg->expires = coap_clock_now() + (coap_tick_t)reg->lifetime * COAP_TICKS_PER_SEC;
+        _heap_fix(rd, reg->heap);
+        rd->generation++;
+        return _make_response(inpkt, COAP_RSPCODE_CHANGED, NULL, NULL, 0, pkt);
+    case COAP_METHOD_DELETE:
+        _remove(rd, reg);
+        return _make_response(inpkt, COAP_RSPCODE_DELETED, NULL, NULL, 0, pkt);
+    default:
+        return _make_response(inpkt, COAP_RSPCODE_METHOD_NOT_ALLOWED, NULL, NULL, 0, pkt);
+    }
+}
+
+/* https://tools.ietf.org/html/rfc9176#section-7 */
+static int _lookup(coap_rd_t *rd, const bool endpoints,
+                   const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    _query_t q;
+    _filter_t f = {NULL, NULL, NULL, false};
+
+    if (inpkt->hdr.code != COAP_METHOD_GET) {
+        return _make_response(inpkt, COAP_RSPCODE_METHOD_NOT_ALLOWED, NULL, NULL, 0, pkt);
+    }
+    if (_parse_query(inpkt, &q) || q.other || q.base.p || q.has_lt) {
+        return _make_response(inpkt, COAP_RSPCODE_BAD_REQUEST, NULL, NULL, 0, pkt);
+    }
+    if (q.ep.p) {
+        f.reg = _find_ep(rd, q.ep.p, q.ep.len);
+        f.none |= !f.reg;
+    }
+    if (q.rt.p) {
+        f.rt = _term_find(&rd->by_rt, q.rt.p, q.rt.len, _hash(q.rt.p, q.rt.len));
+        f.none |= !f.rt;
+    }
+    if (q.ifs.p) {
+        f.ifs = _term_find(&rd->by_if, q.ifs.p, q.ifs.len, _hash(q.ifs.p, q.ifs.len));
+        f.none |= !f.ifs;
+    }
+    return _respond_result(rd, inpkt, &f, endpoints, pkt);
+}
+
+static bool _segment_is(const coap_option_t *opt, const char *s)
+{
+    return (opt->buf.len == strlen(s)) && !memcmp(opt->buf.p, s, opt->buf.len);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_rd_init(coap_rd_t *rd, coap_rd_base_fn base, void *ctx)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->base = base;
+    rd->base_ctx = ctx;
+    rd->buckets = rd->by_rt.size = rd->by_if.size = COAP_RD_BUCKETS;
+    rd->by_ep = calloc(COAP_RD_BUCKETS, sizeof(*rd->by_ep));
+    rd->by_id = calloc(COAP_RD_BUCKETS, sizeof(*rd->by_id));
+    rd->by_rt.buckets = calloc(COAP_RD_BUCKETS, sizeof(*rd->by_rt.buckets));
+    rd->by_if.buckets = calloc(COAP_RD_BUCKETS, sizeof(*rd->by_if.buckets));
+    if (!rd->by_ep || !rd->by_id || !rd->by_rt.buckets || !rd->by_if.buckets) {
+        coap_rd_free(rd);
+        return COAP_ERR_BUSY;
+    }
+    return COAP_SUCCESS;
+}
+
+void coap_rd_free(coap_rd_t *rd)
+{
+    while (rd->registrations) {
+        _remove(rd, rd->expiry[0]);
+    }
+    free(rd->by_ep);
+    free(rd->by_id);
+    free(rd->by_rt.buckets);
+    free(rd->by_if.buckets);
+    free(rd->expiry);
+    rd->by_ep = rd->by_id = NULL;
+    rd->by_rt.buckets = rd->by_if.buckets = NULL;
+    rd->expiry = NULL;
+    rd->expiry_size = 0;
+}
+
+int coap_rd_handle_request(coap_rd_t *rd, const coap_endpoint_t *from,
+                           const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    uint8_t count;
+    const coap_option_t *opt = coap_find_uri_path(inpkt, &count);
+
+    if (!opt || (inpkt->hdr.code == COAP_RSPCODE_EMPTY) ||
+        (inpkt->hdr.code >= MAKE_RSPCODE(2, 0))) {
+        return COAP_ERR_REQUEST_NOT_FOUND;
+    }
+    coap_rd_poll(rd);
+    if (_segment_is(&opt[0], "rd")) {
+        if (count == 1) {
+            return _register(rd, from, inpkt, pkt);
+        }
+        if (count == 2) {
+            return _registration(rd, &opt[1].buf, inpkt, pkt);
+        }
+    }
+    else if ((count == 2) && _segment_is(&opt[0], "rd-lookup")) {
+        if (_segment_is(&opt[1], "res")) {
+            return _lookup(rd, false, inpkt, pkt);
+        }
+        if (_segment_is(&opt[1], "ep")) {
+            return _lookup(rd, true, inpkt, pkt);
+        }
+    }
+    return COAP_ERR_REQUEST_NOT_FOUND;
+}
+
+coap_tick_t coap_rd_poll(coap_rd_t *rd)
+{
+    const coap_tick_t now = coap_clock_now();
+    while (rd->registrations && (rd->expiry[0]->expires <= now)) {
+        _remove(rd, rd->expiry[0]);
+    }
+    return rd->registrations ? rd->expiry[0]->expires : COAP_TICK_NEVER;
+}
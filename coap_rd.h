@@ -0,0 +1,176 @@
+#ifndef COAP_RD_H
+#define COAP_RD_H 1
+
+/**
+ * @file coap_rd.h
+ *
+ * Resource Directory, see https://tools.ietf.org/html/rfc9176
+ *
+ * Endpoints register their links by POST to /rd?ep=name with a link-format
+ * payload, the directory answers with the location /rd/{id} of the
+ * registration. POST to the location refreshes the lifetime or changes
+ * lifetime and base, DELETE removes it and GET returns the links
+ * registered. Registrations expire after their lifetime.
+ *
+ * Lookups at /rd-lookup/res and /rd-lookup/ep are filtered by ep, rt and
+ * if. Registrations are indexed by endpoint name and links by each value of
+ * their rt and if attributes, so a filtered lookup visits the matching links
+ * only. Results are rendered block by block, large ones are paged with
+ * Block2 and carry an ETag that changes with every modification of the
+ * directory. Rendering stops at the end of the block, the next block of the
+ * same result resumes where it stopped while the ETag is unchanged.
+ *
+ * Not supported: sectors (d), simple registration, lookup filters on other
+ * attributes and wildcards in filter values.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "coap.h"
+#include "coap_time.h"
+
+#ifndef COAP_RD_BUCKETS
+#define COAP_RD_BUCKETS         256     //!< initial hash buckets per index, power of 2
+#endif
+#ifndef COAP_RD_MAX_VALUES
+#define COAP_RD_MAX_VALUES      4       //!< rt and if values indexed per link
+#endif
+#ifndef COAP_RD_MAX_BLOCK
+#define COAP_RD_MAX_BLOCK       1024    //!< max. Block2 size, power of 2
+#endif
+#ifndef COAP_RD_MAX_EP
+#define COAP_RD_MAX_EP          63      //!< max. length of endpoint names
+#endif
+#ifndef COAP_RD_MAX_BASE
+#define COAP_RD_MAX_BASE        95      //!< max. length of base URIs
+#endif
+
+#define COAP_RD_DEFAULT_LIFETIME    90000   //!< seconds, if lt is absent
+
+/**
+ * @brief callback function making the base URI of a registering endpoint
+ *
+ * Used if a registration carries no base parameter.
+ *
+ * @param[in] ctx Context given to coap_rd_init()
+ * @param[in] ep Source of the registration
+ * @param[out] buf Receives the URI, e.g. "coap://192.0.2.1:5683"
+ * @param[in] buflen Size of \p buf
+ *
+ * @return 0 on success, some error code otherwise
+ */
+typedef int (*coap_rd_base_fn)(void *ctx, const coap_endpoint_t *ep,
+                               char *buf, const size_t buflen);
+
+typedef struct coap_rd_registration coap_rd_registration_t;
+typedef struct coap_rd_term coap_rd_term_t;
+typedef struct coap_rd_posting coap_rd_posting_t;
+
+/**
+ * Index of link attribute values, doubles its buckets as values are added
+ */
+typedef struct coap_rd_index
+{
+    coap_rd_term_t **buckets;           //!< hash buckets
+    size_t size;                        //!< number of buckets, power of 2
+    size_t count;                       //!< distinct values
+} coap_rd_index_t;
+
+/**
+ * Where rendering of the last lookup result stopped, valid for the
+ * generation and filter rendered
+ */
+typedef struct coap_rd_cursor
+{
+    bool valid;                         //!< a result was rendered
+    bool endpoints;                     //!< endpoints rather than links
+    bool seen;                          //!< endpoint of posting listed before it
+    uint32_t generation;                //!< of the directory rendered
+    uint32_t visit;                     //!< marks of the endpoints listed
+    const coap_rd_registration_t *ep;   //!< ep filter, NULL for all
+    const coap_rd_term_t *rt, *ifs;     //!< rt and if filters, NULL for any
+    size_t offset;                      //!< of the next item in the result
+    size_t bucket;                      //!< of reg in by_id
+    const coap_rd_registration_t *reg;  //!< of the next item
+    size_t link;                        //!< of the next item in reg
+    const coap_rd_posting_t *posting;   //!< next item, walking an rt or if value
+} coap_rd_cursor_t;
+
+/**
+ * Resource Directory state
+ */
+typedef struct coap_rd
+{
+    coap_rd_base_fn base;               //!< makes base URIs, may be NULL
+    void *base_ctx;                     //!< context of base
+    coap_rd_registration_t **by_ep;     //!< index on endpoint name
+    coap_rd_registration_t **by_id;     //!< index on registration ID
+    size_t buckets;                     //!< of by_ep and by_id, power of 2
+    coap_rd_index_t by_rt;              //!< index on rt values
+    coap_rd_index_t by_if;              //!< index on if values
+    coap_rd_registration_t **expiry;    //!< min-heap on expiry
+    size_t expiry_size;                 //!< allocated entries of expiry
+    size_t registrations;               //!< registrations stored
+    size_t links;                       //!< links stored
+    uint32_t next_id;                   //!< ID of next registration
+    uint32_t generation;                //!< changed by each modification
+    uint32_t visit;                     //!< marks registrations seen in a lookup
+    coap_rd_cursor_t cursor;            //!< resume point of the last lookup
+    uint8_t location[10];               //!< Location-Path value of the ID
+    uint8_t etag[4];                    //!< ETag value of lookup results
+    uint8_t block2[3];                  //!< Block2 value of lookup results
+    uint8_t block[COAP_RD_MAX_BLOCK];   //!< payload of lookup results
+} coap_rd_t;
+
+/**
+ * @brief Initialize an empty directory
+ *
+ * @param[out] rd The directory
+ * @param[in] base Callback making base URIs from source addresses, if NULL
+ * registrations must carry a base parameter
+ * @param[in] ctx Context passed to \p base
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if out of memory
+ */
+int coap_rd_init(coap_rd_t *rd, coap_rd_base_fn base, void *ctx);
+
+/**
+ * @brief Free all registrations and indexes
+ */
+void coap_rd_free(coap_rd_t *rd);
+
+/**
+ * @brief Handle a request addressed to the directory
+ *
+ * @param[in,out] rd The directory
+ * @param[in] from Source of the request
+ * @param[in] inpkt The request
+ * @param[out] pkt The response, referring to \p inpkt and \p rd, to be
+ * built right away
+ *
+ * @return COAP_STATE_RSP_SEND if \p pkt holds the response, or
+ * COAP_ERR_REQUEST_NOT_FOUND if \p inpkt is not for the directory.
+ */
+int coap_rd_handle_request(coap_rd_t *rd, const coap_endpoint_t *from,
+                           const coap_packet_t *inpkt, coap_packet_t *pkt);
+
+/**
+ * @brief Remove expired registrations
+ *
+ * Also done by coap_rd_handle_request().
+ *
+ * @return time the next registration expires, or COAP_TICK_NEVER
+ */
+coap_tick_t coap_rd_poll(coap_rd_t *rd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_RD_H
@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap_registry.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+struct coap_registry_retired
+{
+    coap_resource_t *resources;         //!< replaced table
+    uint64_t epoch;                     //!< readers at this epoch cannot see it
+    coap_registry_retired_t *next;
+};
+
+/* resource structs have const members, they are copied as bytes */
+static coap_resource_t *_alloc_table(const size_t count)
+{
+    // one more for the terminator, all zero
+    return calloc(count + 1, sizeof(coap_resource_t));
+}
+
+/*
+ * copy the description of resources, not the state of an exchange, which
+ * belongs to whoever dispatched from the source
+ */
+static void _copy(coap_resource_t *dst, const coap_resource_t *src, const size_t count)
+{
+    memcpy(dst, src, count * sizeof(coap_resource_t));
+    for (size_t i = 0; i < count; ++i) {
+        dst[i].state = COAP_STATE_RDY;
+    }
+}
+
+static bool _same_path(const coap_resource_path_t *a, const coap_resource_path_t *b)
+{
+    if (a == b) {
+        return true;
+    }
+    if (!a || !b || (a->count != b->count)) {
+        return false;
+    }
+    for (int i = 0; i < a->count; ++i) {
+        if (strcmp(a->items[i], b->items[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* oldest epoch any reader may still be in, called with the lock held */
+static uint64_t _min_epoch(coap_registry_t *reg)
+{
+    uint64_t min = __atomic_load_n(&reg->epoch, __ATOMIC_ACQUIRE);
+    for (coap_registry_reader_t *r = reg->readers; r; r = r->next) {
+        const uint64_t epoch = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+        if (epoch < min) {
+            min = epoch;
+        }
+    }
+    return min;
+}
+
+static unsigned _reclaim(coap_registry_t *reg)
+{
+    const uint64_t min = _min_epoch(reg);
+    unsigned waiting = 0;
+    coap_registry_retired_t **pr = &reg->retired;
+    while (*pr) {
+        coap_registry_retired_t *r = *pr;
+        if (r->epoch <= min) {
+            *pr = r->next;
+            free(r->resources);
+            free(r);
+        }
+        else {
+            waiting++;
+            pr = &r->next;
+        }
+    }
+    return waiting;
+}
+
+/*
+ * publish a new table, called with the lock held; readers loading the table
+ * after they saw the new epoch get the new one, so the old one is safe to
+ * free once all readers passed a quiescent state at that epoch
+ */
+static int _publish(coap_registry_t *reg, coap_resource_t *resources, const size_t count)
+{
+    coap_registry_retired_t *r = malloc(sizeof(*r));
+    if (!r) {
+        free(resources);
+        return COAP_ERR_BUSY;
+    }
+    r->resources = reg->resources;
+    __atomic_store_n(&reg->resources, resources, __ATOMIC_SEQ_CST);
+    r->epoch = __atomic_add_fetch(&reg->epoch, 1, __ATOMIC_SEQ_CST);
+    r->next = reg->retired;
+    reg->retired = r;
+    reg->count = count;
+    _reclaim(reg);
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_registry_init(coap_registry_t *reg, const coap_resource_t *resources)
+{
+    size_t count = 0;
+    while (resources && resources[count].handler) {
+        count++;
+    }
+    memset(reg, 0, sizeof(*reg));
+    reg->resources = _alloc_table(count);
+    if (!reg->resources) {
+        return COAP_ERR_BUSY;
+    }
+    _copy(reg->resources, resources, count);
+    reg->count = count;
+    pthread_mutex_init(&reg->lock, NULL);
+    return COAP_SUCCESS;
+}
+
+void coap_registry_free(coap_registry_t *reg)
+{
+    while (reg->retired) {
+        coap_registry_retired_t *r = reg->retired;
+        reg->retired = r->next;
+        free(r->resources);
+        free(r);
+    }
+    free(reg->resources);
+    reg->resources = NULL;
+    pthread_mutex_destroy(&reg->lock);
+}
+
+int coap_registry_add(coap_registry_t *reg, const coap_resource_t *resource)
+{
+    pthread_mutex_lock(&reg->lock);
+    const size_t count = reg->count;
+    coap_resource_t *resources = _alloc_table(count + 1);
+    int rc = COAP_ERR_BUSY;
+    if (resources) {
+        _copy(resources, reg->resources, count);
+        _copy(&resources[count], resource, 1);
+        rc = _publish(reg, resources, count + 1);
+    }
+    pthread_mutex_unlock(&reg->lock);
+    return rc;
+}
+
+int coap_registry_remove(coap_registry_t *reg, const coap_resource_path_t *path,
+                         const coap_method_t method)
+{
+    pthread_mutex_lock(&reg->lock);
+    const size_t count = reg->count;
+    coap_resource_t *resources = _alloc_table(count);
+    int rc = COAP_ERR_BUSY;
+    if (resources) {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const coap_resource_t *rs = &reg->resources[i];
+            if ((rs->method != method) || !_same_path(rs->path, path)) {
+                _copy(&resources[kept++], rs, 1);
+            }
+        }
+        if (kept == count) {
+            free(resources);
+            rc = COAP_ERR_REQUEST_NOT_FOUND;
+        }
+        else {
+            rc = _publish(reg, resources, kept);
+        }
+    }
+    pthread_mutex_unlock(&reg->lock);
+    return rc;
+}
+
+unsigned coap_registry_reclaim(coap_registry_t *reg)
+{
+    pthread_mutex_lock(&reg->lock);
+    const unsigned waiting = _reclaim(reg);
+    pthread_mutex_unlock(&reg->lock);
+    return waiting;
+}
+
+void coap_registry_synchronize(coap_registry_t *reg)
+{
+    const struct timespec ts = {0, 100000};
+    while (coap_registry_reclaim(reg)) {
+        nanosleep(&ts, NULL);
+    }
+}
+
+void coap_registry_attach(coap_registry_t *reg, coap_registry_reader_t *reader)
+{
+    pthread_mutex_lock(&reg->lock);
+    // holds no pointer yet, so it is quiescent at the current epoch
+    reader->epoch = __atomic_load_n(&reg->epoch, __ATOMIC_ACQUIRE);
+    reader->next = reg->readers;
+    reg->readers = reader;
+    pthread_mutex_unlock(&reg->lock);
+}
+
+void coap_registry_detach(coap_registry_t *reg, coap_registry_reader_t *reader)
+{
+    pthread_mutex_lock(&reg->lock);
+    for (coap_registry_reader_t **pr = &reg->readers; *pr; pr = &(*pr)->next) {
+        if (*pr == reader) {
+            *pr = reader->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reg->lock);
+}
@@ -0,0 +1,149 @@
+#ifndef COAP_REGISTRY_H
+#define COAP_REGISTRY_H 1
+
+/**
+ * @file coap_registry.h
+ *
+ * Resource table that can change while requests are dispatched.
+ *
+ * The registry holds a NULL-terminated resource array, as given to
+ * coap_handle_packet(). Adding or removing a resource copies the array and
+ * publishes the copy with an atomic store, so dispatching threads read the
+ * table with a single load and walk it exactly like a static one, without
+ * any lock.
+ *
+ * Replaced tables are freed once every reader has passed a quiescent state
+ * after the replacement (quiescent-state-based reclamation). Readers attach
+ * with coap_registry_attach() and call coap_registry_quiescent() whenever
+ * they hold no pointer into the table, e.g. once per coap_udp_run(). A
+ * reader waiting for traffic delays reclamation, not writers: writers never
+ * wait unless they ask to with coap_registry_synchronize().
+ *
+ * The registry copies resource structs, not what they point to. Paths,
+ * formats and response templates of a removed resource must stay valid
+ * until coap_registry_synchronize() returns.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "coap.h"
+
+typedef struct coap_registry_retired coap_registry_retired_t;
+
+/**
+ * Thread dispatching requests from a registry
+ */
+typedef struct coap_registry_reader
+{
+    uint64_t epoch;                     //!< epoch seen at the last quiescent state
+    struct coap_registry_reader *next;  //!< next attached reader
+} coap_registry_reader_t;
+
+/**
+ * Registry
+ */
+typedef struct coap_registry
+{
+    coap_resource_t *resources;         //!< current table, NULL-terminated
+    uint64_t epoch;                     //!< incremented with each table published
+    size_t count;                       //!< resources in the current table
+    pthread_mutex_t lock;               //!< serializes writers and attaching
+    coap_registry_reader_t *readers;    //!< attached readers
+    coap_registry_retired_t *retired;   //!< replaced tables, newest first
+} coap_registry_t;
+
+/**
+ * @brief Initialize with a copy of a resource array
+ *
+ * @param[out] reg The registry
+ * @param[in] resources Array terminated by a resource without handler, may
+ * be NULL for an empty table
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if out of memory
+ */
+int coap_registry_init(coap_registry_t *reg, const coap_resource_t *resources);
+
+/**
+ * @brief Free all tables, readers must be gone
+ */
+void coap_registry_free(coap_registry_t *reg);
+
+/**
+ * @brief Add a resource
+ *
+ * Resources are matched in table order, \p resource goes to the end.
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if out of memory
+ */
+int coap_registry_add(coap_registry_t *reg, const coap_resource_t *resource);
+
+/**
+ * @brief Remove the resources of a path and method
+ *
+ * @param[in,out] reg The registry
+ * @param[in] path Path of the resources, compared item by item
+ * @param[in] method Method of the resources
+ *
+ * @return 0 on success, COAP_ERR_REQUEST_NOT_FOUND if none matched, or
+ * COAP_ERR_BUSY if out of memory
+ */
+int coap_registry_remove(coap_registry_t *reg, const coap_resource_path_t *path,
+                         const coap_method_t method);
+
+/**
+ * @brief Free replaced tables no reader can see any longer
+ *
+ * Done by coap_registry_add() and coap_registry_remove() as well.
+ *
+ * @return number of tables still waiting for their grace period
+ */
+unsigned coap_registry_reclaim(coap_registry_t *reg);
+
+/**
+ * @brief Wait until all replaced tables are freed
+ *
+ * Returns once every attached reader passed a quiescent state, must not be
+ * called by a reader.
+ */
+void coap_registry_synchronize(coap_registry_t *reg);
+
+/**
+ * @brief Attach the calling thread as reader
+ */
+void coap_registry_attach(coap_registry_t *reg, coap_registry_reader_t *reader);
+
+/**
+ * @brief Detach a reader, it must not access the table any longer
+ */
+void coap_registry_detach(coap_registry_t *reg, coap_registry_reader_t *reader);
+
+/**
+ * @brief Current table, for coap_handle_packet() and friends
+ *
+ * Valid until the next coap_registry_quiescent() of the calling reader.
+ */
+static inline coap_resource_t *coap_registry_resources(coap_registry_t *reg)
+{
+    return __atomic_load_n(&reg->resources, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Declare that the calling reader holds no pointer into any table
+ */
+static inline void coap_registry_quiescent(coap_registry_t *reg,
+                                           coap_registry_reader_t *reader)
+{
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&reg->epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_REGISTRY_H
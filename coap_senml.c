@@ -0,0 +1,817 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "coap_senml.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+
+/* position within the pack */
+enum {
+    _STATE_START = 0,       // expect array
+    _STATE_RECORD,          // expect record or end of array
+    _STATE_NEXT,            // JSON only, expect separator or end of array
+    _STATE_DONE,            // pack complete
+};
+
+#define _INDEFINITE     UINT64_MAX
+
+/* labels, https://tools.ietf.org/html/rfc8428#section-6 */
+typedef enum {
+    _LABEL_BVER = -1,
+    _LABEL_BN   = -2,
+    _LABEL_BT   = -3,
+    _LABEL_BU   = -4,
+    _LABEL_BV   = -5,
+    _LABEL_BS   = -6,
+    _LABEL_N    = 0,
+    _LABEL_U    = 1,
+    _LABEL_V    = 2,
+    _LABEL_VS   = 3,
+    _LABEL_VB   = 4,
+    _LABEL_S    = 5,
+    _LABEL_T    = 6,
+    _LABEL_UT   = 7,
+    _LABEL_VD   = 8,
+    _LABEL_UNKNOWN = 99,
+} _label_t;
+
+static const struct {
+    const char *name;
+    _label_t label;
+} _labels[] = {
+    {"bn", _LABEL_BN}, {"bt", _LABEL_BT}, {"bu", _LABEL_BU},
+    {"bv", _LABEL_BV}, {"bs", _LABEL_BS}, {"bver", _LABEL_BVER},
+    {"n", _LABEL_N}, {"u", _LABEL_U}, {"v", _LABEL_V}, {"vs", _LABEL_VS},
+    {"vb", _LABEL_VB}, {"s", _LABEL_S}, {"t", _LABEL_T}, {"ut", _LABEL_UT},
+    {"vd", _LABEL_VD},
+};
+
+/* fields of a single record as found in the input */
+typedef struct {
+    uint32_t present;       // bit (label + 8) set if field present
+    coap_buffer_t bn, bu, n, u, vs, vd;
+    double bt, bv, bs, v, s, t, ut;
+    bool vb;
+} _fields_t;
+
+#define _HAS(f, l)      ((f)->present & (1U << ((l) + 8)))
+
+static void _reset(coap_senml_decoder_t *d);
+static _label_t _label_by_name(const coap_buffer_t *key);
+static int _set_field(_fields_t *f, const _label_t label,
+                      const coap_cbor_item_t *val);
+static int _emit(coap_senml_decoder_t *d, const _fields_t *f);
+static size_t _json_ws(const uint8_t *buf, const size_t len, size_t p);
+static int _json_string(const uint8_t *buf, const size_t len, size_t *p,
+                        coap_buffer_t *str);
+static int _json_record(coap_senml_decoder_t *d, const uint8_t *buf,
+                        const size_t len, size_t *used);
+static int _json_step(coap_senml_decoder_t *d, const uint8_t *buf,
+                      const size_t len, size_t *used);
+static int _cbor_record(coap_senml_decoder_t *d, coap_cbor_reader_t *r);
+static int _cbor_step(coap_senml_decoder_t *d, const uint8_t *buf,
+                      const size_t len, size_t *used);
+static int _step(coap_senml_decoder_t *d, const uint8_t *buf,
+                 const size_t len, size_t *used);
+static int _json_put(coap_senml_encoder_t *e, const char *str, size_t len);
+static int _json_put_number(coap_senml_encoder_t *e, const char *key,
+                            double value);
+static int _json_put_string(coap_senml_encoder_t *e, const char *key,
+                            const coap_buffer_t *str, bool base64);
+static int _cbor_put_field(coap_senml_encoder_t *e, _label_t label,
+                           double value);
+
+static void _reset(coap_senml_decoder_t *d)
+{
+    d->state = _STATE_START;
+    d->remaining = 0;
+    d->next_block = 0;
+    d->base_name_len = 0;
+    d->base_unit_len = 0;
+    d->base_time = 0;
+    d->base_value = 0;
+    d->base_sum = 0;
+    d->carry_len = 0;
+}
+
+static _label_t _label_by_name(const coap_buffer_t *key)
+{
+    for (size_t i = 0; i < sizeof(_labels) / sizeof(_labels[0]); ++i) {
+        if ((strlen(_labels[i].name) == key->len) &&
+            !memcmp(_labels[i].name, key->p, key->len)) {
+            return _labels[i].label;
+        }
+    }
+    return _LABEL_UNKNOWN;
+}
+
+/* store a decoded value, the item type has to fit the label */
+static int _set_field(_fields_t *f, const _label_t label,
+                      const coap_cbor_item_t *val)
+{
+    double num = 0;
+    const bool is_text = (val->type == COAP_CBOR_TEXT);
+    const bool is_bool = (val->type == COAP_CBOR_TRUE) ||
+                         (val->type == COAP_CBOR_FALSE);
+    bool is_num = true;
+    switch (val->type) {
+    case COAP_CBOR_UINT:   num = (double)val->val.u; break;
+    case COAP_CBOR_NEGINT: num = -1.0 - (double)val->val.u; break;
+    case COAP_CBOR_FLOAT:  num = val->val.f; break;
+    default:               is_num = false; break;
+    }
+    switch (label) {
+    case _LABEL_BN: if (!is_text) return COAP_ERR_MALFORMED; f->bn = val->val.str; break;
+    case _LABEL_BU: if (!is_text) return COAP_ERR_MALFORMED; f->bu = val->val.str; break;
+    case _LABEL_N:  if (!is_text) return COAP_ERR_MALFORMED; f->n = val->val.str; break;
+    case _LABEL_U:  if (!is_text) return COAP_ERR_MALFORMED; f->u = val->val.str; break;
+    case _LABEL_VS: if (!is_text) return COAP_ERR_MALFORMED; f->vs = val->val.str; break;
+    case _LABEL_VD:
+        // byte string in CBOR, base64url text in JSON
+        if (!is_text && (val->type != COAP_CBOR_BYTES)) return COAP_ERR_MALFORMED;
+        f->vd = val->val.str;
+        break;
+    case _LABEL_VB:
+        if (!is_bool) return COAP_ERR_MALFORMED;
+        f->vb = (val->type == COAP_CBOR_TRUE);
+        break;
+    case _LABEL_BVER:
+        if (!is_num) return COAP_ERR_MALFORMED;
+        break;
+    case _LABEL_BT: if (!is_num) return COAP_ERR_MALFORMED; f->bt = num; break;
+    case _LABEL_BV: if (!is_num) return COAP_ERR_MALFORMED; f->bv = num; break;
+    case _LABEL_BS: if (!is_num) return COAP_ERR_MALFORMED; f->bs = num; break;
+    case _LABEL_V:  if (!is_num) return COAP_ERR_MALFORMED; f->v = num; break;
+    case _LABEL_S:  if (!is_num) return COAP_ERR_MALFORMED; f->s = num; break;
+    case _LABEL_T:  if (!is_num) return COAP_ERR_MALFORMED; f->t = num; break;
+    case _LABEL_UT: if (!is_num) return COAP_ERR_MALFORMED; f->ut = num; break;
+    default:
+        return COAP_SUCCESS;
+    }
+    f->present |= 1U << (label + 8);
+    return COAP_SUCCESS;
+}
+
+/* update base fields, resolve and pass record to the callback */
+static int _emit(coap_senml_decoder_t *d, const _fields_t *f)
+{
+    coap_senml_record_t rec;
+    if (_HAS(f, _LABEL_BN)) {
+        if (f->bn.len > sizeof(d->base_name)) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        memcpy(d->base_name, f->bn.p, f->bn.len);
+        d->base_name_len = f->bn.len;
+    }
+    if (_HAS(f, _LABEL_BU)) {
+        if (f->bu.len > sizeof(d->base_unit)) {
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        }
+        memcpy(d->base_unit, f->bu.p, f->bu.len);
+        d->base_unit_len = f->bu.len;
+    }
+    if (_HAS(f, _LABEL_BT)) d->base_time = f->bt;
+    if (_HAS(f, _LABEL_BV)) d->base_value = f->bv;
+    if (_HAS(f, _LABEL_BS)) d->base_sum = f->bs;
+
+    memset(&rec, 0, sizeof(rec));
+    if (_HAS(f, _LABEL_V)) {
+        rec.type = COAP_SENML_VALUE;
+        rec.value = d->base_value + f->v;
+    }
+    else if (_HAS(f, _LABEL_VS)) {
+        rec.type = COAP_SENML_STRING;
+        rec.data = f->vs;
+    }
+    else if (_HAS(f, _LABEL_VB)) {
+        rec.type = COAP_SENML_BOOL;
+        rec.boolean = f->vb;
+    }
+    else if (_HAS(f, _LABEL_VD)) {
+        rec.type = COAP_SENML_DATA;
+        rec.data = f->vd;
+    }
+    if (_HAS(f, _LABEL_S)) {
+        rec.has_sum = true;
+        rec.sum = d->base_sum + f->s;
+    }
+    // a record of base fields only
+    if ((rec.type == COAP_SENML_NONE) && !rec.has_sum) {
+        return COAP_SUCCESS;
+    }
+    const size_t nlen = _HAS(f, _LABEL_N) ? f->n.len : 0;
+    if (d->base_name_len + nlen > sizeof(d->name)) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    memcpy(d->name, d->base_name, d->base_name_len);
+    if (nlen) {
+        memcpy(d->name + d->base_name_len, f->n.p, nlen);
+    }
+    rec.name.p = (const uint8_t *)d->name;
+    rec.name.len = d->base_name_len + nlen;
+    if (_HAS(f, _LABEL_U)) {
+        rec.unit = f->u;
+    }
+    else {
+        rec.unit.p = (const uint8_t *)d->base_unit;
+        rec.unit.len = d->base_unit_len;
+    }
+    rec.time = d->base_time + (_HAS(f, _LABEL_T) ? f->t : 0);
+    rec.update_time = _HAS(f, _LABEL_UT) ? f->ut : 0;
+    return d->handler(d->arg, &rec);
+}
+
+static size_t _json_ws(const uint8_t *buf, const size_t len, size_t p)
+{
+    while ((p < len) && ((buf[p] == ' ') || (buf[p] == '\t') ||
+                         (buf[p] == '\r') || (buf[p] == '\n'))) {
+        p++;
+    }
+    return p;
+}
+
+/* string at buf[*p] == '"', escapes are kept as is */
+static int _json_string(const uint8_t *buf, const size_t len, size_t *p,
+                        coap_buffer_t *str)
+{
+    size_t i = *p + 1;
+    while ((i < len) && (buf[i] != '"')) {
+        i += (buf[i] == '\\') ? 2 : 1;
+    }
+    if (i >= len) {
+        return COAP_ERR_INCOMPLETE;
+    }
+    str->p = buf + *p + 1;
+    str->len = i - *p - 1;
+    *p = i + 1;
+    return COAP_SUCCESS;
+}
+
+/* object at buf[0] == '{', only called on complete objects */
+static int _json_record(coap_senml_decoder_t *d, const uint8_t *buf,
+                        const size_t len, size_t *used)
+{
+    _fields_t fields;
+    size_t p = 1;
+    int rc;
+    memset(&fields, 0, sizeof(fields));
+    p = _json_ws(buf, len, p);
+    if ((p < len) && (buf[p] == '}')) {
+        *used = p + 1;
+        return COAP_SUCCESS;
+    }
+    while (p < len) {
+        coap_buffer_t key;
+        coap_cbor_item_t val;
+        if (buf[p] != '"') {
+            return COAP_ERR_MALFORMED;
+        }
+        if ((rc = _json_string(buf, len, &p, &key))) {
+            return rc;
+        }
+        p = _json_ws(buf, len, p);
+        if ((p >= len) || (buf[p] != ':')) {
+            return COAP_ERR_MALFORMED;
+        }
+        p = _json_ws(buf, len, p + 1);
+        if (p >= len) {
+            return COAP_ERR_MALFORMED;
+        }
+        if (buf[p] == '"') {
+            val.type = COAP_CBOR_TEXT;
+            if ((rc = _json_string(buf, len, &p, &val.val.str))) {
+                return rc;
+            }
+        }
+        else if ((len - p >= 4) && !memcmp(buf + p, "true", 4)) {
+            val.type = COAP_CBOR_TRUE;
+            p += 4;
+        }
+        else if ((len - p >= 5) && !memcmp(buf + p, "false", 5)) {
+            val.type = COAP_CBOR_FALSE;
+            p += 5;
+        }
+        else {
+            // copy number token to terminate it for strtod
+            char num[40];
+            size_t n = 0;
+            char *end;
+            while ((p + n < len) && (n < sizeof(num) - 1) && buf[p + n] &&
+                   strchr("+-.0123456789eE", buf[p + n])) {
+                num[n] = buf[p + n];
+                n++;
+            }
+            num[n] = '\0';
+            val.type = COAP_CBOR_FLOAT;
+            val.val.f = strtod(num, &end);
+            if ((n == 0) || (end != num + n)) {
+                return COAP_ERR_MALFORMED;
+            }
+            p += n;
+        }
+        const _label_t label = _label_by_name(&key);
+        // labels ending with '_' must be understood
+        if ((label == _LABEL_UNKNOWN) && key.len && (key.p[key.len - 1] == '_')) {
+            return COAP_ERR_UNSUPPORTED;
+        }
+        if ((rc = _set_field(&fields, label, &val))) {
+            return rc;
+        }
+        p = _json_ws(buf, len, p);
+        if ((p < len) && (buf[p] == ',')) {
+            p = _json_ws(buf, len, p + 1);
+            continue;
+        }
+        if ((p < len) && (buf[p] == '}')) {
+            *used = p + 1;
+            return _emit(d, &fields);
+        }
+        return COAP_ERR_MALFORMED;
+    }
+    return COAP_ERR_MALFORMED;
+}
+
+static int _json_step(coap_senml_decoder_t *d, const uint8_t *buf,
+                      const size_t len, size_t *used)
+{
+    size_t p = _json_ws(buf, len, 0);
+    if (d->state == _STATE_DONE) {
+        *used = len;
+        return (p < len) ? COAP_ERR_MALFORMED : COAP_SUCCESS;
+    }
+    if (p >= len) {
+        return COAP_ERR_INCOMPLETE;
+    }
+    switch (d->state) {
+    case _STATE_START:
+        if (buf[p] != '[') {
+            return COAP_ERR_MALFORMED;
+        }
+        d->state = _STATE_RECORD;
+        *used = p + 1;
+        return COAP_SUCCESS;
+    case _STATE_NEXT:
+        if ((buf[p] != ',') && (buf[p] != ']')) {
+            return COAP_ERR_MALFORMED;
+        }
+        d->state = (buf[p] == ',') ? _STATE_RECORD : _STATE_DONE;
+        *used = p + 1;
+        return COAP_SUCCESS;
+    default:
+        break;
+    }
+    if (buf[p] == ']') {
+        d->state = _STATE_DONE;
+        *used = p + 1;
+        return COAP_SUCCESS;
+    }
+    if (buf[p] != '{') {
+        return COAP_ERR_MALFORMED;
+    }
+    // find end of object first, it may be cut by the chunk boundary
+    size_t end = p + 1;
+    while ((end < len) && (buf[end] != '}')) {
+        if (buf[end] == '"') {
+            coap_buffer_t str;
+            int rc = _json_string(buf, len, &end, &str);
+            if (rc) {
+                return rc;
+            }
+            continue;
+        }
+        end++;
+    }
+    if (end >= len) {
+        return COAP_ERR_INCOMPLETE;
+    }
+    size_t n = 0;
+    int rc = _json_record(d, buf + p, end + 1 - p, &n);
+    if (rc) {
+        return rc;
+    }
+    d->state = _STATE_NEXT;
+    *used = p + n;
+    return COAP_SUCCESS;
+}
+
+static int _cbor_record(coap_senml_decoder_t *d, coap_cbor_reader_t *r)
+{
+    _fields_t fields;
+    coap_cbor_item_t map, key, val;
+    int rc;
+    memset(&fields, 0, sizeof(fields));
+    if ((rc = coap_cbor_next(r, &map))) {
+        return rc;
+    }
+    if (map.type != COAP_CBOR_MAP) {
+        return COAP_ERR_MALFORMED;
+    }
+    for (uint64_t i = 0; map.indefinite || (i < map.val.count); ++i) {
+        _label_t label = _LABEL_UNKNOWN;
+        if ((rc = coap_cbor_next(r, &key))) {
+            return rc;
+        }
+        if (key.type == COAP_CBOR_BREAK) {
+            if (!map.indefinite) {
+                return COAP_ERR_MALFORMED;
+            }
+            break;
+        }
+        if ((key.type == COAP_CBOR_UINT) && (key.val.u <= _LABEL_VD)) {
+            label = (_label_t)key.val.u;
+        }
+        else if ((key.type == COAP_CBOR_NEGINT) && (key.val.u < 6)) {
+            label = (_label_t)(-1 - (int)key.val.u);
+        }
+        else if (key.type == COAP_CBOR_TEXT) {
+            label = _label_by_name(&key.val.str);
+        }
+        // unknown labels are skipped, values of known ones are no containers
+        if (label == _LABEL_UNKNOWN) {
+            rc = coap_cbor_skip(r);
+        }
+        else if (!(rc = coap_cbor_next(r, &val))) {
+            rc = _set_field(&fields, label, &val);
+        }
+        if (rc) {
+            return rc;
+        }
+    }
+    return _emit(d, &fields);
+}
+
+static int _cbor_step(coap_senml_decoder_t *d, const uint8_t *buf,
+                      const size_t len, size_t *used)
+{
+    coap_cbor_reader_t r;
+    coap_cbor_item_t item;
+    int rc;
+    coap_cbor_reader_init(&r, buf, len);
+    if (d->state == _STATE_DONE) {
+        *used = len;
+        return COAP_ERR_MALFORMED;
+    }
+    if (d->state == _STATE_START) {
+        if ((rc = coap_cbor_next(&r, &item))) {
+            return rc;
+        }
+        if (item.type != COAP_CBOR_ARRAY) {
+            return COAP_ERR_MALFORMED;
+        }
+        d->remaining = item.indefinite ? _INDEFINITE : item.val.count;
+        d->state = d->remaining ? _STATE_RECORD : _STATE_DONE;
+        *used = r.pos;
+        return COAP_SUCCESS;
+    }
+    if ((d->remaining == _INDEFINITE) && (buf[0] == 0xFF)) {
+        d->state = _STATE_DONE;
+        *used = 1;
+        return COAP_SUCCESS;
+    }
+    // make sure the record is complete before emitting anything
+    if ((rc = coap_cbor_skip(&r))) {
+        return rc;
+    }
+    coap_cbor_reader_init(&r, buf, r.pos);
+    if ((rc = _cbor_record(d, &r))) {
+        return rc;
+    }
+    if ((d->remaining != _INDEFINITE) && (--d->remaining == 0)) {
+        d->state = _STATE_DONE;
+    }
+    *used = r.len;
+    return COAP_SUCCESS;
+}
+
+static int _step(coap_senml_decoder_t *d, const uint8_t *buf,
+                 const size_t len, size_t *used)
+{
+    *used = 0;
+    if (d->format == COAP_CONTENTTYPE_APP_SENML_CBOR) {
+        return _cbor_step(d, buf, len, used);
+    }
+    return _json_step(d, buf, len, used);
+}
+
+static int _json_put(coap_senml_encoder_t *e, const char *str, size_t len)
+{
+    coap_cbor_writer_t *w = &e->w;
+    if (w->err) {
+        return w->err;
+    }
+    if (len > w->len - w->pos) {
+        w->err = COAP_ERR_BUFFER_TOO_SMALL;
+        return w->err;
+    }
+    memcpy(w->p + w->pos, str, len);
+    w->pos += len;
+    return COAP_SUCCESS;
+}
+
+static int _json_put_number(coap_senml_encoder_t *e, const char *key,
+                            double value)
+{
+    char num[48];
+    // shortest representation that reads back the same
+    int n = snprintf(num, sizeof(num), "\"%s\":%.15g", key, value);
+    if (strtod(num + strlen(key) + 3, NULL) != value) {
+        n = snprintf(num, sizeof(num), "\"%s\":%.17g", key, value);
+    }
+    return _json_put(e, num, n);
+}
+
+static int _json_put_string(coap_senml_encoder_t *e, const char *key,
+                            const coap_buffer_t *str, bool base64)
+{
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    char tmp[8];
+    _json_put(e, "\"", 1);
+    _json_put(e, key, strlen(key));
+    _json_put(e, "\":\"", 3);
+    if (base64) {
+        // base64url without padding, https://tools.ietf.org/html/rfc8428#section-4.3
+        for (size_t i = 0; i < str->len; i += 3) {
+            uint32_t v = str->p[i] << 16;
+            size_t n = 2;
+            if (i + 1 < str->len) { v |= str->p[i + 1] << 8; n++; }
+            if (i + 2 < str->len) { v |= str->p[i + 2]; n++; }
+            for (size_t k = 0; k < n; ++k) {
+                tmp[k] = b64[(v >> (18 - 6 * k)) & 0x3F];
+            }
+            _json_put(e, tmp, n);
+        }
+    }
+    else {
+        for (size_t i = 0; i < str->len; ++i) {
+            const uint8_t c = str->p[i];
+            if ((c == '"') || (c == '\\')) {
+                tmp[0] = '\\';
+                tmp[1] = c;
+                _json_put(e, tmp, 2);
+            }
+            else if (c < 0x20) {
+                snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+                _json_put(e, tmp, 6);
+            }
+            else {
+                _json_put(e, (const char *)&c, 1);
+            }
+        }
+    }
+    return _json_put(e, "\"", 1);
+}
+
+static int _cbor_put_field(coap_senml_encoder_t *e, _label_t label,
+                           double value)
+{
+    coap_cbor_put_int(&e->w, label);
+    // integral values as integer, they encode shorter
+    if ((value >= -9007199254740992.0) && (value <= 9007199254740992.0) &&
+        (value == (double)(int64_t)value)) {
+        return coap_cbor_put_int(&e->w, (int64_t)value);
+    }
+    return coap_cbor_put_float(&e->w, value);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_senml_decoder_init(coap_senml_decoder_t *d,
+                            const coap_content_type_t format,
+                            coap_senml_handler handler, void *arg)
+{
+    if ((format != COAP_CONTENTTYPE_APP_SENML_JSON) &&
+        (format != COAP_CONTENTTYPE_APP_SENML_CBOR)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    d->format = format;
+    d->handler = handler;
+    d->arg = arg;
+    d->last_id = 0;
+    _reset(d);
+    return COAP_SUCCESS;
+}
+
+int coap_senml_decode(coap_senml_decoder_t *d,
+                      const uint8_t *buf, const size_t buflen,
+                      const bool last)
+{
+    size_t pos = 0;
+    size_t used;
+    int rc;
+    // complete the record cut at the end of the previous chunk first
+    while (d->carry_len > 0) {
+        const size_t old = d->carry_len;
+        size_t n = sizeof(d->carry) - old;
+        if (n > buflen - pos) {
+            n = buflen - pos;
+        }
+        memcpy(d->carry + old, buf + pos, n);
+        d->carry_len += n;
+        pos += n;
+        rc = _step(d, d->carry, d->carry_len, &used);
+        if (rc == COAP_ERR_INCOMPLETE) {
+            if (d->carry_len == sizeof(d->carry)) {
+                return COAP_ERR_BUFFER_TOO_SMALL;
+            }
+            return last ? COAP_ERR_INCOMPLETE : COAP_SUCCESS;
+        }
+        if (rc) {
+            return rc;
+        }
+        if (used >= old) {
+            // continue in place, behind the completed record
+            pos -= d->carry_len - used;
+            d->carry_len = 0;
+        }
+        else {
+            // only part of the carried bytes consumed, retry with the rest
+            pos -= n;
+            memmove(d->carry, d->carry + used, old - used);
+            d->carry_len = old - used;
+        }
+    }
+    while (pos < buflen) {
+        rc = _step(d, buf + pos, buflen - pos, &used);
+        if (rc == COAP_ERR_INCOMPLETE) {
+            if (buflen - pos > sizeof(d->carry)) {
+                return COAP_ERR_BUFFER_TOO_SMALL;
+            }
+            memcpy(d->carry, buf + pos, buflen - pos);
+            d->carry_len = buflen - pos;
+            break;
+        }
+        if (rc) {
+            return rc;
+        }
+        pos += used;
+    }
+    if (last && (d->state != _STATE_DONE)) {
+        return COAP_ERR_INCOMPLETE;
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_senml_decode_block1(coap_senml_decoder_t *d,
+                             const coap_packet_t *inpkt,
+                             coap_block_t *block)
+{
+    int rc = coap_get_block_option(inpkt, COAP_OPTION_BLOCK1, block);
+    if (rc == COAP_ERR_OPTION_NOT_FOUND) {
+        block->num = 0;
+        block->more = false;
+        block->szx = 0;
+        _reset(d);
+        return coap_senml_decode(d, inpkt->payload.p, inpkt->payload.len, true);
+    }
+    if (rc) {
+        return rc;
+    }
+    // retransmission of the block decoded last, e.g. as its response got
+    // lost; block 0 by message ID, as it may also start the next pack
+    if (((block->num + 1) == d->next_block) &&
+        (block->num || (inpkt->hdr.id == d->last_id))) {
+        return COAP_SUCCESS;
+    }
+    if (block->num == 0) {
+        _reset(d);
+    }
+    else if (block->num != d->next_block) {
+        return COAP_ERR_BLOCK_SEQUENCE;
+    }
+    d->next_block = block->num + 1;
+    d->last_id = inpkt->hdr.id;
+    return coap_senml_decode(d, inpkt->payload.p, inpkt->payload.len,
+                             !block->more);
+}
+
+int coap_senml_encoder_init(coap_senml_encoder_t *e,
+                            const coap_content_type_t format,
+                            uint8_t *buf, const size_t buflen,
+                            const coap_senml_base_t *base)
+{
+    if ((format != COAP_CONTENTTYPE_APP_SENML_JSON) &&
+        (format != COAP_CONTENTTYPE_APP_SENML_CBOR)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    e->format = format;
+    e->base = base;
+    e->count = 0;
+    coap_cbor_writer_init(&e->w, buf, buflen);
+    // record count is unknown upfront
+    if (format == COAP_CONTENTTYPE_APP_SENML_CBOR) {
+        return coap_cbor_put_array_indef(&e->w);
+    }
+    return _json_put(e, "[", 1);
+}
+
+int coap_senml_put_record(coap_senml_encoder_t *e,
+                          const coap_senml_record_t *record)
+{
+    const coap_senml_base_t *b = e->base;
+    const coap_senml_record_t *r = record;
+    const bool cbor = (e->format == COAP_CONTENTTYPE_APP_SENML_CBOR);
+    e->base = NULL;
+    if (cbor) {
+        size_t count = (r->name.len > 0) + (r->unit.len > 0) +
+                       (r->type != COAP_SENML_NONE) + r->has_sum +
+                       (r->time != 0) + (r->update_time != 0);
+        if (b) {
+            count += (b->name.len > 0) + (b->unit.len > 0) +
+                     (b->time != 0) + (b->value != 0);
+        }
+        coap_cbor_put_map(&e->w, count);
+        if (b && b->name.len) {
+            coap_cbor_put_int(&e->w, _LABEL_BN);
+            coap_cbor_put_text(&e->w, (const char *)b->name.p, b->name.len);
+        }
+        if (b && b->time) _cbor_put_field(e, _LABEL_BT, b->time);
+        if (b && b->unit.len) {
+            coap_cbor_put_int(&e->w, _LABEL_BU);
+            coap_cbor_put_text(&e->w, (const char *)b->unit.p, b->unit.len);
+        }
+        if (b && b->value) _cbor_put_field(e, _LABEL_BV, b->value);
+        if (r->name.len) {
+            coap_cbor_put_int(&e->w, _LABEL_N);
+            coap_cbor_put_text(&e->w, (const char *)r->name.p, r->name.len);
+        }
+        if (r->unit.len) {
+            coap_cbor_put_int(&e->w, _LABEL_U);
+            coap_cbor_put_text(&e->w, (const char *)r->unit.p, r->unit.len);
+        }
+        switch (r->type) {
+        case COAP_SENML_VALUE:
+            _cbor_put_field(e, _LABEL_V, r->value);
+            break;
+        case COAP_SENML_STRING:
+            coap_cbor_put_int(&e->w, _LABEL_VS);
+            coap_cbor_put_text(&e->w, (const char *)r->data.p, r->data.len);
+            break;
+        case COAP_SENML_BOOL:
+            coap_cbor_put_int(&e->w, _LABEL_VB);
+            coap_cbor_put_bool(&e->w, r->boolean);
+            break;
+        case COAP_SENML_DATA:
+            coap_cbor_put_int(&e->w, _LABEL_VD);
+            coap_cbor_put_bytes(&e->w, r->data.p, r->data.len);
+            break;
+        default:
+            break;
+        }
+        if (r->has_sum) _cbor_put_field(e, _LABEL_S, r->sum);
+        if (r->time) _cbor_put_field(e, _LABEL_T, r->time);
+        if (r->update_time) _cbor_put_field(e, _LABEL_UT, r->update_time);
+        e->count++;
+        return e->w.err;
+    }
+    // JSON, comma separated objects with comma separated members
+    const char *sep = "";
+    _json_put(e, e->count ? ",{" : "{", e->count ? 2 : 1);
+#define _SEP() do { _json_put(e, sep, strlen(sep)); sep = ","; } while (0)
+    if (b && b->name.len) { _SEP(); _json_put_string(e, "bn", &b->name, false); }
+    if (b && b->time) { _SEP(); _json_put_number(e, "bt", b->time); }
+    if (b && b->unit.len) { _SEP(); _json_put_string(e, "bu", &b->unit, false); }
+    if (b && b->value) { _SEP(); _json_put_number(e, "bv", b->value); }
+    if (r->name.len) { _SEP(); _json_put_string(e, "n", &r->name, false); }
+    if (r->unit.len) { _SEP(); _json_put_string(e, "u", &r->unit, false); }
+    switch (r->type) {
+    case COAP_SENML_VALUE:
+        _SEP();
+        _json_put_number(e, "v", r->value);
+        break;
+    case COAP_SENML_STRING:
+        _SEP();
+        _json_put_string(e, "vs", &r->data, false);
+        break;
+    case COAP_SENML_BOOL:
+        _SEP();
+        _json_put(e, r->boolean ? "\"vb\":true" : "\"vb\":false",
+                  r->boolean ? 9 : 10);
+        break;
+    case COAP_SENML_DATA:
+        _SEP();
+        _json_put_string(e, "vd", &r->data, true);
+        break;
+    default:
+        break;
+    }
+    if (r->has_sum) { _SEP(); _json_put_number(e, "s", r->sum); }
+    if (r->time) { _SEP(); _json_put_number(e, "t", r->time); }
+    if (r->update_time) { _SEP(); _json_put_number(e, "ut", r->update_time); }
+#undef _SEP
+    e->count++;
+    return _json_put(e, "}", 1);
+}
+
+int coap_senml_encoder_finish(coap_senml_encoder_t *e, size_t *buflen)
+{
+    if (e->format == COAP_CONTENTTYPE_APP_SENML_CBOR) {
+        coap_cbor_put_break(&e->w);
+    }
+    else {
+        _json_put(e, "]", 1);
+    }
+    return coap_cbor_writer_finish(&e->w, buflen);
+}
@@ -0,0 +1,217 @@
+#ifndef COAP_SENML_H
+#define COAP_SENML_H 1
+
+/**
+ * @file coap_senml.h
+ *
+ * SenML packs in JSON and CBOR representation,
+ * see https://tools.ietf.org/html/rfc8428
+ *
+ * The decoder streams a pack one record at a time to a callback, resolving
+ * base name, time, unit, value and sum on the way. It accepts a pack in
+ * arbitrary chunks, e.g. the payloads of Block1 transfers, and keeps only the
+ * bytes of a record cut at a chunk boundary. No memory is allocated.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "coap.h"
+#include "coap_cbor.h"
+
+#ifndef COAP_SENML_MAX_NAME
+#define COAP_SENML_MAX_NAME     64      //!< max. length of resolved names
+#endif
+#ifndef COAP_SENML_MAX_UNIT
+#define COAP_SENML_MAX_UNIT     16      //!< max. length of base unit
+#endif
+#ifndef COAP_SENML_MAX_RECORD
+#define COAP_SENML_MAX_RECORD   256     //!< max. size of a record cut by a chunk boundary
+#endif
+
+/**
+ * Kind of value carried by a SenML record
+ */
+typedef enum
+{
+    COAP_SENML_NONE             = 0,    //!< no value, sum only
+    COAP_SENML_VALUE,                   //!< numeric value "v"
+    COAP_SENML_STRING,                  //!< string value "vs"
+    COAP_SENML_BOOL,                    //!< boolean value "vb"
+    COAP_SENML_DATA,                    //!< data value "vd"
+} coap_senml_type_t;
+
+/**
+ * A resolved SenML record
+ *
+ * Buffers are valid during the callback only. Data values of JSON packs are
+ * passed base64url encoded as received, JSON escapes are not resolved.
+ */
+typedef struct coap_senml_record
+{
+    coap_buffer_t name;         //!< base name and name
+    coap_buffer_t unit;         //!< unit, or base unit
+    double time;                //!< base time plus time
+    double update_time;         //!< max. time before next update, 0 if unset
+    coap_senml_type_t type;     //!< type of value
+    double value;               //!< base value plus value
+    bool boolean;               //!< boolean value
+    coap_buffer_t data;         //!< string or data value
+    bool has_sum;               //!< sum is present
+    double sum;                 //!< base sum plus sum
+} coap_senml_record_t;
+
+/**
+ * Base fields emitted with the first record of a pack
+ */
+typedef struct coap_senml_base
+{
+    coap_buffer_t name;         //!< base name, len 0 if unset
+    coap_buffer_t unit;         //!< base unit, len 0 if unset
+    double time;                //!< base time, 0 if unset
+    double value;               //!< base value, 0 if unset
+} coap_senml_base_t;
+
+/**
+ * @brief callback function receiving decoded records
+ *
+ * @param[in] arg Argument given to coap_senml_decoder_init()
+ * @param[in] record The resolved record
+ *
+ * @return 0 to continue, any other value stops decoding and is returned
+ */
+typedef int (*coap_senml_handler)(void *arg, const coap_senml_record_t *record);
+
+/**
+ * SenML decoder state, persists across chunks of one pack
+ */
+typedef struct coap_senml_decoder
+{
+    coap_content_type_t format;         //!< SENML_JSON or SENML_CBOR
+    coap_senml_handler handler;         //!< record callback
+    void *arg;                          //!< callback argument
+    int state;                          //!< position within the pack
+    uint64_t remaining;                 //!< CBOR records left, definite arrays
+    uint32_t next_block;                //!< expected Block1 number
+    uint16_t last_id;                   //!< message ID of the block decoded last
+    char base_name[COAP_SENML_MAX_NAME];
+    size_t base_name_len;
+    char base_unit[COAP_SENML_MAX_UNIT];
+    size_t base_unit_len;
+    double base_time;
+    double base_value;
+    double base_sum;
+    char name[COAP_SENML_MAX_NAME];     //!< resolved name of current record
+    uint8_t carry[COAP_SENML_MAX_RECORD]; //!< record cut at chunk boundary
+    size_t carry_len;
+} coap_senml_decoder_t;
+
+/**
+ * SenML encoder state
+ */
+typedef struct coap_senml_encoder
+{
+    coap_content_type_t format;         //!< SENML_JSON or SENML_CBOR
+    coap_cbor_writer_t w;               //!< output, used for JSON as well
+    const coap_senml_base_t *base;      //!< base fields, until first record
+    size_t count;                       //!< number of records written
+} coap_senml_encoder_t;
+
+/**
+ * @brief Initialize SenML decoder for a new pack
+ *
+ * @param[out] d The decoder
+ * @param[in] format COAP_CONTENTTYPE_APP_SENML_JSON or _CBOR
+ * @param[in] handler Callback receiving records
+ * @param[in] arg Argument passed to \p handler
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED for other formats
+ */
+int coap_senml_decoder_init(coap_senml_decoder_t *d,
+                            const coap_content_type_t format,
+                            coap_senml_handler handler, void *arg);
+
+/**
+ * @brief Decode a chunk of a pack
+ *
+ * Passes every complete record to the callback. An incomplete record at
+ * the end of \p buf is kept until the next chunk arrives.
+ *
+ * @param[in,out] d The decoder
+ * @param[in] buf Chunk of the pack
+ * @param[in] buflen Size of \p buf in bytes
+ * @param[in] last True if this is the last chunk of the pack
+ *
+ * @return 0 on success, COAP_ERR_MALFORMED on invalid input,
+ * COAP_ERR_INCOMPLETE if \p last is set but the pack is not complete,
+ * COAP_ERR_BUFFER_TOO_SMALL if a cut record or a name exceeds the limits,
+ * or the value returned by the callback.
+ */
+int coap_senml_decode(coap_senml_decoder_t *d,
+                      const uint8_t *buf, const size_t buflen,
+                      const bool last);
+
+/**
+ * @brief Decode the payload of a request carrying a pack or part of it
+ *
+ * Without Block1 option the payload is decoded as complete pack. Otherwise
+ * blocks have to arrive in order; block 0 restarts the pack. The block
+ * decoded last may arrive again, e.g. if its response got lost, and is not
+ * decoded twice; block 0 counts as such only with the same message ID.
+ *
+ * @param[in,out] d The decoder
+ * @param[in] inpkt The request packet
+ * @param[out] block Block1 option of the request, to be echoed in the
+ * response, num 0 and more false without Block1 option.
+ *
+ * @return as coap_senml_decode(), 0 for a repeated block, or
+ * COAP_ERR_BLOCK_SEQUENCE if a block is missing. Respond with 4.08 in this
+ * case.
+ */
+int coap_senml_decode_block1(coap_senml_decoder_t *d,
+                             const coap_packet_t *inpkt,
+                             coap_block_t *block);
+
+/**
+ * @brief Initialize SenML encoder
+ *
+ * @param[out] e The encoder
+ * @param[in] format COAP_CONTENTTYPE_APP_SENML_JSON or _CBOR
+ * @param[in] buf Output buffer, e.g. from coap_build_payload_buffer()
+ * @param[in] buflen Size of \p buf in bytes
+ * @param[in] base Base fields, written with the first record, may be NULL
+ *
+ * @return 0 on success, or COAP_ERR_UNSUPPORTED for other formats
+ */
+int coap_senml_encoder_init(coap_senml_encoder_t *e,
+                            const coap_content_type_t format,
+                            uint8_t *buf, const size_t buflen,
+                            const coap_senml_base_t *base);
+
+/**
+ * @brief Append a record to the pack
+ *
+ * The name, unit, time and value are written as given, relative to the base
+ * fields. Fields are omitted if unset (empty, zero or COAP_SENML_NONE).
+ *
+ * @return 0 on success, or COAP_ERR_BUFFER_TOO_SMALL
+ */
+int coap_senml_put_record(coap_senml_encoder_t *e,
+                          const coap_senml_record_t *record);
+
+/**
+ * @brief Finish the pack
+ *
+ * @param[in,out] e The encoder
+ * @param[out] buflen Number of bytes encoded
+ *
+ * @return 0 on success, or the first error that occurred while encoding
+ */
+int coap_senml_encoder_finish(coap_senml_encoder_t *e, size_t *buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_SENML_H
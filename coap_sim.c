@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "coap_random.h"
+#include "coap_sim.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _NET            0x0A000000U     //!< 10.0.0.0/8
+#define _MAX_NODES      ((1U << 24) - 2)
+
+struct coap_sim_event
+{
+    uint64_t at_us;                     //!< due time
+    uint64_t seq;                       //!< order of scheduling
+    coap_sim_node_t *dst;               //!< receiver, NULL for timers
+    coap_sim_timer_fn fn;               //!< timer callback
+    void *arg;                          //!< argument of fn
+    coap_endpoint_t from;               //!< sender of the datagram
+    size_t len;                         //!< size of the datagram
+    uint8_t buf[];                      //!< the datagram
+};
+
+static coap_sim_t *_installed;
+
+static coap_tick_t _sim_clock(void);
+static bool _chance(const uint32_t ppm);
+static coap_sim_node_t *_lookup(const coap_sim_t *sim, const coap_endpoint_t *ep);
+static bool _before(const coap_sim_event_t *a, const coap_sim_event_t *b);
+static int _push(coap_sim_t *sim, coap_sim_event_t *ev);
+static coap_sim_event_t *_pop(coap_sim_t *sim);
+
+static coap_tick_t _sim_clock(void)
+{
+    return _installed->now_us / (1000000 / COAP_TICKS_PER_SEC);
+}
+
+static bool _chance(const uint32_t ppm)
+{
+    return ppm && ((coap_random_next() % COAP_SIM_PPM) < ppm);
+}
+
+/* the address is the index, no search needed */
+static coap_sim_node_t *_lookup(const coap_sim_t *sim, const coap_endpoint_t *ep)
+{
+    struct sockaddr_in sin;
+    if (ep->len != sizeof(sin)) {
+        return NULL;
+    }
+    memcpy(&sin, ep->addr, sizeof(sin));
+    const uint32_t addr = ntohl(sin.sin_addr.s_addr);
+    if ((sin.sin_family != AF_INET) || (ntohs(sin.sin_port) != COAP_SIM_PORT) ||
+        ((addr & 0xFF000000U) != _NET)) {
+        return NULL;
+    }
+    const size_t i = (addr & 0x00FFFFFFU) - 1;
+    return (i < sim->nnodes) ? sim->nodes[i] : NULL;
+}
+
+static bool _before(const coap_sim_event_t *a, const coap_sim_event_t *b)
+{
+    return (a->at_us < b->at_us) || ((a->at_us == b->at_us) && (a->seq < b->seq));
+}
+
+static int _push(coap_sim_t *sim, coap_sim_event_t *ev)
+{
+    if (sim->nevents == sim->events_size) {
+        const size_t size = sim->events_size ? 2 * sim->events_size : 1024;
+        coap_sim_event_t **events = realloc(sim->events, size * sizeof(*events));
+        if (!events) {
+            free(ev);
+            return COAP_ERR_BUSY;
+        }
+        sim->events = events;
+        sim->events_size = size;
+    }
+    ev->seq = sim->seq++;
+    // sift up
+    size_t i = sim->nevents++;
+    while (i) {
+        const size_t parent = (i - 1) / 2;
+        if (!_before(ev, sim->events[parent])) {
+            break;
+        }
+        sim->events[i] = sim->events[parent];
+        i = parent;
+    }
+    sim->events[i] = ev;
+    return COAP_SUCCESS;
+}
+
+static coap_sim_event_t *_pop(coap_sim_t *sim)
+{
+    coap_sim_event_t *top = sim->events[0];
+    coap_sim_event_t *last = sim->events[--sim->nevents];
+    // sift the last one down from the root
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= sim->nevents) {
+            break;
+        }
+        if ((child + 1 < sim->nevents) &&
+            _before(sim->events[child + 1], sim->events[child])) {
+            child++;
+        }
+        if (!_before(sim->events[child], last)) {
+            break;
+        }
+        sim->events[i] = sim->events[child];
+        i = child;
+    }
+    if (sim->nevents) {
+        sim->events[i] = last;
+    }
+    return top;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_sim_init(coap_sim_t *sim, const coap_sim_link_t *link,
+                   const uint32_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    if (link) {
+        sim->link = *link;
+    }
+    coap_random_seed(seed);
+    _installed = sim;
+    coap_clock_set(_sim_clock);
+}
+
+void coap_sim_free(coap_sim_t *sim)
+{
+    while (sim->nevents) {
+        free(sim->events[--sim->nevents]);
+    }
+    free(sim->events);
+    free(sim->nodes);
+    sim->events = NULL;
+    sim->nodes = NULL;
+    sim->events_size = sim->nodes_size = sim->nnodes = 0;
+    if (_installed == sim) {
+        _installed = NULL;
+        coap_clock_set(NULL);
+    }
+}
+
+int coap_sim_attach(coap_sim_t *sim, coap_sim_node_t *node,
+                    coap_sim_handler handler, void *arg)
+{
+    struct sockaddr_in sin;
+    if (sim->nnodes == _MAX_NODES) {
+        return COAP_ERR_BUSY;
+    }
+    if (sim->nnodes == sim->nodes_size) {
+        const size_t size = sim->nodes_size ? 2 * sim->nodes_size : 64;
+        coap_sim_node_t **nodes = realloc(sim->nodes, size * sizeof(*nodes));
+        if (!nodes) {
+            return COAP_ERR_BUSY;
+        }
+        sim->nodes = nodes;
+        sim->nodes_size = size;
+    }
+    memset(node, 0, sizeof(*node));
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(COAP_SIM_PORT);
+    sin.sin_addr.s_addr = htonl(_NET | (uint32_t)(sim->nnodes + 1));
+    memcpy(node->ep.addr, &sin, sizeof(sin));
+    node->ep.len = sizeof(sin);
+    node->sim = sim;
+    node->handler = handler;
+    node->arg = arg;
+    sim->nodes[sim->nnodes++] = node;
+    return COAP_SUCCESS;
+}
+
+int coap_sim_send(void *ctx, const coap_endpoint_t *ep,
+                  const uint8_t *buf, const size_t buflen)
+{
+    coap_sim_node_t *node = ctx;
+    coap_sim_t *sim = node->sim;
+    const coap_sim_link_t *link = node->link ? node->link : &sim->link;
+    node->tx++;
+    sim->sent++;
+    coap_sim_node_t *dst = _lookup(sim, ep);
+    if (!dst) {
+        sim->unreachable++;
+        return COAP_SUCCESS;
+    }
+    if (_chance(link->loss)) {
+        sim->lost++;
+        return COAP_SUCCESS;
+    }
+    int copies = 1;
+    if (_chance(link->duplicate)) {
+        sim->duplicated++;
+        copies++;
+    }
+    while (copies--) {
+        coap_sim_event_t *ev = malloc(sizeof(*ev) + buflen);
+        if (!ev) {
+            return COAP_ERR_BUSY;
+        }
+        ev->at_us = sim->now_us + link->delay_us;
+        if (link->jitter_us) {
+            ev->at_us += coap_random_next() % (link->jitter_us + 1);
+        }
+        ev->dst = dst;
+        ev->fn = NULL;
+        ev->arg = NULL;
+        ev->from = node->ep;
+        ev->len = buflen;
+        memcpy(ev->buf, buf, buflen);
+        const int rc = _push(sim, ev);
+        if (rc) {
+            return rc;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_sim_timer(coap_sim_t *sim, const coap_tick_t at,
+                   coap_sim_timer_fn fn, void *arg)
+{
+    if (at == COAP_TICK_NEVER) {
+        return COAP_SUCCESS;
+    }
+    coap_sim_event_t *ev = malloc(sizeof(*ev));
+    if (!ev) {
+        return COAP_ERR_BUSY;
+    }
+    const uint64_t at_us = at * (1000000 / COAP_TICKS_PER_SEC);
+    ev->at_us = (at_us > sim->now_us) ? at_us : sim->now_us;
+    ev->dst = NULL;
+    ev->fn = fn;
+    ev->arg = arg;
+    ev->len = 0;
+    return _push(sim, ev);
+}
+
+uint64_t coap_sim_run(coap_sim_t *sim, const coap_tick_t until)
+{
+    const uint64_t until_us = (until == COAP_TICK_NEVER) ? UINT64_MAX :
+                              until * (1000000 / COAP_TICKS_PER_SEC);
+    uint64_t n = 0;
+    while (sim->nevents && (sim->events[0]->at_us <= until_us)) {
+        coap_sim_event_t *ev = _pop(sim);
+        if (ev->at_us > sim->now_us) {
+            sim->now_us = ev->at_us;
+        }
+        if (ev->dst) {
+            ev->dst->rx++;
+            ev->dst->handler(ev->dst->arg, &ev->from, ev->buf, ev->len);
+        }
+        else {
+            ev->fn(ev->arg);
+        }
+        free(ev);
+        n++;
+    }
+    if ((until != COAP_TICK_NEVER) && (sim->now_us < until_us)) {
+        sim->now_us = until_us;
+    }
+    sim->processed += n;
+    return n;
+}
@@ -0,0 +1,173 @@
+#ifndef COAP_SIM_H
+#define COAP_SIM_H 1
+
+/**
+ * @file coap_sim.h
+ *
+ * In-process network simulation on a virtual clock.
+ *
+ * Nodes attached to a simulation exchange datagrams through
+ * coap_sim_send(), which matches coap_transport_send, so clients, proxies
+ * and servers run unchanged on top of it. Datagrams are lost, duplicated
+ * and delayed as configured per link; random jitter of the delay reorders
+ * them. Delivery and timers are events ordered by virtual time, which only
+ * advances as coap_sim_run() processes them, and the library clock follows
+ * it while the simulation is installed. Runs are deterministic for a given
+ * seed and order of calls, and as fast as the handlers allow, regardless of
+ * timeouts in between.
+ *
+ * Nodes get IPv4 addresses 10.0.0.0/8 in order of attachment, so up to 2^24
+ * of them can be simulated. The simulation is single-threaded.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "coap.h"
+#include "coap_time.h"
+
+#define COAP_SIM_PORT           5683    //!< port of all nodes
+#define COAP_SIM_PPM            1000000 //!< probabilities are parts per million
+
+/**
+ * @brief callback function receiving datagrams
+ *
+ * Datagrams may be sent and timers set from within.
+ *
+ * @param[in] arg Argument given to coap_sim_attach()
+ * @param[in] from Sender of the datagram
+ * @param[in] buf The datagram, valid during the callback only
+ * @param[in] buflen Size of \p buf in bytes
+ */
+typedef void (*coap_sim_handler)(void *arg, const coap_endpoint_t *from,
+                                 const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief callback function of a timer
+ */
+typedef void (*coap_sim_timer_fn)(void *arg);
+
+/**
+ * Properties of the path from a node to any other
+ */
+typedef struct coap_sim_link
+{
+    uint32_t loss;                      //!< ppm of datagrams lost
+    uint32_t duplicate;                 //!< ppm of datagrams delivered twice
+    uint32_t delay_us;                  //!< minimum one-way delay
+    uint32_t jitter_us;                 //!< max. random delay on top, reorders
+} coap_sim_link_t;
+
+typedef struct coap_sim coap_sim_t;
+typedef struct coap_sim_event coap_sim_event_t;
+
+/**
+ * Simulated host
+ */
+typedef struct coap_sim_node
+{
+    coap_sim_t *sim;                    //!< simulation attached to
+    coap_endpoint_t ep;                 //!< address, set by coap_sim_attach()
+    coap_sim_handler handler;           //!< receives datagrams
+    void *arg;                          //!< argument of handler
+    const coap_sim_link_t *link;        //!< outgoing link, NULL for the default
+    uint64_t rx;                        //!< datagrams received
+    uint64_t tx;                        //!< datagrams sent
+} coap_sim_node_t;
+
+/**
+ * Simulation state
+ */
+struct coap_sim
+{
+    uint64_t now_us;                    //!< virtual time
+    uint64_t seq;                       //!< orders events of equal time
+    coap_sim_link_t link;               //!< default link of nodes
+    coap_sim_node_t **nodes;            //!< attached nodes, by address
+    size_t nnodes;
+    size_t nodes_size;
+    coap_sim_event_t **events;          //!< pending events, min-heap by time
+    size_t nevents;
+    size_t events_size;
+    uint64_t processed;                 //!< events processed
+    uint64_t sent;                      //!< datagrams sent
+    uint64_t lost;                      //!< datagrams lost on links
+    uint64_t duplicated;                //!< datagrams duplicated on links
+    uint64_t unreachable;               //!< datagrams to unknown addresses
+};
+
+/**
+ * @brief Initialize a simulation and install its clock
+ *
+ * The library clock, see coap_clock_now(), reads the virtual time of
+ * \p sim, starting at 0, until coap_sim_free(). Losses, duplicates and
+ * jitter are drawn from the generators of the calling thread, see
+ * coap_random.h, which are seeded with \p seed.
+ *
+ * @param[out] sim The simulation
+ * @param[in] link Default link of nodes, NULL for a perfect network
+ * @param[in] seed Seed passed to coap_random_seed()
+ */
+void coap_sim_init(coap_sim_t *sim, const coap_sim_link_t *link,
+                   const uint32_t seed);
+
+/**
+ * @brief Release pending events and restore the monotonic clock
+ */
+void coap_sim_free(coap_sim_t *sim);
+
+/**
+ * @brief Attach a node and assign its address
+ *
+ * @param[in,out] sim The simulation
+ * @param[out] node The node, must stay valid during the simulation
+ * @param[in] handler Callback receiving datagrams
+ * @param[in] arg Argument passed to \p handler
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if no address or memory is left
+ */
+int coap_sim_attach(coap_sim_t *sim, coap_sim_node_t *node,
+                    coap_sim_handler handler, void *arg);
+
+/**
+ * @brief Send a datagram
+ *
+ * Matches coap_transport_send, pass the sending node as \p ctx.
+ *
+ * @return 0 on success, also if the link loses the datagram or its
+ * destination does not exist, or COAP_ERR_BUSY if out of memory
+ */
+int coap_sim_send(void *ctx, const coap_endpoint_t *ep,
+                  const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief Call \p fn at virtual time \p at
+ *
+ * Timers due in the past fire with the next event, COAP_TICK_NEVER is
+ * ignored. There is no cancellation, a callback finding nothing to do is
+ * cheap.
+ *
+ * @return 0 on success, or COAP_ERR_BUSY if out of memory
+ */
+int coap_sim_timer(coap_sim_t *sim, const coap_tick_t at,
+                   coap_sim_timer_fn fn, void *arg);
+
+/**
+ * @brief Process events in order of time
+ *
+ * @param[in,out] sim The simulation
+ * @param[in] until Virtual time to stop at, COAP_TICK_NEVER to run until no
+ * event is left
+ *
+ * @return number of events processed
+ */
+uint64_t coap_sim_run(coap_sim_t *sim, const coap_tick_t until);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_SIM_H
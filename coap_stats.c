@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "coap_stats.h"
+
+#ifdef MICROCOAP_STATS
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(COAP_STATS_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define _USE_TSC 1
+#endif
+
+/* --- PRIVATE -------------------------------------------------------------- */
+/* histograms of one thread, never freed so that samples outlive the thread */
+typedef struct _buffer
+{
+    struct _buffer *next;
+    unsigned countdown;                 //!< packets until the next sample
+    bool sampled;                       //!< current packet is timed
+    coap_histogram_t stages[COAP_STATS_STAGES];
+    coap_histogram_t resources[COAP_STATS_RESOURCES];
+} _buffer_t;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static _buffer_t *_buffers;             //!< buffers of all threads
+static __thread _buffer_t *_local;      //!< buffer of this thread
+static volatile unsigned _every = 1;
+static const coap_resource_t *_resources;   //!< table seen last, for names
+#ifdef _USE_TSC
+static uint64_t _tsc0, _ns0;            //!< calibration start
+#endif
+
+static uint64_t _monotonic_ns(void);
+static _buffer_t *_buffer(void);
+static unsigned _bucket(const uint64_t v);
+static uint64_t _bucket_value(const unsigned b);
+static void _record(coap_histogram_t *h, const uint64_t v);
+static void _merge(coap_histogram_t *h, const size_t offset);
+static double _ns_per_tick(void);
+static size_t _print(char *buf, const size_t size, const size_t len,
+                     const char *fmt, ...);
+static size_t _print_histogram(char *buf, const size_t size, const size_t len,
+                               const coap_histogram_t *h);
+
+static uint64_t _monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static _buffer_t *_buffer(void)
+{
+    if (!_local) {
+        _local = calloc(1, sizeof(*_local));
+        if (!_local) {
+            return NULL;
+        }
+        pthread_mutex_lock(&_lock);
+#ifdef _USE_TSC
+        if (!_buffers) {
+            _tsc0 = __rdtsc();
+            _ns0 = _monotonic_ns();
+        }
+#endif
+        _local->next = _buffers;
+        _buffers = _local;
+        pthread_mutex_unlock(&_lock);
+    }
+    return _local;
+}
+
+/* exact below 8, then 8 buckets per power of 2 */
+static unsigned _bucket(const uint64_t v)
+{
+    if (v < (1U << COAP_STATS_SUB_BITS)) {
+        return (unsigned)v;
+    }
+    const unsigned e = 63 - __builtin_clzll(v);
+    if (e >= COAP_STATS_MAX_BITS) {
+        return COAP_STATS_BUCKETS - 1;
+    }
+    return ((e - COAP_STATS_SUB_BITS + 1) << COAP_STATS_SUB_BITS) +
+           ((v >> (e - COAP_STATS_SUB_BITS)) & ((1U << COAP_STATS_SUB_BITS) - 1));
+}
+
+/* middle of the values falling into a bucket */
+static uint64_t _bucket_value(const unsigned b)
+{
+    if (b < (1U << COAP_STATS_SUB_BITS)) {
+        return b;
+    }
+    const unsigned e = (b >> COAP_STATS_SUB_BITS) + COAP_STATS_SUB_BITS - 1;
+    const uint64_t sub = (1U << COAP_STATS_SUB_BITS) +
+                         (b & ((1U << COAP_STATS_SUB_BITS) - 1));
+    const uint64_t width = 1ULL << (e - COAP_STATS_SUB_BITS);
+    return sub * width + width / 2;
+}
+
+static void _record(coap_histogram_t *h, const uint64_t v)
+{
+    h->count++;
+    h->sum += v;
+    if (v > h->max) {
+        h->max = v;
+    }
+    h->buckets[_bucket(v)]++;
+}
+
+/* sum up the histogram at offset within all thread buffers */
+static void _merge(coap_histogram_t *h, const size_t offset)
+{
+    memset(h, 0, sizeof(*h));
+    pthread_mutex_lock(&_lock);
+    for (const _buffer_t *b = _buffers; b; b = b->next) {
+        // recording threads go on, a sample may be off by one
+        const coap_histogram_t *t = (const coap_histogram_t *)((const uint8_t *)b + offset);
+        h->count += t->count;
+        h->sum += t->sum;
+        if (t->max > h->max) {
+            h->max = t->max;
+        }
+        for (unsigned i = 0; i < COAP_STATS_BUCKETS; ++i) {
+            h->buckets[i] += t->buckets[i];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    h->ns_per_tick = _ns_per_tick();
+}
+
+/* rdtsc is scaled by the wall time elapsed since the first sample */
+static double _ns_per_tick(void)
+{
+#ifdef _USE_TSC
+    const uint64_t tsc = __rdtsc();
+    const uint64_t ns = _monotonic_ns();
+    if (!_buffers || (tsc <= _tsc0)) {
+        return 1.0;
+    }
+    return (double)(ns - _ns0) / (double)(tsc - _tsc0);
+#else
+    return 1.0;
+#endif
+}
+
+/* append to buf, output beyond size is cut off */
+static size_t _print(char *buf, const size_t size, const size_t len,
+                     const char *fmt, ...)
+{
+    va_list ap;
+    if (len >= size - 1) {
+        return len;
+    }
+    va_start(ap, fmt);
+    const int n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return len;
+    }
+    return ((size_t)n < size - len) ? len + n : size - 1;
+}
+
+static size_t _print_histogram(char *buf, const size_t size, const size_t len,
+                               const coap_histogram_t *h)
+{
+    return _print(buf, size, len, " %llu %llu %llu %llu %llu\n",
+                  (unsigned long long)h->count,
+                  (unsigned long long)coap_histogram_percentile(h, 50),
+                  (unsigned long long)coap_histogram_percentile(h, 90),
+                  (unsigned long long)coap_histogram_percentile(h, 99),
+                  (unsigned long long)(h->max * h->ns_per_tick));
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+void coap_stats_sampling(const unsigned every)
+{
+    _every = every;
+}
+
+uint64_t coap_stats_now(void)
+{
+#ifdef _USE_TSC
+    return __rdtsc();
+#else
+    return _monotonic_ns();
+#endif
+}
+
+uint64_t coap_stats_begin(void)
+{
+    _buffer_t *b = _buffer();
+    const unsigned every = _every;
+    if (!b || !every) {
+        return 0;
+    }
+    if (b->countdown == 0) {
+        b->countdown = every;
+    }
+    b->sampled = (--b->countdown == 0);
+    return b->sampled ? coap_stats_now() : 0;
+}
+
+uint64_t coap_stats_mark(void)
+{
+    return (_local && _local->sampled) ? coap_stats_now() : 0;
+}
+
+uint64_t coap_stats_lap(const uint64_t t, const coap_stats_stage_t stage)
+{
+    if (!t || (stage >= COAP_STATS_STAGES)) {
+        return 0;
+    }
+    const uint64_t now = coap_stats_now();
+    _record(&_local->stages[stage], now - t);
+    return now;
+}
+
+void coap_stats_end(const uint64_t t0, const coap_resource_t *resources,
+                    const coap_resource_t *rs)
+{
+    if (!t0 || !rs) {
+        return;
+    }
+    const size_t index = rs - resources;
+    _resources = resources;
+    if (index < COAP_STATS_RESOURCES) {
+        _record(&_local->resources[index], coap_stats_now() - t0);
+    }
+}
+
+int coap_stats_stage(const coap_stats_stage_t stage, coap_histogram_t *h)
+{
+    if (stage >= COAP_STATS_STAGES) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    _merge(h, offsetof(_buffer_t, stages) + stage * sizeof(coap_histogram_t));
+    return COAP_SUCCESS;
+}
+
+int coap_stats_resource(const size_t index, coap_histogram_t *h)
+{
+    if (index >= COAP_STATS_RESOURCES) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    _merge(h, offsetof(_buffer_t, resources) + index * sizeof(coap_histogram_t));
+    return COAP_SUCCESS;
+}
+
+void coap_stats_reset(void)
+{
+    pthread_mutex_lock(&_lock);
+    for (_buffer_t *b = _buffers; b; b = b->next) {
+        memset(b->stages, 0, sizeof(b->stages));
+        memset(b->resources, 0, sizeof(b->resources));
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+uint64_t coap_histogram_percentile(const coap_histogram_t *h, const double p)
+{
+    if (!h->count) {
+        return 0;
+    }
+    const uint64_t rank = (uint64_t)(p / 100.0 * (h->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < COAP_STATS_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = _bucket_value(i);
+            return (uint64_t)(((v < h->max) ? v : h->max) * h->ns_per_tick);
+        }
+    }
+    return (uint64_t)(h->max * h->ns_per_tick);
+}
+
+int coap_stats_handle_get(const coap_resource_t *resource,
+                          const coap_packet_t *inpkt,
+                          coap_packet_t *pkt)
+{
+    static const char *stages[COAP_STATS_STAGES] =
+        {"parse", "lookup", "handler", "build", "send"};
+    static const char *methods[] = {"?", "GET", "POST", "PUT", "DELETE"};
+    // the response refers to it until built
+    static __thread char text[COAP_STATS_TEXT_LEN];
+    coap_histogram_t *h = malloc(sizeof(*h));
+    size_t len = 0;
+    if (!h) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                  COAP_TYPE_ACK, COAP_RSPCODE_INTERNAL_SERVER_ERROR,
+                                  NULL, NULL, 0, pkt);
+    }
+    len = _print(text, sizeof(text), len, "n p50 p90 p99 max [ns]\n");
+    for (int s = 0; s < COAP_STATS_STAGES; ++s) {
+        coap_stats_stage((coap_stats_stage_t)s, h);
+        len = _print(text, sizeof(text), len, "%s", stages[s]);
+        len = _print_histogram(text, sizeof(text), len, h);
+    }
+    const coap_resource_t *rs = _resources;
+    for (size_t i = 0; rs && rs[i].handler && (i < COAP_STATS_RESOURCES); ++i) {
+        coap_stats_resource(i, h);
+        if (!h->count) {
+            continue;
+        }
+        len = _print(text, sizeof(text), len, "%s ",
+                     methods[(rs[i].method <= COAP_METHOD_DELETE) ? rs[i].method : 0]);
+        for (int j = 0; rs[i].path && (j < rs[i].path->count); ++j) {
+            len = _print(text, sizeof(text), len, "/%s", rs[i].path->items[j]);
+        }
+        len = _print_histogram(text, sizeof(text), len, h);
+    }
+    free(h);
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)text, len, pkt);
+}
+
+#endif /* MICROCOAP_STATS */
@@ -0,0 +1,175 @@
+#ifndef COAP_STATS_H
+#define COAP_STATS_H 1
+
+/**
+ * @file coap_stats.h
+ *
+ * Latency histograms per pipeline stage and per resource.
+ *
+ * Built with MICROCOAP_STATS only, otherwise the COAP_STATS_* macros expand
+ * to nothing and coap_stats.c is empty. Each thread records into a buffer of
+ * its own, readers merge the buffers of all threads. Histograms are log-linear
+ * like HDR histograms, i.e. each power of 2 is split into 8 buckets and
+ * reported values are within 12.5% of the recorded ones.
+ *
+ * Time is taken with clock_gettime(CLOCK_MONOTONIC), or with rdtsc on x86
+ * when built with COAP_STATS_RDTSC.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "coap.h"
+
+#ifndef COAP_STATS_RESOURCES
+#define COAP_STATS_RESOURCES    16      //!< resources tracked, in table order
+#endif
+#ifndef COAP_STATS_TEXT_LEN
+#define COAP_STATS_TEXT_LEN     512     //!< max. size of /.well-known/stats
+#endif
+
+#define COAP_STATS_SUB_BITS     3       //!< 2^3 buckets per power of 2
+#define COAP_STATS_MAX_BITS     40      //!< values are clamped to 2^40 ticks
+#define COAP_STATS_BUCKETS      ((COAP_STATS_MAX_BITS - COAP_STATS_SUB_BITS + 1) \
+                                 << COAP_STATS_SUB_BITS)
+
+/**
+ * Pipeline stage
+ */
+typedef enum
+{
+    COAP_STATS_PARSE            = 0,    //!< coap_parse()
+    COAP_STATS_LOOKUP,                  //!< finding the resource
+    COAP_STATS_HANDLER,                 //!< handler, or stamping the template
+    COAP_STATS_BUILD,                   //!< coap_build()
+    COAP_STATS_SEND,                    //!< handing the response to the transport
+    COAP_STATS_STAGES
+} coap_stats_stage_t;
+
+/**
+ * Latency histogram
+ */
+typedef struct coap_histogram
+{
+    uint64_t count;                     //!< number of samples
+    uint64_t sum;                       //!< sum of samples in ticks
+    uint64_t max;                       //!< largest sample in ticks
+    double ns_per_tick;                 //!< scale, set when read
+    uint64_t buckets[COAP_STATS_BUCKETS];
+} coap_histogram_t;
+
+#ifdef MICROCOAP_STATS
+
+/** start timing a packet, t is 0 unless it is sampled */
+#define COAP_STATS_BEGIN(t)             uint64_t t = coap_stats_begin(), t##_begin = t
+/** start timing within a packet already sampled, e.g. at the transport */
+#define COAP_STATS_MARK(t)              uint64_t t = coap_stats_mark()
+/** record time since t for a stage and restart t */
+#define COAP_STATS_LAP(t, stage)        (t = coap_stats_lap((t), (stage)))
+/** record time since COAP_STATS_BEGIN(t) for the resource handling the packet */
+#define COAP_STATS_END(t, resources, rs) coap_stats_end(t##_begin, (resources), (rs))
+
+/**
+ * @brief Set sampling rate
+ *
+ * @param[in] every Time one packet out of \p every per thread, 1 by default,
+ * 0 turns timing off.
+ */
+void coap_stats_sampling(const unsigned every);
+
+/**
+ * @brief Get current time in ticks
+ */
+uint64_t coap_stats_now(void);
+
+/**
+ * @brief Decide whether to sample the next packet
+ *
+ * @return the current time if sampled, 0 otherwise
+ */
+uint64_t coap_stats_begin(void);
+
+/**
+ * @return the current time if the current packet is sampled, 0 otherwise
+ */
+uint64_t coap_stats_mark(void);
+
+/**
+ * @brief Record a stage
+ *
+ * @param[in] t Start of the stage, 0 if not sampled
+ * @param[in] stage The stage
+ *
+ * @return the current time, the start of the next stage, or 0
+ */
+uint64_t coap_stats_lap(const uint64_t t, const coap_stats_stage_t stage);
+
+/**
+ * @brief Record handling a packet by a resource
+ *
+ * @param[in] t0 Value returned by coap_stats_begin()
+ * @param[in] resources The resource table
+ * @param[in] rs The resource in \p resources, NULL if none matched
+ */
+void coap_stats_end(const uint64_t t0, const coap_resource_t *resources,
+                    const coap_resource_t *rs);
+
+/**
+ * @brief Merge the histograms of a stage over all threads
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED for an unknown stage
+ */
+int coap_stats_stage(const coap_stats_stage_t stage, coap_histogram_t *h);
+
+/**
+ * @brief Merge the histograms of a resource over all threads
+ *
+ * @param[in] index Position of the resource in its table
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if \p index is not tracked
+ */
+int coap_stats_resource(const size_t index, coap_histogram_t *h);
+
+/**
+ * @brief Clear the histograms of all threads
+ */
+void coap_stats_reset(void);
+
+/**
+ * @brief Get a percentile of a merged histogram
+ *
+ * @param[in] h The histogram
+ * @param[in] p Percentile, 0 to 100
+ *
+ * @return value in ns, 0 if the histogram is empty
+ */
+uint64_t coap_histogram_percentile(const coap_histogram_t *h, const double p);
+
+/**
+ * @brief Handler for /.well-known/stats
+ *
+ * Responds with count, median, 90th and 99th percentile and maximum in ns
+ * per stage and per resource, as plain text. Resources are named after the
+ * table last passed to coap_stats_end().
+ */
+int coap_stats_handle_get(const coap_resource_t *resource,
+                          const coap_packet_t *inpkt,
+                          coap_packet_t *pkt);
+
+#else /* MICROCOAP_STATS */
+
+#define COAP_STATS_BEGIN(t)
+#define COAP_STATS_MARK(t)
+#define COAP_STATS_LAP(t, stage)
+#define COAP_STATS_END(t, resources, rs)
+
+#endif /* MICROCOAP_STATS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_STATS_H
@@ -0,0 +1,30 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <time.h>
+
+#include "coap_time.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+static coap_tick_t _monotonic_now(void);
+
+static coap_clock_fn _clock = _monotonic_now;
+
+static coap_tick_t _monotonic_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (coap_tick_t)ts.tv_sec * COAP_TICKS_PER_SEC +
+           ts.tv_nsec / (1000000000 / COAP_TICKS_PER_SEC);
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+coap_tick_t coap_clock_now(void)
+{
+    return _clock();
+}
+
+void coap_clock_set(coap_clock_fn clock)
+{
+    _clock = clock ? clock : _monotonic_now;
+}
@@ -0,0 +1,47 @@
+#ifndef COAP_TIME_H
+#define COAP_TIME_H 1
+
+/**
+ * @file coap_time.h
+ *
+ * Time base of the library. All timeouts (retransmission, Max-Age, ...) are
+ * measured in milliseconds of a monotonic clock, which may be replaced, e.g.
+ * by a virtual clock for simulation.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef uint64_t coap_tick_t;   //!< point in time in milliseconds
+
+#define COAP_TICKS_PER_SEC  1000    //!< resolution of coap_tick_t
+#define COAP_TICK_NEVER     UINT64_MAX  //!< no deadline
+
+/**
+ * @brief callback function returning the current time
+ */
+typedef coap_tick_t (*coap_clock_fn)(void);
+
+/**
+ * @brief Get current time
+ *
+ * @return milliseconds of the configured clock, CLOCK_MONOTONIC by default
+ */
+coap_tick_t coap_clock_now(void);
+
+/**
+ * @brief Replace the clock
+ *
+ * @param[in] clock Function returning the current time, NULL restores the
+ * default monotonic clock.
+ */
+void coap_clock_set(coap_clock_fn clock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_TIME_H
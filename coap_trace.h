@@ -0,0 +1,105 @@
+#ifndef COAP_TRACE_H
+#define COAP_TRACE_H 1
+
+/**
+ * @file coap_trace.h
+ *
+ * Static tracepoints (USDT) of provider "microcoap" on the packet pipeline.
+ *
+ * A probe is a single nop plus an ELF note describing its arguments, so it
+ * costs next to nothing until bpftrace or perf attach to it. sys/sdt.h of
+ * systemtap is used if installed, otherwise the note is emitted here for
+ * x86-64 and AArch64 with GCC or clang. Define MICROCOAP_NO_TRACE to remove
+ * the probes entirely.
+ *
+ * Probes, all arguments are 64 bit unsigned:
+ *  - parse_entry(buf, buflen)
+ *  - parse_return(buf, rc)
+ *  - dispatch(resource, method, msgid, name), name is the last path item of
+ *    the resource, resource and name are 0 if no resource matched
+ *  - handler_return(resource, state, rspcode)
+ *  - template(resource, msgid), response copied from a template
+ *  - link_format(resource, msgid), link format rendered into the response
+ *  - build(pkt, buflen, rc)
+ *  - retransmit(msgid, retransmits, timeout_ms), by the client
+ *  - timeout(msgid, retransmits), client exchange given up
+ */
+
+#include <stdint.h>
+
+#if defined(MICROCOAP_NO_TRACE)
+#define _COAP_TRACE_NONE 1
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _COAP_TRACE_SDT 1
+#endif
+#endif
+
+#if defined(_COAP_TRACE_SDT)
+
+#include <sys/sdt.h>
+#define COAP_TRACE1(name, a) \
+    DTRACE_PROBE1(microcoap, name, (uint64_t)(a))
+#define COAP_TRACE2(name, a, b) \
+    DTRACE_PROBE2(microcoap, name, (uint64_t)(a), (uint64_t)(b))
+#define COAP_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(microcoap, name, (uint64_t)(a), (uint64_t)(b), (uint64_t)(c))
+#define COAP_TRACE4(name, a, b, c, d) \
+    DTRACE_PROBE4(microcoap, name, (uint64_t)(a), (uint64_t)(b), (uint64_t)(c), \
+                  (uint64_t)(d))
+
+#elif !defined(_COAP_TRACE_NONE) && defined(__GNUC__) && defined(__ELF__) && \
+      (defined(__x86_64__) || defined(__aarch64__))
+
+/*
+ * the layout of sys/sdt.h, version 3 notes: address of the probe, of
+ * _.stapsdt.base to detect prelinking, of the semaphore (none), then
+ * provider, name and arguments as SIZE@OPERAND
+ */
+#define _COAP_SDT(name, args, ...) \
+    __asm__ __volatile__( \
+        "990: nop\n" \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+        ".balign 4\n" \
+        ".4byte 992f-991f, 994f-993f, 3\n" \
+        "991: .asciz \"stapsdt\"\n" \
+        "992: .balign 4\n" \
+        "993: .8byte 990b\n" \
+        ".8byte _.stapsdt.base\n" \
+        ".8byte 0\n" \
+        ".asciz \"microcoap\"\n" \
+        ".asciz \"" #name "\"\n" \
+        ".asciz \"" args "\"\n" \
+        "994: .balign 4\n" \
+        ".popsection\n" \
+        ".ifndef _.stapsdt.base\n" \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n" \
+        ".hidden _.stapsdt.base\n" \
+        "_.stapsdt.base: .space 1\n" \
+        ".size _.stapsdt.base, 1\n" \
+        ".popsection\n" \
+        ".endif\n" \
+        :: __VA_ARGS__)
+
+#define COAP_TRACE1(name, a) \
+    _COAP_SDT(name, "8@%0", "nor"((uint64_t)(a)))
+#define COAP_TRACE2(name, a, b) \
+    _COAP_SDT(name, "8@%0 8@%1", "nor"((uint64_t)(a)), "nor"((uint64_t)(b)))
+#define COAP_TRACE3(name, a, b, c) \
+    _COAP_SDT(name, "8@%0 8@%1 8@%2", "nor"((uint64_t)(a)), "nor"((uint64_t)(b)), \
+              "nor"((uint64_t)(c)))
+#define COAP_TRACE4(name, a, b, c, d) \
+    _COAP_SDT(name, "8@%0 8@%1 8@%2 8@%3", "nor"((uint64_t)(a)), \
+              "nor"((uint64_t)(b)), "nor"((uint64_t)(c)), "nor"((uint64_t)(d)))
+
+#else
+
+#define COAP_TRACE1(name, a)
+#define COAP_TRACE2(name, a, b)
+#define COAP_TRACE3(name, a, b, c)
+#define COAP_TRACE4(name, a, b, c, d)
+
+#endif
+
+#endif //COAP_TRACE_H
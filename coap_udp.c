@@ -0,0 +1,955 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/io_uring.h>
+
+#include "coap_udp.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+#define _RING_ENTRIES   (2 * COAP_UDP_BATCH)
+#define _RECV_TAG       UINT64_MAX
+#define _CTRL_SIZE      (CMSG_SPACE(sizeof(int)) + \
+                         CMSG_SPACE(sizeof(struct in6_pktinfo)))
+#define _RBUF_SIZE      (sizeof(struct io_uring_recvmsg_out) + \
+                         sizeof(struct sockaddr_storage) + \
+                         _CTRL_SIZE + COAP_UDP_RECV_SIZE)
+#define _GSO_MAX        65000   //!< payload bytes per GSO send, below 64k
+#define _FALLBACK       (-1)
+#define _ALL            ((COAP_UDP_BATCH >= 64) ? UINT64_MAX : \
+                         ((1ULL << COAP_UDP_BATCH) - 1))
+#define _OUTBUFS        64      //!< datagram buffers, segments share a message
+
+/* message, i.e. one datagram or a run of segments sent at once */
+typedef struct
+{
+    struct iovec iov[COAP_UDP_GSO_SEGMENTS];
+    struct sockaddr_storage addr;
+    uint64_t bufs;                      //!< datagram buffers referenced
+    size_t total;                       //!< bytes of all segments
+    uint16_t segsize;                   //!< size of all but the last segment
+    bool closed;                        //!< last segment short, no appending
+    union {
+        struct cmsghdr align;
+        uint8_t buf[CMSG_SPACE(sizeof(uint16_t))];
+    } ctrl;                             //!< UDP_SEGMENT
+} _outmsg_t;
+
+typedef union
+{
+    struct cmsghdr align;
+    uint8_t buf[_CTRL_SIZE];
+} _inctrl_t;                            //!< UDP_GRO, and IP_PKTINFO or IPV6_PKTINFO
+
+struct coap_udp_state
+{
+    // provided buffer ring, first so that it is page aligned
+    struct io_uring_buf bufs[COAP_UDP_RECV_BUFFERS];
+    uint8_t rbufs[COAP_UDP_RECV_BUFFERS][_RBUF_SIZE];
+    size_t size;                        //!< size of this mapping
+    // epoll backend
+    int epfd;
+    struct mmsghdr in[COAP_UDP_BATCH];
+    struct iovec iniov[COAP_UDP_BATCH];
+    struct sockaddr_storage inaddr[COAP_UDP_BATCH];
+    _inctrl_t inctrl[COAP_UDP_BATCH];
+    uint8_t inbuf[COAP_UDP_BATCH][COAP_UDP_RECV_SIZE];
+    unsigned outcount;                  //!< messages queued for sendmmsg
+    // send messages and datagram buffers, queued (epoll) or in flight (io_uring)
+    struct mmsghdr out[COAP_UDP_BATCH];
+    _outmsg_t outmsg[COAP_UDP_BATCH];
+    uint64_t msgbusy;                   //!< messages in flight, io_uring
+    int open;                           //!< message accepting segments, or -1
+    uint8_t outbuf[_OUTBUFS][COAP_UDP_MAX_PDU];
+    uint64_t bufbusy;                   //!< datagram buffers in use
+    // io_uring backend
+    int ringfd;
+    bool fixed_file;                    //!< socket registered as file 0
+    bool armed;                         //!< multishot receive active
+    bool received;                      //!< multishot receive worked once
+    void *ring;
+    size_t ringlen;
+    struct io_uring_sqe *sqes;
+    size_t sqeslen;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;             //!< tail incl. SQEs not yet published
+    unsigned sqpending;                 //!< SQEs not yet submitted
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    uint16_t br_tail;
+    struct msghdr rmsg;                 //!< layout of multishot receive buffers
+    // receive completions reaped while sending, dispatched by the next run
+    struct io_uring_cqe deferred[COAP_UDP_RECV_BUFFERS + 1];
+    unsigned ndeferred;
+};
+
+static int _io_uring_setup(unsigned entries, struct io_uring_params *p);
+static int _io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                           unsigned flags, void *arg, size_t argsz);
+static int _io_uring_register(int fd, unsigned opcode, void *arg,
+                              unsigned nr_args);
+static void _to_endpoint(const void *addr, const socklen_t len,
+                         coap_endpoint_t *ep);
+static int _gro_size(const struct msghdr *msg);
+static bool _is_multicast(const struct msghdr *msg);
+static void _deliver(coap_udp_t *u, const coap_endpoint_t *ep,
+                     const uint8_t *buf, const size_t len, const int segsize);
+static int _send_direct(coap_udp_t *u, const coap_endpoint_t *ep,
+                        const uint8_t *buf, const size_t buflen);
+static int _alloc_buf(coap_udp_state_t *s, const uint8_t *buf, const size_t buflen);
+static bool _append(coap_udp_t *u, const coap_endpoint_t *ep,
+                    const uint8_t *buf, const size_t buflen);
+static void _init_msg(coap_udp_state_t *s, const unsigned m,
+                      const coap_endpoint_t *ep, const int b,
+                      const size_t buflen);
+static void _release_msg(coap_udp_t *u, const unsigned m, const int res);
+static int _epoll_open(coap_udp_t *u);
+static void _epoll_flush(coap_udp_t *u);
+static int _epoll_send(coap_udp_t *u, const coap_endpoint_t *ep,
+                       const uint8_t *buf, const size_t buflen);
+static int _epoll_run(coap_udp_t *u, const int timeout_ms);
+static int _uring_open(coap_udp_t *u);
+static void _uring_close(coap_udp_state_t *s);
+static struct io_uring_sqe *_uring_get_sqe(coap_udp_t *u);
+static void _uring_arm_recv(coap_udp_t *u);
+static int _uring_recv(coap_udp_t *u, const struct io_uring_cqe *cqe);
+static int _uring_reap(coap_udp_t *u, const bool dispatch);
+static void _uring_flush(coap_udp_t *u);
+static int _uring_send(coap_udp_t *u, const coap_endpoint_t *ep,
+                       const uint8_t *buf, const size_t buflen);
+static int _uring_run(coap_udp_t *u, const int timeout_ms);
+static int _open(coap_udp_t *u, const struct sockaddr *addr,
+                 const socklen_t addrlen, const coap_udp_backend_t backend,
+                 coap_udp_handler handler, void *arg, const bool reuseport);
+
+/* no liburing, the three system calls are all it takes */
+static int _io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                           unsigned flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+static int _io_uring_register(int fd, unsigned opcode, void *arg,
+                              unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void _to_endpoint(const void *addr, const socklen_t len,
+                         coap_endpoint_t *ep)
+{
+    ep->len = (len < COAP_ENDPOINT_MAXLEN) ? len : COAP_ENDPOINT_MAXLEN;
+    memcpy(ep->addr, addr, ep->len);
+}
+
+/* segment size of a coalesced burst, 0 for a single datagram */
+static int _gro_size(const struct msghdr *msg)
+{
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c)) {
+        if ((c->cmsg_level == SOL_UDP) && (c->cmsg_type == UDP_GRO)) {
+            int segsize;
+            memcpy(&segsize, CMSG_DATA(c), sizeof(segsize));
+            return segsize;
+        }
+    }
+    return 0;
+}
+
+/* destination address of the datagram is a group, known once joined */
+static bool _is_multicast(const struct msghdr *msg)
+{
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c)) {
+        if ((c->cmsg_level == IPPROTO_IP) && (c->cmsg_type == IP_PKTINFO)) {
+            struct in_pktinfo pi;
+            memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+            return IN_MULTICAST(ntohl(pi.ipi_addr.s_addr));
+        }
+        if ((c->cmsg_level == IPPROTO_IPV6) && (c->cmsg_type == IPV6_PKTINFO)) {
+            struct in6_pktinfo pi;
+            uint32_t v4;
+            memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+            // IPv4 groups joined by an IPv6 socket
+            memcpy(&v4, &pi.ipi6_addr.s6_addr[12], sizeof(v4));
+            return IN6_IS_ADDR_MULTICAST(&pi.ipi6_addr) ||
+                   (IN6_IS_ADDR_V4MAPPED(&pi.ipi6_addr) && IN_MULTICAST(ntohl(v4)));
+        }
+    }
+    return false;
+}
+
+static void _deliver(coap_udp_t *u, const coap_endpoint_t *ep,
+                     const uint8_t *buf, const size_t len, const int segsize)
+{
+    const size_t step = (segsize > 0) ? (size_t)segsize : len;
+    for (size_t off = 0; off < len; off += step) {
+        const size_t n = (len - off < step) ? len - off : step;
+        u->rx++;
+        if (u->pcap) {
+            coap_pcap_capture(u->pcap, false, &u->local, ep, buf + off, n);
+        }
+        u->handler(u->arg, ep, buf + off, n);
+    }
+}
+
+/* out of buffers or messages, do it the slow way */
+static int _send_direct(coap_udp_t *u, const coap_endpoint_t *ep,
+                        const uint8_t *buf, const size_t buflen)
+{
+    u->syscalls++;
+    u->tx++;
+    if (sendto(u->fd, buf, buflen, 0,
+               (const struct sockaddr *)ep->addr, ep->len) < 0) {
+        return COAP_ERR_IO;
+    }
+    return COAP_SUCCESS;
+}
+
+/* copy datagram into a free buffer, -1 if there is none */
+static int _alloc_buf(coap_udp_state_t *s, const uint8_t *buf, const size_t buflen)
+{
+    if (s->bufbusy == UINT64_MAX) {
+        return -1;
+    }
+    const int b = __builtin_ctzll(~s->bufbusy);
+    s->bufbusy |= (1ULL << b);
+    memcpy(s->outbuf[b], buf, buflen);
+    return b;
+}
+
+/* add datagram as segment to the open message, if it continues the run */
+static bool _append(coap_udp_t *u, const coap_endpoint_t *ep,
+                    const uint8_t *buf, const size_t buflen)
+{
+    coap_udp_state_t *s = u->state;
+    if (!(u->offload & COAP_UDP_GSO) || (s->open < 0)) {
+        return false;
+    }
+    _outmsg_t *msg = &s->outmsg[s->open];
+    struct msghdr *hdr = &s->out[s->open].msg_hdr;
+    if (msg->closed || (buflen > msg->segsize) || (buflen == 0) ||
+        (hdr->msg_iovlen >= COAP_UDP_GSO_SEGMENTS) ||
+        (msg->total + buflen > _GSO_MAX) || (hdr->msg_namelen != ep->len) ||
+        memcmp(&msg->addr, ep->addr, ep->len)) {
+        return false;
+    }
+    const int b = _alloc_buf(s, buf, buflen);
+    if (b < 0) {
+        return false;
+    }
+    msg->iov[hdr->msg_iovlen].iov_base = s->outbuf[b];
+    msg->iov[hdr->msg_iovlen].iov_len = buflen;
+    hdr->msg_iovlen++;
+    msg->bufs |= (1ULL << b);
+    msg->total += buflen;
+    msg->closed = (buflen < msg->segsize);
+    // the kernel splits the payload every segsize bytes
+    struct cmsghdr *c = &msg->ctrl.align;
+    c->cmsg_level = SOL_UDP;
+    c->cmsg_type = UDP_SEGMENT;
+    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(c), &msg->segsize, sizeof(uint16_t));
+    hdr->msg_control = msg->ctrl.buf;
+    hdr->msg_controllen = sizeof(msg->ctrl.buf);
+    return true;
+}
+
+static void _init_msg(coap_udp_state_t *s, const unsigned m,
+                      const coap_endpoint_t *ep, const int b,
+                      const size_t buflen)
+{
+    _outmsg_t *msg = &s->outmsg[m];
+    struct msghdr *hdr = &s->out[m].msg_hdr;
+    memcpy(&msg->addr, ep->addr, ep->len);
+    msg->iov[0].iov_base = s->outbuf[b];
+    msg->iov[0].iov_len = buflen;
+    msg->bufs = (1ULL << b);
+    msg->total = buflen;
+    msg->segsize = (uint16_t)buflen;
+    msg->closed = false;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->msg_name = &msg->addr;
+    hdr->msg_namelen = ep->len;
+    hdr->msg_iov = msg->iov;
+    hdr->msg_iovlen = 1;
+    s->open = m;
+}
+
+/*
+ * free buffers of a message once sent, res < 0 if sending failed. Without
+ * checksum offload on the route the kernel refuses GSO with EIO, then the
+ * segments go out one by one and GSO stays off.
+ */
+static void _release_msg(coap_udp_t *u, const unsigned m, const int res)
+{
+    coap_udp_state_t *s = u->state;
+    _outmsg_t *msg = &s->outmsg[m];
+    struct msghdr *hdr = &s->out[m].msg_hdr;
+    if ((res == -EIO) && (hdr->msg_iovlen > 1)) {
+        coap_endpoint_t ep;
+        u->offload &= ~COAP_UDP_GSO;
+        _to_endpoint(&msg->addr, hdr->msg_namelen, &ep);
+        for (size_t i = 0; i < hdr->msg_iovlen; ++i) {
+            _send_direct(u, &ep, msg->iov[i].iov_base, msg->iov[i].iov_len);
+        }
+    }
+    else if (res >= 0) {
+        u->tx += hdr->msg_iovlen;
+    }
+    s->bufbusy &= ~msg->bufs;
+    msg->bufs = 0;
+}
+
+static int _epoll_open(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    struct epoll_event ev;
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (s->epfd < 0) {
+        return COAP_ERR_IO;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, u->fd, &ev) < 0) {
+        return COAP_ERR_IO;
+    }
+    for (unsigned i = 0; i < COAP_UDP_BATCH; ++i) {
+        s->iniov[i].iov_base = s->inbuf[i];
+        s->iniov[i].iov_len = COAP_UDP_RECV_SIZE;
+    }
+    s->outcount = 0;
+    s->open = -1;
+    u->backend = COAP_UDP_EPOLL;
+    return COAP_SUCCESS;
+}
+
+static void _epoll_flush(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    unsigned sent = 0;
+    while (sent < s->outcount) {
+        u->syscalls++;
+        int n = sendmmsg(u->fd, &s->out[sent], s->outcount - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // drop the message that failed, CoAP copes with loss
+            _release_msg(u, sent, -errno);
+            n = 1;
+        }
+        else {
+            for (int i = 0; i < n; ++i) {
+                _release_msg(u, sent + i, 0);
+            }
+        }
+        sent += n;
+    }
+    s->outcount = 0;
+    s->open = -1;
+}
+
+static int _epoll_send(coap_udp_t *u, const coap_endpoint_t *ep,
+                       const uint8_t *buf, const size_t buflen)
+{
+    coap_udp_state_t *s = u->state;
+    if (_append(u, ep, buf, buflen)) {
+        return COAP_SUCCESS;
+    }
+    if (s->outcount == COAP_UDP_BATCH) {
+        _epoll_flush(u);
+    }
+    int b = _alloc_buf(s, buf, buflen);
+    if (b < 0) {
+        _epoll_flush(u);
+        b = _alloc_buf(s, buf, buflen);
+    }
+    _init_msg(s, s->outcount++, ep, b, buflen);
+    return COAP_SUCCESS;
+}
+
+static int _epoll_run(coap_udp_t *u, const int timeout_ms)
+{
+    coap_udp_state_t *s = u->state;
+    struct epoll_event ev;
+    coap_endpoint_t ep;
+    _epoll_flush(u);
+    u->syscalls++;
+    int n = epoll_wait(s->epfd, &ev, 1, timeout_ms);
+    if (n <= 0) {
+        return ((n < 0) && (errno != EINTR)) ? COAP_ERR_IO : COAP_SUCCESS;
+    }
+    for (;;) {
+        for (unsigned i = 0; i < COAP_UDP_BATCH; ++i) {
+            struct msghdr *hdr = &s->in[i].msg_hdr;
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_name = &s->inaddr[i];
+            hdr->msg_namelen = sizeof(s->inaddr[i]);
+            hdr->msg_iov = &s->iniov[i];
+            hdr->msg_iovlen = 1;
+            hdr->msg_control = s->inctrl[i].buf;
+            hdr->msg_controllen = sizeof(s->inctrl[i].buf);
+        }
+        u->syscalls++;
+        n = recvmmsg(u->fd, s->in, COAP_UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                break;
+            }
+            return COAP_ERR_IO;
+        }
+        for (int i = 0; i < n; ++i) {
+            const struct msghdr *hdr = &s->in[i].msg_hdr;
+            if (hdr->msg_flags & MSG_TRUNC) {
+                continue;
+            }
+            _to_endpoint(&s->inaddr[i], hdr->msg_namelen, &ep);
+            u->multicast = u->groups && _is_multicast(hdr);
+            _deliver(u, &ep, s->inbuf[i], s->in[i].msg_len, _gro_size(hdr));
+        }
+        _epoll_flush(u);
+        if (n < COAP_UDP_BATCH) {
+            break;
+        }
+    }
+    return COAP_SUCCESS;
+}
+
+static int _uring_open(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    struct io_uring_params p;
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                              IORING_FEAT_EXT_ARG;
+    memset(&p, 0, sizeof(p));
+    // completions are only ever reaped by the thread submitting
+    p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+              IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    s->ringfd = _io_uring_setup(_RING_ENTRIES, &p);
+    if ((s->ringfd < 0) && (errno == EINVAL)) {
+        memset(&p, 0, sizeof(p));
+        s->ringfd = _io_uring_setup(_RING_ENTRIES, &p);
+    }
+    if (s->ringfd < 0) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    if ((p.features & required) != required) {
+        goto fail;
+    }
+    // SQ and CQ ring share one mapping
+    const size_t sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    const size_t cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    s->ringlen = (sqlen > cqlen) ? sqlen : cqlen;
+    s->ring = mmap(NULL, s->ringlen, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, s->ringfd, IORING_OFF_SQ_RING);
+    if (s->ring == MAP_FAILED) {
+        s->ring = NULL;
+        goto fail;
+    }
+    s->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    s->sqes = mmap(NULL, s->sqeslen, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, s->ringfd, IORING_OFF_SQES);
+    if (s->sqes == MAP_FAILED) {
+        s->sqes = NULL;
+        goto fail;
+    }
+    uint8_t *ring = s->ring;
+    s->sq_head = (unsigned *)(ring + p.sq_off.head);
+    s->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    s->sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    s->sq_array = (unsigned *)(ring + p.sq_off.array);
+    s->sq_entries = p.sq_entries;
+    s->sq_local_tail = *s->sq_tail;
+    s->sqpending = 0;
+    s->cq_head = (unsigned *)(ring + p.cq_off.head);
+    s->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    s->cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    s->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    // hand all receive buffers to the kernel, the tail overlays bufs[0]
+    struct io_uring_buf_ring *br = (struct io_uring_buf_ring *)s->bufs;
+    for (unsigned i = 0; i < COAP_UDP_RECV_BUFFERS; ++i) {
+        s->bufs[i].addr = (uintptr_t)s->rbufs[i];
+        s->bufs[i].len = _RBUF_SIZE;
+        s->bufs[i].bid = i;
+    }
+    s->br_tail = COAP_UDP_RECV_BUFFERS;
+    __atomic_store_n(&br->tail, s->br_tail, __ATOMIC_RELEASE);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)br;
+    reg.ring_entries = COAP_UDP_RECV_BUFFERS;
+    reg.bgid = 0;
+    if (_io_uring_register(s->ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        goto fail;
+    }
+    // saves a file table lookup per operation, optional
+    int fds[1] = {u->fd};
+    s->fixed_file = (_io_uring_register(s->ringfd, IORING_REGISTER_FILES, fds, 1) == 0);
+
+    // room for the UDP_GRO and PKTINFO control messages in every buffer
+    memset(&s->rmsg, 0, sizeof(s->rmsg));
+    s->rmsg.msg_namelen = sizeof(struct sockaddr_storage);
+    s->rmsg.msg_controllen = _CTRL_SIZE;
+    s->msgbusy = 0;
+    s->open = -1;
+    s->armed = false;
+    s->received = false;
+    _uring_arm_recv(u);
+    u->backend = COAP_UDP_URING;
+    return COAP_SUCCESS;
+fail:
+    _uring_close(s);
+    return COAP_ERR_UNSUPPORTED;
+}
+
+static void _uring_close(coap_udp_state_t *s)
+{
+    if (s->sqes) {
+        munmap(s->sqes, s->sqeslen);
+        s->sqes = NULL;
+    }
+    if (s->ring) {
+        munmap(s->ring, s->ringlen);
+        s->ring = NULL;
+    }
+    if (s->ringfd >= 0) {
+        close(s->ringfd);
+        s->ringfd = -1;
+    }
+}
+
+static struct io_uring_sqe *_uring_get_sqe(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    const unsigned head = __atomic_load_n(s->sq_head, __ATOMIC_ACQUIRE);
+    if (s->sq_local_tail - head >= s->sq_entries) {
+        return NULL;
+    }
+    const unsigned idx = s->sq_local_tail & *s->sq_mask;
+    struct io_uring_sqe *sqe = &s->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    if (s->fixed_file) {
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+    }
+    else {
+        sqe->fd = u->fd;
+    }
+    s->sq_array[idx] = idx;
+    s->sq_local_tail++;
+    s->sqpending++;
+    return sqe;
+}
+
+/* one request keeps delivering datagrams until it runs out of buffers */
+static void _uring_arm_recv(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    struct io_uring_sqe *sqe = _uring_get_sqe(u);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->addr = (uintptr_t)&s->rmsg;
+    sqe->len = 1;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = _RECV_TAG;
+    s->armed = true;
+}
+
+/* dispatch a receive completion and recycle its buffer */
+static int _uring_recv(coap_udp_t *u, const struct io_uring_cqe *cqe)
+{
+    coap_udp_state_t *s = u->state;
+    coap_endpoint_t ep;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        s->armed = false;
+    }
+    if (cqe->res < 0) {
+        // kernel without multishot recvmsg
+        if (!s->received && ((cqe->res == -EINVAL) || (cqe->res == -EOPNOTSUPP))) {
+            return _FALLBACK;
+        }
+        return COAP_SUCCESS;
+    }
+    s->received = true;
+    const unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const uint8_t *b = s->rbufs[bid];
+    const struct io_uring_recvmsg_out *o = (const struct io_uring_recvmsg_out *)b;
+    if (!(o->flags & MSG_TRUNC)) {
+        struct msghdr ctrl;
+        const uint8_t *name = b + sizeof(*o);
+        memset(&ctrl, 0, sizeof(ctrl));
+        ctrl.msg_control = (void *)(name + s->rmsg.msg_namelen);
+        ctrl.msg_controllen = o->controllen;
+        _to_endpoint(name, o->namelen, &ep);
+        u->multicast = u->groups && _is_multicast(&ctrl);
+        _deliver(u, &ep, name + s->rmsg.msg_namelen + s->rmsg.msg_controllen,
+                 o->payloadlen, _gro_size(&ctrl));
+    }
+    struct io_uring_buf *buf = &s->bufs[s->br_tail & (COAP_UDP_RECV_BUFFERS - 1)];
+    buf->addr = (uintptr_t)b;
+    buf->len = _RBUF_SIZE;
+    buf->bid = bid;
+    s->br_tail++;
+    return COAP_SUCCESS;
+}
+
+/*
+ * consume completions. Unless dispatching, receives are put aside, so
+ * that sending never calls the handler.
+ */
+static int _uring_reap(coap_udp_t *u, const bool dispatch)
+{
+    coap_udp_state_t *s = u->state;
+    struct io_uring_buf_ring *br = (struct io_uring_buf_ring *)s->bufs;
+    int rc = COAP_SUCCESS;
+    for (;;) {
+        // the handler may send and reap in turn, consume before dispatching
+        const unsigned head = *s->cq_head;
+        if (head == __atomic_load_n(s->cq_tail, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        const struct io_uring_cqe cqe = s->cqes[head & *s->cq_mask];
+        if ((cqe.user_data == _RECV_TAG) && !dispatch &&
+            (s->ndeferred == sizeof(s->deferred) / sizeof(s->deferred[0]))) {
+            break;
+        }
+        __atomic_store_n(s->cq_head, head + 1, __ATOMIC_RELEASE);
+        if (cqe.user_data != _RECV_TAG) {
+            _release_msg(u, (unsigned)cqe.user_data, cqe.res);
+            s->msgbusy &= ~(1ULL << cqe.user_data);
+        }
+        else if (!dispatch) {
+            s->deferred[s->ndeferred++] = cqe;
+        }
+        else if (_uring_recv(u, &cqe) == _FALLBACK) {
+            rc = _FALLBACK;
+        }
+        __atomic_store_n(&br->tail, s->br_tail, __ATOMIC_RELEASE);
+    }
+    return rc;
+}
+
+/* submit queued sends to free their buffers, as epoll does when full */
+static void _uring_flush(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    __atomic_store_n(s->sq_tail, s->sq_local_tail, __ATOMIC_RELEASE);
+    s->open = -1;
+    u->syscalls++;
+    int n = _io_uring_enter(s->ringfd, s->sqpending, 0, IORING_ENTER_GETEVENTS,
+                            NULL, 0);
+    if (n > 0) {
+        s->sqpending -= ((unsigned)n < s->sqpending) ? (unsigned)n : s->sqpending;
+    }
+    _uring_reap(u, false);
+}
+
+/* messages may take segments until submitted, the kernel copies msghdr then */
+static int _uring_send(coap_udp_t *u, const coap_endpoint_t *ep,
+                       const uint8_t *buf, const size_t buflen)
+{
+    coap_udp_state_t *s = u->state;
+    if (_append(u, ep, buf, buflen)) {
+        return COAP_SUCCESS;
+    }
+    if (((s->msgbusy & _ALL) == _ALL) || (s->bufbusy == UINT64_MAX)) {
+        _uring_flush(u);
+    }
+    if ((s->msgbusy & _ALL) == _ALL) {
+        return _send_direct(u, ep, buf, buflen);
+    }
+    const unsigned m = __builtin_ctzll(~s->msgbusy);
+    const int b = _alloc_buf(s, buf, buflen);
+    if (b < 0) {
+        return _send_direct(u, ep, buf, buflen);
+    }
+    struct io_uring_sqe *sqe = _uring_get_sqe(u);
+    if (!sqe) {
+        s->bufbusy &= ~(1ULL << b);
+        return _send_direct(u, ep, buf, buflen);
+    }
+    _init_msg(s, m, ep, b, buflen);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = (uintptr_t)&s->out[m].msg_hdr;
+    sqe->len = 1;
+    sqe->user_data = m;
+    s->msgbusy |= (1ULL << m);
+    return COAP_SUCCESS;
+}
+
+static int _uring_run(coap_udp_t *u, const int timeout_ms)
+{
+    coap_udp_state_t *s = u->state;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if ((timeout_ms >= 0) || s->ndeferred) {
+        const int t = s->ndeferred ? 0 : timeout_ms;
+        ts.tv_sec = t / 1000;
+        ts.tv_nsec = (t % 1000) * 1000000LL;
+        arg.ts = (uintptr_t)&ts;
+    }
+    // submit queued sends and wait, one system call
+    __atomic_store_n(s->sq_tail, s->sq_local_tail, __ATOMIC_RELEASE);
+    s->open = -1;
+    u->syscalls++;
+    int n = _io_uring_enter(s->ringfd, s->sqpending, 1,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                            &arg, sizeof(arg));
+    if (n < 0) {
+        if ((errno != ETIME) && (errno != EINTR) && (errno != EBUSY)) {
+            return COAP_ERR_IO;
+        }
+    }
+    else {
+        s->sqpending -= ((unsigned)n < s->sqpending) ? (unsigned)n : s->sqpending;
+    }
+    int rc = COAP_SUCCESS;
+    do {
+        // put aside while sending, older than anything left in the ring
+        for (unsigned i = 0; i < s->ndeferred; ++i) {
+            if (_uring_recv(u, &s->deferred[i]) == _FALLBACK) {
+                rc = _FALLBACK;
+            }
+        }
+        s->ndeferred = 0;
+        if (_uring_reap(u, true) == _FALLBACK) {
+            rc = _FALLBACK;
+        }
+    } while (s->ndeferred);
+    if (rc == _FALLBACK) {
+        return rc;
+    }
+    if (!s->armed) {
+        _uring_arm_recv(u);
+    }
+    return COAP_SUCCESS;
+}
+
+static int _open(coap_udp_t *u, const struct sockaddr *addr,
+                 const socklen_t addrlen, const coap_udp_backend_t backend,
+                 coap_udp_handler handler, void *arg, const bool reuseport)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t size = (sizeof(coap_udp_state_t) + page - 1) & ~(page - 1);
+    const int on = 1;
+    memset(u, 0, sizeof(*u));
+    u->handler = handler;
+    u->arg = arg;
+    u->fd = socket(addr->sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (u->fd < 0) {
+        return COAP_ERR_IO;
+    }
+    socklen_t locallen = sizeof(u->local.addr);
+    if ((reuseport && (setsockopt(u->fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)) ||
+        (bind(u->fd, addr, addrlen) < 0) ||
+        (getsockname(u->fd, (struct sockaddr *)u->local.addr, &locallen) < 0)) {
+        close(u->fd);
+        return COAP_ERR_IO;
+    }
+    u->local.len = locallen;
+    // page aligned, as the provided buffer ring requires
+    void *state = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (state == MAP_FAILED) {
+        close(u->fd);
+        return COAP_ERR_IO;
+    }
+    u->state = state;
+    u->state->size = size;
+    u->state->epfd = -1;
+    u->state->ringfd = -1;
+    u->state->open = -1;
+    if (backend != COAP_UDP_EPOLL) {
+        int rc = _uring_open(u);
+        if (!rc) {
+            return COAP_SUCCESS;
+        }
+        if (backend == COAP_UDP_URING) {
+            coap_udp_close(u);
+            return rc;
+        }
+    }
+    if (_epoll_open(u)) {
+        coap_udp_close(u);
+        return COAP_ERR_IO;
+    }
+    return COAP_SUCCESS;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_udp_open(coap_udp_t *u, const struct sockaddr *addr,
+                  const socklen_t addrlen, const coap_udp_backend_t backend,
+                  coap_udp_handler handler, void *arg)
+{
+    return _open(u, addr, addrlen, backend, handler, arg, false);
+}
+
+int coap_udp_open_reuseport(coap_udp_t *u, const struct sockaddr *addr,
+                            const socklen_t addrlen, const coap_udp_backend_t backend,
+                            coap_udp_handler handler, void *arg)
+{
+    return _open(u, addr, addrlen, backend, handler, arg, true);
+}
+
+int coap_udp_steer(coap_udp_t *u, const int *cpus, const unsigned n)
+{
+    // socket i for a datagram received on cpus[i], by CPU modulo n otherwise
+    struct sock_filter code[2 * COAP_UDP_MAX_REUSEPORT + 3];
+    unsigned len = 0;
+    if (!n || (n > COAP_UDP_MAX_REUSEPORT)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (unsigned i = 0; cpus && (i < n); ++i) {
+        code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)cpus[i], 0, 1);
+        code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n);
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+    const struct sock_fprog prog = {(unsigned short)len, code};
+    if (setsockopt(u->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        return COAP_ERR_IO;
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_udp_incoming_cpu(coap_udp_t *u, const int cpu)
+{
+    if (setsockopt(u->fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+        return COAP_ERR_IO;
+    }
+    return COAP_SUCCESS;
+}
+
+int coap_udp_busy_poll(coap_udp_t *u, const unsigned usecs, const unsigned budget)
+{
+    const int us = (int)usecs;
+    const int on = 1;
+    const int b = (int)budget;
+    if (setsockopt(u->fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0) {
+        return COAP_ERR_IO;
+    }
+    // both refine SO_BUSY_POLL, kernels before 5.11 lack them
+    setsockopt(u->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on));
+    if (budget) {
+        setsockopt(u->fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &b, sizeof(b));
+    }
+    return COAP_SUCCESS;
+}
+
+unsigned coap_udp_offload(coap_udp_t *u, const unsigned flags)
+{
+    int on = 1;
+    int segsize = 0;
+    u->offload = 0;
+    // probing UDP_SEGMENT with size 0 leaves it off per default
+    if ((flags & COAP_UDP_GSO) &&
+        !setsockopt(u->fd, SOL_UDP, UDP_SEGMENT, &segsize, sizeof(segsize))) {
+        u->offload |= COAP_UDP_GSO;
+    }
+    if ((flags & COAP_UDP_GRO) &&
+        !setsockopt(u->fd, SOL_UDP, UDP_GRO, &on, sizeof(on))) {
+        u->offload |= COAP_UDP_GRO;
+    }
+    return u->offload;
+}
+
+int coap_udp_join(coap_udp_t *u, const struct sockaddr *group,
+                  const unsigned ifindex)
+{
+    const int on = 1;
+    const bool ipv6 = (((const struct sockaddr *)u->local.addr)->sa_family == AF_INET6);
+    struct group_req req;
+    memset(&req, 0, sizeof(req));
+    req.gr_interface = ifindex;
+    memcpy(&req.gr_group, group, (group->sa_family == AF_INET6) ?
+           sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+    // destination addresses tell requests to the group from unicast ones
+    if (setsockopt(u->fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+                   ipv6 ? IPV6_RECVPKTINFO : IP_PKTINFO, &on, sizeof(on)) < 0) {
+        return COAP_ERR_IO;
+    }
+    // an IPv6 socket joins IPv4 groups as well
+    if (setsockopt(u->fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP, MCAST_JOIN_GROUP,
+                   &req, sizeof(req)) < 0) {
+        return COAP_ERR_IO;
+    }
+    u->groups++;
+    return COAP_SUCCESS;
+}
+
+int coap_udp_send(void *ctx, const coap_endpoint_t *ep,
+                  const uint8_t *buf, const size_t buflen)
+{
+    coap_udp_t *u = ctx;
+    if (buflen > COAP_UDP_MAX_PDU) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    if (u->pcap) {
+        coap_pcap_capture(u->pcap, true, &u->local, ep, buf, buflen);
+    }
+    if (u->backend == COAP_UDP_URING) {
+        return _uring_send(u, ep, buf, buflen);
+    }
+    return _epoll_send(u, ep, buf, buflen);
+}
+
+int coap_udp_run(coap_udp_t *u, const int timeout_ms)
+{
+    if (u->backend == COAP_UDP_URING) {
+        int rc = _uring_run(u, timeout_ms);
+        if (rc != _FALLBACK) {
+            return rc;
+        }
+        // switch over, datagrams in flight are lost
+        _uring_close(u->state);
+        u->state->bufbusy = 0;
+        u->state->msgbusy = 0;
+        u->state->ndeferred = 0;
+        if (_epoll_open(u)) {
+            return COAP_ERR_IO;
+        }
+        return COAP_SUCCESS;
+    }
+    return _epoll_run(u, timeout_ms);
+}
+
+void coap_udp_close(coap_udp_t *u)
+{
+    coap_udp_state_t *s = u->state;
+    if (s) {
+        _uring_close(s);
+        if (s->epfd >= 0) {
+            close(s->epfd);
+        }
+        munmap(s, s->size);
+        u->state = NULL;
+    }
+    if (u->fd >= 0) {
+        close(u->fd);
+        u->fd = -1;
+    }
+}
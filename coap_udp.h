@@ -0,0 +1,232 @@
+#ifndef COAP_UDP_H
+#define COAP_UDP_H 1
+
+/**
+ * @file coap_udp.h
+ *
+ * UDP transport for Linux, batching datagrams in both directions.
+ *
+ * Two backends are available: io_uring with a multishot recvmsg feeding a
+ * ring of kernel-provided buffers, where responses are queued and submitted
+ * along with the next wait, and epoll with recvmmsg/sendmmsg. The io_uring
+ * backend is used if the kernel supports it, otherwise epoll takes over,
+ * also at run time if multishot receive turns out to be unavailable.
+ *
+ * With segmentation offload enabled, consecutive datagrams of equal size to
+ * the same peer leave in one send, e.g. Block2 chunks or notifications.
+ * With receive offload enabled, bursts coalesced by the kernel are split
+ * into single datagrams again before they reach the handler.
+ *
+ * Once a multicast group is joined, the handler can tell datagrams sent to
+ * a group from unicast ones, see coap_group.h for responding to them.
+ *
+ * Several transports may share a port with coap_udp_open_reuseport(), one
+ * per thread, and have the kernel hand each datagram to the socket of the
+ * CPU it arrived on, see coap_udp_steer() and coap_workers.h.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/socket.h>
+
+#include "coap.h"
+#include "coap_pcap.h"
+
+#ifndef COAP_UDP_BATCH
+#define COAP_UDP_BATCH          32      //!< datagrams per batch, max. 64
+#endif
+#ifndef COAP_UDP_MAX_PDU
+#define COAP_UDP_MAX_PDU        1152    //!< max. size of a datagram
+#endif
+#ifndef COAP_UDP_RECV_BUFFERS
+#define COAP_UDP_RECV_BUFFERS   64      //!< io_uring receive buffers, power of 2
+#endif
+#ifndef COAP_UDP_RECV_SIZE
+#define COAP_UDP_RECV_SIZE      65536   //!< size of receive buffers, fits a GRO burst
+#endif
+#ifndef COAP_UDP_GSO_SEGMENTS
+#define COAP_UDP_GSO_SEGMENTS   32      //!< max. datagrams per GSO send
+#endif
+#ifndef COAP_UDP_MAX_REUSEPORT
+#define COAP_UDP_MAX_REUSEPORT  64      //!< sockets steered by coap_udp_steer()
+#endif
+
+#define COAP_UDP_GSO            0x01    //!< send runs of datagrams with UDP_SEGMENT
+#define COAP_UDP_GRO            0x02    //!< accept coalesced datagrams, UDP_GRO
+
+/**
+ * Transport backend
+ */
+typedef enum
+{
+    COAP_UDP_AUTO               = 0,    //!< io_uring if supported, else epoll
+    COAP_UDP_EPOLL,                     //!< epoll, recvmmsg and sendmmsg
+    COAP_UDP_URING,                     //!< io_uring, fail if unsupported
+} coap_udp_backend_t;
+
+/**
+ * @brief callback function receiving datagrams
+ *
+ * Responses may be sent from within with coap_udp_send().
+ *
+ * @param[in] arg Argument given to coap_udp_open()
+ * @param[in] from Sender of the datagram
+ * @param[in] buf The datagram, valid during the callback only
+ * @param[in] buflen Size of \p buf in bytes
+ */
+typedef void (*coap_udp_handler)(void *arg, const coap_endpoint_t *from,
+                                 const uint8_t *buf, const size_t buflen);
+
+typedef struct coap_udp_state coap_udp_state_t;
+
+/**
+ * UDP transport
+ */
+typedef struct coap_udp
+{
+    int fd;                             //!< the socket
+    coap_udp_backend_t backend;         //!< backend in use, EPOLL or URING
+    coap_udp_handler handler;           //!< receives datagrams
+    void *arg;                          //!< argument of handler
+    coap_udp_state_t *state;            //!< backend state, mapped by coap_udp_open()
+    unsigned offload;                   //!< COAP_UDP_GSO and COAP_UDP_GRO in effect
+    uint64_t syscalls;                  //!< system calls for receiving and sending
+    uint64_t rx;                        //!< datagrams received
+    uint64_t tx;                        //!< datagrams sent
+    coap_endpoint_t local;              //!< bound address
+    coap_pcap_t *pcap;                  //!< captures datagrams if set
+    unsigned groups;                    //!< multicast groups joined
+    bool multicast;                     //!< datagram passed to the handler was sent to a group
+} coap_udp_t;
+
+/**
+ * @brief Open socket and backend
+ *
+ * @param[out] u The transport
+ * @param[in] addr Local address to bind to, its family selects IPv4 or IPv6
+ * @param[in] addrlen Size of \p addr
+ * @param[in] backend Backend to use
+ * @param[in] handler Callback receiving datagrams
+ * @param[in] arg Argument passed to \p handler
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if io_uring was requested but is
+ * not available, or COAP_ERR_IO with errno set.
+ */
+int coap_udp_open(coap_udp_t *u, const struct sockaddr *addr,
+                  const socklen_t addrlen, const coap_udp_backend_t backend,
+                  coap_udp_handler handler, void *arg);
+
+/**
+ * @brief Open socket and backend, sharing the port with other sockets
+ *
+ * As coap_udp_open() with SO_REUSEPORT set before binding. The first socket
+ * of a group may bind to port 0, the others then bind to the port in
+ * u->local of the first. The kernel spreads datagrams across the group by
+ * flow hash, unless steered by coap_udp_steer().
+ */
+int coap_udp_open_reuseport(coap_udp_t *u, const struct sockaddr *addr,
+                            const socklen_t addrlen, const coap_udp_backend_t backend,
+                            coap_udp_handler handler, void *arg);
+
+/**
+ * @brief Steer datagrams of a reuseport group by the CPU receiving them
+ *
+ * Attaches a classic BPF program to the group of \p u, which hands a
+ * datagram received on cpus[i] to the i-th socket that joined the group,
+ * and one received on any other CPU to socket cpu modulo \p n.
+ *
+ * @param[in,out] u Any transport of the group
+ * @param[in] cpus CPU of each socket, in the order they were opened, or
+ * NULL to steer by CPU modulo \p n alone
+ * @param[in] n Sockets in the group, max. COAP_UDP_MAX_REUSEPORT
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if \p n is out of range, or
+ * COAP_ERR_IO with errno set
+ */
+int coap_udp_steer(coap_udp_t *u, const int *cpus, const unsigned n);
+
+/**
+ * @brief Tell the kernel the CPU the socket is served on, SO_INCOMING_CPU
+ *
+ * Without a steering program the kernel prefers a socket of a reuseport
+ * group whose CPU matches the one the datagram arrived on.
+ *
+ * @return 0 on success, or COAP_ERR_IO with errno set
+ */
+int coap_udp_incoming_cpu(coap_udp_t *u, const int cpu);
+
+/**
+ * @brief Let blocking receives busy poll the device queue, SO_BUSY_POLL
+ *
+ * Only effective for devices with NAPI, not on loopback; also requests
+ * SO_PREFER_BUSY_POLL and, if \p budget is not 0, SO_BUSY_POLL_BUDGET
+ * where the kernel supports them. Raising \p usecs above
+ * net.core.busy_read requires CAP_NET_ADMIN.
+ *
+ * @param[in,out] u The transport
+ * @param[in] usecs Time to poll before sleeping, 0 to disable
+ * @param[in] budget Packets per poll of the device queue, 0 for default
+ *
+ * @return 0 on success, or COAP_ERR_IO with errno set
+ */
+int coap_udp_busy_poll(coap_udp_t *u, const unsigned usecs, const unsigned budget);
+
+/**
+ * @brief Enable segmentation and receive offload
+ *
+ * @param[in,out] u The transport
+ * @param[in] flags COAP_UDP_GSO, COAP_UDP_GRO, or both
+ *
+ * @return the flags supported by the kernel and now in effect
+ */
+unsigned coap_udp_offload(coap_udp_t *u, const unsigned flags);
+
+/**
+ * @brief Join a multicast group
+ *
+ * Requests to the group arrive at the bound port, with u->multicast set
+ * during the handler call. E.g. All-CoAP-Nodes, see COAP_GROUP_ALL_NODES_IPV4.
+ *
+ * @param[in,out] u The transport
+ * @param[in] group Group address, IPv4 groups may be joined by IPv6 sockets
+ * @param[in] ifindex Interface to join on, 0 lets the kernel choose
+ *
+ * @return 0 on success, or COAP_ERR_IO with errno set
+ */
+int coap_udp_join(coap_udp_t *u, const struct sockaddr *group,
+                  const unsigned ifindex);
+
+/**
+ * @brief Queue a datagram
+ *
+ * Matches coap_transport_send, pass the transport as \p ctx. Datagrams are
+ * sent in batches, at the latest by the next coap_udp_run().
+ *
+ * @return 0 on success, COAP_ERR_BUFFER_TOO_SMALL if \p buflen exceeds
+ * COAP_UDP_MAX_PDU, or COAP_ERR_IO.
+ */
+int coap_udp_send(void *ctx, const coap_endpoint_t *ep,
+                  const uint8_t *buf, const size_t buflen);
+
+/**
+ * @brief Send queued datagrams, wait for and dispatch received ones
+ *
+ * @param[in,out] u The transport
+ * @param[in] timeout_ms Max. time to wait, -1 to wait forever
+ *
+ * @return 0 on success, also if nothing arrived in time, or COAP_ERR_IO
+ */
+int coap_udp_run(coap_udp_t *u, const int timeout_ms);
+
+/**
+ * @brief Close socket and release backend
+ */
+void coap_udp_close(coap_udp_t *u);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_UDP_H
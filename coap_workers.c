@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "coap_workers.h"
+
+/* --- PRIVATE -------------------------------------------------------------- */
+struct coap_workers_state
+{
+    pthread_t threads[COAP_WORKERS_MAX];
+    const struct sockaddr *addr;        //!< address of the next socket to open
+    socklen_t addrlen;
+    struct sockaddr_storage bound;      //!< address of the first socket, aligned
+    bool opened;                        //!< next worker is done opening
+    bool unpinned;                      //!< a worker could not be pinned
+    bool stop;
+    pthread_mutex_t lock;               //!< protects opening one after the other
+    pthread_cond_t wake;
+};
+
+static uint64_t _now_ns(void);
+static int _open(coap_worker_t *w);
+static void _serve(coap_worker_t *w);
+static void *_worker(void *arg);
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* on the worker thread, so that the ring and its buffers belong to it */
+static int _open(coap_worker_t *w)
+{
+    coap_workers_t *ws = w->workers;
+    coap_workers_state_t *s = ws->state;
+    const coap_workers_params_t *p = &ws->params;
+    if (ws->flags & COAP_WORKERS_PIN) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            s->unpinned = true;
+        }
+    }
+    int rc = coap_udp_open_reuseport(&w->udp, s->addr, s->addrlen, p->backend,
+                                     ws->handler, w);
+    if (rc) {
+        return rc;
+    }
+    if (ws->flags & COAP_WORKERS_STEER) {
+        coap_udp_incoming_cpu(&w->udp, w->cpu);
+    }
+    if ((ws->flags & COAP_WORKERS_BUSY_POLL) &&
+        coap_udp_busy_poll(&w->udp, p->busy_poll_us, p->busy_poll_budget)) {
+        ws->kernel_busy_poll = false;
+    }
+    return COAP_SUCCESS;
+}
+
+/*
+ * busy polling spins on non-blocking runs until nothing arrived for
+ * busy_poll_us, yielding to whatever else is runnable on the CPU
+ */
+static void _serve(coap_worker_t *w)
+{
+    coap_workers_t *ws = w->workers;
+    coap_workers_state_t *s = ws->state;
+    const uint64_t spin_ns = (ws->flags & COAP_WORKERS_BUSY_POLL) ?
+                             (uint64_t)ws->params.busy_poll_us * 1000 : 0;
+    coap_registry_t *reg = ws->params.registry;
+    uint64_t idle_since = _now_ns();
+    uint64_t rx = w->udp.rx;
+    while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+        if (spin_ns) {
+            if ((w->status = coap_udp_run(&w->udp, 0))) {
+                return;
+            }
+            // handlers returned, no pointer into the table is left
+            if (reg) {
+                coap_registry_quiescent(reg, &w->reader);
+            }
+            if (w->udp.rx != rx) {
+                rx = w->udp.rx;
+                idle_since = _now_ns();
+                continue;
+            }
+            if (_now_ns() - idle_since < spin_ns) {
+                w->spins++;
+                sched_yield();
+                continue;
+            }
+        }
+        if ((w->status = coap_udp_run(&w->udp, COAP_WORKERS_WAKEUP_MS))) {
+            return;
+        }
+        if (reg) {
+            coap_registry_quiescent(reg, &w->reader);
+        }
+        w->sleeps++;
+        rx = w->udp.rx;
+        idle_since = _now_ns();
+    }
+}
+
+static void *_worker(void *arg)
+{
+    coap_worker_t *w = arg;
+    coap_workers_state_t *s = w->workers->state;
+    // all workers serve the same resources, none may fill their caches
+    coap_content_cache(false);
+    const int rc = _open(w);
+    pthread_mutex_lock(&s->lock);
+    w->status = rc;
+    s->opened = true;
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    if (!rc) {
+        coap_registry_t *reg = w->workers->params.registry;
+        if (reg) {
+            coap_registry_attach(reg, &w->reader);
+        }
+        _serve(w);
+        if (reg) {
+            coap_registry_detach(reg, &w->reader);
+        }
+        coap_udp_close(&w->udp);
+    }
+    return NULL;
+}
+
+/* --- PUBLIC --------------------------------------------------------------- */
+int coap_workers_start(coap_workers_t *ws, const coap_workers_params_t *params,
+                       const struct sockaddr *addr, const socklen_t addrlen,
+                       coap_udp_handler handler, void *arg)
+{
+    int cpus[COAP_WORKERS_MAX];
+    memset(ws, 0, sizeof(*ws));
+    if (!params->threads || (params->threads > COAP_WORKERS_MAX)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    coap_workers_state_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return COAP_ERR_IO;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    s->addr = addr;
+    s->addrlen = addrlen;
+    ws->state = s;
+    ws->params = *params;
+    ws->params.cpus = NULL;
+    ws->flags = params->flags & (COAP_WORKERS_PIN | COAP_WORKERS_STEER | COAP_WORKERS_BUSY_POLL);
+    ws->kernel_busy_poll = (ws->flags & COAP_WORKERS_BUSY_POLL) != 0;
+    ws->handler = handler;
+    ws->arg = arg;
+    // one after the other, the kernel numbers the group in order of binding
+    for (unsigned i = 0; i < params->threads; ++i) {
+        coap_worker_t *w = &ws->worker[i];
+        w->workers = ws;
+        w->index = i;
+        w->cpu = cpus[i] = params->cpus ? params->cpus[i] : (int)i;
+        s->opened = false;
+        int rc = pthread_create(&s->threads[i], NULL, _worker, w);
+        if (rc) {
+            errno = rc;
+            coap_workers_stop(ws);
+            return COAP_ERR_IO;
+        }
+        ws->threads++;
+        pthread_mutex_lock(&s->lock);
+        while (!s->opened) {
+            pthread_cond_wait(&s->wake, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+        if ((rc = w->status)) {
+            coap_workers_stop(ws);
+            return rc;
+        }
+        if (!i) {
+            memcpy(&s->bound, w->udp.local.addr, w->udp.local.len);
+            s->addr = (const struct sockaddr *)&s->bound;
+            s->addrlen = (socklen_t)w->udp.local.len;
+        }
+    }
+    if (s->unpinned) {
+        ws->flags &= ~COAP_WORKERS_PIN;
+    }
+    if ((ws->flags & COAP_WORKERS_STEER) &&
+        coap_udp_steer(&ws->worker[0].udp, cpus, ws->threads)) {
+        ws->flags &= ~COAP_WORKERS_STEER;
+    }
+    return COAP_SUCCESS;
+}
+
+void coap_workers_stop(coap_workers_t *ws)
+{
+    coap_workers_state_t *s = ws->state;
+    if (!s) {
+        return;
+    }
+    __atomic_store_n(&s->stop, true, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < ws->threads; ++i) {
+        pthread_join(s->threads[i], NULL);
+    }
+    ws->threads = 0;
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    ws->state = NULL;
+}
@@ -0,0 +1,154 @@
+#ifndef COAP_WORKERS_H
+#define COAP_WORKERS_H 1
+
+/**
+ * @file coap_workers.h
+ *
+ * Multi-threaded server, one UDP transport per thread sharing the port.
+ *
+ * Every worker opens a coap_udp_t with SO_REUSEPORT on its own thread and
+ * runs it, handling datagrams start to end without handing them to another
+ * thread. Unlike coap_pool.h, which takes blocking handlers off a receive
+ * thread, workers are receive threads themselves.
+ *
+ * Optionally, each worker is pinned to a CPU, COAP_WORKERS_PIN, and the
+ * kernel steers each datagram to the worker pinned to the CPU that received
+ * it, COAP_WORKERS_STEER, so that packet and handler share the cache and no
+ * wakeup crosses cores. Steering needs receive queues spread across the
+ * worker CPUs, e.g. by RSS or RPS, and otherwise falls back to CPU modulo
+ * workers.
+ *
+ * With COAP_WORKERS_BUSY_POLL, a worker keeps polling its socket without
+ * blocking for busy_poll_us after the last datagram, trading a core for the
+ * wakeup latency, and asks the kernel to busy poll the device queue as well,
+ * see coap_udp_busy_poll().
+ *
+ * Handlers of different workers run concurrently and must synchronize any
+ * state they share. Dispatching writes nothing into the resource table,
+ * the separate-response exchange of coap_handle_request() is kept per
+ * thread, so all workers may serve one table. Workers may dispatch from a coap_registry_t given in
+ * the parameters, each attaching as reader and passing a quiescent state
+ * after every run of its transport, so resources can be added and removed
+ * while they serve, see coap_worker_resources().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "coap.h"
+#include "coap_registry.h"
+#include "coap_udp.h"
+
+#ifndef COAP_WORKERS_MAX
+#define COAP_WORKERS_MAX        COAP_UDP_MAX_REUSEPORT  //!< worker threads
+#endif
+#ifndef COAP_WORKERS_WAKEUP_MS
+#define COAP_WORKERS_WAKEUP_MS  100     //!< max. blocking wait, bounds coap_workers_stop()
+#endif
+
+#define COAP_WORKERS_PIN        0x01    //!< pin worker i to cpus[i]
+#define COAP_WORKERS_STEER      0x02    //!< datagrams to the worker on the receiving CPU
+#define COAP_WORKERS_BUSY_POLL  0x04    //!< poll without blocking while traffic flows
+
+typedef struct coap_workers coap_workers_t;
+typedef struct coap_workers_state coap_workers_state_t;
+
+/**
+ * Configuration of coap_workers_start()
+ */
+typedef struct coap_workers_params
+{
+    unsigned threads;                   //!< workers, at most COAP_WORKERS_MAX
+    const int *cpus;                    //!< CPU of each worker, NULL for 0 to threads - 1
+    unsigned flags;                     //!< COAP_WORKERS_PIN, _STEER, _BUSY_POLL
+    unsigned busy_poll_us;              //!< polling after the last datagram, also SO_BUSY_POLL
+    unsigned busy_poll_budget;          //!< SO_BUSY_POLL_BUDGET, 0 for default
+    coap_udp_backend_t backend;         //!< backend of the transports
+    coap_registry_t *registry;          //!< resources of the handlers, optional
+} coap_workers_params_t;
+
+/**
+ * Worker thread and its transport
+ *
+ * Passed to the handler as its argument; responses are sent with
+ * coap_udp_send(&worker->udp, ...).
+ */
+typedef struct coap_worker
+{
+    coap_workers_t *workers;            //!< group, holds the argument of coap_workers_start()
+    unsigned index;                     //!< position in the reuseport group
+    int cpu;                            //!< CPU served, pinned if COAP_WORKERS_PIN
+    int status;                         //!< 0, or the error that ended the worker
+    coap_udp_t udp;                     //!< transport, owned by the worker thread
+    coap_registry_reader_t reader;      //!< attached to params.registry, if set
+    uint64_t spins;                     //!< empty polls while busy polling
+    uint64_t sleeps;                    //!< blocking waits
+} coap_worker_t;
+
+/**
+ * Workers serving one port
+ */
+struct coap_workers
+{
+    coap_workers_state_t *state;        //!< threads, start and stop
+    coap_workers_params_t params;       //!< configuration, cpus moved to worker[i].cpu
+    unsigned flags;                     //!< COAP_WORKERS_* in effect
+    bool kernel_busy_poll;              //!< SO_BUSY_POLL accepted by all sockets
+    coap_udp_handler handler;           //!< receives datagrams
+    void *arg;                          //!< argument of coap_workers_start()
+    unsigned threads;                   //!< workers running
+    coap_worker_t worker[COAP_WORKERS_MAX];
+};
+
+/**
+ * @brief Start workers, each opening and running a transport on the port
+ *
+ * Workers are started one after the other, worker i opening the i-th socket
+ * of the group, the first binding to \p addr and the others to the address
+ * it was bound to, so port 0 works. Options the kernel or privileges do not
+ * allow are left out, ws->flags and ws->kernel_busy_poll tell those in
+ * effect.
+ *
+ * @param[out] ws The workers, must stay valid until coap_workers_stop()
+ * @param[in] params Configuration
+ * @param[in] addr Local address to bind to
+ * @param[in] addrlen Size of \p addr
+ * @param[in] handler Callback receiving datagrams, with the coap_worker_t
+ * as argument
+ * @param[in] arg Kept in ws->arg
+ *
+ * @return 0 on success, COAP_ERR_UNSUPPORTED if params->threads is out of
+ * range, or the error of the first worker failing to open its transport
+ */
+int coap_workers_start(coap_workers_t *ws, const coap_workers_params_t *params,
+                       const struct sockaddr *addr, const socklen_t addrlen,
+                       coap_udp_handler handler, void *arg);
+
+/**
+ * @brief Stop and join the workers, close their transports
+ *
+ * Takes up to COAP_WORKERS_WAKEUP_MS.
+ */
+void coap_workers_stop(coap_workers_t *ws);
+
+/**
+ * @brief Current resources of the registry, for the handler of \p w
+ *
+ * Valid until the handler returns.
+ *
+ * @return the table, or NULL if the workers have no registry
+ */
+static inline coap_resource_t *coap_worker_resources(coap_worker_t *w)
+{
+    coap_registry_t *reg = w->workers->params.registry;
+    return reg ? coap_registry_resources(reg) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COAP_WORKERS_H
@@ -1,31 +1,182 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 
 #include "coap.h"
 #include "coap_dump.h"
+#include "coap_group.h"
+#include "coap_oscore.h"
+#include "coap_pool.h"
+#include "coap_rd.h"
+#include "coap_registry.h"
+#include "coap_stats.h"
+#include "coap_udp.h"
 
 extern void resource_setup(const coap_resource_t *resources);
+extern void resource_set_peer(const coap_endpoint_t *from);
 extern coap_resource_t resources[];
 
-int main(void)
+static coap_udp_t udp;
+static coap_pcap_t pcap;
+static coap_pool_t pool;
+static coap_pool_owner_t owner;
+static coap_registry_t registry;
+static coap_registry_reader_t reader;
+static coap_rd_t rd;
+static bool rd_enabled;
+static coap_group_t group;
+static coap_oscore_t oscore;
+static bool oscore_enabled;
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
 {
-    int fd;
-#ifdef IPV6
-    struct sockaddr_in6 servaddr, cliaddr;
-#else /* IPV6 */
-    struct sockaddr_in servaddr, cliaddr;
-#endif /* IPV6 */
-    uint8_t buf[1024];
+    (void) sig;
+    running = 0;
+}
+
+/* base URI of an endpoint registering without base parameter */
+static int rd_base(void *ctx, const coap_endpoint_t *ep, char *buf, const size_t buflen)
+{
+    const struct sockaddr *sa = (const struct sockaddr *)ep->addr;
+    char host[INET6_ADDRSTRLEN];
+    (void) ctx;
+    if (sa->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)ep->addr;
+        if (!inet_ntop(AF_INET6, &sin6->sin6_addr, host, sizeof(host)))
+            return COAP_ERR_UNSUPPORTED;
+        snprintf(buf, buflen, "coap://[%s]:%u", host, ntohs(sin6->sin6_port));
+        return 0;
+    }
+    const struct sockaddr_in *sin = (const struct sockaddr_in *)ep->addr;
+    if (!inet_ntop(AF_INET, &sin->sin_addr, host, sizeof(host)))
+        return COAP_ERR_UNSUPPORTED;
+    snprintf(buf, buflen, "coap://%s:%u", host, ntohs(sin->sin_port));
+    return 0;
+}
+
+/* hex string to bytes, length or -1 */
+static int parse_hex(const char *hex, uint8_t *buf, const size_t buflen)
+{
+    size_t len = 0;
+    unsigned byte;
+    while (hex[0] && hex[0] != ':')
+    {
+        if (len == buflen || 1 != sscanf(hex, "%2x", &byte) || !hex[1])
+            return -1;
+        buf[len++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return (int)len;
+}
+
+/* OSCORE sequence number, persisted in the file at ctx */
+static int oscore_store(void *ctx, const uint64_t seq)
+{
+    FILE *f = fopen(ctx, "w");
+    if (!f)
+        return COAP_ERR_IO;
+    const bool written = fprintf(f, "%llu\n", (unsigned long long)seq) > 0;
+    if (0 != fclose(f) || !written)
+        return COAP_ERR_IO;
+    return 0;
+}
+
+/* the sequence number stored last, 0 if none was */
+static uint64_t oscore_load(const char *path)
+{
+    unsigned long long seq = 0;
+    FILE *f = fopen(path, "r");
+    if (f)
+    {
+        if (1 != fscanf(f, "%llu", &seq))
+            seq = 0;
+        fclose(f);
+    }
+    return seq;
+}
+
+/* requests for /rd and /rd-lookup, false if it is none */
+static bool handle_rd(const coap_endpoint_t *from, const uint8_t *buf, const size_t buflen)
+{
+    coap_packet_t inpkt, pkt;
+    uint8_t outbuf[COAP_RD_MAX_BLOCK + 64];
+    size_t outlen = sizeof(outbuf);
+    if (0 != coap_parse(buf, buflen, &inpkt) ||
+        COAP_ERR_REQUEST_NOT_FOUND == coap_rd_handle_request(&rd, from, &inpkt, &pkt))
+        return false;
+    if (0 == coap_build(&pkt, outbuf, &outlen))
+        coap_udp_send(&udp, from, outbuf, outlen);
+    return true;
+}
 
+static void handle_datagram(void *arg, const coap_endpoint_t *from,
+                            const uint8_t *buf, const size_t buflen)
+{
+    // the table as of now, valid until the next quiescent state
+    coap_resource_t *rs = coap_registry_resources(arg);
+    uint8_t outbuf[1024];
+    size_t outlen = sizeof(outbuf);
+    int rc;
+#ifdef MICROCOAP_DEBUG
+    printf("Received: ");
+    coap_dump(buf, buflen, true);
+    printf("\n");
+#endif
+
+    // only non-confirmable requests to a group, https://tools.ietf.org/html/rfc7252#section-8.1
+    if (udp.multicast && !coap_group_accepts(buf, buflen))
+        return;
+    if (rd_enabled && handle_rd(from, buf, buflen))
+        return;
+    resource_set_peer(from);
+    if (oscore_enabled)
+        rc = coap_oscore_handle_packet(&oscore, 1, rs, buf, buflen, outbuf, &outlen);
+    else if (pool.workers)
+        rc = coap_pool_handle_packet(&owner, rs, from, buf, buflen, outbuf, &outlen);
+    else
+        rc = coap_handle_packet(rs, buf, buflen, outbuf, &outlen);
+    if (COAP_STATE_RSP_WAIT == rc)
+        return;     // taken over by the pool, nothing to acknowledge
+    if (0 != rc)
+        printf("Bad packet rc=%d\n", rc);
+    else
+    {
+#ifdef MICROCOAP_DEBUG
+        printf("Sending: ");
+        coap_dump(outbuf, outlen, true);
+        printf("\n");
+#endif
+        COAP_STATS_MARK(t);
+        if (udp.multicast)
+            coap_group_send(&group, from, outbuf, outlen);
+        else
+            coap_udp_send(&udp, from, outbuf, outlen);
+        COAP_STATS_LAP(t, COAP_STATS_SEND);
+    }
+}
+
+int main(void)
+{
 #ifdef IPV6
-    fd = socket(AF_INET6,SOCK_DGRAM,0);
+    struct sockaddr_in6 servaddr;
 #else /* IPV6 */
-    fd = socket(AF_INET,SOCK_DGRAM,0);
+    struct sockaddr_in servaddr;
 #endif /* IPV6 */
+    // COAP_UDP_BACKEND=epoll or uring, io_uring with fallback otherwise
+    const char *name = getenv("COAP_UDP_BACKEND");
+    coap_udp_backend_t backend = COAP_UDP_AUTO;
+    if (name && !strcmp(name, "epoll"))
+        backend = COAP_UDP_EPOLL;
+    else if (name && !strcmp(name, "uring"))
+        backend = COAP_UDP_URING;
 
     bzero(&servaddr,sizeof(servaddr));
 #ifdef IPV6
@@ -37,49 +188,150 @@ int main(void)
     servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
     servaddr.sin_port = htons(COAP_DEFAULT_PORT);
 #endif /* IPV6 */
-    bind(fd,(struct sockaddr *)&servaddr, sizeof(servaddr));
+    if (0 != coap_udp_open(&udp, (struct sockaddr *)&servaddr, sizeof(servaddr),
+                           backend, handle_datagram, &registry))
+    {
+        perror("coap_udp_open");
+        return 1;
+    }
+    printf("backend: %s\n", (udp.backend == COAP_UDP_URING) ? "io_uring" : "epoll");
+    coap_udp_offload(&udp, COAP_UDP_GSO | COAP_UDP_GRO);
+    // COAP_PCAP=file captures all datagrams
+    const char *capture = getenv("COAP_PCAP");
+    if (capture)
+    {
+        if (0 != coap_pcap_open(&pcap, capture, 0))
+        {
+            perror("coap_pcap_open");
+            return 1;
+        }
+        udp.pcap = &pcap;
+    }
 
-    resource_setup(resources);
+    // COAP_POOL_WORKERS=n runs handlers of blocking resources on n threads
+    const char *workers = getenv("COAP_POOL_WORKERS");
+    if (workers && atoi(workers) > 0)
+    {
+        if (0 != coap_pool_init(&pool, (unsigned)atoi(workers)) ||
+            0 != coap_pool_attach(&pool, &owner, coap_udp_send, &udp))
+        {
+            perror("coap_pool_init");
+            return 1;
+        }
+    }
 
-    while(1)
+    // COAP_RD=1 serves a Resource Directory at /rd and /rd-lookup
+    const char *directory = getenv("COAP_RD");
+    if (directory && atoi(directory) > 0)
     {
-        int n, rc;
-        socklen_t len = sizeof(cliaddr);
-        coap_packet_t pkt;
+        if (0 != coap_rd_init(&rd, rd_base, NULL))
+        {
+            perror("coap_rd_init");
+            return 1;
+        }
+        rd_enabled = true;
+    }
 
-        n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&cliaddr, &len);
-#ifdef MICROCOAP_DEBUG
-        printf("Received: ");
-        coap_dump(buf, n, true);
-        printf("\n");
-#endif
+    // COAP_GROUP=1 joins All-CoAP-Nodes, answering after a random leisure
+    coap_group_init(&group, coap_udp_send, &udp, COAP_GROUP_DEFAULT_LEISURE);
+    const char *multicast = getenv("COAP_GROUP");
+    if (multicast && atoi(multicast) > 0)
+    {
+#ifdef IPV6
+        struct sockaddr_in6 groupaddr;
+        bzero(&groupaddr, sizeof(groupaddr));
+        groupaddr.sin6_family = AF_INET6;
+        inet_pton(AF_INET6, COAP_GROUP_ALL_NODES_IPV6_LINK, &groupaddr.sin6_addr);
+#else /* IPV6 */
+        struct sockaddr_in groupaddr;
+        bzero(&groupaddr, sizeof(groupaddr));
+        groupaddr.sin_family = AF_INET;
+        inet_pton(AF_INET, COAP_GROUP_ALL_NODES_IPV4, &groupaddr.sin_addr);
+#endif /* IPV6 */
+        if (0 != coap_udp_join(&udp, (struct sockaddr *)&groupaddr, 0))
+        {
+            perror("coap_udp_join");
+            return 1;
+        }
+    }
 
-        if (0 != (rc = coap_parse(buf, n, &pkt)))
-            printf("Bad packet rc=%d\n", rc);
-        else
+    // COAP_OSCORE=secret[:salt] in hex protects requests of a client with
+    // empty sender ID, the server is ID 01, as in RFC 8613 appendix C.1; the
+    // sequence number is kept in COAP_OSCORE_SSN, oscore.ssn by default
+    const char *master = getenv("COAP_OSCORE");
+    if (master)
+    {
+        static uint8_t secret[32], salt[32], server_id[1] = {0x01};
+        const char *colon = strchr(master, ':');
+        const int secretlen = parse_hex(master, secret, sizeof(secret));
+        const int saltlen = colon ? parse_hex(colon + 1, salt, sizeof(salt)) : 0;
+        coap_oscore_params_t params;
+        bzero(&params, sizeof(params));
+        params.secret.p = secret;
+        params.secret.len = (secretlen > 0) ? (size_t)secretlen : 0;
+        params.salt.p = salt;
+        params.salt.len = (saltlen > 0) ? (size_t)saltlen : 0;
+        params.sender_id.p = server_id;
+        params.sender_id.len = sizeof(server_id);
+        const char *ssn = getenv("COAP_OSCORE_SSN");
+        params.store_ctx = (void *)(ssn ? ssn : "oscore.ssn");
+        params.store = oscore_store;
+        params.seq = oscore_load(params.store_ctx);
+        if (secretlen <= 0 || saltlen < 0 || 0 != coap_oscore_init(&oscore, &params))
         {
-            size_t buflen = sizeof(buf);
-            coap_packet_t rsppkt;
-#ifdef MICROCOAP_DEBUG
-            coap_dump_packet(&pkt);
-#endif
-            coap_handle_request(resources, &pkt, &rsppkt);
+            fprintf(stderr, "COAP_OSCORE: invalid secret or salt\n");
+            return 1;
+        }
+        oscore_enabled = true;
+    }
 
-            if (0 != (rc = coap_build(&rsppkt, buf, &buflen)))
-                printf("coap_build failed rc=%d\n", rc);
-            else
-            {
-#ifdef MICROCOAP_DEBUG
-                printf("Sending: ");
-                coap_dump(buf, buflen, true);
-                printf("\n");
-#endif
-#ifdef MICROCOAP_DEBUG
-                coap_dump_packet(&rsppkt);
-#endif
+    resource_setup(resources);
+    // dispatch from a registry, so resources may come and go while serving
+    if (0 != coap_registry_init(&registry, resources))
+    {
+        perror("coap_registry_init");
+        return 1;
+    }
+    coap_registry_attach(&registry, &reader);
 
-                sendto(fd, buf, buflen, 0, (struct sockaddr *)&cliaddr, sizeof(cliaddr));
-            }
+    // stop cleanly, so that the capture is complete
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    while(running)
+    {
+        // poll for separate responses while the pool works
+        int timeout_ms = owner.pending ? 1 : -1;
+        coap_tick_t due = coap_group_poll(&group);
+        if (pool.workers)
+        {
+            const coap_tick_t retransmit = coap_pool_poll(&owner);
+            if (retransmit < due)
+                due = retransmit;
+        }
+        if (COAP_TICK_NEVER != due)
+        {
+            const coap_tick_t now = coap_clock_now();
+            const int wait = (due > now) ? (int)(due - now) : 0;
+            if (timeout_ms < 0 || wait < timeout_ms)
+                timeout_ms = wait;
+        }
+        if (0 != coap_udp_run(&udp, timeout_ms))
+        {
+            perror("coap_udp_run");
+            break;
         }
+        if (owner.pending)
+            coap_pool_complete(&owner);
+        // jobs of the pool still point into the table
+        if (!owner.pending)
+            coap_registry_quiescent(&registry, &reader);
     }
+    coap_pool_close(&pool);
+    if (rd_enabled)
+        coap_rd_free(&rd);
+    coap_udp_close(&udp);
+    coap_registry_detach(&registry, &reader);
+    coap_registry_free(&registry);
+    coap_pcap_close(&pcap);
+    return running ? 1 : 0;
 }
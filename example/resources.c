@@ -2,41 +2,166 @@
 #include <stdio.h>
 #include <string.h>
 #include "coap.h"
+#include "coap_senml.h"
+#include "coap_stats.h"
+#include "coap_time.h"
+
+#define SENML_TRANSFERS     4       //!< concurrent Block1 uploads
+#define SENML_TIMEOUT       (30 * COAP_TICKS_PER_SEC)   //!< abandoned after
+
+extern coap_resource_t resources[];
 
 static char light = '0';
-const uint16_t rsplen = 128;
-static char rsp[128] = "";
+static uint8_t rsp[512];
+static uint8_t rsp_block2[1];
+
+static const uint8_t ct_txt_plain[2] = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN);
+
+static int patch_health(const coap_resource_t *resource,
+                        const coap_packet_t *inpkt,
+                        uint8_t *buf, const size_t len);
+static uint8_t health_pdu[32];
+static coap_response_template_t response_health =
+    {{health_pdu, sizeof(health_pdu)}, 0, 0, patch_health, 3, 8, false};
+static uint32_t health_requests;
+
+/* sender of the request being handled, Block1 transfers are kept per peer */
+static coap_endpoint_t peer;
+
+void resource_set_peer(const coap_endpoint_t *from)
+{
+    if (from) {
+        peer = *from;
+    }
+    else {
+        memset(&peer, 0, sizeof(peer));
+    }
+}
 
 void resource_setup(const coap_resource_t *resources)
 {
-    coap_make_link_format(resources, rsp, rsplen);
-    printf("resources: %s\n", rsp);
+    coap_packet_t pkt;
+    char links[1024];
+    coap_make_link_format(resources, links, sizeof(links));
+    printf("resources: %s\n", links);
+    // static response, copied by coap_handle_packet() from now on
+    coap_make_response(0, NULL, COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                       ct_txt_plain, (const uint8_t *)"ok 00000000", 11, &pkt);
+    coap_make_response_template(&pkt, &response_health);
 }
 
 static const coap_resource_path_t path_well_known_core = {2, {".well-known", "core"}};
+/* coap_handle_packet() renders the link format itself, with all blocks */
 static int handle_get_well_known_core(const coap_resource_t *resource,
                                       const coap_packet_t *inpkt,
                                       coap_packet_t *pkt)
 {
+    coap_link_filter_t filter;
+    size_t len = sizeof(rsp);
+    bool more;
     printf("handle_get_well_known_core\n");
+    if (coap_get_link_filter(inpkt, &filter)) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                  COAP_TYPE_ACK, COAP_RSPCODE_BAD_REQUEST,
+                                  NULL, NULL, 0, pkt);
+    }
+    coap_make_link_format_block(resources, &filter, 0, rsp, &len, &more);
+    int state = coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                   COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                                   resource->content_type, rsp, len, pkt);
+    // first block only, https://tools.ietf.org/html/rfc7959#section-2.4
+    if (more) {
+        const coap_block_t block = {0, true, 5};
+        coap_add_option(pkt, COAP_OPTION_BLOCK2, rsp_block2,
+                        coap_encode_block_option(&block, rsp_block2));
+    }
+    return state;
+}
+
+/* request counter in hex, at a fixed offset of "ok 00000000" */
+static int patch_health(const coap_resource_t *resource,
+                        const coap_packet_t *inpkt,
+                        uint8_t *buf, const size_t len)
+{
+    (void) resource;
+    (void) inpkt;
+    static const char hex[] = "0123456789abcdef";
+    const uint32_t n = ++health_requests;
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] = hex[(n >> (4 * (len - 1 - i))) & 0xF];
+    }
+    return COAP_SUCCESS;
+}
+
+static const coap_resource_path_t path_health = {1, {"health"}};
+static const coap_link_attrs_t link_health = {"health", "core.s", 11, false};
+static int handle_get_health(const coap_resource_t *resource,
+                             const coap_packet_t *inpkt,
+                             coap_packet_t *pkt)
+{
+    static char health[12];
+    printf("handle_get_health\n");
+    snprintf(health, sizeof(health), "ok %08x", (unsigned)++health_requests);
     return coap_make_response(inpkt->hdr.id, &inpkt->tok,
                               COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
                               resource->content_type,
-                              (const uint8_t *)rsp, strlen(rsp),
+                              (const uint8_t *)health, strlen(health),
                               pkt);
 }
 
+#ifdef MICROCOAP_STATS
+static const coap_resource_path_t path_stats = {2, {".well-known", "stats"}};
+#endif
+
+static int encode_light_txt(const coap_resource_t *resource,
+                            uint8_t *buf, size_t *buflen)
+{
+    (void) resource;
+    if (*buflen < 1) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    buf[0] = light;
+    *buflen = 1;
+    return COAP_SUCCESS;
+}
+
+static int encode_light_json(const coap_resource_t *resource,
+                             uint8_t *buf, size_t *buflen)
+{
+    (void) resource;
+    int n = snprintf((char *)buf, *buflen, "{\"light\":%c}", light);
+    if ((n < 0) || ((size_t)n >= *buflen)) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    *buflen = n;
+    return COAP_SUCCESS;
+}
+
+static uint8_t light_txt[1];
+static uint8_t light_json[16];
+static coap_content_format_t formats_light[] =
+{
+    {   COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN),
+        encode_light_txt, {light_txt, sizeof(light_txt)}, 0, false
+    },
+    {   COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_JSON),
+        encode_light_json, {light_json, sizeof(light_json)}, 0, false
+    },
+    {   COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE),
+        NULL, {NULL, 0}, 0, false
+    }
+};
+
 static const coap_resource_path_t path_light = {1, {"light"}};
+static const coap_link_attrs_t link_light = {"light", "core.a", 0, false};
 static int handle_get_light(const coap_resource_t *resource,
                             const coap_packet_t *inpkt,
                             coap_packet_t *pkt)
 {
     printf("handle_get_light\n");
-    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
-                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
-                              resource->content_type,
-                              (const uint8_t *)&light, 1,
-                              pkt);
+    return coap_make_content_response(resource, inpkt,
+                                      COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                                      pkt);
 }
 
 static int handle_put_light(const coap_resource_t *resource,
@@ -58,6 +183,7 @@ static int handle_put_light(const coap_resource_t *resource,
         light = '0';
         printf("Light OFF\n");
     }
+    coap_invalidate_content(formats_light);
     return coap_make_response(inpkt->hdr.id, &inpkt->tok,
                               COAP_TYPE_ACK, COAP_RSPCODE_CHANGED,
                               resource->content_type,
@@ -65,22 +191,184 @@ static int handle_put_light(const coap_resource_t *resource,
                               pkt);
 }
 
+static int print_senml_record(void *arg, const coap_senml_record_t *record)
+{
+    (void) arg;
+    printf("  %.*s %g %.*s @%g\n", (int)record->name.len, record->name.p,
+           record->value, (int)record->unit.len, record->unit.p, record->time);
+    return COAP_SUCCESS;
+}
+
+/*
+ * Block1 upload, one decoder per peer and token; kept with its final
+ * response code once done, to answer a repeated last block until it expires
+ */
+typedef struct
+{
+    bool active;
+    coap_responsecode_t done;           //!< final response, 0 while in progress
+    coap_endpoint_t peer;
+    uint8_t tok[COAP_MAX_TOKLEN];
+    size_t toklen;
+    coap_tick_t expires;
+    coap_senml_decoder_t decoder;
+} senml_transfer_t;
+
+static senml_transfer_t senml_transfers[SENML_TRANSFERS];
+static uint8_t senml_block1[3];
+static const coap_resource_path_t path_senml = {1, {"senml"}};
+
+/*
+ * transfer of the peer with this token, or if start is set a free slot, or
+ * the slot of a transfer done, which is kept for repeats only
+ */
+static senml_transfer_t *find_senml_transfer(const coap_packet_t *inpkt, const bool start)
+{
+    const coap_tick_t now = coap_clock_now();
+    senml_transfer_t *free_slot = NULL, *done_slot = NULL;
+    for (size_t i = 0; i < SENML_TRANSFERS; ++i) {
+        senml_transfer_t *t = &senml_transfers[i];
+        if (t->active && (t->expires <= now)) {
+            t->active = false;
+        }
+        if (!t->active) {
+            free_slot = free_slot ? free_slot : t;
+            continue;
+        }
+        if ((t->peer.len == peer.len) && !memcmp(t->peer.addr, peer.addr, peer.len) &&
+            (t->toklen == inpkt->tok.len) && !memcmp(t->tok, inpkt->tok.p, t->toklen)) {
+            return t;
+        }
+        if (t->done) {
+            done_slot = done_slot ? done_slot : t;
+        }
+    }
+    free_slot = free_slot ? free_slot : done_slot;
+    if (!start || !free_slot || (inpkt->tok.len > sizeof(free_slot->tok))) {
+        return NULL;
+    }
+    free_slot->active = false;
+    free_slot->done = 0;
+    free_slot->peer = peer;
+    free_slot->toklen = inpkt->tok.len;
+    memcpy(free_slot->tok, inpkt->tok.p, inpkt->tok.len);
+    return free_slot;
+}
+
+static int respond_senml(const coap_packet_t *inpkt, const coap_responsecode_t rspcode,
+                         const coap_block_t *block, coap_packet_t *pkt)
+{
+    int state = coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                   COAP_TYPE_ACK, rspcode,
+                                   NULL, NULL, 0, pkt);
+    // echo Block1, https://tools.ietf.org/html/rfc7959#section-2.3
+    if (coap_find_option(inpkt, COAP_OPTION_BLOCK1)) {
+        coap_add_option(pkt, COAP_OPTION_BLOCK1, senml_block1,
+                        coap_encode_block_option(block, senml_block1));
+    }
+    return state;
+}
+
+static int handle_post_senml(const coap_resource_t *resource,
+                             const coap_packet_t *inpkt,
+                             coap_packet_t *pkt)
+{
+    (void) resource;
+    uint32_t format = COAP_CONTENTTYPE_APP_SENML_JSON;
+    coap_block_t block;
+    coap_responsecode_t rspcode;
+    coap_senml_decoder_t single;
+    coap_senml_decoder_t *senml = &single;
+    senml_transfer_t *transfer = NULL;
+    bool start = true;
+    printf("handle_post_senml\n");
+    coap_get_option_uint(inpkt, COAP_OPTION_CONTENT_FORMAT, &format);
+    const bool blockwise = !coap_get_block_option(inpkt, COAP_OPTION_BLOCK1, &block);
+    if (blockwise) {
+        // (re)start a transfer with block 0, continue it otherwise
+        transfer = find_senml_transfer(inpkt, block.num == 0);
+        if (!transfer) {
+            rspcode = (block.num == 0) ? COAP_RSPCODE_SERVICE_UNAVAILABLE :
+                                         COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE;
+            return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                      COAP_TYPE_ACK, rspcode,
+                                      NULL, NULL, 0, pkt);
+        }
+        senml = &transfer->decoder;
+        transfer->expires = coap_clock_now() + SENML_TIMEOUT;
+        // the last block again, as its response got lost
+        if (transfer->done && ((block.num + 1) == senml->next_block) &&
+            (block.num || (inpkt->hdr.id == senml->last_id))) {
+            return respond_senml(inpkt, transfer->done, &block, pkt);
+        }
+        // a new pack after one done, otherwise block 0 is left to the decoder,
+        // which tells a retransmission from a restart
+        start = !transfer->active || (transfer->done && (block.num == 0));
+        transfer->done = 0;
+    }
+    if (start) {
+        if (coap_senml_decoder_init(senml, format, print_senml_record, NULL)) {
+            if (transfer) {
+                transfer->active = false;
+            }
+            return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                                      COAP_TYPE_ACK, COAP_RSPCODE_UNSUPPORTED_CONTENT_FMT,
+                                      NULL, NULL, 0, pkt);
+        }
+        if (transfer) {
+            transfer->active = true;
+        }
+    }
+    switch (coap_senml_decode_block1(senml, inpkt, &block)) {
+    case COAP_SUCCESS:
+        rspcode = block.more ? COAP_RSPCODE_CONTINUE : COAP_RSPCODE_CHANGED;
+        break;
+    case COAP_ERR_BLOCK_SEQUENCE:
+        rspcode = COAP_RSPCODE_REQUEST_ENTITY_INCOMPLETE;
+        break;
+    default:
+        rspcode = COAP_RSPCODE_BAD_REQUEST;
+        break;
+    }
+    // done with the last block, or given up: kept for repeats until it expires
+    if (transfer && (rspcode != COAP_RSPCODE_CONTINUE)) {
+        transfer->done = rspcode;
+    }
+    return respond_senml(inpkt, rspcode, &block, pkt);
+}
+
 coap_resource_t resources[] =
 {
     {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
         handle_get_well_known_core, &path_well_known_core,
-        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT)
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT), NULL, NULL,
+        COAP_RESOURCE_LINK_FORMAT, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_health, &path_health,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL,
+        &response_health, 0, &link_health
+    },
+#ifdef MICROCOAP_STATS
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        coap_stats_handle_get, &path_stats,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL
     },
+#endif
     {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
         handle_get_light, &path_light,
-        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN)
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), formats_light, NULL, 0, &link_light
     },
     {   COAP_STATE_RDY, COAP_METHOD_PUT, COAP_TYPE_ACK,
         handle_put_light, &path_light,
-        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE)
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_POST, COAP_TYPE_ACK,
+        handle_post_senml, &path_senml,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
     },
     {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
         NULL, NULL,
-        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE)
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
     }
 };
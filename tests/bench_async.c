@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_async.h"
+
+#define REQUESTS    200000
+#define DELAY       5       //!< ms slept by the handler before going upstream
+#define BLOCK_SZX   0       //!< 16 byte blocks
+#define DUPLICATE   100     //!< every n-th request is retransmitted
+#define QUEUE       1024    //!< datagrams in flight, power of 2
+
+enum { SERVER = 1, UPSTREAM, CLIENT };
+
+typedef struct
+{
+    uint8_t from, to;
+    size_t len;
+    uint8_t buf[128];
+} datagram_t;
+
+static datagram_t queue[QUEUE];
+static unsigned head, tail;
+static coap_tick_t vnow;
+static coap_async_t engine;
+
+static const char data[] = "measured by node 7, 21.5 C, 48 % rel. humidity..";
+
+static coap_tick_t vclock(void)
+{
+    return vnow;
+}
+
+static coap_endpoint_t endpoint(const uint8_t id)
+{
+    coap_endpoint_t ep = {1, {id}};
+    return ep;
+}
+
+static int push(const uint8_t from, const uint8_t to,
+                const uint8_t *buf, const size_t len)
+{
+    if ((tail - head == QUEUE) || (len > sizeof(queue[0].buf))) {
+        return COAP_ERR_BUSY;
+    }
+    datagram_t *d = &queue[tail++ % QUEUE];
+    d->from = from;
+    d->to = to;
+    d->len = len;
+    memcpy(d->buf, buf, len);
+    return COAP_SUCCESS;
+}
+
+static int send_from(void *ctx, const coap_endpoint_t *ep,
+                     const uint8_t *buf, const size_t buflen)
+{
+    return push(*(const uint8_t *)ctx, ep->addr[0], buf, buflen);
+}
+
+/* --- upstream, serving data block by block --------------------------------- */
+static int handle_get_data(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    static uint8_t opt[3];
+    coap_block_t block = {0, false, BLOCK_SZX};
+    coap_get_block_option(inpkt, COAP_OPTION_BLOCK2, &block);
+    const size_t size = COAP_BLOCK_SIZE(block.szx);
+    const size_t offset = block.num * size;
+    if (offset >= sizeof(data) - 1) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                                  COAP_RSPCODE_BAD_OPTION, NULL, NULL, 0, pkt);
+    }
+    const size_t len = (sizeof(data) - 1 - offset < size) ? sizeof(data) - 1 - offset : size;
+    block.more = (offset + len < sizeof(data) - 1);
+    coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                       COAP_RSPCODE_CONTENT, resource->content_type,
+                       (const uint8_t *)data + offset, len, pkt);
+    coap_add_option(pkt, COAP_OPTION_BLOCK2, opt, coap_encode_block_option(&block, opt));
+    return COAP_STATE_RSP_SEND;
+}
+
+static const coap_resource_path_t path_data = {1, {"data"}};
+static coap_resource_t upstream_resources[] =
+{
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_data, &path_data,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL
+    },
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+/* --- server, relaying data after a delay ---------------------------------- */
+typedef struct
+{
+    uint32_t num;                       //!< next block
+    size_t len;                         //!< bytes in body
+    uint8_t body[64];                   //!< blocks so far
+} fetch_t;
+
+static const coap_resource_t request_data =
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_data,
+     COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+
+static int handle_get_relay(const coap_resource_t *resource,
+                            const coap_packet_t *inpkt,
+                            coap_packet_t *pkt)
+{
+    coap_async_task_t *task = coap_async_current();
+    fetch_t *f = COAP_ASYNC_LOCALS(task, fetch_t);
+    const coap_endpoint_t upstream = endpoint(UPSTREAM);
+    coap_packet_t req;
+    coap_block_t block;
+    uint8_t opt[3];
+
+    COAP_ASYNC_BEGIN(task);
+    COAP_ASYNC_SLEEP(task, DELAY);
+    do {
+        block.num = f->num;
+        block.more = false;
+        block.szx = BLOCK_SZX;
+        coap_make_request(0, NULL, &request_data, NULL, 0, &req);
+        coap_add_option(&req, COAP_OPTION_BLOCK2, opt, coap_encode_block_option(&block, opt));
+        COAP_ASYNC_REQUEST(task, &upstream, &req);
+        const coap_buffer_t *payload = &task->response.payload;
+        if (task->status || (task->response.hdr.code != COAP_RSPCODE_CONTENT) ||
+            coap_get_block_option(&task->response, COAP_OPTION_BLOCK2, &block) ||
+            (block.num != f->num) || (f->len + payload->len > sizeof(f->body))) {
+            return coap_make_response(0, &inpkt->tok, COAP_TYPE_NONCON,
+                                      COAP_RSPCODE_BAD_GATEWAY, NULL, NULL, 0, pkt);
+        }
+        memcpy(f->body + f->len, payload->p, payload->len);
+        f->len += payload->len;
+        f->num++;
+    } while (block.more);
+    return coap_make_response(0, &inpkt->tok, COAP_TYPE_NONCON,
+                              COAP_RSPCODE_CONTENT, resource->content_type,
+                              f->body, f->len, pkt);
+}
+
+/* fails after a delay, answered with 5.00 by the engine */
+static int handle_get_fail(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    (void)resource;
+    (void)inpkt;
+    (void)pkt;
+    coap_async_task_t *task = coap_async_current();
+    COAP_ASYNC_BEGIN(task);
+    COAP_ASYNC_SLEEP(task, DELAY);
+    return COAP_ERR_TIMEOUT;
+}
+
+static const coap_resource_path_t path_relay = {1, {"relay"}};
+static const coap_resource_path_t path_fail = {1, {"fail"}};
+static coap_resource_t resources[] =
+{
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON,
+        handle_get_relay, &path_relay,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL,
+        COAP_RESOURCE_ASYNC, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON,
+        handle_get_fail, &path_fail,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL,
+        COAP_RESOURCE_ASYNC, NULL
+    },
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+/* --- client --------------------------------------------------------------- */
+static coap_request_template_t tpl;
+static unsigned sent, completed, failed, acks, unexpected, peak;
+
+static void send_request(void)
+{
+    uint8_t buf[64];
+    size_t len = sizeof(buf);
+    const uint32_t n = sent++;
+    const coap_buffer_t tok = {(const uint8_t *)&n, sizeof(n)};
+    coap_build_request(&tpl, (uint16_t)n, &tok, NULL, 0, buf, &len);
+    push(CLIENT, SERVER, buf, len);
+    if (!(n % DUPLICATE)) {
+        push(CLIENT, SERVER, buf, len);
+    }
+}
+
+static void deliver(const datagram_t *d)
+{
+    static const uint8_t server = SERVER, upstream = UPSTREAM;
+    const coap_endpoint_t from = endpoint(d->from);
+    uint8_t out[128];
+    size_t outlen = sizeof(out);
+    coap_packet_t pkt;
+    int rc;
+    if (coap_parse(d->buf, d->len, &pkt)) {
+        return;
+    }
+    switch (d->to) {
+    case UPSTREAM:
+        if (!coap_handle_packet(upstream_resources, d->buf, d->len, out, &outlen)) {
+            send_from((void *)&upstream, &from, out, outlen);
+        }
+        break;
+    case SERVER:
+        // requests are codes 0.01 to 0.31, everything else is for the client
+        if ((pkt.hdr.code > COAP_RSPCODE_EMPTY) && (pkt.hdr.code < MAKE_RSPCODE(1, 0))) {
+            rc = coap_async_handle_packet(&engine, resources, &from, d->buf, d->len,
+                                          out, &outlen);
+            if (!rc) {
+                send_from((void *)&server, &from, out, outlen);
+            }
+        }
+        else {
+            coap_async_handle_response(&engine, &from, &pkt);
+        }
+        break;
+    case CLIENT:
+        if (pkt.hdr.code == COAP_RSPCODE_EMPTY) {
+            acks++;
+        }
+        else if ((pkt.hdr.code == COAP_RSPCODE_CONTENT) &&
+                 (pkt.payload.len == sizeof(data) - 1) &&
+                 !memcmp(pkt.payload.p, data, pkt.payload.len)) {
+            completed++;
+            if (sent < REQUESTS) {
+                send_request();
+            }
+        }
+        else if (pkt.hdr.code == COAP_RSPCODE_INTERNAL_SERVER_ERROR) {
+            failed++;
+        }
+        else {
+            unexpected++;
+        }
+        break;
+    }
+}
+
+static unsigned suspended(void)
+{
+    unsigned n = 0;
+    for (size_t i = 0; i < COAP_ASYNC_MAX_TASKS; ++i) {
+        n += engine.tasks[i].active;
+    }
+    return n;
+}
+
+/* deliver datagrams and expire timers until nothing is left to do */
+static void drain(void)
+{
+    for (;;) {
+        if (head == tail) {
+            // idle until the next timer
+            const coap_tick_t next = coap_async_poll(&engine);
+            if (next == COAP_TICK_NEVER) {
+                break;
+            }
+            vnow = (next > vnow) ? next : vnow;
+            coap_async_poll(&engine);
+            continue;
+        }
+        const datagram_t d = queue[head++ % QUEUE];
+        deliver(&d);
+        const unsigned n = suspended();
+        peak = (n > peak) ? n : peak;
+    }
+}
+
+static int check(const char *what, const bool ok)
+{
+    printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    static const uint8_t server = SERVER;
+    static const coap_resource_t request_relay =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_relay,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+
+    coap_clock_set(vclock);
+    coap_async_init(&engine, send_from, (void *)&server);
+    coap_make_request_template(&request_relay, &tpl);
+
+    printf("%d requests, each sleeping %d ms and fetching %zu blocks upstream, "
+           "%d tasks on one thread\n", REQUESTS, DELAY,
+           (sizeof(data) - 1 + COAP_BLOCK_SIZE(BLOCK_SZX) - 1) / COAP_BLOCK_SIZE(BLOCK_SZX),
+           COAP_ASYNC_MAX_TASKS);
+    const double t0 = now_ns();
+    while (sent < COAP_ASYNC_MAX_TASKS) {
+        send_request();
+    }
+    drain();
+    const double t1 = now_ns();
+
+    printf("completed %u, unexpected %u, empty ACKs %u, rejected %llu\n",
+           completed, unexpected, acks, (unsigned long long)engine.rejected);
+    printf("peak %u suspended handlers, virtual %.1f s, %.0f ns per request\n",
+           peak, (double)vnow / COAP_TICKS_PER_SEC, (t1 - t0) / REQUESTS);
+    int rc = (completed == REQUESTS) && !unexpected && !engine.rejected ? 0 : 1;
+
+    // the last request again, as if its response had been lost
+    uint8_t buf[64];
+    size_t len = sizeof(buf);
+    const uint32_t last = REQUESTS - 1;
+    coap_buffer_t tok = {(const uint8_t *)&last, sizeof(last)};
+    const uint64_t started = engine.started;
+    const unsigned answered = completed;
+    coap_build_request(&tpl, (uint16_t)last, &tok, NULL, 0, buf, &len);
+    push(CLIENT, SERVER, buf, len);
+    drain();
+    rc |= check("completed request retransmitted, answered",
+                (completed == answered + 1) && (engine.started == started));
+
+    // a handler failing after the empty ACK
+    static const coap_resource_t request_fail =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_fail,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    coap_request_template_t fail;
+    coap_make_request_template(&request_fail, &fail);
+    len = sizeof(buf);
+    tok.p = (const uint8_t *)&sent;
+    coap_build_request(&fail, (uint16_t)sent, &tok, NULL, 0, buf, &len);
+    push(CLIENT, SERVER, buf, len);
+    drain();
+    rc |= check("failing handler, 5.00", (failed == 1) && !unexpected);
+    return rc;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_cbor.h"
+
+#define RECORDS     16
+#define ITERATIONS  200000
+
+typedef struct reading
+{
+    const char *name;
+    const char *unit;
+    double value;
+    int64_t time;
+} reading_t;
+
+static reading_t readings[RECORDS];
+static const uint8_t ct_cbor[2] = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_CBOR);
+static const uint8_t ct_json[2] = COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_JSON);
+static volatile double sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* encode straight into the payload region of the datagram */
+static size_t encode_cbor(uint8_t *buf, size_t buflen)
+{
+    coap_packet_t pkt;
+    coap_rw_buffer_t payload;
+    coap_cbor_writer_t w;
+    size_t len;
+    coap_make_response(1, NULL, COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                       ct_cbor, NULL, 0, &pkt);
+    coap_build_payload_buffer(&pkt, buf, buflen, &payload);
+    coap_cbor_writer_init(&w, payload.p, payload.len);
+    coap_cbor_put_array(&w, RECORDS);
+    for (int i = 0; i < RECORDS; ++i) {
+        coap_cbor_put_map(&w, 4);
+        coap_cbor_put_text(&w, "n", 1);
+        coap_cbor_put_text(&w, readings[i].name, strlen(readings[i].name));
+        coap_cbor_put_text(&w, "u", 1);
+        coap_cbor_put_text(&w, readings[i].unit, strlen(readings[i].unit));
+        coap_cbor_put_text(&w, "v", 1);
+        coap_cbor_put_float(&w, readings[i].value);
+        coap_cbor_put_text(&w, "t", 1);
+        coap_cbor_put_int(&w, readings[i].time);
+    }
+    if (coap_cbor_writer_finish(&w, &len)) {
+        return 0;
+    }
+    pkt.payload.p = payload.p;
+    pkt.payload.len = len;
+    coap_build(&pkt, buf, &buflen);
+    return buflen;
+}
+
+/* render into scratch buffer, then copy into the datagram */
+static size_t encode_json(uint8_t *buf, size_t buflen)
+{
+    static char scratch[1024];
+    coap_packet_t pkt;
+    size_t len = 0;
+    scratch[len++] = '[';
+    for (int i = 0; i < RECORDS; ++i) {
+        len += snprintf(scratch + len, sizeof(scratch) - len,
+                        "%s{\"n\":\"%s\",\"u\":\"%s\",\"v\":%.9g,\"t\":%lld}",
+                        i ? "," : "", readings[i].name, readings[i].unit,
+                        readings[i].value, (long long)readings[i].time);
+    }
+    scratch[len++] = ']';
+    coap_make_response(1, NULL, COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                       ct_json, (const uint8_t *)scratch, len, &pkt);
+    coap_build(&pkt, buf, &buflen);
+    return buflen;
+}
+
+static int decode_cbor(const coap_packet_t *pkt)
+{
+    coap_cbor_reader_t r;
+    coap_cbor_item_t item;
+    coap_buffer_t key;
+    int n = 0;
+    coap_cbor_reader_init(&r, pkt->payload.p, pkt->payload.len);
+    if (coap_cbor_next(&r, &item) || (item.type != COAP_CBOR_ARRAY)) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < item.val.count; ++i) {
+        coap_cbor_item_t map;
+        if (coap_cbor_next(&r, &map) || (map.type != COAP_CBOR_MAP)) {
+            return -1;
+        }
+        for (uint64_t k = 0; k < map.val.count; ++k) {
+            double v;
+            if (coap_cbor_get_text(&r, &key)) {
+                return -1;
+            }
+            if ((key.len == 1) && (key.p[0] == 'v' || key.p[0] == 't')) {
+                if (coap_cbor_get_float(&r, &v)) {
+                    return -1;
+                }
+                sink = v;
+            }
+            else if (coap_cbor_skip(&r)) {
+                return -1;
+            }
+        }
+        n++;
+    }
+    return n;
+}
+
+/* minimal parser for exactly the records encode_json() produces */
+static int decode_json(const coap_packet_t *pkt)
+{
+    char text[1024];
+    int n = 0;
+    memcpy(text, pkt->payload.p, pkt->payload.len);
+    text[pkt->payload.len] = '\0';
+    for (char *p = strchr(text, '{'); p; p = strchr(p, '{')) {
+        char *end = strchr(p, '}');
+        for (char *k = strchr(p, '"'); k && (k < end); k = strchr(k, '"')) {
+            const char name = k[1];
+            k = strchr(k + 1, '"') + 2;   // skip name and colon
+            if (*k == '"') {
+                k = strchr(k + 1, '"') + 1;
+            }
+            else {
+                double v = strtod(k, &k);
+                if (name == 'v' || name == 't') {
+                    sink = v;
+                }
+            }
+            k = (*k == ',') ? k + 1 : end;
+        }
+        p = end;
+        n++;
+    }
+    return n;
+}
+
+static void run(const char *label, size_t (*encode)(uint8_t *, size_t),
+                int (*decode)(const coap_packet_t *))
+{
+    uint8_t buf[1024];
+    coap_packet_t pkt;
+    size_t len = 0;
+    double t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        readings[i % RECORDS].time++;
+        len = encode(buf, sizeof(buf));
+    }
+    double t1 = now_ns();
+    int records = 0;
+    coap_parse(buf, len, &pkt);
+    for (int i = 0; i < ITERATIONS; ++i) {
+        records += decode(&pkt);
+    }
+    double t2 = now_ns();
+    printf("%-5s datagram %4zu bytes  encode %8.1f ns  decode %8.1f ns  (%d records)\n",
+           label, len, (t1 - t0) / ITERATIONS, (t2 - t1) / ITERATIONS,
+           records / ITERATIONS);
+}
+
+int main(void)
+{
+    static const char *names[] = {"temp", "humidity", "pressure", "co2"};
+    static const char *units[] = {"Cel", "%RH", "Pa", "ppm"};
+    for (int i = 0; i < RECORDS; ++i) {
+        readings[i].name = names[i % 4];
+        readings[i].unit = units[i % 4];
+        readings[i].value = 20.5 + i * 0.25;
+        readings[i].time = 1476400000 + i;
+    }
+    // a map of 2^63 pairs claims 2^64 items, which must not wrap to 0
+    static const uint8_t huge_map[] = {0xBB, 0x80, 0, 0, 0, 0, 0, 0, 0, 0x00, 0x00};
+    coap_cbor_reader_t r;
+    coap_cbor_reader_init(&r, huge_map, sizeof(huge_map));
+    if (coap_cbor_skip(&r) != COAP_ERR_INCOMPLETE) {
+        printf("oversized map skipped\n");
+        return 1;
+    }
+    printf("%d records per datagram, %d iterations\n", RECORDS, ITERATIONS);
+    run("cbor", encode_cbor, decode_cbor);
+    run("json", encode_json, decode_json);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "coap.h"
+
+#define BATCH       4096    //!< datagrams parsed before any is handled
+#define ROUNDS      100
+#define DGRAM_SIZE  64
+
+static const coap_resource_path_t path_value = {3, {"sensors", "{id}", "value"}};
+static int value_handler(const coap_resource_t *resource,
+                         const coap_packet_t *inpkt, coap_packet_t *pkt);
+static coap_resource_t resources[] =
+{
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK, value_handler, &path_value,
+     COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL},
+    {(coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0, NULL, NULL,
+     COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL}
+};
+static uint8_t dgrams[BATCH][DGRAM_SIZE];
+static size_t lens[BATCH];
+static coap_packet_t full[BATCH];
+static coap_packet_compact_t compact[BATCH];
+static int failures;
+static volatile size_t sink;
+
+static int value_handler(const coap_resource_t *resource,
+                         const coap_packet_t *inpkt, coap_packet_t *pkt)
+{
+    coap_buffer_t id;
+    if (coap_get_path_param(resource, inpkt, "id", &id)) {
+        return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                                  COAP_RSPCODE_NOT_FOUND, NULL, NULL, 0, pkt);
+    }
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                              COAP_RSPCODE_CONTENT, resource->content_type,
+                              id.p, id.len, pkt);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* L1 data cache read misses of this thread, -1 without counters, e.g. in a VM */
+static int l1_open(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void l1_start(const int fd)
+{
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static long long l1_stop(const int fd)
+{
+    long long count = -1;
+    if ((fd < 0) || ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) ||
+        (read(fd, &count, sizeof(count)) != sizeof(count))) {
+        return -1;
+    }
+    return count;
+}
+
+static void check(const bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/* GET /sensors/<n>/value, some with Accept or a query */
+static size_t make_request(const unsigned n, uint8_t *buf, const size_t buflen)
+{
+    static const uint8_t accept[] = {COAP_CONTENTTYPE_TXT_PLAIN};
+    char id[12];
+    uint8_t token[4];
+    const coap_buffer_t tok = {token, sizeof(token)};
+    coap_packet_t pkt;
+    size_t len = buflen;
+    memcpy(token, &n, sizeof(token));
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.hdr.ver = COAP_VERSION;
+    pkt.hdr.t = COAP_TYPE_CON;
+    pkt.hdr.tkl = sizeof(token);
+    pkt.hdr.code = COAP_METHOD_GET;
+    pkt.hdr.id = (uint16_t)n;
+    pkt.tok = tok;
+    snprintf(id, sizeof(id), "%u", n % 1000);
+    coap_add_option(&pkt, COAP_OPTION_URI_PATH, (const uint8_t *)"sensors", 7);
+    coap_add_option(&pkt, COAP_OPTION_URI_PATH, (const uint8_t *)id, strlen(id));
+    coap_add_option(&pkt, COAP_OPTION_URI_PATH, (const uint8_t *)"value", 5);
+    if (n % 3 == 0) {
+        coap_add_option(&pkt, COAP_OPTION_ACCEPT, accept, sizeof(accept));
+    }
+    if (n % 5 == 0) {
+        coap_add_option(&pkt, COAP_OPTION_URI_QUERY, (const uint8_t *)"unit=C", 6);
+    }
+    return coap_build(&pkt, buf, &len) ? 0 : len;
+}
+
+static bool same_packet(const coap_packet_t *a, const coap_packet_t *b)
+{
+    if (memcmp(&a->hdr, &b->hdr, sizeof(a->hdr)) || (a->tok.len != b->tok.len) ||
+        (a->tok.len && (a->tok.p != b->tok.p)) || (a->numopts != b->numopts) ||
+        (a->payload.p != b->payload.p) || (a->payload.len != b->payload.len)) {
+        return false;
+    }
+    for (size_t i = 0; i < a->numopts; ++i) {
+        if ((a->opts[i].num != b->opts[i].num) || (a->opts[i].buf.p != b->opts[i].buf.p) ||
+            (a->opts[i].buf.len != b->opts[i].buf.len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* both layouts parse to the same packet, or fail alike */
+static void check_layouts(void)
+{
+    static const uint8_t payload[] = {0x42, 0x01, 0x12, 0x34, 0xab, 0xcd, 0xff, 'h', 'i'};
+    static const uint8_t empty[] = {0x50, 0x00, 0x00, 0x01};
+    static const uint8_t marker_only[] = {0x50, 0x02, 0x00, 0x01, 0xff};
+    static const uint8_t bad_token[] = {0x49, 0x01, 0x00, 0x01, 1, 2};
+    static const uint8_t bad_option[] = {0x40, 0x01, 0x00, 0x01, 0xb5, 'a'};
+    static const uint8_t bad_version[] = {0x80, 0x01, 0x00, 0x01};
+    const struct { const uint8_t *buf; size_t len; } cases[] =
+    {
+        {payload, sizeof(payload)}, {empty, sizeof(empty)},
+        {marker_only, sizeof(marker_only)}, {bad_token, sizeof(bad_token)},
+        {bad_option, sizeof(bad_option)}, {bad_version, sizeof(bad_version)},
+        {dgrams[0], lens[0]}, {dgrams[15], lens[15]},
+    };
+    coap_packet_t pkt, expanded;
+    coap_packet_compact_t cpkt;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const int rc = coap_parse(cases[i].buf, cases[i].len, &pkt);
+        check(coap_parse_compact(cases[i].buf, cases[i].len, &cpkt) == rc, "same result");
+        if (rc) {
+            continue;
+        }
+        coap_expand_compact(&cpkt, &expanded);
+        check(same_packet(&pkt, &expanded), "expanded equals parsed");
+        for (size_t j = 0; j < pkt.numopts; ++j) {
+            const coap_option_t opt = coap_compact_option(&cpkt, j);
+            check((opt.num == pkt.opts[j].num) && (opt.buf.p == pkt.opts[j].buf.p), "option");
+        }
+    }
+    coap_buffer_t value;
+    coap_parse_compact(dgrams[15], lens[15], &cpkt);
+    coap_parse(dgrams[15], lens[15], &pkt);
+    check(!coap_compact_find_option(&cpkt, COAP_OPTION_URI_QUERY, &value) &&
+          (value.p == coap_find_option(&pkt, COAP_OPTION_URI_QUERY)->buf.p), "find option");
+    check(coap_compact_find_option(&cpkt, COAP_OPTION_CONTENT_FORMAT, &value) ==
+          COAP_ERR_OPTION_NOT_FOUND, "absent option");
+    // dispatch from either layout answers alike
+    uint8_t out1[128], out2[128];
+    size_t len1 = sizeof(out1), len2 = sizeof(out2);
+    check(!coap_handle_packet(resources, dgrams[15], lens[15], out1, &len1) &&
+          !coap_handle_compact(resources, &cpkt, out2, &len2, NULL, NULL) &&
+          (len1 == len2) && !memcmp(out1, out2, len1), "same response");
+}
+
+/* what a batch consumer does before dispatch: route by the first Uri-Path */
+static size_t route_full(void)
+{
+    size_t sum = 0;
+    for (size_t i = 0; i < BATCH; ++i) {
+        const coap_option_t *opt = coap_find_option(&full[i], COAP_OPTION_URI_PATH);
+        sum += opt ? opt->buf.len + full[i].tok.len + full[i].payload.len : 0;
+    }
+    return sum;
+}
+
+static size_t route_compact(void)
+{
+    size_t sum = 0;
+    coap_buffer_t value;
+    for (size_t i = 0; i < BATCH; ++i) {
+        if (!coap_compact_find_option(&compact[i], COAP_OPTION_URI_PATH, &value)) {
+            sum += value.len + compact[i].hdr.tkl + coap_compact_payload(&compact[i]).len;
+        }
+    }
+    return sum;
+}
+
+static void report(const char *name, const size_t size, const double ns,
+                   const long long misses)
+{
+    if (misses >= 0) {
+        printf("%-10s %5zu bytes  %8.1f ns  %8.2f\n", name, size, ns / (ROUNDS * BATCH),
+               (double)misses / (ROUNDS * BATCH));
+    }
+    else {
+        printf("%-10s %5zu bytes  %8.1f ns       n/a\n", name, size, ns / (ROUNDS * BATCH));
+    }
+}
+
+int main(void)
+{
+    uint8_t out[128];
+    for (unsigned i = 0; i < BATCH; ++i) {
+        lens[i] = make_request(i, dgrams[i], DGRAM_SIZE);
+    }
+    check_layouts();
+
+    const int fd = l1_open();
+    printf("batches of %d GET /sensors/{id}/value, per packet\n", BATCH);
+    printf("layout     state            time  L1D misses\n");
+    // parse a batch, then one routing pass over the parsed packets
+    double t0 = now_ns();
+    l1_start(fd);
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            coap_parse(dgrams[i], lens[i], &full[i]);
+        }
+        sink += route_full();
+    }
+    long long m = l1_stop(fd);
+    report("regular", sizeof(coap_packet_t), now_ns() - t0, m);
+    t0 = now_ns();
+    l1_start(fd);
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            coap_parse_compact(dgrams[i], lens[i], &compact[i]);
+        }
+        sink += route_compact();
+    }
+    m = l1_stop(fd);
+    report("compact", sizeof(coap_packet_compact_t), now_ns() - t0, m);
+
+    // dispatch the parsed batch, each packet expanded again for the handler
+    printf("\nparse, route and dispatch\n");
+    t0 = now_ns();
+    l1_start(fd);
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            coap_parse(dgrams[i], lens[i], &full[i]);
+        }
+        sink += route_full();
+        for (size_t i = 0; i < BATCH; ++i) {
+            size_t outlen = sizeof(out);
+            sink += coap_handle_packet(resources, dgrams[i], lens[i], out, &outlen);
+        }
+    }
+    m = l1_stop(fd);
+    report("regular", sizeof(coap_packet_t), now_ns() - t0, m);
+    t0 = now_ns();
+    l1_start(fd);
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            coap_parse_compact(dgrams[i], lens[i], &compact[i]);
+        }
+        sink += route_compact();
+        for (size_t i = 0; i < BATCH; ++i) {
+            size_t outlen = sizeof(out);
+            sink += coap_handle_compact(resources, &compact[i], out, &outlen, NULL, NULL);
+        }
+    }
+    m = l1_stop(fd);
+    report("compact", sizeof(coap_packet_compact_t), now_ns() - t0, m);
+    if (fd < 0) {
+        printf("no L1D counter, e.g. in a VM or with perf_event_paranoid > 2\n");
+    }
+    else {
+        close(fd);
+    }
+
+    if (failures) {
+        printf("%d checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "coap.h"
+#include "coap.hpp"
+
+#define ITERATIONS  2000000
+#define PATHS       9
+
+static const char payload[] = "21.5";
+static volatile size_t sink;
+
+/* --- C resource table ----------------------------------------------------- */
+static int handle_get(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt,
+                      coap_packet_t *pkt)
+{
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)payload, sizeof(payload) - 1, pkt);
+}
+
+static const coap_resource_path_t paths[PATHS] =
+{
+    {2, {"room", "kitchen"}}, {2, {"room", "hall"}}, {2, {"room", "bath"}},
+    {3, {"floor", "1", "power"}}, {3, {"floor", "2", "power"}},
+    {3, {"floor", "3", "power"}}, {1, {"uptime"}}, {1, {"version"}},
+    {3, {"sensor", "{id}", "value"}},
+};
+
+#define RESOURCE(p) \
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK, handle_get, p, \
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL }
+
+static coap_resource_t resources[] =
+{
+    RESOURCE(&paths[0]), RESOURCE(&paths[1]), RESOURCE(&paths[2]),
+    RESOURCE(&paths[3]), RESOURCE(&paths[4]), RESOURCE(&paths[5]),
+    RESOURCE(&paths[6]), RESOURCE(&paths[7]), RESOURCE(&paths[8]),
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+/* --- C++ route table ------------------------------------------------------ */
+static constexpr auto content = [](const coap::exchange &ex) {
+    return ex.reply(COAP_RSPCODE_CONTENT, std::string_view(payload, sizeof(payload) - 1));
+};
+
+static constexpr auto routes = coap::routes(
+    coap::get("/room/kitchen", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/room/hall", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/room/bath", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/floor/1/power", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/floor/2/power", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/floor/3/power", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/uptime", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/version", COAP_CONTENTTYPE_TXT_PLAIN, content),
+    coap::get("/sensor/{id}/value", COAP_CONTENTTYPE_TXT_PLAIN, content));
+
+// a handler failing, or responding later, leaves nothing to send
+static constexpr auto failing = coap::routes(
+    coap::get("/uptime", COAP_CONTENTTYPE_TXT_PLAIN,
+              [](const coap::exchange &) { return (int)COAP_ERR_UNSUPPORTED; }));
+
+static_assert(coap::link_format<routes>.substr(0, 25) == "</room/kitchen>;ct=0,</ro",
+              "link format rendered at compile time");
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    static const coap_resource_path_t path_sensor = {3, {"sensor", "17", "value"}};
+    static const coap_resource_path_t path_missing = {2, {"room", "attic"}};
+    uint8_t req[PATHS + 1][64];
+    size_t reqlen[PATHS + 1];
+    uint8_t out_c[128], out_cpp[128];
+    char links[256];
+    uint8_t token[4] = {1, 2, 3, 4};
+    coap_buffer_t tok = {token, sizeof(token)};
+
+    // one request per route, and one for a path that does not exist
+    for (int i = 0; i <= PATHS; ++i) {
+        coap_resource_t rs =
+            {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL,
+             (i == PATHS - 1) ? &path_sensor : (i == PATHS) ? &path_missing : &paths[i],
+             COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+        coap_request_template_t tpl;
+        reqlen[i] = sizeof(req[i]);
+        if (coap_make_request_template(&rs, &tpl) ||
+            coap_build_request(&tpl, (uint16_t)i, &tok, NULL, 0, req[i], &reqlen[i])) {
+            printf("request failed\n");
+            return 1;
+        }
+    }
+    // both ways must yield the same datagrams
+    for (int i = 0; i <= PATHS; ++i) {
+        size_t len_c = sizeof(out_c), len_cpp = sizeof(out_cpp);
+        if (coap_handle_packet(resources, req[i], reqlen[i], out_c, &len_c) ||
+            coap::handle_packet<routes>(req[i], reqlen[i], out_cpp, &len_cpp) ||
+            (len_c != len_cpp) || memcmp(out_c, out_cpp, len_c)) {
+            printf("responses differ for request %d\n", i);
+            return 1;
+        }
+    }
+    size_t len_failed = sizeof(out_cpp);
+    if ((coap::handle_packet<failing>(req[6], reqlen[6], out_cpp, &len_failed) !=
+         COAP_ERR_UNSUPPORTED) || (len_failed != sizeof(out_cpp))) {
+        printf("failing handler answered\n");
+        return 1;
+    }
+    if (coap_make_link_format(resources, links, sizeof(links)) ||
+        (coap::link_format<routes> != links)) {
+        printf("link formats differ\n");
+        return 1;
+    }
+
+    printf("GET on %d routes and one missing path, %d iterations\n", PATHS, ITERATIONS);
+    double t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        const int r = i % (PATHS + 1);
+        size_t len = sizeof(out_c);
+        coap_handle_packet(resources, req[r], reqlen[r], out_c, &len);
+        sink += len;
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        const int r = i % (PATHS + 1);
+        size_t len = sizeof(out_cpp);
+        coap::handle_packet<routes>(req[r], reqlen[r], out_cpp, &len);
+        sink += len;
+    }
+    double t2 = now_ns();
+    printf("coap_handle_packet     %8.1f ns\n", (t1 - t0) / ITERATIONS);
+    printf("coap::handle_packet    %8.1f ns\n", (t2 - t1) / ITERATIONS);
+    printf("link format, %zu bytes at compile time\n%s\n",
+           coap::link_format<routes>.size(), coap::link_format<routes>.data());
+    return 0;
+}
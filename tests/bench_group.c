@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "coap.h"
+#include "coap_client.h"
+#include "coap_group.h"
+#include "coap_sim.h"
+
+#define MEMBERS     200
+#define WINDOW_MS   10      //!< the gateway forwards
+#define BUDGET      20      //!< datagrams per window, drops the rest
+#define RATE        2000    //!< bytes per second left for responses
+
+/* a server in the group */
+typedef struct
+{
+    coap_sim_node_t node;
+    coap_group_t group;
+    coap_tick_t poll_at;                //!< pending poll timer
+} member_t;
+
+static coap_sim_t sim;
+static member_t members[MEMBERS];
+static coap_sim_node_t client_node;
+static coap_client_t client;
+static coap_tick_t client_poll_at;
+static coap_endpoint_t group_ep;
+static int failures;
+
+/* what the client sees behind the gateway */
+static coap_tick_t window;
+static unsigned in_window, peak;
+static uint64_t dropped, collected, distinct, last_ms;
+static bool done, seen[MEMBERS];
+
+static const coap_resource_path_t path_sensor = {1, {"sensor"}};
+static const coap_resource_path_t path_nothing = {1, {"nothing"}};
+
+static int handle_get_sensor(const coap_resource_t *resource,
+                             const coap_packet_t *inpkt,
+                             coap_packet_t *pkt)
+{
+    static const uint8_t value[] = "21.5";
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              value, sizeof(value) - 1, pkt);
+}
+
+static coap_resource_t resources[] =
+{
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_sensor, &path_sensor,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL},
+    {(coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL}
+};
+
+static void check(const bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static void member_poll(void *arg)
+{
+    member_t *m = arg;
+    if (coap_clock_now() != m->poll_at) {
+        return;     // superseded by an earlier timer
+    }
+    m->poll_at = coap_group_poll(&m->group);
+    coap_sim_timer(&sim, m->poll_at, member_poll, m);
+}
+
+/* every request arrives via multicast */
+static void member_recv(void *arg, const coap_endpoint_t *from,
+                        const uint8_t *buf, const size_t buflen)
+{
+    member_t *m = arg;
+    uint8_t out[256];
+    size_t outlen = sizeof(out);
+    if (!coap_group_accepts(buf, buflen) ||
+        coap_handle_packet(resources, buf, buflen, out, &outlen)) {
+        return;
+    }
+    coap_group_send(&m->group, from, out, outlen);
+    const coap_tick_t next = coap_group_poll(&m->group);
+    if (next < m->poll_at) {
+        m->poll_at = next;
+        coap_sim_timer(&sim, next, member_poll, m);
+    }
+}
+
+/* the network delivers datagrams to the group to all its members */
+static int client_send(void *ctx, const coap_endpoint_t *ep,
+                       const uint8_t *buf, const size_t buflen)
+{
+    if (!coap_endpoint_equal(ep, &group_ep)) {
+        return coap_sim_send(ctx, ep, buf, buflen);
+    }
+    for (unsigned i = 0; i < MEMBERS; ++i) {
+        coap_sim_send(ctx, &members[i].node.ep, buf, buflen);
+    }
+    return COAP_SUCCESS;
+}
+
+static void client_poll(void *arg)
+{
+    (void)arg;
+    if (coap_clock_now() != client_poll_at) {
+        return;
+    }
+    client_poll_at = coap_client_poll(&client);
+    coap_sim_timer(&sim, client_poll_at, client_poll, NULL);
+}
+
+static void client_recv(void *arg, const coap_endpoint_t *from,
+                        const uint8_t *buf, const size_t buflen)
+{
+    coap_packet_t pkt;
+    (void)arg;
+    const coap_tick_t now = coap_clock_now();
+    if (now >= window + WINDOW_MS) {
+        window = now - now % WINDOW_MS;
+        in_window = 0;
+    }
+    if (++in_window > peak) {
+        peak = in_window;
+    }
+    if (in_window > BUDGET) {
+        dropped++;
+        return;
+    }
+    if (!coap_parse(buf, buflen, &pkt)) {
+        coap_client_handle_packet(&client, from, &pkt);
+    }
+}
+
+static void collect(void *arg, const int status, const coap_packet_t *rsppkt)
+{
+    (void)arg;
+    if (status == COAP_ERR_TIMEOUT) {
+        done = true;
+        return;
+    }
+    if (status || !rsppkt || (rsppkt->hdr.code != COAP_RSPCODE_CONTENT) ||
+        (rsppkt->hdr.t != COAP_TYPE_NONCON) || !client.from) {
+        failures++;
+        return;
+    }
+    for (unsigned i = 0; i < MEMBERS; ++i) {
+        if (!seen[i] && coap_endpoint_equal(client.from, &members[i].node.ep)) {
+            seen[i] = true;
+            distinct++;
+        }
+    }
+    collected++;
+    last_ms = coap_clock_now();
+}
+
+/* one request to the group, returns the responses collected */
+static uint64_t run(const coap_tick_t leisure, const coap_resource_path_t *path,
+                    const coap_msgtype_t type, int *rc)
+{
+    coap_sim_link_t link = {0, 0, 1000, 2000};
+    coap_sim_init(&sim, &link, 1);
+    coap_sim_attach(&sim, &client_node, client_recv, NULL);
+    coap_client_init(&client, client_send, &client_node);
+    for (unsigned i = 0; i < MEMBERS; ++i) {
+        coap_sim_attach(&sim, &members[i].node, member_recv, &members[i]);
+        coap_group_init(&members[i].group, coap_sim_send, &members[i].node, leisure);
+        members[i].poll_at = COAP_TICK_NEVER;
+    }
+    window = 0;
+    in_window = peak = 0;
+    dropped = collected = distinct = last_ms = 0;
+    done = false;
+    memset(seen, 0, sizeof(seen));
+
+    const coap_resource_t req =
+        {COAP_STATE_RDY, COAP_METHOD_GET, type, NULL, path,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    coap_packet_t pkt;
+    coap_make_request(0, NULL, &req, NULL, 0, &pkt);
+    *rc = coap_client_request_multicast(&client, &group_ep, &pkt,
+                                        leisure + 1000, collect, NULL);
+    client_poll_at = coap_client_poll(&client);
+    coap_sim_timer(&sim, client_poll_at, client_poll, NULL);
+    coap_sim_run(&sim, COAP_TICK_NEVER);
+    coap_sim_free(&sim);
+    return collected;
+}
+
+int main(void)
+{
+    struct sockaddr_in sin;
+    int rc;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(5683);
+    inet_pton(AF_INET, COAP_GROUP_ALL_NODES_IPV4, &sin.sin_addr);
+    memcpy(group_ep.addr, &sin, sizeof(sin));
+    group_ep.len = sizeof(sin);
+
+    // errors are suppressed, confirmable requests to a group are refused
+    check(run(0, &path_nothing, COAP_TYPE_NONCON, &rc) == 0 && !rc && done &&
+          members[0].group.suppressed == 1, "errors suppressed");
+    check(run(0, &path_sensor, COAP_TYPE_CON, &rc) == 0 &&
+          rc == COAP_ERR_TYPE_MISMATCH, "confirmable refused");
+    uint8_t con[] = {0x40, COAP_METHOD_GET, 0, 1};
+    check(!coap_group_accepts(con, sizeof(con)), "confirmable not accepted");
+
+    printf("%u members, gateway forwards %u datagrams per %u ms\n", MEMBERS, BUDGET, WINDOW_MS);
+    printf("%-10s %10s %10s %10s %10s\n", "leisure", "peak", "dropped", "collected", "last");
+    const coap_tick_t leisures[] = {0, 1000, COAP_GROUP_DEFAULT_LEISURE,
+                                    coap_group_leisure(64, MEMBERS, RATE)};
+    for (size_t i = 0; i < sizeof(leisures) / sizeof(leisures[0]); ++i) {
+        run(leisures[i], &path_sensor, COAP_TYPE_NONCON, &rc);
+        printf("%-7llu ms %10u %10llu %10llu %7llu ms\n",
+               (unsigned long long)leisures[i], peak, (unsigned long long)dropped,
+               (unsigned long long)collected, (unsigned long long)last_ms);
+        check(!rc && done && (collected == distinct) &&
+              (collected + dropped == MEMBERS), "all responses accounted for");
+        check(!leisures[i] || (last_ms <= leisures[i] + 10), "within leisure");
+    }
+    return failures ? 1 : 0;
+}
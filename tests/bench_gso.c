@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "coap.h"
+#include "coap_udp.h"
+
+#define BLOCKS      32768   //!< 1024 byte blocks, 32 MB
+#define BLOCK_SIZE  1024
+#define WINDOW      128     //!< blocks in flight
+#define SOCKBUF     (4 * 1024 * 1024)
+
+typedef struct
+{
+    uint64_t blocks;
+    uint64_t bytes;
+    uint64_t bad;
+} counter_t;
+
+static double cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* every datagram must still be a CoAP message after GRO */
+static void handle_block(void *arg, const coap_endpoint_t *from,
+                         const uint8_t *buf, const size_t buflen)
+{
+    (void) from;
+    counter_t *c = arg;
+    coap_packet_t pkt;
+    if (coap_parse(buf, buflen, &pkt) || (pkt.payload.len != BLOCK_SIZE)) {
+        c->bad++;
+        return;
+    }
+    c->blocks++;
+    c->bytes += pkt.payload.len;
+}
+
+/* 2.05 Content with Block2, as sent by a server answering a large GET */
+static size_t make_block(const uint32_t num, uint8_t *buf, size_t buflen)
+{
+    static uint8_t payload[BLOCK_SIZE];
+    uint8_t block2[3];
+    coap_block_t block = {num, true, 6};
+    coap_packet_t pkt;
+    coap_make_response((uint16_t)num, NULL, COAP_TYPE_NONCON, COAP_RSPCODE_CONTENT,
+                       NULL, payload, sizeof(payload), &pkt);
+    coap_add_option(&pkt, COAP_OPTION_BLOCK2, block2,
+                    coap_encode_block_option(&block, block2));
+    if (coap_build(&pkt, buf, &buflen)) {
+        return 0;
+    }
+    return buflen;
+}
+
+static int open_transport(coap_udp_t *u, const coap_udp_backend_t backend,
+                          counter_t *c)
+{
+    struct sockaddr_in addr;
+    int size = SOCKBUF;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (coap_udp_open(u, (struct sockaddr *)&addr, sizeof(addr), backend,
+                      handle_block, c)) {
+        return -1;
+    }
+    setsockopt(u->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(u->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    return 0;
+}
+
+static int run(const coap_udp_backend_t backend, const unsigned offload)
+{
+    coap_udp_t tx, rx;
+    counter_t c = {0, 0, 0};
+    coap_endpoint_t ep;
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    uint8_t buf[COAP_UDP_MAX_PDU];
+    unsigned lost = 0;
+
+    if (open_transport(&rx, backend, &c) || open_transport(&tx, backend, NULL)) {
+        perror("coap_udp_open");
+        return 1;
+    }
+    const unsigned rxoff = coap_udp_offload(&rx, offload);
+    const unsigned txoff = coap_udp_offload(&tx, offload);
+    getsockname(rx.fd, (struct sockaddr *)&addr, &addrlen);
+    ep.len = addrlen;
+    memcpy(ep.addr, &addr, addrlen);
+
+    const double t0 = cpu_ns();
+    for (uint32_t num = 0; num < BLOCKS; num += WINDOW) {
+        const uint64_t expect = c.blocks + c.bad + WINDOW;
+        for (uint32_t i = num; i < num + WINDOW; ++i) {
+            coap_udp_send(&tx, &ep, buf, make_block(i, buf, sizeof(buf)));
+        }
+        coap_udp_run(&tx, 0);
+        // wait for the window, a lost datagram must not stall the benchmark
+        while (c.blocks + c.bad < expect) {
+            const uint64_t before = rx.rx;
+            coap_udp_run(&rx, 100);
+            if (rx.rx == before) {
+                lost += expect - c.blocks - c.bad;
+                break;
+            }
+        }
+    }
+    const double t1 = cpu_ns();
+
+    const double mb = c.bytes / (1024.0 * 1024.0);
+    printf("%-8s %-3s %-3s %8.0f %8.0f %9.2f %5u %4llu\n",
+           (rx.backend == COAP_UDP_URING) ? "io_uring" : "epoll",
+           (txoff & COAP_UDP_GSO) ? "on" : "off",
+           (rxoff & COAP_UDP_GRO) ? "on" : "off",
+           tx.syscalls / mb, rx.syscalls / mb, (t1 - t0) / 1e6 / mb,
+           lost, (unsigned long long)c.bad);
+    coap_udp_close(&tx);
+    coap_udp_close(&rx);
+    return c.bad ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    coap_udp_backend_t backend = COAP_UDP_EPOLL;
+    int rc = 0;
+    if ((argc > 1) && !strcmp(argv[1], "uring")) {
+        backend = COAP_UDP_URING;
+    }
+    printf("%d blocks of %d bytes over loopback, window %d\n", BLOCKS, BLOCK_SIZE, WINDOW);
+    printf("backend  GSO GRO tx sc/MB rx sc/MB cpu ms/MB  lost  bad\n");
+    rc |= run(backend, 0);
+    rc |= run(backend, COAP_UDP_GSO);
+    rc |= run(backend, COAP_UDP_GSO | COAP_UDP_GRO);
+    return rc;
+}
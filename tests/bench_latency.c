@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "coap.h"
+#include "coap_registry.h"
+#include "coap_udp.h"
+#include "coap_workers.h"
+
+#define REQUESTS    20000
+#define WARMUP      1000
+#define MAX_THREADS 4
+#define BUSY_POLL   50      //!< us polled after the last datagram
+
+static const char payload[] = "21.5";
+
+static int handle_get(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt,
+                      coap_packet_t *pkt)
+{
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)payload, sizeof(payload) - 1, pkt);
+}
+
+static const coap_resource_path_t path = {1, {"ping"}};
+static coap_resource_t resources[] =
+{
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get, &path,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL
+    },
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+static coap_registry_t registry;
+
+/* the whole exchange on the worker that received the request */
+static void handle_datagram(void *arg, const coap_endpoint_t *from,
+                            const uint8_t *buf, const size_t buflen)
+{
+    coap_worker_t *w = arg;
+    uint8_t out[128];
+    size_t outlen = sizeof(out);
+    if (!coap_handle_packet(coap_worker_resources(w), buf, buflen, out, &outlen)) {
+        coap_udp_send(&w->udp, from, out, outlen);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct
+{
+    const char *name;
+    unsigned flags;
+} bench_mode_t;
+
+static double rtt[REQUESTS];
+
+static int run(const bench_mode_t *mode, const unsigned threads,
+               const coap_udp_backend_t backend)
+{
+    static coap_workers_t ws;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    coap_workers_params_t params;
+    memset(&params, 0, sizeof(params));
+    params.threads = threads;
+    params.flags = mode->flags;
+    params.busy_poll_us = BUSY_POLL;
+    params.backend = backend;
+    params.registry = &registry;
+    if (coap_workers_start(&ws, &params, (struct sockaddr *)&addr, sizeof(addr),
+                           handle_datagram, NULL)) {
+        perror("coap_workers_start");
+        return 1;
+    }
+
+    // the client shares CPU 0 with the first worker, as loopback receives on
+    // the sending CPU, steering hands its requests to that worker
+    if (mode->flags & COAP_WORKERS_PIN) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    struct sockaddr_storage server;
+    memcpy(&server, ws.worker[0].udp.local.addr, ws.worker[0].udp.local.len);
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    const struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (const struct sockaddr *)&server,
+                (socklen_t)ws.worker[0].udp.local.len) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    static const coap_resource_t request =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    coap_request_template_t tpl;
+    coap_make_request_template(&request, &tpl);
+    unsigned lost = 0, bad = 0, n = 0;
+    for (unsigned i = 0; i < WARMUP + REQUESTS; ++i) {
+        uint8_t req[64], rsp[128];
+        size_t len = sizeof(req);
+        const coap_buffer_t tok = {(const uint8_t *)&i, sizeof(i)};
+        coap_packet_t pkt;
+        coap_build_request(&tpl, (uint16_t)i, &tok, NULL, 0, req, &len);
+        const double t0 = now_ns();
+        send(fd, req, len, 0);
+        const ssize_t got = recv(fd, rsp, sizeof(rsp), 0);
+        const double t1 = now_ns();
+        if (got < 0) {
+            lost++;
+            continue;
+        }
+        if (coap_parse(rsp, (size_t)got, &pkt) || (pkt.hdr.id != (uint16_t)i) ||
+            (pkt.hdr.code != COAP_RSPCODE_CONTENT)) {
+            bad++;
+        }
+        if (i >= WARMUP) {
+            rtt[n++] = t1 - t0;
+        }
+    }
+    close(fd);
+    const unsigned flags = ws.flags;
+    const bool kernel_busy_poll = ws.kernel_busy_poll;
+    uint64_t spins = 0, sleeps = 0;
+    char handled[64] = "";
+    coap_workers_stop(&ws);
+    for (unsigned i = 0; i < threads; ++i) {
+        const size_t used = strlen(handled);
+        snprintf(handled + used, sizeof(handled) - used, "%s%llu", i ? "/" : "",
+                 (unsigned long long)ws.worker[i].udp.rx);
+        spins += ws.worker[i].spins;
+        sleeps += ws.worker[i].sleeps;
+    }
+
+    qsort(rtt, n, sizeof(rtt[0]), compare);
+    double sum = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        sum += rtt[i];
+    }
+    if (!n) {
+        printf("%-10s no responses\n", mode->name);
+        return 1;
+    }
+    printf("%-10s %-4s %-4s %-4s %7.1f %7.1f %7.1f %8.1f %9llu %7llu %4u %4u  %s\n",
+           mode->name,
+           (flags & COAP_WORKERS_PIN) ? "yes" : "no",
+           (flags & COAP_WORKERS_STEER) ? "yes" : "no",
+           (flags & COAP_WORKERS_BUSY_POLL) ? (kernel_busy_poll ? "kern" : "spin") : "no",
+           sum / n / 1e3, rtt[n / 2] / 1e3, rtt[n * 99 / 100] / 1e3,
+           rtt[n * 999 / 1000] / 1e3,
+           (unsigned long long)spins, (unsigned long long)sleeps, lost, bad, handled);
+
+    // let the client run anywhere again
+    cpu_set_t all;
+    CPU_ZERO(&all);
+    for (unsigned i = 0; i < CPU_SETSIZE; ++i) {
+        CPU_SET(i, &all);
+    }
+    sched_setaffinity(0, sizeof(all), &all);
+    return (lost || bad) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const bench_mode_t modes[] =
+    {
+        {"default", 0},
+        {"pinned", COAP_WORKERS_PIN},
+        {"steered", COAP_WORKERS_PIN | COAP_WORKERS_STEER},
+        {"busy-poll", COAP_WORKERS_PIN | COAP_WORKERS_STEER | COAP_WORKERS_BUSY_POLL},
+    };
+    coap_udp_backend_t backend = COAP_UDP_EPOLL;
+    if ((argc > 1) && !strcmp(argv[1], "uring")) {
+        backend = COAP_UDP_URING;
+    }
+    if (coap_registry_init(&registry, resources)) {
+        return 1;
+    }
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const unsigned threads = (cpus < 1) ? 1 : (cpus > MAX_THREADS) ? MAX_THREADS : (unsigned)cpus;
+
+    printf("%d ping-pong GETs over loopback, %u workers on %ld CPUs, busy poll %d us\n",
+           REQUESTS, threads, cpus, BUSY_POLL);
+    printf("mode       pin  steer busy mean us  p50 us  p99 us p99.9 us     spins  sleeps lost  bad  handled\n");
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        rc |= run(&modes[i], threads, backend);
+    }
+    coap_registry_free(&registry);
+    return rc;
+}
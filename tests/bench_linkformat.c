@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+
+#define MAX_RESOURCES   1024
+#define ITERATIONS      200     //!< per table size
+#define DATAGRAM        1100    //!< size of response buffers
+
+static coap_resource_path_t paths[MAX_RESOURCES];
+static char names[MAX_RESOURCES][8];
+static coap_resource_t resources[MAX_RESOURCES + 2];
+static const coap_resource_path_t path_core = {2, {".well-known", "core"}};
+static const coap_link_attrs_t link_temp = {"temperature", "core.s", 0, true};
+static const coap_link_attrs_t link_light = {"light", "core.a", 16, false};
+static int failures;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(const bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static int handle_get(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt,
+                      coap_packet_t *pkt)
+{
+    (void)resource;
+    return coap_make_ack(inpkt, pkt);
+}
+
+/* resource structs have const members, they are copied as bytes */
+static void set(const size_t i, const coap_resource_t *resource)
+{
+    memcpy(&resources[i], resource, sizeof(coap_resource_t));
+}
+
+/* /.well-known/core, then /s/0 ... /s/n-1, even ones are temperatures */
+static void make_table(const size_t n, const bool attrs)
+{
+    const coap_resource_t core =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK, handle_get, &path_core,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_LINKFORMAT), NULL, NULL,
+         COAP_RESOURCE_LINK_FORMAT, NULL};
+    set(0, &core);
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(names[i], sizeof(names[i]), "%u", (unsigned)i);
+        paths[i].count = 2;
+        paths[i].items[0] = "s";
+        paths[i].items[1] = names[i];
+        const coap_resource_t rs =
+            {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK, handle_get, &paths[i],
+             COAP_SET_CONTENTTYPE((i % 2) ? COAP_CONTENTTYPE_APP_JSON : COAP_CONTENTTYPE_TXT_PLAIN),
+             NULL, NULL, 0, attrs ? ((i % 2) ? &link_light : &link_temp) : NULL};
+        set(i + 1, &rs);
+    }
+    memset(&resources[n + 1], 0, sizeof(coap_resource_t));
+}
+
+/* coap_make_link_format() as it was, rescanning buf for each piece */
+static int legacy_link_format(const coap_resource_t *resources,
+                              char *buf, size_t buflen)
+{
+    if (buflen < 4) { // <>;
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    memset(buf,0,buflen);
+    int len = buflen - 1;
+    for (const coap_resource_t *rs = resources; rs->handler; ++rs) {
+        if (0 > len)
+            return COAP_ERR_BUFFER_TOO_SMALL;
+        if (!rs->formats &&
+            (COAP_CONTENTTYPE_NONE == COAP_GET_CONTENTTYPE(rs->content_type)))
+            continue;
+        if (0 < strlen(buf)) {
+            strncat(buf, ",", len);
+            len--;
+        }
+        strncat(buf, "<", len);
+        len--;
+        for (int i = 0; i < rs->path->count; i++) {
+            strncat(buf, "/", len);
+            len--;
+            strncat(buf, rs->path->items[i], len);
+            len -= strlen(rs->path->items[i]);
+        }
+        strncat(buf, ">;", len);
+        len -= 2;
+        len -= sprintf(buf + (buflen - len - 1), "ct=%d",
+                       COAP_GET_CONTENTTYPE(rs->content_type));
+    }
+    return COAP_SUCCESS;
+}
+
+/* GET /.well-known/core?query, block < 0 for none; returns the response code */
+static uint8_t request(const char *query, const int block, const int szx,
+                       size_t outlen, char *out, coap_block_t *rspblock)
+{
+    static const coap_resource_t req =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_core,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    static const uint8_t tok[] = {0xab, 0xcd};
+    const coap_buffer_t token = {tok, sizeof(tok)};
+    uint8_t in[128], outbuf[DATAGRAM], value[4];
+    char q[64];
+    size_t inlen = sizeof(in);
+    coap_packet_t pkt, rsp;
+    coap_make_request(0x1234, &token, &req, NULL, 0, &pkt);
+    strcpy(q, query);
+    for (char *param = strtok(q, "&"); param; param = strtok(NULL, "&")) {
+        coap_add_option(&pkt, COAP_OPTION_URI_QUERY, (const uint8_t *)param, strlen(param));
+    }
+    if (block >= 0) {
+        const coap_block_t b = {(uint32_t)block, false, (uint8_t)szx};
+        coap_add_option(&pkt, COAP_OPTION_BLOCK2, value, coap_encode_block_option(&b, value));
+    }
+    if (coap_build(&pkt, in, &inlen) ||
+        coap_handle_packet(resources, in, inlen, outbuf, &outlen) ||
+        coap_parse(outbuf, outlen, &rsp)) {
+        return 0;
+    }
+    if ((rsp.hdr.id != 0x1234) || (rsp.tok.len != 2) || memcmp(rsp.tok.p, tok, 2)) {
+        return 0;
+    }
+    if (out && rsp.payload.len) {
+        strncat(out, (const char *)rsp.payload.p, rsp.payload.len);
+    }
+    rspblock->num = 0;
+    rspblock->more = false;
+    rspblock->szx = 0xff;
+    coap_get_block_option(&rsp, COAP_OPTION_BLOCK2, rspblock);
+    return rsp.hdr.code;
+}
+
+/* all blocks, as a client would follow them */
+static bool fetch(const char *query, char *out)
+{
+    coap_block_t b = {0, true, COAP_BLOCK_MAX_SZX};
+    int num = -1;
+    out[0] = '\0';
+    do {
+        if (request(query, num, b.szx, DATAGRAM, out, &b) != COAP_RSPCODE_CONTENT) {
+            return false;
+        }
+        num = b.num + 1;
+    } while (b.more);
+    return true;
+}
+
+static void test(void)
+{
+    static char expected[65536], out[65536];
+    coap_link_filter_t none = {{NULL, 0}, {NULL, 0}, {NULL, 0}, -1};
+    coap_block_t b;
+    size_t len;
+    bool more;
+
+    make_table(4, false);
+    legacy_link_format(resources, expected, sizeof(expected));
+    coap_make_link_format(resources, out, sizeof(out));
+    check(!strcmp(expected, out), "same as before");
+    check(coap_make_link_format(resources, out, 20) == COAP_ERR_BUFFER_TOO_SMALL &&
+          strlen(out) == 19, "truncated");
+
+    make_table(200, true);
+    check(!coap_make_link_format(resources, expected, sizeof(expected)), "rendered");
+    check(!strncmp(expected, "</.well-known/core>;ct=40,</s/0>;ct=0;rt=\"temperature\";"
+                   "if=\"core.s\";obs,</s/1>;ct=50;rt=\"light\";if=\"core.a\";sz=16,", 106),
+          "attributes");
+    len = 100;
+    check(!coap_make_link_format_block(resources, NULL, 1000, (uint8_t *)out, &len, &more) &&
+          len == 100 && more && !memcmp(out, expected + 1000, 100), "part");
+    len = 100;
+    check(coap_make_link_format_block(resources, &none, strlen(expected), (uint8_t *)out,
+                                      &len, &more) == COAP_ERR_OPTION_NOT_FOUND, "past the end");
+
+    // without Block2 the first block is sent, as large as fits
+    out[0] = '\0';
+    check(request("", -1, 0, DATAGRAM, out, &b) == COAP_RSPCODE_CONTENT &&
+          b.num == 0 && b.more && b.szx == COAP_BLOCK_MAX_SZX &&
+          !strncmp(out, expected, 1024), "first block");
+    out[0] = '\0';
+    check(request("", -1, 0, 600, out, &b) == COAP_RSPCODE_CONTENT &&
+          b.szx == 5 && strlen(out) == 512, "smaller datagram");
+    check(fetch("", out) && !strcmp(out, expected), "all blocks");
+    out[0] = '\0';
+    check(request("", 3, 6, 300, out, &b) == COAP_RSPCODE_CONTENT &&
+          b.num == 12 && b.szx == 4 && !strncmp(out, expected + 3072, 256), "block reduced");
+    check(request("", 99, 6, DATAGRAM, NULL, &b) == COAP_RSPCODE_BAD_OPTION, "out of range");
+
+    // filters
+    check(fetch("rt=light", out) && !strncmp(out, "</s/1>;", 7) &&
+          !strstr(out, "temperature") && strstr(out, "</s/199>;"), "by rt");
+    check(fetch("rt=temp*", out) && !strncmp(out, "</s/0>;", 7) &&
+          !strstr(out, "light"), "by rt prefix");
+    check(fetch("href=/s/1*", out) &&
+          !strcmp(strrchr(out, '<'), "</s/199>;ct=50;rt=\"light\";if=\"core.a\";sz=16") &&
+          !strstr(out, "</s/2>"), "by href prefix");
+    check(fetch("href=/s/12", out) &&
+          !strcmp(out, "</s/12>;ct=0;rt=\"temperature\";if=\"core.s\";obs"), "by href");
+    check(fetch("ct=40", out) && !strcmp(out, "</.well-known/core>;ct=40"), "by ct");
+    check(fetch("rt=light&if=core.s", out) && !out[0], "disjoint");
+    check(fetch("rt=light&href=/s/7", out) &&
+          !strcmp(out, "</s/7>;ct=50;rt=\"light\";if=\"core.a\";sz=16"), "combined");
+    check(request("title=x", -1, 0, DATAGRAM, NULL, &b) == COAP_RSPCODE_BAD_REQUEST, "unsupported");
+    check(request("ct=x", -1, 0, DATAGRAM, NULL, &b) == COAP_RSPCODE_BAD_REQUEST, "bad ct");
+}
+
+int main(void)
+{
+    static char buf[65536];
+    test();
+
+    // legacy rescans the buffer per piece, the writer appends once
+    printf("%-10s %16s %16s %16s\n", "resources", "legacy", "writer", "1st block");
+    for (size_t n = 16; n <= MAX_RESOURCES; n *= 4) {
+        uint8_t block[1024];
+        make_table(n, false);
+        double t0 = now_ns();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            legacy_link_format(resources, buf, sizeof(buf));
+        }
+        const double legacy = (now_ns() - t0) / ITERATIONS;
+        t0 = now_ns();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            coap_make_link_format(resources, buf, sizeof(buf));
+        }
+        const double writer = (now_ns() - t0) / ITERATIONS;
+        t0 = now_ns();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            size_t len = sizeof(block);
+            bool more;
+            coap_make_link_format_block(resources, NULL, 0, block, &len, &more);
+        }
+        const double first = (now_ns() - t0) / ITERATIONS;
+        printf("%-10u %13.0f ns %13.0f ns %13.0f ns\n", (unsigned)n, legacy, writer, first);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_crypto.h"
+#include "coap_oscore.h"
+
+#define ITERATIONS  200000
+#define DATAGRAM    1152
+#define REQUESTS    20000   //!< protected, each with a new sequence number
+
+static const coap_resource_path_t path_hello = {1, {"hello"}};
+static const coap_resource_path_t path_secret = {1, {"secret"}};
+static int failures;
+static uint64_t stored;     //!< sequence number persisted last, by any context
+static unsigned stores;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(const bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static size_t unhex(const char *hex, uint8_t *buf)
+{
+    const size_t len = strlen(hex) / 2;
+    for (size_t i = 0; i < len; ++i) {
+        sscanf(hex + 2 * i, "%2hhx", &buf[i]);
+    }
+    return len;
+}
+
+static bool equal(const uint8_t *buf, const size_t len, const char *hex)
+{
+    uint8_t expected[256];
+    return (len == unhex(hex, expected)) && !memcmp(buf, expected, len);
+}
+
+static int handle_get_hello(const coap_resource_t *resource,
+                            const coap_packet_t *inpkt,
+                            coap_packet_t *pkt)
+{
+    static const uint8_t hello[] = "Hello World!";
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              hello, sizeof(hello) - 1, pkt);
+}
+
+static coap_resource_t resources[] =
+{
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_hello, &path_hello,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL},
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_hello, &path_secret,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, COAP_RESOURCE_OSCORE, NULL},
+    {(coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL}
+};
+
+static int store_seq(void *ctx, const uint64_t seq)
+{
+    (void)ctx;
+    stored = seq;
+    stores++;
+    return COAP_SUCCESS;
+}
+
+/* security contexts of https://tools.ietf.org/html/rfc8613#appendix-C.1 */
+static void make_contexts(coap_oscore_t *client, coap_oscore_t *server)
+{
+    static uint8_t secret[16], salt[8], id[1] = {0x01};
+    coap_oscore_params_t params;
+    unhex("0102030405060708090a0b0c0d0e0f10", secret);
+    unhex("9e7ca92223786340", salt);
+    memset(&params, 0, sizeof(params));
+    params.secret.p = secret;
+    params.secret.len = sizeof(secret);
+    params.salt.p = salt;
+    params.salt.len = sizeof(salt);
+    params.recipient_id.p = id;
+    params.recipient_id.len = sizeof(id);
+    check(coap_oscore_init(client, &params) == COAP_ERR_UNSUPPORTED, "not persisted");
+    params.store = store_seq;
+    check(!coap_oscore_init(client, &params), "client context");
+    params.sender_id = params.recipient_id;
+    params.recipient_id.len = 0;
+    check(!coap_oscore_init(server, &params), "server context");
+}
+
+static void test_crypto(void)
+{
+    uint8_t key[16], in[64], out[64], nonce[13], aad[8];
+    coap_aes_t aes;
+    // FIPS-197 appendix C.1, RFC 3610 packet vector #1
+    unhex("000102030405060708090a0b0c0d0e0f", key);
+    unhex("00112233445566778899aabbccddeeff", in);
+    coap_aes_init(&aes, key);
+    coap_aes_encrypt(&aes, in, out);
+    check(equal(out, 16, "69c4e0d86a7b0430d8cdb78070b4c55a"), "aes");
+    unhex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf", key);
+    unhex("00000003020100a0a1a2a3a4a5", nonce);
+    const size_t aadlen = unhex("0001020304050607", aad);
+    const size_t len = unhex("08090a0b0c0d0e0f101112131415161718191a1b1c1d1e", in);
+    coap_aes_init(&aes, key);
+    check(!coap_aes_ccm_encrypt(&aes, nonce, aad, aadlen, in, len, out) &&
+          equal(out, len + COAP_CCM_TAG_SIZE,
+                "588c979a61c663d2f066d0c2c0f989806d5f6b61dac38417e8d12cfdf926e0"), "ccm");
+    check(!coap_aes_ccm_decrypt(&aes, nonce, aad, aadlen, out, len + COAP_CCM_TAG_SIZE, out) &&
+          !memcmp(out, in, len), "ccm decrypt");
+    coap_aes_ccm_encrypt(&aes, nonce, aad, aadlen, in, len, out);
+    out[len] ^= 1;
+    check(coap_aes_ccm_decrypt(&aes, nonce, aad, aadlen, out, len + COAP_CCM_TAG_SIZE, out) ==
+          COAP_ERR_DECRYPT, "ccm forged");
+    // RFC 6234, RFC 5869 test case 1
+    coap_sha256((const uint8_t *)"abc", 3, out);
+    check(equal(out, 32, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), "sha256");
+    uint8_t ikm[22], salt[13], info[10];
+    memset(ikm, 0x0b, sizeof(ikm));
+    unhex("000102030405060708090a0b0c", salt);
+    unhex("f0f1f2f3f4f5f6f7f8f9", info);
+    coap_hkdf_sha256(salt, sizeof(salt), ikm, sizeof(ikm), info, sizeof(info), out, 42);
+    check(equal(out, 42, "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf"
+                         "34007208d5b887185865"), "hkdf");
+}
+
+/* https://tools.ietf.org/html/rfc8613#appendix-C.4 and C.7 */
+static void test_oscore(void)
+{
+    coap_oscore_t client, server;
+    coap_oscore_request_t creq, sreq;
+    coap_packet_t pkt;
+    uint8_t in[DATAGRAM], out[DATAGRAM], plain[DATAGRAM];
+    size_t len, outlen = sizeof(out), plainlen = sizeof(plain);
+    make_contexts(&client, &server);
+    uint8_t iv[13];
+    unhex("4622d4dd6d944168eefb54987c", iv);
+    check(!memcmp(client.common_iv, iv, sizeof(iv)), "common iv");
+    // replay window as if established by an Echo challenge
+    server.replay_valid = true;
+
+    len = unhex("44015d1f00003974396c6f63616c686f737483747631", in);
+    client.seq = 20;
+    check(!coap_parse(in, len, &pkt) && !coap_oscore_protect(&client, &pkt, &creq, out, &outlen) &&
+          equal(out, outlen, "44025d1f00003974396c6f63616c686f7374620914ff612f1092f1776f1c1668b3825e") &&
+          client.seq == 21, "protect request");
+    check(!coap_parse(out, outlen, &pkt) && !coap_oscore_unprotect(&server, &pkt, &sreq, plain, &plainlen) &&
+          equal(plain, plainlen, "44015d1f00003974b3747631"), "unprotect request");
+    plainlen = sizeof(plain);
+    check(coap_oscore_unprotect(&server, &pkt, &sreq, plain, &plainlen) == COAP_ERR_REPLAY, "replay");
+
+    len = unhex("64455d1f00003974ff48656c6c6f20576f726c6421", in);
+    outlen = sizeof(out);
+    check(!coap_parse(in, len, &pkt) && !coap_oscore_protect(&server, &pkt, &sreq, out, &outlen) &&
+          equal(out, outlen, "64445d1f0000397490ffdbaad1e9a7e7b2a813d3c31524378303cdafae119106"),
+          "protect response");
+    plainlen = sizeof(plain);
+    check(!coap_parse(out, outlen, &pkt) && !coap_oscore_unprotect(&client, &pkt, &creq, plain, &plainlen) &&
+          !memcmp(plain, in, len) && plainlen == len, "unprotect response");
+    out[outlen - 1] ^= 1;
+    plainlen = sizeof(plain);
+    check(!coap_parse(out, outlen, &pkt) &&
+          coap_oscore_unprotect(&client, &pkt, &creq, plain, &plainlen) == COAP_ERR_DECRYPT, "forged");
+}
+
+/* GET of path, protected by client or not, with Echo value if given */
+static size_t make_get(coap_oscore_t *client, coap_oscore_request_t *req,
+                       const uint16_t id, const coap_resource_path_t *path,
+                       const coap_buffer_t *echo, uint8_t *buf)
+{
+    const coap_resource_t get =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, path,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    static const uint8_t tok[] = {0x12, 0x34};
+    const coap_buffer_t token = {tok, sizeof(tok)};
+    coap_packet_t pkt;
+    size_t len = DATAGRAM;
+    coap_make_request(id, &token, &get, NULL, 0, &pkt);
+    if (echo) {
+        coap_add_option(&pkt, COAP_OPTION_ECHO, echo->p, echo->len);
+    }
+    if (client) {
+        coap_oscore_protect(client, &pkt, req, buf, &len);
+    }
+    else {
+        coap_build(&pkt, buf, &len);
+    }
+    return len;
+}
+
+/* GET /hello */
+static size_t make_request(coap_oscore_t *client, coap_oscore_request_t *req,
+                           const uint16_t id, uint8_t *buf)
+{
+    return make_get(client, req, id, &path_hello, NULL, buf);
+}
+
+static uint8_t response_code(const uint8_t *buf, const size_t len)
+{
+    coap_packet_t pkt;
+    return coap_parse(buf, len, &pkt) ? 0 : pkt.hdr.code;
+}
+
+/* inner code of a protected response, its Echo value is copied to echo */
+static uint8_t inner_code(coap_oscore_t *client, coap_oscore_request_t *req,
+                          const uint8_t *buf, const size_t len, uint8_t *echo)
+{
+    uint8_t plain[DATAGRAM];
+    size_t plainlen = sizeof(plain);
+    coap_packet_t pkt;
+    if (coap_parse(buf, len, &pkt) ||
+        coap_oscore_unprotect(client, &pkt, req, plain, &plainlen) ||
+        coap_parse(plain, plainlen, &pkt)) {
+        return 0;
+    }
+    const coap_option_t *opt = coap_find_option(&pkt, COAP_OPTION_ECHO);
+    if (echo && opt && (opt->buf.len == COAP_OSCORE_ECHO_SIZE)) {
+        memcpy(echo, opt->buf.p, COAP_OSCORE_ECHO_SIZE);
+    }
+    return pkt.hdr.code;
+}
+
+/* partial IV in the OSCORE option of a protected message, its length or 0 */
+static size_t partial_iv(const uint8_t *buf, const size_t len, uint8_t *piv)
+{
+    coap_packet_t pkt;
+    const coap_option_t *opt;
+    if (coap_parse(buf, len, &pkt) || !(opt = coap_find_option(&pkt, COAP_OPTION_OSCORE)) ||
+        !opt->buf.len || ((size_t)(opt->buf.p[0] & 0x07) >= opt->buf.len)) {
+        return 0;
+    }
+    memcpy(piv, opt->buf.p + 1, opt->buf.p[0] & 0x07);
+    return opt->buf.p[0] & 0x07;
+}
+
+/* answer the Echo challenge of servers without replay window */
+static bool establish(coap_oscore_t *client, coap_oscore_t *servers, const size_t count)
+{
+    uint8_t in[DATAGRAM], out[DATAGRAM], echo[COAP_OSCORE_ECHO_SIZE] = {0};
+    const coap_buffer_t value = {echo, sizeof(echo)};
+    coap_oscore_request_t req;
+    size_t outlen = sizeof(out);
+    size_t len = make_request(client, &req, 1, in);
+    if (coap_oscore_handle_packet(servers, count, resources, in, len, out, &outlen) ||
+        (inner_code(client, &req, out, outlen, echo) != COAP_RSPCODE_UNAUTHORIZED)) {
+        return false;
+    }
+    len = make_get(client, &req, 2, &path_hello, &value, in);
+    outlen = sizeof(out);
+    return !coap_oscore_handle_packet(servers, count, resources, in, len, out, &outlen) &&
+           (inner_code(client, &req, out, outlen, NULL) == COAP_RSPCODE_CONTENT);
+}
+
+/* https://tools.ietf.org/html/rfc8613#appendix-B.1 */
+static void test_restart(void)
+{
+    coap_oscore_t client, server;
+    coap_oscore_request_t req, first;
+    uint8_t in[DATAGRAM], out[DATAGRAM], echo[COAP_OSCORE_ECHO_SIZE] = {0};
+    const coap_buffer_t value = {echo, sizeof(echo)};
+    size_t outlen = sizeof(out);
+    // stored once per window, ahead of the numbers used
+    stores = 0;
+    make_contexts(&client, &server);
+    for (unsigned i = 0; i <= COAP_OSCORE_SSN_WINDOW; ++i) {
+        make_request(&client, &req, 1, in);
+    }
+    check(stores == 2 && stored == 2 * COAP_OSCORE_SSN_WINDOW &&
+          client.seq == COAP_OSCORE_SSN_WINDOW + 1, "stored ahead");
+    // after a restart, both continue beyond anything used before
+    coap_oscore_params_t params;
+    static uint8_t secret[16], id[1] = {0x01};
+    memset(&params, 0, sizeof(params));
+    params.secret.p = secret;
+    params.secret.len = sizeof(secret);
+    params.sender_id.p = id;
+    params.sender_id.len = sizeof(id);
+    params.seq = stored;
+    params.store = store_seq;
+    check(!coap_oscore_init(&client, &params) && client.seq == 2 * COAP_OSCORE_SSN_WINDOW,
+          "restarted");
+
+    // a server without replay window challenges authentic requests
+    make_contexts(&client, &server);
+    size_t len = make_request(&client, &first, 1, in);
+    check(!coap_oscore_handle_packet(&server, 1, resources, in, len, out, &outlen) &&
+          inner_code(&client, &first, out, outlen, echo) == COAP_RSPCODE_UNAUTHORIZED &&
+          !server.replay_valid && server.echo_valid, "challenged");
+    uint8_t replay[DATAGRAM];
+    memcpy(replay, in, len);
+    const size_t replaylen = len;
+    // a replay gets the same Echo, under a nonce of the server's own
+    uint8_t piv[COAP_OSCORE_MAX_PIV], piv2[COAP_OSCORE_MAX_PIV];
+    uint8_t echo2[COAP_OSCORE_ECHO_SIZE] = {0};
+    const size_t pivlen = partial_iv(out, outlen, piv);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(&server, 1, resources, replay, replaylen, out, &outlen) &&
+          inner_code(&client, &first, out, outlen, echo2) == COAP_RSPCODE_UNAUTHORIZED &&
+          !memcmp(echo, echo2, sizeof(echo)), "replayed before window, same Echo");
+    const size_t piv2len = partial_iv(out, outlen, piv2);
+    check(pivlen && piv2len && ((pivlen != piv2len) || memcmp(piv, piv2, pivlen)),
+          "challenges with own partial IVs");
+    len = make_get(&client, &req, 2, &path_hello, &value, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(&server, 1, resources, in, len, out, &outlen) &&
+          inner_code(&client, &req, out, outlen, NULL) == COAP_RSPCODE_CONTENT &&
+          server.replay_valid && !server.echo_valid, "echoed");
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(&server, 1, resources, replay, replaylen, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_UNAUTHORIZED, "challenged request replayed");
+    len = make_request(&client, &req, 3, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(&server, 1, resources, in, len, out, &outlen) &&
+          inner_code(&client, &req, out, outlen, NULL) == COAP_RSPCODE_CONTENT, "established");
+}
+
+static void test_server(void)
+{
+    coap_oscore_t client, server[2], other, stranger;
+    coap_oscore_request_t req;
+    coap_packet_t pkt;
+    uint8_t in[DATAGRAM], out[DATAGRAM], plain[DATAGRAM];
+    size_t outlen = sizeof(out), plainlen = sizeof(plain);
+    make_contexts(&client, &server[1]);
+    make_contexts(&other, &server[0]);
+    // another client, another ID
+    server[0].recipient_id[0] = 0x02;
+    server[0].recipient_id_len = 1;
+    check(establish(&client, server, 2), "established");
+    size_t len = make_request(&client, &req, 1, in);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_CHANGED, "protected");
+    check(!coap_parse(out, outlen, &pkt) && !coap_oscore_unprotect(&client, &pkt, &req, plain, &plainlen) &&
+          !coap_parse(plain, plainlen, &pkt) && pkt.hdr.code == COAP_RSPCODE_CONTENT &&
+          pkt.payload.len == 12 && !memcmp(pkt.payload.p, "Hello World!", 12), "response");
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_UNAUTHORIZED, "replayed");
+    len = make_request(&client, &req, 2, in);
+    in[len - 1] ^= 1;
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_BAD_REQUEST, "forged");
+    make_contexts(&stranger, &other);
+    stranger.sender_id[0] = 0x03;
+    stranger.sender_id_len = 1;
+    len = make_request(&stranger, &req, 3, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_UNAUTHORIZED, "unknown kid");
+    len = make_request(NULL, NULL, 4, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_CONTENT, "unprotected");
+    len = make_get(NULL, NULL, 8, &path_secret, NULL, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_UNAUTHORIZED, "unprotected, OSCORE only");
+    len = make_get(&client, &req, 9, &path_secret, NULL, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_CHANGED, "protected, OSCORE only");
+    // replay window: late but new is fine, too late is not
+    client.seq = 100;
+    len = make_request(&client, &req, 5, in);
+    outlen = sizeof(out);
+    coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen);
+    client.seq = 100 - COAP_OSCORE_REPLAY_WINDOW + 1;
+    len = make_request(&client, &req, 6, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_CHANGED, "in window");
+    client.seq = 100 - COAP_OSCORE_REPLAY_WINDOW;
+    len = make_request(&client, &req, 7, in);
+    outlen = sizeof(out);
+    check(!coap_oscore_handle_packet(server, 2, resources, in, len, out, &outlen) &&
+          response_code(out, outlen) == COAP_RSPCODE_UNAUTHORIZED, "behind window");
+}
+
+/* ns per message of the crypto alone, and of handling a GET plain vs protected */
+static void bench(void)
+{
+    static uint8_t plain[DATAGRAM], sealed[DATAGRAM], in[DATAGRAM], out[DATAGRAM];
+    static uint8_t requests[REQUESTS][64];
+    static size_t lengths[REQUESTS];
+    uint8_t key[16] = {0}, nonce[13] = {0}, aad[20] = {0};
+    coap_oscore_t client, server;
+    coap_oscore_request_t req;
+    coap_aes_t aes;
+    double t0;
+    coap_aes_init(&aes, key);
+
+    const size_t len = make_request(NULL, NULL, 1, in);
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size_t outlen = sizeof(out);
+        coap_handle_packet(resources, in, len, out, &outlen);
+    }
+    const double dispatch = (now_ns() - t0) / ITERATIONS;
+    printf("GET /hello, parse, dispatch and build: %6.0f ns\n\n", dispatch);
+
+    printf("%-8s %8s %12s %12s\n", "aes", "bytes", "seal", "open");
+    const bool accelerated = coap_crypto_accelerated();
+    for (int accel = accelerated; accel >= 0; --accel) {
+        coap_crypto_set_accelerated(accel);
+        for (size_t n = 16; n <= 1024; n *= 8) {
+            t0 = now_ns();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                nonce[12] = (uint8_t)i;
+                coap_aes_ccm_encrypt(&aes, nonce, aad, sizeof(aad), plain, n, sealed);
+            }
+            const double seal = (now_ns() - t0) / ITERATIONS;
+            nonce[12] = 0;
+            coap_aes_ccm_encrypt(&aes, nonce, aad, sizeof(aad), plain, n, sealed);
+            t0 = now_ns();
+            for (int i = 0; i < ITERATIONS; ++i) {
+                coap_aes_ccm_decrypt(&aes, nonce, aad, sizeof(aad), sealed,
+                                     n + COAP_CCM_TAG_SIZE, plain);
+            }
+            const double open = (now_ns() - t0) / ITERATIONS;
+            printf("%-8s %8u %9.0f ns %9.0f ns\n", accel ? "AES-NI" : "portable",
+                   (unsigned)n, seal, open);
+        }
+    }
+
+    // server side: unprotect, dispatch, protect the response
+    printf("\n%-8s %20s\n", "aes", "protected GET /hello");
+    for (int accel = accelerated; accel >= 0; --accel) {
+        coap_crypto_set_accelerated(accel);
+        make_contexts(&client, &server);
+        establish(&client, &server, 1);
+        for (int i = 0; i < REQUESTS; ++i) {
+            lengths[i] = make_request(&client, &req, (uint16_t)i, requests[i]);
+        }
+        t0 = now_ns();
+        for (int i = 0; i < REQUESTS; ++i) {
+            size_t outlen = sizeof(out);
+            coap_oscore_handle_packet(&server, 1, resources, requests[i], lengths[i],
+                                      out, &outlen);
+        }
+        const double oscore = (now_ns() - t0) / REQUESTS;
+        printf("%-8s %17.0f ns\n", accel ? "AES-NI" : "portable", oscore);
+    }
+    coap_crypto_set_accelerated(accelerated);
+}
+
+int main(void)
+{
+    const bool accelerated = coap_crypto_accelerated();
+    for (int accel = accelerated; accel >= 0; --accel) {
+        coap_crypto_set_accelerated(accel);
+        test_crypto();
+        test_oscore();
+        test_server();
+        test_restart();
+    }
+    coap_crypto_set_accelerated(accelerated);
+    bench();
+    return failures ? 1 : 0;
+}
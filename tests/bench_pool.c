@@ -0,0 +1,312 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_pool.h"
+
+#define OWNERS      2
+#define REQUESTS    20000   //!< per owner
+#define BLOCKING    100     //!< every n-th request is for /slow
+#define SLOW_US     100     //!< time the slow handler blocks
+#define FAILING     1000    //!< every n-th request is for /fail, blocking too
+
+/* a receive thread, without socket */
+typedef struct
+{
+    pthread_t thread;
+    coap_pool_t *pool;
+    coap_pool_owner_t owner;
+    coap_endpoint_t ep;
+    uint64_t inline_rsp, acks, separate, failed, bad;
+    unsigned nunacked;                  //!< separate responses to acknowledge
+    uint16_t unacked[64];               //!< their message IDs
+    double received;                    //!< until all requests were handled
+    double elapsed;                     //!< until all responses were sent
+} owner_t;
+
+static const coap_resource_path_t path_fast = {1, {"fast"}};
+static const coap_resource_path_t path_slow = {1, {"slow"}};
+static unsigned slow_runs;              //!< calls of the slow handler
+
+static int handle_get_fast(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)"fast", 4, pkt);
+}
+
+/* stands in for disk or database access */
+static int handle_get_slow(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    const struct timespec ts = {0, SLOW_US * 1000};
+    __atomic_add_fetch(&slow_runs, 1, __ATOMIC_RELAXED);
+    nanosleep(&ts, NULL);
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)"slow", 4, pkt);
+}
+
+/* fails without a response, the pool answers 5.00 */
+static int handle_get_fail(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    (void)resource;
+    (void)inpkt;
+    (void)pkt;
+    return COAP_ERR_UNSUPPORTED;
+}
+
+static const coap_resource_path_t path_fail = {1, {"fail"}};
+static coap_resource_t resources[] =
+{
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_fast, &path_fast,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_slow, &path_slow,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL,
+        COAP_RESOURCE_BLOCKING, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_fail, &path_fail,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL,
+        COAP_RESOURCE_BLOCKING, NULL
+    },
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+static coap_request_template_t tpl_fast, tpl_slow, tpl_fail;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* separate responses, called on the owner thread */
+static int send_separate(void *ctx, const coap_endpoint_t *ep,
+                         const uint8_t *buf, const size_t buflen)
+{
+    owner_t *o = ctx;
+    coap_packet_t pkt;
+    (void)ep;
+    if (coap_parse(buf, buflen, &pkt) || (pkt.hdr.t != COAP_TYPE_CON) ||
+        (o->nunacked == sizeof(o->unacked) / sizeof(o->unacked[0]))) {
+        o->bad++;
+        return COAP_SUCCESS;
+    }
+    o->unacked[o->nunacked++] = pkt.hdr.id;
+    if (pkt.hdr.code == COAP_RSPCODE_INTERNAL_SERVER_ERROR) {
+        o->failed++;
+    }
+    else if ((pkt.payload.len != 4) || memcmp(pkt.payload.p, "slow", 4)) {
+        o->bad++;
+    }
+    else {
+        o->separate++;
+    }
+    return COAP_SUCCESS;
+}
+
+/* the client acknowledging the separate responses */
+static void acknowledge(owner_t *o)
+{
+    for (unsigned i = 0; i < o->nunacked; ++i) {
+        uint8_t ack[4] = {(COAP_VERSION << 6) | (COAP_TYPE_ACK << 4), COAP_RSPCODE_EMPTY,
+                          (uint8_t)(o->unacked[i] >> 8), (uint8_t)o->unacked[i]};
+        uint8_t out[16];
+        size_t outlen = sizeof(out);
+        if (coap_pool_handle_packet(&o->owner, resources, &o->ep, ack, sizeof(ack),
+                                    out, &outlen) != COAP_STATE_RSP_WAIT) {
+            o->bad++;
+        }
+    }
+    o->nunacked = 0;
+}
+
+static void *run_owner(void *arg)
+{
+    owner_t *o = arg;
+    uint8_t in[128], out[256];
+    uint8_t token[4];
+    const coap_buffer_t tok = {token, sizeof(token)};
+    const double t0 = now_ns();
+    for (unsigned i = 0; i < REQUESTS; ++i) {
+        const bool slow = !(i % BLOCKING);
+        const bool fail = !(i % FAILING);
+        size_t inlen = sizeof(in), outlen = sizeof(out);
+        memcpy(token, &i, sizeof(token));
+        coap_build_request(fail ? &tpl_fail : slow ? &tpl_slow : &tpl_fast,
+                           (uint16_t)i, &tok, NULL, 0, in, &inlen);
+        int rc = o->pool ?
+                 coap_pool_handle_packet(&o->owner, resources, &o->ep, in, inlen, out, &outlen) :
+                 coap_handle_packet(resources, in, inlen, out, &outlen);
+        if (rc) {
+            // inline, a failing handler leaves nothing to send
+            if (fail && !o->pool) {
+                o->failed++;
+            }
+            else {
+                o->bad++;
+            }
+        }
+        else if (out[1] == COAP_RSPCODE_EMPTY) {
+            o->acks++;
+        }
+        else {
+            o->inline_rsp++;
+        }
+        if (o->pool && o->owner.pending) {
+            coap_pool_complete(&o->owner);
+            acknowledge(o);
+        }
+    }
+    o->received = now_ns() - t0;
+    while (o->pool && o->owner.pending) {
+        coap_pool_complete(&o->owner);
+        acknowledge(o);
+        sched_yield();
+    }
+    // all acknowledged, nothing left to retransmit
+    if (o->pool && (coap_pool_poll(&o->owner) != COAP_TICK_NEVER)) {
+        o->bad++;
+    }
+    o->elapsed = now_ns() - t0;
+    return NULL;
+}
+
+static int run(const unsigned workers)
+{
+    coap_pool_t pool;
+    owner_t owners[OWNERS];
+    memset(owners, 0, sizeof(owners));
+    if (workers && coap_pool_init(&pool, workers)) {
+        printf("coap_pool_init failed\n");
+        return 1;
+    }
+    for (unsigned i = 0; i < OWNERS; ++i) {
+        owners[i].ep.len = 1;
+        owners[i].ep.addr[0] = (uint8_t)i;
+        if (workers) {
+            owners[i].pool = &pool;
+            coap_pool_attach(&pool, &owners[i].owner, send_separate, &owners[i]);
+        }
+        pthread_create(&owners[i].thread, NULL, run_owner, &owners[i]);
+    }
+    double received = 0, elapsed = 0;
+    uint64_t inline_rsp = 0, acks = 0, separate = 0, failed = 0, rejected = 0, bad = 0;
+    for (unsigned i = 0; i < OWNERS; ++i) {
+        pthread_join(owners[i].thread, NULL);
+        received = (owners[i].received > received) ? owners[i].received : received;
+        elapsed = (owners[i].elapsed > elapsed) ? owners[i].elapsed : elapsed;
+        inline_rsp += owners[i].inline_rsp;
+        acks += owners[i].acks;
+        separate += owners[i].separate;
+        failed += owners[i].failed;
+        bad += owners[i].bad;
+        rejected += owners[i].owner.rejected;
+    }
+    if (workers) {
+        coap_pool_close(&pool);
+    }
+    const uint64_t total = (uint64_t)OWNERS * REQUESTS;
+    printf("%2u workers  %8.0f req/s received  %6.1f ms until done  inline %llu, "
+           "empty ACK %llu, separate %llu, failed %llu, 5.03 %llu\n", workers,
+           total / (received / 1e9), elapsed / 1e6,
+           (unsigned long long)inline_rsp, (unsigned long long)acks,
+           (unsigned long long)separate, (unsigned long long)failed,
+           (unsigned long long)rejected);
+    // every request answered once, blocking ones separately if offloaded,
+    // failing ones with 5.00 then
+    if (bad || (inline_rsp + separate + failed != total) ||
+        (workers && (acks != separate + failed))) {
+        printf("mismatch, %llu bad\n", (unsigned long long)bad);
+        return 1;
+    }
+    return 0;
+}
+
+/* a blocking request sent again, in flight and after its response */
+static int check_retransmission(void)
+{
+    coap_pool_t pool;
+    owner_t o;
+    uint8_t in[128], out[64];
+    size_t inlen = sizeof(in), outlen;
+    const uint32_t n = 7;
+    const coap_buffer_t tok = {(const uint8_t *)&n, sizeof(n)};
+    memset(&o, 0, sizeof(o));
+    o.ep.len = 1;
+    if (coap_pool_init(&pool, 1) ||
+        coap_pool_attach(&pool, &o.owner, send_separate, &o)) {
+        return 1;
+    }
+    o.pool = &pool;
+    coap_build_request(&tpl_slow, (uint16_t)n, &tok, NULL, 0, in, &inlen);
+    const unsigned runs = __atomic_load_n(&slow_runs, __ATOMIC_RELAXED);
+    unsigned acked = 0;
+    for (int i = 0; i < 2; ++i) {
+        outlen = sizeof(out);
+        acked += !coap_pool_handle_packet(&o.owner, resources, &o.ep, in, inlen,
+                                          out, &outlen) &&
+                 (out[1] == COAP_RSPCODE_EMPTY);
+    }
+    while (o.owner.pending) {
+        coap_pool_complete(&o.owner);
+        sched_yield();
+    }
+    // the response got lost, the client asks again
+    outlen = sizeof(out);
+    acked += !coap_pool_handle_packet(&o.owner, resources, &o.ep, in, inlen,
+                                      out, &outlen) &&
+             (out[1] == COAP_RSPCODE_EMPTY);
+    const bool ok = (acked == 3) && (o.separate == 2) && !o.bad &&
+                    (o.unacked[0] == o.unacked[1]) &&
+                    (__atomic_load_n(&slow_runs, __ATOMIC_RELAXED) == runs + 1);
+    acknowledge(&o);
+    coap_pool_close(&pool);
+    printf("%-44s %s\n", "retransmitted request, handled once", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(void)
+{
+    static const coap_resource_t req_fast =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_fast,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    static const coap_resource_t req_slow =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_slow,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    static const coap_resource_t req_fail =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_fail,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    coap_make_request_template(&req_fast, &tpl_fast);
+    coap_make_request_template(&req_slow, &tpl_slow);
+    coap_make_request_template(&req_fail, &tpl_fail);
+
+    printf("%u receive threads x %u requests, every %u. blocks %u us\n",
+           OWNERS, REQUESTS, BLOCKING, SLOW_US);
+    int rc = check_retransmission();
+    rc |= run(0);
+    for (unsigned workers = 1; workers <= 8; workers *= 2) {
+        rc |= run(workers);
+    }
+    return rc;
+}
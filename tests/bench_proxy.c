@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_proxy.h"
+
+#define REQUESTS    100000
+#define MAX_AGE     10      //!< s, Max-Age of upstream responses
+#define COLLAPSED   4       //!< identical GETs in flight at once
+#define QUEUE       256     //!< datagrams in flight, power of 2
+
+enum { CLIENT = 1, PROXY, UPSTREAM };
+
+typedef struct
+{
+    uint8_t from, to;
+    size_t len;
+    uint8_t buf[128];
+} datagram_t;
+
+static datagram_t queue[QUEUE];
+static unsigned head, tail;
+static coap_tick_t vnow;
+static coap_proxy_t proxy;
+
+static const char temp[] = "21.5";
+static const char bogus[] = "spoofed";
+
+static coap_tick_t vclock(void)
+{
+    return vnow;
+}
+
+static coap_endpoint_t endpoint(const uint8_t id)
+{
+    coap_endpoint_t ep = {1, {id}};
+    return ep;
+}
+
+static int push(const uint8_t from, const uint8_t to,
+                const uint8_t *buf, const size_t len)
+{
+    if ((tail - head == QUEUE) || (len > sizeof(queue[0].buf))) {
+        return COAP_ERR_BUSY;
+    }
+    datagram_t *d = &queue[tail++ % QUEUE];
+    d->from = from;
+    d->to = to;
+    d->len = len;
+    memcpy(d->buf, buf, len);
+    return COAP_SUCCESS;
+}
+
+static int send_from(void *ctx, const coap_endpoint_t *ep,
+                     const uint8_t *buf, const size_t buflen)
+{
+    return push(*(const uint8_t *)ctx, ep->addr[0], buf, buflen);
+}
+
+static int resolve(void *ctx, const coap_buffer_t *host, const uint16_t port,
+                   coap_endpoint_t *ep)
+{
+    (void)ctx;
+    static const char name[] = "upstream.local";
+    if ((port != COAP_DEFAULT_PORT) || (host->len != sizeof(name) - 1) ||
+        memcmp(host->p, name, host->len)) {
+        return COAP_ERR_UNSUPPORTED;
+    }
+    *ep = endpoint(UPSTREAM);
+    return COAP_SUCCESS;
+}
+
+/* --- upstream ------------------------------------------------------------- */
+static unsigned hits;                   //!< requests handled upstream
+static bool spoof;                      //!< answer the next request with a wrong token
+
+static int handle_get_temp(const coap_resource_t *resource,
+                           const coap_packet_t *inpkt,
+                           coap_packet_t *pkt)
+{
+    static uint8_t maxage[4];
+    hits++;
+    coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                       COAP_RSPCODE_CONTENT, resource->content_type,
+                       (const uint8_t *)temp, sizeof(temp) - 1, pkt);
+    coap_add_option(pkt, COAP_OPTION_MAX_AGE, maxage,
+                    coap_encode_option_uint(MAX_AGE, maxage));
+    return COAP_STATE_RSP_SEND;
+}
+
+static int handle_post_temp(const coap_resource_t *resource,
+                            const coap_packet_t *inpkt,
+                            coap_packet_t *pkt)
+{
+    hits++;
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok, COAP_TYPE_ACK,
+                              COAP_RSPCODE_CHANGED, resource->content_type,
+                              NULL, 0, pkt);
+}
+
+static const coap_resource_path_t path_temp = {1, {"temp"}};
+static coap_resource_t upstream_resources[] =
+{
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_temp, &path_temp,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL
+    },
+    {   COAP_STATE_RDY, COAP_METHOD_POST, COAP_TYPE_ACK,
+        handle_post_temp, &path_temp,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    },
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+/* piggybacked ACK matching the message ID of the request, not its token */
+static void send_spoofed(const coap_endpoint_t *to, const coap_packet_t *inpkt)
+{
+    static const uint8_t upstream = UPSTREAM;
+    uint8_t tok[COAP_MAX_TOKLEN];
+    uint8_t out[128];
+    size_t outlen = sizeof(out);
+    coap_packet_t pkt;
+    memcpy(tok, inpkt->tok.p, inpkt->tok.len);
+    tok[0] ^= 0xff;
+    const coap_buffer_t wrong = {tok, inpkt->tok.len};
+    coap_make_response(inpkt->hdr.id, &wrong, COAP_TYPE_ACK,
+                       COAP_RSPCODE_CONTENT, NULL,
+                       (const uint8_t *)bogus, sizeof(bogus) - 1, &pkt);
+    if (!coap_build(&pkt, out, &outlen)) {
+        send_from((void *)&upstream, to, out, outlen);
+    }
+}
+
+/* --- client --------------------------------------------------------------- */
+typedef struct
+{
+    unsigned acks;                      //!< empty ACKs
+    unsigned piggybacked;               //!< 2.05 in an ACK, i.e. from cache
+    unsigned separate;                  //!< 2.05 in a separate response
+    unsigned changed;                   //!< 2.04
+    unsigned unexpected;                //!< anything else
+    uint32_t last;                      //!< token of the last response
+} received_t;
+
+static received_t rx;
+
+static void send_request(const coap_method_t method, const uint32_t token,
+                         const bool reverse)
+{
+    static const coap_resource_path_t path_dev = {2, {"dev", "temp"}};
+    static const coap_resource_path_t path_none = {0, {NULL}};
+    static const char uri[] = "coap://upstream.local/temp";
+    const coap_resource_t request =
+        {COAP_STATE_RDY, method, COAP_TYPE_CON, NULL,
+         reverse ? &path_dev : &path_none,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    const coap_buffer_t tok = {(const uint8_t *)&token, sizeof(token)};
+    uint8_t buf[128];
+    size_t len = sizeof(buf);
+    coap_packet_t pkt;
+    coap_make_request((uint16_t)token, &tok, &request, NULL, 0, &pkt);
+    if (!reverse) {
+        coap_add_option(&pkt, COAP_OPTION_PROXY_URI, (const uint8_t *)uri,
+                        sizeof(uri) - 1);
+    }
+    if (!coap_build(&pkt, buf, &len)) {
+        push(CLIENT, PROXY, buf, len);
+    }
+}
+
+static void receive(const coap_packet_t *pkt)
+{
+    if (pkt->hdr.tkl == sizeof(rx.last)) {
+        memcpy(&rx.last, pkt->tok.p, sizeof(rx.last));
+    }
+    if (pkt->hdr.code == COAP_RSPCODE_EMPTY) {
+        rx.acks++;
+    }
+    else if (pkt->hdr.code == COAP_RSPCODE_CHANGED) {
+        rx.changed++;
+    }
+    else if ((pkt->hdr.code == COAP_RSPCODE_CONTENT) &&
+             (pkt->payload.len == sizeof(temp) - 1) &&
+             !memcmp(pkt->payload.p, temp, pkt->payload.len)) {
+        if (pkt->hdr.t == COAP_TYPE_ACK) {
+            rx.piggybacked++;
+        }
+        else {
+            rx.separate++;
+        }
+    }
+    else {
+        rx.unexpected++;
+    }
+}
+
+/* --- proxy and transport -------------------------------------------------- */
+static void deliver(const datagram_t *d)
+{
+    static const uint8_t proxy_id = PROXY, upstream = UPSTREAM;
+    const coap_endpoint_t from = endpoint(d->from);
+    uint8_t out[128];
+    size_t outlen = sizeof(out);
+    coap_packet_t pkt, rsp;
+    int rc;
+    if (coap_parse(d->buf, d->len, &pkt)) {
+        return;
+    }
+    switch (d->to) {
+    case UPSTREAM:
+        if (spoof) {
+            spoof = false;
+            send_spoofed(&from, &pkt);
+        }
+        else if (!coap_handle_packet(upstream_resources, d->buf, d->len, out, &outlen)) {
+            send_from((void *)&upstream, &from, out, outlen);
+        }
+        break;
+    case PROXY:
+        rc = coap_proxy_handle_request(&proxy, &from, &pkt, &rsp);
+        if ((rc == COAP_STATE_RSP_SEND) || (rc == COAP_STATE_ACK_SEND)) {
+            if (!coap_build(&rsp, out, &outlen)) {
+                send_from((void *)&proxy_id, &from, out, outlen);
+            }
+        }
+        else if (rc == COAP_ERR_REQUEST_NOT_FOUND) {
+            coap_proxy_handle_response(&proxy, &from, &pkt);
+        }
+        break;
+    case CLIENT:
+        receive(&pkt);
+        break;
+    }
+}
+
+static void run(void)
+{
+    for (;;) {
+        if (head == tail) {
+            // idle until the next retransmission
+            const coap_tick_t next = coap_proxy_poll(&proxy);
+            if (head == tail) {
+                if (next == COAP_TICK_NEVER) {
+                    return;
+                }
+                vnow = (next > vnow) ? next : vnow;
+                coap_proxy_poll(&proxy);
+            }
+            continue;
+        }
+        const datagram_t d = queue[head++ % QUEUE];
+        deliver(&d);
+    }
+}
+
+static int check(const char *what, const bool ok)
+{
+    printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    static const uint8_t proxy_id = PROXY;
+    static const coap_resource_path_t path_route = {2, {"dev", "*"}};
+    static const coap_proxy_route_t routes[] =
+    {
+        {&path_route, {1, {UPSTREAM}}, 1},
+        {NULL, {0, {0}}, 0}
+    };
+    int failed = 0;
+    uint32_t token = 0;
+    received_t before;
+
+    coap_clock_set(vclock);
+    vnow = 1;
+    coap_proxy_init(&proxy, send_from, (void *)&proxy_id, resolve, NULL, routes);
+
+    // reverse proxy: empty ACK, then the separate response under our token
+    send_request(COAP_METHOD_GET, ++token, true);
+    run();
+    failed |= check("reverse GET forwarded upstream",
+                    (hits == 1) && (rx.acks == 1) && (rx.separate == 1) &&
+                    (rx.last == token) && !rx.unexpected);
+
+    // same request again, piggybacked from the cache
+    send_request(COAP_METHOD_GET, ++token, true);
+    run();
+    failed |= check("repeated GET served from cache",
+                    (hits == 1) && (rx.piggybacked == 1) && (rx.last == token));
+
+    // once stale, identical GETs in flight share one upstream request
+    vnow += (MAX_AGE + 1) * COAP_TICKS_PER_SEC;
+    before = rx;
+    for (unsigned i = 0; i < COLLAPSED; ++i) {
+        send_request(COAP_METHOD_GET, ++token, true);
+    }
+    run();
+    failed |= check("concurrent GETs collapsed",
+                    (hits == 2) && (rx.acks - before.acks == COLLAPSED) &&
+                    (rx.separate - before.separate == COLLAPSED));
+
+    // forward proxy by Proxy-Uri, resolved to the same upstream
+    before = rx;
+    send_request(COAP_METHOD_GET, ++token, false);
+    run();
+    failed |= check("forward GET by Proxy-Uri",
+                    (hits == 3) && (rx.separate - before.separate == 1) &&
+                    (rx.last == token));
+
+    // piggybacked ACK with the right message ID but a foreign token is
+    // ignored, the retransmission gets the real response
+    vnow += (MAX_AGE + 1) * COAP_TICKS_PER_SEC;
+    before = rx;
+    spoof = true;
+    send_request(COAP_METHOD_GET, ++token, true);
+    run();
+    failed |= check("piggybacked ACK with wrong token ignored",
+                    !spoof && (hits == 4) && (rx.separate - before.separate == 1) &&
+                    !rx.unexpected);
+    if (failed) {
+        return 1;
+    }
+
+    // timing: cache hits, and POSTs each forwarded upstream
+    printf("%d cache hits and %d forwarded POSTs, client, proxy and upstream "
+           "on one thread\n", REQUESTS, REQUESTS);
+    before = rx;
+    double t0 = now_ns();
+    for (unsigned i = 0; i < REQUESTS; ++i) {
+        send_request(COAP_METHOD_GET, ++token, true);
+        run();
+    }
+    double t1 = now_ns();
+    printf("cache hits  %u, %.0f ns per request\n",
+           rx.piggybacked - before.piggybacked, (t1 - t0) / REQUESTS);
+    t0 = now_ns();
+    for (unsigned i = 0; i < REQUESTS; ++i) {
+        send_request(COAP_METHOD_POST, ++token, true);
+        run();
+    }
+    t1 = now_ns();
+    printf("forwarded   %u, %.0f ns per request\n",
+           rx.changed - before.changed, (t1 - t0) / REQUESTS);
+    return (rx.piggybacked - before.piggybacked == REQUESTS) &&
+           (rx.changed - before.changed == REQUESTS) && !rx.unexpected ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_rd.h"
+#include "coap_time.h"
+
+#define LOOKUPS     20000
+#define GROUPS      100     //!< endpoints share rt="group-n"
+
+static coap_tick_t clock_ms;
+static int failures;
+
+static coap_tick_t sim_clock(void)
+{
+    return clock_ms;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* endpoints are 4 address bytes */
+static int make_base(void *ctx, const coap_endpoint_t *ep, char *buf, const size_t buflen)
+{
+    (void)ctx;
+    snprintf(buf, buflen, "coap://10.%u.%u.%u", ep->addr[1], ep->addr[2], ep->addr[3]);
+    return COAP_SUCCESS;
+}
+
+static void check(const bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * one request, e.g. "rd-lookup/res?rt=x&if=y", the response payload is
+ * appended to out if given
+ */
+static uint8_t request(coap_rd_t *rd, const coap_endpoint_t *from,
+                       const coap_method_t method, const char *uri,
+                       const char *payload, const int block, char *out)
+{
+    static const uint8_t ct[] = {COAP_CONTENTTYPE_APP_LINKFORMAT};
+    char buf[256];
+    uint8_t value[3];
+    coap_packet_t req, rsp;
+    strcpy(buf, uri);
+    memset(&req, 0, sizeof(req));
+    req.hdr.ver = COAP_VERSION;
+    req.hdr.t = COAP_TYPE_CON;
+    req.hdr.code = method;
+    req.payload.p = (const uint8_t *)payload;
+    req.payload.len = payload ? strlen(payload) : 0;
+    char *query = strchr(buf, '?');
+    if (query) {
+        *query++ = '\0';
+    }
+    for (char *seg = strtok(buf, "/"); seg; seg = strtok(NULL, "/")) {
+        coap_add_option(&req, COAP_OPTION_URI_PATH, (const uint8_t *)seg, strlen(seg));
+    }
+    for (char *param = query ? strtok(query, "&") : NULL; param; param = strtok(NULL, "&")) {
+        coap_add_option(&req, COAP_OPTION_URI_QUERY, (const uint8_t *)param, strlen(param));
+    }
+    if (payload) {
+        coap_add_option(&req, COAP_OPTION_CONTENT_FORMAT, ct, sizeof(ct));
+    }
+    if (block >= 0) {
+        const coap_block_t b = {(uint32_t)block, false, 6};
+        coap_add_option(&req, COAP_OPTION_BLOCK2, value, coap_encode_block_option(&b, value));
+    }
+    if (coap_rd_handle_request(rd, from, &req, &rsp) != COAP_STATE_RSP_SEND) {
+        return 0;
+    }
+    if (out) {
+        strncat(out, (const char *)rsp.payload.p, rsp.payload.len);
+    }
+    coap_block_t b;
+    if (!coap_get_block_option(&rsp, COAP_OPTION_BLOCK2, &b) && b.more) {
+        return 0xff;    // more blocks follow
+    }
+    return rsp.hdr.code;
+}
+
+/* all blocks of a lookup, returns the number of links */
+static size_t lookup(coap_rd_t *rd, const char *uri, char *out, const size_t outlen)
+{
+    uint8_t code;
+    int block = 0;
+    out[0] = '\0';
+    do {
+        // leave room for another block
+        if (strlen(out) + COAP_RD_MAX_BLOCK >= outlen) {
+            return 0;
+        }
+        code = request(rd, NULL, COAP_METHOD_GET, uri, NULL, block++, out);
+    } while (code == 0xff);
+    if (code != COAP_RSPCODE_CONTENT) {
+        return 0;
+    }
+    size_t n = 0;
+    for (const char *p = out; *p; ++p) {
+        n += (*p == '<');
+    }
+    return n;
+}
+
+static void fill(coap_rd_t *rd, const unsigned n)
+{
+    char uri[64], payload[256];
+    for (unsigned i = 0; i < n; ++i) {
+        const coap_endpoint_t ep = {4, {10, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i}};
+        snprintf(uri, sizeof(uri), "rd?ep=node-%u", i);
+        snprintf(payload, sizeof(payload),
+                 "</temp>;rt=\"temperature\";if=\"core.s\";ct=0,"
+                 "</hum>;rt=\"humidity\";if=\"core.s\","
+                 "</led>;rt=\"light\";if=\"core.a\","
+                 "</id>;rt=\"group-%u dev-%u\"", i % GROUPS, i);
+        request(rd, &ep, COAP_METHOD_POST, uri, payload, -1, NULL);
+    }
+}
+
+static double time_lookup(coap_rd_t *rd, const unsigned n, const char *fmt)
+{
+    char uri[64];
+    const double t0 = now_ns();
+    for (unsigned i = 0; i < LOOKUPS; ++i) {
+        snprintf(uri, sizeof(uri), fmt, (i * 7919) % n);
+        request(rd, NULL, COAP_METHOD_GET, uri, NULL, 0, NULL);
+    }
+    return (now_ns() - t0) / LOOKUPS;
+}
+
+/* all blocks of the links of all registrations */
+static double time_paging(coap_rd_t *rd)
+{
+    const double t0 = now_ns();
+    int block = 0;
+    while (request(rd, NULL, COAP_METHOD_GET, "rd-lookup/res", NULL, block, NULL) == 0xff) {
+        block++;
+    }
+    return (now_ns() - t0) / (block + 1);
+}
+
+static void test(void)
+{
+    coap_rd_t rd;
+    char uri[64];
+    static char out[1 << 20];
+    const coap_endpoint_t ep = {4, {10, 0, 0, 1}};
+    coap_rd_init(&rd, make_base, NULL);
+    fill(&rd, 1000);
+    check(rd.registrations == 1000 && rd.links == 4000, "registered");
+
+    check(lookup(&rd, "rd-lookup/res?ep=node-42", out, sizeof(out)) == 4, "by ep");
+    check(strstr(out, "<coap://10.0.0.42/temp>;rt=\"temperature\";if=\"core.s\";ct=0;"
+                      "anchor=\"coap://10.0.0.42\"") == out, "link rendered");
+    check(lookup(&rd, "rd-lookup/res?rt=group-7", out, sizeof(out)) == 10, "by rt");
+    check(lookup(&rd, "rd-lookup/res?rt=dev-7", out, sizeof(out)) == 1, "by second rt");
+    check(lookup(&rd, "rd-lookup/res?if=core.s", out, sizeof(out)) == 2000, "by if, paged");
+    check(lookup(&rd, "rd-lookup/res?rt=light&if=core.a", out, sizeof(out)) == 1000, "by rt and if");
+    check(lookup(&rd, "rd-lookup/res?rt=light&if=core.s", out, sizeof(out)) == 0 &&
+          !out[0], "disjoint");
+    check(lookup(&rd, "rd-lookup/res?rt=nothing", out, sizeof(out)) == 0, "unknown rt");
+    check(lookup(&rd, "rd-lookup/ep?rt=group-7", out, sizeof(out)) == 10, "endpoints by rt");
+    check(lookup(&rd, "rd-lookup/ep?if=core.s", out, sizeof(out)) == 1000, "endpoints deduplicated");
+    check(lookup(&rd, "rd-lookup/res", out, sizeof(out)) == 4000, "all links");
+    check(request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/res?href=/temp", NULL, -1, NULL) ==
+          COAP_RSPCODE_BAD_REQUEST, "unsupported filter");
+    check(request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/res?rt=group-7", NULL, 99, NULL) ==
+          COAP_RSPCODE_BAD_OPTION, "block out of range");
+
+    // blocks resumed from the cursor equal blocks rendered from the start
+    char resumed[COAP_RD_MAX_BLOCK + 1] = "", cold[COAP_RD_MAX_BLOCK + 1] = "";
+    for (int i = 0; i < 3; ++i) {
+        request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/ep?if=core.s", NULL, i, NULL);
+    }
+    request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/ep?if=core.s", NULL, 3, resumed);
+    check(rd.cursor.offset > 0, "resumed");
+    request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/res?rt=group-7", NULL, 0, NULL);
+    request(&rd, NULL, COAP_METHOD_GET, "rd-lookup/ep?if=core.s", NULL, 3, cold);
+    check(resumed[0] && !strcmp(resumed, cold), "resumed block");
+
+    // re-registration replaces the links, keeps the location
+    check(request(&rd, &ep, COAP_METHOD_POST, "rd?ep=node-1&lt=10&base=coap://h",
+                  "</a>;rt=\"x\"", -1, NULL) == COAP_RSPCODE_CREATED, "re-register");
+    check(rd.registrations == 1000 && rd.links == 3997, "replaced");
+    check(lookup(&rd, "rd-lookup/ep?ep=node-1", out, sizeof(out)) == 1 &&
+          !strcmp(out, "</rd/2>;ep=\"node-1\";base=\"coap://h\";lt=10"), "endpoint rendered");
+    check(lookup(&rd, "rd/2", out, sizeof(out)) == 1 &&
+          !strcmp(out, "<coap://h/a>;rt=\"x\";anchor=\"coap://h\""), "read registration");
+    check(request(&rd, &ep, COAP_METHOD_POST, "rd?ep=bad", "<a>;rt=\"x", -1, NULL) ==
+          COAP_RSPCODE_BAD_REQUEST, "malformed links");
+
+    // lifetime, update and removal
+    clock_ms += 9000;
+    check(request(&rd, NULL, COAP_METHOD_POST, "rd/2", NULL, -1, NULL) ==
+          COAP_RSPCODE_CHANGED, "update");
+    clock_ms += 9000;
+    coap_rd_poll(&rd);
+    check(rd.registrations == 1000, "refreshed");
+    clock_ms += 2000;
+    check(coap_rd_poll(&rd) == clock_ms + COAP_RD_DEFAULT_LIFETIME * 1000ULL - 20000,
+          "next expiry");
+    check(rd.registrations == 999 && lookup(&rd, "rd-lookup/res?rt=x", out, sizeof(out)) == 0,
+          "expired");
+    snprintf(uri, sizeof(uri), "rd/%u", 3);
+    check(request(&rd, NULL, COAP_METHOD_DELETE, uri, NULL, -1, NULL) ==
+          COAP_RSPCODE_DELETED, "delete");
+    check(request(&rd, NULL, COAP_METHOD_DELETE, uri, NULL, -1, NULL) ==
+          COAP_RSPCODE_NOT_FOUND, "deleted");
+    check(lookup(&rd, "rd-lookup/res?rt=group-2", out, sizeof(out)) == 9, "index updated");
+    coap_rd_free(&rd);
+}
+
+int main(void)
+{
+    coap_clock_set(sim_clock);
+    test();
+
+    // filtered lookups touch the matching links only
+    printf("%-22s %12s %12s %12s %12s\n", "registrations", "ep=", "rt= (1)", "rt= (n/100)",
+           "all, /block");
+    for (unsigned n = 1000; n <= 64000; n *= 4) {
+        coap_rd_t rd;
+        coap_rd_init(&rd, make_base, NULL);
+        double t0 = now_ns();
+        fill(&rd, n);
+        const double reg = (now_ns() - t0) / n;
+        printf("%-8u %6.0f ns/reg %9.0f ns %9.0f ns %9.0f ns %9.0f ns\n", n, reg,
+               time_lookup(&rd, n, "rd-lookup/res?ep=node-%u"),
+               time_lookup(&rd, n, "rd-lookup/res?rt=dev-%u"),
+               time_lookup(&rd, GROUPS, "rd-lookup/res?rt=group-%u"),
+               time_paging(&rd));
+        coap_rd_free(&rd);
+    }
+    coap_clock_set(NULL);
+    return failures ? 1 : 0;
+}
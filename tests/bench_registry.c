@@ -0,0 +1,171 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_registry.h"
+
+#define READERS     4
+#define REQUESTS    2000000 //!< per reader
+#define BATCH       64      //!< requests between quiescent states
+
+typedef struct
+{
+    pthread_t thread;
+    coap_registry_t *reg;               //!< NULL for the static table
+    coap_registry_reader_t reader;
+    uint64_t ok, bad;
+    double elapsed;
+    bool done;
+} reader_t;
+
+static const coap_resource_path_t paths[] =
+{
+    {1, {"a"}}, {1, {"b"}}, {1, {"c"}}, {1, {"d"}},
+    {1, {"e"}}, {1, {"f"}}, {1, {"g"}}, {1, {"h"}},
+};
+static const coap_resource_path_t path_tmp = {1, {"tmp"}};
+
+static int handle_get(const coap_resource_t *resource,
+                      const coap_packet_t *inpkt,
+                      coap_packet_t *pkt)
+{
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              (const uint8_t *)resource->path->items[0], 1, pkt);
+}
+
+#define RESOURCE(p) \
+    {   COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK, handle_get, p, \
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL }
+
+static coap_resource_t resources[] =
+{
+    RESOURCE(&paths[0]), RESOURCE(&paths[1]), RESOURCE(&paths[2]), RESOURCE(&paths[3]),
+    RESOURCE(&paths[4]), RESOURCE(&paths[5]), RESOURCE(&paths[6]), RESOURCE(&paths[7]),
+    {   (coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL
+    }
+};
+
+static const coap_resource_t resource_tmp = RESOURCE(&path_tmp);
+
+static coap_request_template_t tpl;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* dispatch the last resource, so each request walks the whole table */
+static void *run_reader(void *arg)
+{
+    reader_t *r = arg;
+    uint8_t in[64], out[64];
+    if (r->reg) {
+        coap_registry_attach(r->reg, &r->reader);
+    }
+    const double t0 = now_ns();
+    for (unsigned i = 0; i < REQUESTS; ++i) {
+        size_t inlen = sizeof(in), outlen = sizeof(out);
+        coap_build_request(&tpl, (uint16_t)i, NULL, NULL, 0, in, &inlen);
+        coap_resource_t *rs = r->reg ? coap_registry_resources(r->reg) : resources;
+        if (!coap_handle_packet(rs, in, inlen, out, &outlen) &&
+            (out[1] == COAP_RSPCODE_CONTENT) && (out[outlen - 1] == 'h')) {
+            r->ok++;
+        }
+        else {
+            r->bad++;
+        }
+        if (r->reg && !(i % BATCH)) {
+            coap_registry_quiescent(r->reg, &r->reader);
+        }
+    }
+    r->elapsed = now_ns() - t0;
+    if (r->reg) {
+        coap_registry_detach(r->reg, &r->reader);
+    }
+    __atomic_store_n(&r->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int run(const char *name, coap_registry_t *reg, const unsigned nreaders,
+               const bool writer)
+{
+    reader_t readers[READERS];
+    memset(readers, 0, sizeof(readers));
+    bool writing = writer;
+    for (unsigned i = 0; i < nreaders; ++i) {
+        readers[i].reg = reg;
+        pthread_create(&readers[i].thread, NULL, run_reader, &readers[i]);
+    }
+    // swap the table as fast as possible while the readers run
+    uint64_t swaps = 0;
+    const struct timespec ts = {0, 10000};
+    while (writing) {
+        if (coap_registry_add(reg, &resource_tmp) ||
+            coap_registry_remove(reg, &path_tmp, COAP_METHOD_GET)) {
+            printf("swap failed\n");
+            break;
+        }
+        swaps += 2;
+        nanosleep(&ts, NULL);
+        bool done = true;
+        for (unsigned i = 0; i < nreaders; ++i) {
+            done &= __atomic_load_n(&readers[i].done, __ATOMIC_ACQUIRE);
+        }
+        if (done) {
+            writing = false;
+        }
+    }
+    double elapsed = 0;
+    uint64_t ok = 0, bad = 0;
+    for (unsigned i = 0; i < nreaders; ++i) {
+        pthread_join(readers[i].thread, NULL);
+        elapsed += readers[i].elapsed;
+        ok += readers[i].ok;
+        bad += readers[i].bad;
+    }
+    unsigned waiting = 0;
+    if (reg) {
+        waiting = coap_registry_reclaim(reg);
+    }
+    printf("%-28s %u readers  %6.1f ns/request  swaps %8llu  tables left %u\n",
+           name, nreaders, elapsed / (ok + bad),
+           (unsigned long long)swaps, waiting);
+    if (bad || waiting) {
+        printf("mismatch, %llu bad\n", (unsigned long long)bad);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const coap_resource_t req =
+        {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &paths[7],
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+    coap_registry_t reg;
+    coap_make_request_template(&req, &tpl);
+    if (coap_registry_init(&reg, resources)) {
+        printf("coap_registry_init failed\n");
+        return 1;
+    }
+
+    printf("%u resources, %u requests per reader, quiescent every %u\n",
+           (unsigned)(sizeof(paths) / sizeof(paths[0])), REQUESTS, BATCH);
+    int rc = run("static table", NULL, 1, false);
+    rc |= run("registry", &reg, 1, false);
+    rc |= run("static table", NULL, READERS, false);
+    rc |= run("registry", &reg, READERS, false);
+    rc |= run("registry, swapping", &reg, READERS, true);
+    coap_registry_free(&reg);
+    return rc;
+}
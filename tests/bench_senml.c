@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "coap.h"
+#include "coap_senml.h"
+
+#define ITERATIONS  200000
+#define MAX_RECORDS 16
+#define BLOCK_SZX   3       //!< 128 byte blocks, block 0 holds whole records
+
+/* the example server, for its Block1 uploads to /senml */
+extern void resource_setup(const coap_resource_t *resources);
+extern coap_resource_t resources[];
+
+/* a record as received, with copies of what is valid during the callback only */
+typedef struct
+{
+    char name[COAP_SENML_MAX_NAME + 1];
+    char unit[COAP_SENML_MAX_UNIT + 1];
+    char data[32];
+    coap_senml_record_t rec;
+} received_t;
+
+static received_t received[MAX_RECORDS];
+static unsigned nreceived;
+static int failures;
+
+static const coap_senml_base_t base =
+{
+    {(const uint8_t *)"urn:dev:ow:10e2073a01080063:", 28},
+    {(const uint8_t *)"Cel", 3},
+    1276020076, 0
+};
+
+static coap_senml_record_t records[] =
+{
+    {.name = {(const uint8_t *)"temp", 4}, .type = COAP_SENML_VALUE, .value = 23.5},
+    {.name = {(const uint8_t *)"temp", 4}, .time = 60, .type = COAP_SENML_VALUE, .value = 23.75},
+    {.name = {(const uint8_t *)"hum", 3}, .unit = {(const uint8_t *)"%RH", 3}, .time = 60,
+     .type = COAP_SENML_VALUE, .value = 48},
+    {.name = {(const uint8_t *)"door", 4}, .type = COAP_SENML_BOOL, .boolean = true},
+    {.name = {(const uint8_t *)"room", 4}, .type = COAP_SENML_STRING,
+     .data = {(const uint8_t *)"kitchen", 7}},
+    {.name = {(const uint8_t *)"energy", 6}, .unit = {(const uint8_t *)"J", 1},
+     .type = COAP_SENML_NONE, .has_sum = true, .sum = 1250.5},
+};
+#define RECORDS     (sizeof(records) / sizeof(records[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(const bool ok, const char *what)
+{
+    printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+static void copy(char *dst, const size_t size, const coap_buffer_t *src)
+{
+    const size_t len = (src->len < size - 1) ? src->len : size - 1;
+    if (len) {
+        memcpy(dst, src->p, len);
+    }
+    dst[len] = '\0';
+}
+
+static int collect(void *arg, const coap_senml_record_t *record)
+{
+    (void)arg;
+    if (nreceived == MAX_RECORDS) {
+        return COAP_ERR_BUFFER_TOO_SMALL;
+    }
+    received_t *r = &received[nreceived++];
+    copy(r->name, sizeof(r->name), &record->name);
+    copy(r->unit, sizeof(r->unit), &record->unit);
+    copy(r->data, sizeof(r->data), &record->data);
+    r->rec = *record;
+    return COAP_SUCCESS;
+}
+
+static int count_records(void *arg, const coap_senml_record_t *record)
+{
+    (void)record;
+    (*(unsigned *)arg)++;
+    return COAP_SUCCESS;
+}
+
+static size_t encode(const coap_content_type_t format, uint8_t *buf, const size_t buflen)
+{
+    coap_senml_encoder_t e;
+    size_t len = 0;
+    coap_senml_encoder_init(&e, format, buf, buflen, &base);
+    for (size_t i = 0; i < RECORDS; ++i) {
+        coap_senml_put_record(&e, &records[i]);
+    }
+    return coap_senml_encoder_finish(&e, &len) ? 0 : len;
+}
+
+/* every record resolved against the base fields, as encoded */
+static bool resolved(void)
+{
+    if (nreceived != RECORDS) {
+        return false;
+    }
+    for (size_t i = 0; i < RECORDS; ++i) {
+        const coap_senml_record_t *want = &records[i];
+        const received_t *got = &received[i];
+        char name[COAP_SENML_MAX_NAME + 1];
+        snprintf(name, sizeof(name), "%.*s%.*s", (int)base.name.len, base.name.p,
+                 (int)want->name.len, want->name.p);
+        const coap_buffer_t *unit = want->unit.len ? &want->unit : &base.unit;
+        if (strcmp(got->name, name) || (strlen(got->unit) != unit->len) ||
+            memcmp(got->unit, unit->p, unit->len) ||
+            (got->rec.time != base.time + want->time) ||
+            (got->rec.type != want->type) || (got->rec.has_sum != want->has_sum)) {
+            return false;
+        }
+        if (((want->type == COAP_SENML_VALUE) && (got->rec.value != want->value)) ||
+            ((want->type == COAP_SENML_BOOL) && (got->rec.boolean != want->boolean)) ||
+            ((want->type == COAP_SENML_STRING) &&
+             ((strlen(got->data) != want->data.len) ||
+              memcmp(got->data, want->data.p, want->data.len))) ||
+            (want->has_sum && (got->rec.sum != want->sum))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* whole, then in chunks of every size, so records are cut anywhere */
+static void test_round_trip(const char *name, const coap_content_type_t format)
+{
+    uint8_t pack[512];
+    char what[64];
+    coap_senml_decoder_t d;
+    const size_t len = encode(format, pack, sizeof(pack));
+    nreceived = 0;
+    coap_senml_decoder_init(&d, format, collect, NULL);
+    snprintf(what, sizeof(what), "%s round trip, base fields resolved", name);
+    check(len && !coap_senml_decode(&d, pack, len, true) && resolved(), what);
+    bool ok = true;
+    for (size_t chunk = 1; ok && (chunk < len); ++chunk) {
+        nreceived = 0;
+        coap_senml_decoder_init(&d, format, collect, NULL);
+        for (size_t off = 0; ok && (off < len); off += chunk) {
+            const size_t n = (len - off < chunk) ? len - off : chunk;
+            ok = !coap_senml_decode(&d, pack + off, n, off + n == len);
+        }
+        ok = ok && resolved();
+    }
+    snprintf(what, sizeof(what), "%s records cut at chunk boundaries", name);
+    check(ok, what);
+    nreceived = 0;
+    coap_senml_decoder_init(&d, format, collect, NULL);
+    snprintf(what, sizeof(what), "%s pack cut short", name);
+    check(coap_senml_decode(&d, pack, len - 1, true) == COAP_ERR_INCOMPLETE, what);
+}
+
+/* POST of one Block1 block of pack */
+static void make_block(const uint16_t id, const uint32_t num, const uint8_t *pack,
+                       const size_t len, coap_packet_t *pkt, uint8_t *opt)
+{
+    static const coap_resource_path_t path = {1, {"senml"}};
+    static const coap_resource_t post =
+        {COAP_STATE_RDY, COAP_METHOD_POST, COAP_TYPE_CON, NULL, &path,
+         COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_APP_SENML_JSON), NULL, NULL, 0, NULL};
+    static const uint8_t token[] = {0x5e, 0x41};
+    const coap_buffer_t tok = {token, sizeof(token)};
+    const size_t size = COAP_BLOCK_SIZE(BLOCK_SZX);
+    const size_t off = num * size;
+    coap_block_t block = {num, off + size < len, BLOCK_SZX};
+    coap_make_request(id, &tok, &post, pack + off, (len - off < size) ? len - off : size, pkt);
+    coap_add_option(pkt, COAP_OPTION_BLOCK1, opt, coap_encode_block_option(&block, opt));
+}
+
+static int decode_block(coap_senml_decoder_t *d, const uint16_t id, const uint32_t num,
+                        const uint8_t *pack, const size_t len)
+{
+    coap_packet_t pkt;
+    coap_block_t block;
+    uint8_t opt[3];
+    make_block(id, num, pack, len, &pkt, opt);
+    return coap_senml_decode_block1(d, &pkt, &block);
+}
+
+static void test_block1(void)
+{
+    uint8_t pack[512];
+    coap_senml_decoder_t d;
+    const size_t len = encode(COAP_CONTENTTYPE_APP_SENML_JSON, pack, sizeof(pack));
+    const uint32_t blocks = (uint32_t)((len + COAP_BLOCK_SIZE(BLOCK_SZX) - 1) /
+                                       COAP_BLOCK_SIZE(BLOCK_SZX));
+    bool ok = true;
+    nreceived = 0;
+    coap_senml_decoder_init(&d, COAP_CONTENTTYPE_APP_SENML_JSON, collect, NULL);
+    for (uint32_t num = 0; num < blocks; ++num) {
+        ok = ok && !decode_block(&d, (uint16_t)(100 + num), num, pack, len);
+    }
+    check(ok && resolved(), "Block1 in order");
+
+    nreceived = 0;
+    coap_senml_decoder_init(&d, COAP_CONTENTTYPE_APP_SENML_JSON, collect, NULL);
+    decode_block(&d, 200, 0, pack, len);
+    decode_block(&d, 201, 1, pack, len);
+    check(decode_block(&d, 203, 3, pack, len) == COAP_ERR_BLOCK_SEQUENCE, "Block1 gap");
+
+    // every block twice, as if each response got lost
+    ok = true;
+    nreceived = 0;
+    coap_senml_decoder_init(&d, COAP_CONTENTTYPE_APP_SENML_JSON, collect, NULL);
+    for (uint32_t num = 0; num < blocks; ++num) {
+        ok = ok && !decode_block(&d, (uint16_t)(300 + num), num, pack, len) &&
+             !decode_block(&d, (uint16_t)(300 + num), num, pack, len);
+    }
+    check(ok && resolved(), "Block1 retransmitted, decoded once");
+
+    // block 0 with a new message ID starts the next pack
+    nreceived = 0;
+    ok = !decode_block(&d, 400, 0, pack, len);
+    const unsigned first = nreceived;
+    check(ok && first && !decode_block(&d, 400, 0, pack, len) && (nreceived == first) &&
+          (d.next_block == 1), "Block1 restart");
+}
+
+/* response code of the example server to one block, -1 if none */
+static int server_block(const uint16_t id, const uint32_t num, const uint8_t *pack,
+                        const size_t len)
+{
+    coap_packet_t pkt, rsp;
+    uint8_t opt[3], in[256], out[128];
+    size_t inlen = sizeof(in), outlen = sizeof(out);
+    make_block(id, num, pack, len, &pkt, opt);
+    if (coap_build(&pkt, in, &inlen) ||
+        coap_handle_packet(resources, in, inlen, out, &outlen) ||
+        coap_parse(out, outlen, &rsp)) {
+        return -1;
+    }
+    return rsp.hdr.code;
+}
+
+/* an upload with block 0 and the last block sent twice, then the last block again */
+static void test_server(void)
+{
+    uint8_t pack[512];
+    const size_t len = encode(COAP_CONTENTTYPE_APP_SENML_JSON, pack, sizeof(pack));
+    const uint32_t blocks = (uint32_t)((len + COAP_BLOCK_SIZE(BLOCK_SZX) - 1) /
+                                       COAP_BLOCK_SIZE(BLOCK_SZX));
+    bool ok = (server_block(600, 0, pack, len) == COAP_RSPCODE_CONTINUE);
+    for (uint32_t num = 0; ok && (num < blocks); ++num) {
+        const int code = (num + 1 < blocks) ? COAP_RSPCODE_CONTINUE : COAP_RSPCODE_CHANGED;
+        ok = (server_block((uint16_t)(600 + num), num, pack, len) == code);
+    }
+    check(ok, "server, repeated blocks");
+    check(server_block((uint16_t)(600 + blocks - 1), blocks - 1, pack, len) ==
+          COAP_RSPCODE_CHANGED, "server, last block repeated after the upload");
+}
+
+static void bench(const char *name, const coap_content_type_t format)
+{
+    uint8_t pack[512];
+    coap_senml_decoder_t d;
+    unsigned n = 0;
+    const size_t len = encode(format, pack, sizeof(pack));
+    double t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        encode(format, pack, sizeof(pack));
+    }
+    const double enc = (now_ns() - t0) / ITERATIONS;
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        coap_senml_decoder_init(&d, format, count_records, &n);
+        coap_senml_decode(&d, pack, len, true);
+    }
+    const double dec = (now_ns() - t0) / ITERATIONS;
+    printf("%-5s %4zu bytes  encode %6.0f ns  decode %6.0f ns  %u records\n",
+           name, len, enc, dec, n / ITERATIONS);
+}
+
+int main(void)
+{
+    resource_setup(resources);
+    test_round_trip("JSON", COAP_CONTENTTYPE_APP_SENML_JSON);
+    test_round_trip("CBOR", COAP_CONTENTTYPE_APP_SENML_CBOR);
+    test_block1();
+    test_server();
+    if (failures) {
+        return 1;
+    }
+    printf("\n%zu records per pack, %d iterations\n", RECORDS, ITERATIONS);
+    bench("json", COAP_CONTENTTYPE_APP_SENML_JSON);
+    bench("cbor", COAP_CONTENTTYPE_APP_SENML_CBOR);
+    return 0;
+}
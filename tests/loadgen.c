@@ -0,0 +1,461 @@
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coap.h"
+#include "coap_random.h"
+
+#define DSTPORT         "5683"
+#define MAX_MIX         16
+#define MAX_SOCKETS     64      //!< per thread
+#define MAX_WINDOW      1024    //!< requests in flight per socket
+#define MAX_SAMPLES     (1 << 20)   //!< latency samples kept per thread
+#define MAX_PAYLOAD     1024
+
+/* one kind of request of the mix */
+typedef struct
+{
+    coap_method_t method;
+    coap_resource_path_t path;
+    unsigned weight;
+    size_t payload;
+    coap_request_template_t tpl[2];     //!< CON and NON
+} mix_t;
+
+typedef struct
+{
+    bool busy;
+    uint16_t gen;                       //!< tells late responses apart
+    uint64_t sent;                      //!< ns
+} slot_t;
+
+typedef struct
+{
+    int fd;
+    uint16_t msgid;
+    unsigned inflight;
+    unsigned next;                      //!< next slot to try
+    slot_t slots[MAX_WINDOW];
+} conn_t;
+
+typedef struct
+{
+    pthread_t thread;
+    unsigned id;
+    conn_t conns[MAX_SOCKETS];
+    uint64_t sent, received, lost, skipped, bad;
+    uint64_t codes[256];
+    uint64_t nsamples;                  //!< latencies seen, reservoir sampled
+    uint32_t *samples;                  //!< us
+} worker_t;
+
+/* options */
+static struct addrinfo *dst;
+static mix_t mix[MAX_MIX];
+static unsigned nmix, total_weight;
+static unsigned threads = 1, sockets = 1, window, non_percent;
+static double rate;                     //!< requests/s, open loop if > 0
+static double duration = 5;
+static unsigned timeout_ms = 1000;
+static uint8_t payload[MAX_PAYLOAD];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* METHOD:path[:weight[:payload]], e.g. PUT:/light:10:1 */
+static int parse_mix(char *spec)
+{
+    static const char *methods[] = {NULL, "GET", "POST", "PUT", "DELETE"};
+    mix_t *m = &mix[nmix];
+    char *method = strtok(spec, ":");
+    char *path = strtok(NULL, ":");
+    char *weight = strtok(NULL, ":");
+    char *size = strtok(NULL, ":");
+    if (!method || !path || (nmix == MAX_MIX)) {
+        return -1;
+    }
+    memset(m, 0, sizeof(*m));
+    for (int i = COAP_METHOD_GET; i <= COAP_METHOD_DELETE; ++i) {
+        if (!strcmp(method, methods[i])) {
+            m->method = (coap_method_t)i;
+        }
+    }
+    m->weight = weight ? (unsigned)atoi(weight) : 1;
+    m->payload = size ? (size_t)atoi(size) : 0;
+    if (!m->method || !m->weight || (m->payload > MAX_PAYLOAD)) {
+        return -1;
+    }
+    for (char *seg = strtok(path, "/"); seg; seg = strtok(NULL, "/")) {
+        if (m->path.count == COAP_MAX_PATHITEMS) {
+            return -1;
+        }
+        m->path.items[m->path.count++] = strdup(seg);
+    }
+    for (int t = 0; t < 2; ++t) {
+        const coap_resource_t rs = {COAP_STATE_RDY, m->method,
+                                    t ? COAP_TYPE_NONCON : COAP_TYPE_CON, NULL, &m->path,
+                                    COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+        if (coap_make_request_template(&rs, &m->tpl[t])) {
+            return -1;
+        }
+    }
+    total_weight += m->weight;
+    nmix++;
+    return 0;
+}
+
+static const mix_t *pick_mix(void)
+{
+    unsigned r = coap_random_next() % total_weight;
+    for (unsigned i = 0; i < nmix; ++i) {
+        if (r < mix[i].weight) {
+            return &mix[i];
+        }
+        r -= mix[i].weight;
+    }
+    return &mix[0];
+}
+
+static void record(worker_t *w, const uint64_t ns)
+{
+    const uint32_t us = (ns / 1000 < UINT32_MAX) ? (uint32_t)(ns / 1000) : UINT32_MAX;
+    if (w->nsamples < MAX_SAMPLES) {
+        w->samples[w->nsamples] = us;
+    }
+    else {
+        // reservoir sampling keeps a uniform subset
+        const uint64_t j = ((uint64_t)coap_random_next() << 32 | coap_random_next()) %
+                           (w->nsamples + 1);
+        if (j < MAX_SAMPLES) {
+            w->samples[j] = us;
+        }
+    }
+    w->nsamples++;
+}
+
+/*
+ * send one request on c, false if its window is full; its latency counts
+ * from intended, the time it was due, so that a late send is no excuse
+ */
+static bool send_request(worker_t *w, conn_t *c, const uint64_t intended)
+{
+    uint8_t buf[MAX_PAYLOAD + 128];
+    size_t buflen = sizeof(buf);
+    uint8_t token[4];
+    const coap_buffer_t tok = {token, sizeof(token)};
+    if (c->inflight >= window) {
+        return false;
+    }
+    while (c->slots[c->next].busy) {
+        c->next = (c->next + 1) % window;
+    }
+    const unsigned s = c->next;
+    slot_t *slot = &c->slots[s];
+    const mix_t *m = pick_mix();
+    const bool non = (coap_random_next() % 100) < non_percent;
+    slot->gen++;
+    token[0] = (uint8_t)(s >> 8);
+    token[1] = (uint8_t)s;
+    token[2] = (uint8_t)(slot->gen >> 8);
+    token[3] = (uint8_t)slot->gen;
+    if (coap_build_request(&m->tpl[non], c->msgid++, &tok, payload, m->payload,
+                           buf, &buflen)) {
+        return false;
+    }
+    slot->sent = intended;
+    if (send(c->fd, buf, buflen, 0) < 0) {
+        return false;
+    }
+    slot->busy = true;
+    c->inflight++;
+    w->sent++;
+    return true;
+}
+
+/* empty ACK of a confirmable separate response */
+static void send_ack(conn_t *c, const coap_packet_t *rsp)
+{
+    uint8_t buf[4];
+    size_t buflen = sizeof(buf);
+    coap_packet_t pkt;
+    coap_make_response(rsp->hdr.id, NULL, COAP_TYPE_ACK, COAP_RSPCODE_EMPTY,
+                       NULL, NULL, 0, &pkt);
+    if (!coap_build(&pkt, buf, &buflen)) {
+        send(c->fd, buf, buflen, 0);
+    }
+}
+
+static void receive(worker_t *w, conn_t *c)
+{
+    uint8_t buf[2048];
+    coap_packet_t pkt;
+    ssize_t n;
+    while ((n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        const uint64_t now = now_ns();
+        if (coap_parse(buf, n, &pkt)) {
+            w->bad++;
+            continue;
+        }
+        if (pkt.hdr.code == COAP_RSPCODE_EMPTY) {
+            continue;   // separate response follows
+        }
+        // late ones too, or the server keeps retransmitting them
+        if (pkt.hdr.t == COAP_TYPE_CON) {
+            send_ack(c, &pkt);
+        }
+        if (pkt.tok.len != 4) {
+            w->bad++;
+            continue;
+        }
+        const unsigned s = (pkt.tok.p[0] << 8) | pkt.tok.p[1];
+        const uint16_t gen = (pkt.tok.p[2] << 8) | pkt.tok.p[3];
+        if ((s >= window) || !c->slots[s].busy || (c->slots[s].gen != gen)) {
+            continue;   // late, already counted as lost
+        }
+        c->slots[s].busy = false;
+        c->inflight--;
+        w->received++;
+        w->codes[pkt.hdr.code]++;
+        record(w, now - c->slots[s].sent);
+    }
+}
+
+static void expire(worker_t *w, conn_t *c, const uint64_t now)
+{
+    for (unsigned s = 0; (s < window) && c->inflight; ++s) {
+        // now may be older than requests sent since
+        if (c->slots[s].busy && (now > c->slots[s].sent) &&
+            (now - c->slots[s].sent > timeout_ms * 1000000ULL)) {
+            c->slots[s].busy = false;
+            c->inflight--;
+            w->lost++;
+        }
+    }
+}
+
+static void *run(void *arg)
+{
+    worker_t *w = arg;
+    struct pollfd pfd[MAX_SOCKETS];
+    const uint64_t start = now_ns();
+    const uint64_t end = start + (uint64_t)(duration * 1e9);
+    // open loop: requests are due at fixed intervals, regardless of responses
+    const double interval = (rate > 0) ? 1e9 * threads / rate : 0;
+    uint64_t due = start;
+    uint64_t last_expire = start;
+    unsigned rr = 0;
+    for (unsigned i = 0; i < sockets; ++i) {
+        pfd[i].fd = w->conns[i].fd;
+        pfd[i].events = POLLIN;
+    }
+    for (uint64_t now = start; now < end; now = now_ns()) {
+        if (interval > 0) {
+            while (due <= now) {
+                if (!send_request(w, &w->conns[rr++ % sockets], due)) {
+                    w->skipped++;
+                }
+                due += (uint64_t)interval;
+            }
+        }
+        else {
+            for (unsigned i = 0; i < sockets; ++i) {
+                while (send_request(w, &w->conns[i], now_ns())) {
+                }
+            }
+        }
+        int wait = 1;
+        if ((interval > 0) && (due > now)) {
+            wait = (int)((due - now) / 1000000);
+        }
+        if (poll(pfd, sockets, wait) > 0) {
+            for (unsigned i = 0; i < sockets; ++i) {
+                if (pfd[i].revents & POLLIN) {
+                    receive(w, &w->conns[i]);
+                }
+            }
+        }
+        if (now - last_expire > 10000000ULL) {
+            for (unsigned i = 0; i < sockets; ++i) {
+                expire(w, &w->conns[i], now);
+            }
+            last_expire = now;
+        }
+    }
+    // drain responses still on their way
+    const uint64_t drain = now_ns() + timeout_ms * 1000000ULL;
+    for (uint64_t now = now_ns(); now < drain; now = now_ns()) {
+        unsigned inflight = 0;
+        for (unsigned i = 0; i < sockets; ++i) {
+            inflight += w->conns[i].inflight;
+        }
+        if (!inflight || (poll(pfd, sockets, 10) < 0)) {
+            break;
+        }
+        for (unsigned i = 0; i < sockets; ++i) {
+            receive(w, &w->conns[i]);
+        }
+    }
+    for (unsigned i = 0; i < sockets; ++i) {
+        expire(w, &w->conns[i], UINT64_MAX / 2);
+    }
+    return NULL;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "USAGE: %s [options] host\n"
+            "  -m METHOD:path[:weight[:payload]]  add to request mix, repeatable,\n"
+            "                                     default GET:/.well-known/core\n"
+            "  -n percent   non-confirmable requests, default 0\n"
+            "  -t threads   default 1\n"
+            "  -s sockets   per thread, default 1\n"
+            "  -w window    requests in flight per socket, default 1, open loop " \
+            "%u\n"
+            "  -r rate      requests/s in total (open loop)\n"
+            "  -d seconds   duration, default 5\n"
+            "  -o ms        timeout of a request, default 1000\n"
+            "  -p port      default " DSTPORT "\n", name, MAX_WINDOW);
+}
+
+int main(int argc, char *argv[])
+{
+    struct addrinfo hints;
+    const char *port = DSTPORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:t:s:w:r:d:o:p:")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (parse_mix(optarg)) {
+                fprintf(stderr, "bad request mix: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n': non_percent = (unsigned)atoi(optarg); break;
+        case 't': threads = (unsigned)atoi(optarg); break;
+        case 's': sockets = (unsigned)atoi(optarg); break;
+        case 'w': window = (unsigned)atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'o': timeout_ms = (unsigned)atoi(optarg); break;
+        case 'p': port = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (!window) {
+        // the window of the open loop only bounds the requests awaiting a response
+        window = (rate > 0) ? MAX_WINDOW : 1;
+    }
+    if ((optind != argc - 1) || !threads || !sockets || (sockets > MAX_SOCKETS) ||
+        (window > MAX_WINDOW)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!nmix) {
+        char spec[] = "GET:/.well-known/core";
+        parse_mix(spec);
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int rv = getaddrinfo(argv[optind], port, &hints, &dst);
+    if (rv) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+        return 1;
+    }
+    memset(payload, '1', sizeof(payload));
+
+    worker_t *workers = calloc(threads, sizeof(*workers));
+    for (unsigned t = 0; t < threads; ++t) {
+        worker_t *w = &workers[t];
+        w->id = t;
+        w->samples = malloc(MAX_SAMPLES * sizeof(*w->samples));
+        for (unsigned i = 0; i < sockets; ++i) {
+            conn_t *c = &w->conns[i];
+            c->fd = socket(dst->ai_family, SOCK_DGRAM, 0);
+            if ((c->fd < 0) || connect(c->fd, dst->ai_addr, dst->ai_addrlen)) {
+                perror("socket");
+                return 1;
+            }
+            c->msgid = coap_msgid_next();
+        }
+    }
+    printf("%u threads x %u sockets, %s loop", threads, sockets,
+           (rate > 0) ? "open" : "closed");
+    if (rate > 0) {
+        printf(" at %.0f req/s", rate);
+    }
+    else {
+        printf(", window %u", window);
+    }
+    printf(", %u%% NON, %.1f s\n", non_percent, duration);
+
+    for (unsigned t = 0; t < threads; ++t) {
+        pthread_create(&workers[t].thread, NULL, run, &workers[t]);
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    // merge
+    uint64_t sent = 0, received = 0, lost = 0, skipped = 0, bad = 0, nsamples = 0;
+    uint64_t codes[256] = {0};
+    for (unsigned t = 0; t < threads; ++t) {
+        worker_t *w = &workers[t];
+        sent += w->sent;
+        received += w->received;
+        lost += w->lost;
+        skipped += w->skipped;
+        bad += w->bad;
+        nsamples += (w->nsamples < MAX_SAMPLES) ? w->nsamples : MAX_SAMPLES;
+        for (unsigned i = 0; i < 256; ++i) {
+            codes[i] += w->codes[i];
+        }
+    }
+    uint32_t *all = malloc((nsamples ? nsamples : 1) * sizeof(*all));
+    size_t k = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+        const uint64_t n = (workers[t].nsamples < MAX_SAMPLES) ? workers[t].nsamples : MAX_SAMPLES;
+        memcpy(all + k, workers[t].samples, n * sizeof(*all));
+        k += n;
+    }
+    qsort(all, k, sizeof(*all), cmp_u32);
+
+    printf("sent %llu, received %llu, lost %llu, not sent %llu, malformed %llu\n",
+           (unsigned long long)sent, (unsigned long long)received,
+           (unsigned long long)lost, (unsigned long long)skipped, (unsigned long long)bad);
+    // responses drained after the run still belong to requests sent within it
+    printf("throughput %.0f req/s\n", received / duration);
+    if (k) {
+        printf("latency [us] p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+               all[k / 2], all[k * 90 / 100], all[k * 99 / 100],
+               all[k * 999 / 1000], all[k - 1]);
+    }
+    for (unsigned i = 0; i < 256; ++i) {
+        if (codes[i]) {
+            printf("  %u.%02u  %llu\n", i >> 5, i & 0x1F, (unsigned long long)codes[i]);
+        }
+    }
+    freeaddrinfo(dst);
+    return (received || !sent) ? 0 : 1;
+}
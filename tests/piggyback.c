@@ -3,6 +3,7 @@
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 
 #include "coap.h"
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coap.h"
+#include "coap_pcap.h"
+
+#define DSTPORT     5683
+
+/* the example server, to reproduce its behaviour offline */
+extern void resource_setup(const coap_resource_t *resources);
+extern coap_resource_t resources[];
+
+typedef struct
+{
+    uint64_t ts_us;
+    size_t len;
+    uint8_t *pdu;
+} request_t;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint16_t dst_port(const coap_endpoint_t *ep)
+{
+    const struct sockaddr *sa = (const struct sockaddr *)ep->addr;
+    if (sa->sa_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)ep->addr)->sin6_port);
+    }
+    return ntohs(((const struct sockaddr_in *)ep->addr)->sin_port);
+}
+
+/* requests only, i.e. datagrams to the server port */
+static request_t *load(const char *path, const uint16_t port, size_t *count)
+{
+    coap_pcap_reader_t *r = malloc(sizeof(*r));
+    coap_pcap_record_t rec;
+    request_t *reqs = NULL;
+    size_t cap = 0;
+    int rc;
+    *count = 0;
+    if (!r || (rc = coap_pcap_reader_open(r, path))) {
+        fprintf(stderr, "%s: cannot read capture\n", path);
+        free(r);
+        return NULL;
+    }
+    while (!(rc = coap_pcap_read(r, &rec))) {
+        if (dst_port(&rec.dst) != port) {
+            continue;
+        }
+        if (*count == cap) {
+            cap = cap ? 2 * cap : 1024;
+            reqs = realloc(reqs, cap * sizeof(*reqs));
+        }
+        request_t *q = &reqs[(*count)++];
+        q->ts_us = rec.ts_us;
+        q->len = rec.len;
+        q->pdu = malloc(rec.len ? rec.len : 1);
+        memcpy(q->pdu, rec.payload, rec.len);
+    }
+    if (rc == COAP_ERR_MALFORMED) {
+        fprintf(stderr, "%s: corrupt record after %zu requests\n", path, *count);
+    }
+    coap_pcap_reader_close(r);
+    free(r);
+    return reqs;
+}
+
+/* sleep until offset us after start */
+static void wait_until(const double start, const uint64_t offset_us)
+{
+    const double due = start + offset_us * 1e3;
+    double now = now_ns();
+    if (now < due) {
+        struct timespec ts;
+        const double ns = due - now;
+        ts.tv_sec = (time_t)(ns / 1e9);
+        ts.tv_nsec = (long)(ns - ts.tv_sec * 1e9);
+        nanosleep(&ts, NULL);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool timing = false;
+    unsigned loops = 1;
+    uint16_t port = DSTPORT;
+    uint64_t codes[256] = {0};
+    uint64_t errors = 0;
+    uint8_t outbuf[1152];
+    size_t count;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "tn:p:")) != -1) {
+        switch (opt) {
+        case 't':
+            timing = true;
+            break;
+        case 'n':
+            loops = (unsigned)atoi(optarg);
+            break;
+        case 'p':
+            port = (uint16_t)atoi(optarg);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "USAGE: %s [-t] [-n loops] [-p port] capture.pcap\n"
+                        "  -t  keep original timing, default is maximum speed\n"
+                        "  -n  replay n times\n"
+                        "  -p  server port, datagrams to it are replayed, default %d\n",
+                argv[0], DSTPORT);
+        return 1;
+    }
+    request_t *reqs = load(argv[optind], port, &count);
+    if (!count) {
+        fprintf(stderr, "no requests to port %u\n", port);
+        return 1;
+    }
+    resource_setup(resources);
+
+    const double start = now_ns();
+    for (unsigned l = 0; l < loops; ++l) {
+        const double loop_start = now_ns();
+        for (size_t i = 0; i < count; ++i) {
+            size_t outlen = sizeof(outbuf);
+            if (timing) {
+                wait_until(loop_start, reqs[i].ts_us - reqs[0].ts_us);
+            }
+            if (coap_handle_packet(resources, reqs[i].pdu, reqs[i].len, outbuf, &outlen)) {
+                errors++;
+            }
+            else {
+                codes[outbuf[1]]++;
+            }
+        }
+    }
+    const double elapsed = now_ns() - start;
+
+    // report to stderr, handlers of the example print to stdout
+    const uint64_t total = (uint64_t)count * loops;
+    fprintf(stderr, "%llu requests, %llu rejected, %.3f s, %.0f req/s, %.0f ns/req\n",
+            (unsigned long long)total, (unsigned long long)errors, elapsed / 1e9,
+            total / (elapsed / 1e9), elapsed / total);
+    for (unsigned c = 0; c < 256; ++c) {
+        if (codes[c]) {
+            fprintf(stderr, "  %u.%02u  %llu\n", c >> 5, c & 0x1F,
+                    (unsigned long long)codes[c]);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        free(reqs[i].pdu);
+    }
+    free(reqs);
+    return 0;
+}
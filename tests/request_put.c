@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include "coap.h"
+#include "coap_random.h"
 
 #define DSTPORT     "5683"
 
@@ -93,9 +94,11 @@ int main(int argc, char *argv[])
     struct sockaddr_storage cliaddr;
     socklen_t len = sizeof(cliaddr);
     coap_packet_t req, rsp;
-    uint16_t msgid = 42;
+    uint8_t token[4];
+    const coap_buffer_t tok = {token, sizeof(token)};
+    coap_token_next(token, sizeof(token));
     printf("coap_make_request\n");
-    coap_make_request(msgid, NULL, &resources[0], (uint8_t *)argv[3], strlen(argv[3]), &req);
+    coap_make_request(coap_msgid_next(), &tok, &resources[0], (uint8_t *)argv[3], strlen(argv[3]), &req);
     uint8_t buf[1024];
     size_t buflen = sizeof(buf);
     if (0 != (rc = coap_build(&req, buf, &buflen))) {
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coap.h"
+#include "coap_client.h"
+#include "coap_random.h"
+#include "coap_sim.h"
+
+/* a virtual peer, requesting from the server one after another */
+typedef struct
+{
+    coap_sim_node_t node;
+    coap_client_t client;
+    unsigned remaining;                 //!< requests still to send
+    coap_tick_t poll_at;                //!< pending poll timer
+} peer_t;
+
+static coap_sim_t sim;
+static coap_sim_node_t server;
+static const coap_endpoint_t *server_ep;
+static unsigned think_ms = 1000;
+
+static uint64_t requests, completed, timeouts, resets, failed, executions;
+
+static const coap_resource_path_t path_sensor = {1, {"sensor"}};
+
+static int handle_get_sensor(const coap_resource_t *resource,
+                             const coap_packet_t *inpkt,
+                             coap_packet_t *pkt)
+{
+    static const uint8_t value[] = "21.5";
+    // no deduplication in the server, retransmissions execute again
+    executions++;
+    return coap_make_response(inpkt->hdr.id, &inpkt->tok,
+                              COAP_TYPE_ACK, COAP_RSPCODE_CONTENT,
+                              resource->content_type,
+                              value, sizeof(value) - 1, pkt);
+}
+
+/* responses are piggybacked on the ACK */
+static coap_resource_t resources[] =
+{
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_ACK,
+        handle_get_sensor, &path_sensor,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_TXT_PLAIN), NULL, NULL, 0, NULL},
+    {(coap_state_t)0, (coap_method_t)0, (coap_msgtype_t)0,
+        NULL, NULL,
+        COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL}
+};
+
+/* the request of the peers, confirmable */
+static const coap_resource_t request_sensor =
+    {COAP_STATE_RDY, COAP_METHOD_GET, COAP_TYPE_CON, NULL, &path_sensor,
+     COAP_SET_CONTENTTYPE(COAP_CONTENTTYPE_NONE), NULL, NULL, 0, NULL};
+
+static double now_ns(const clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void server_recv(void *arg, const coap_endpoint_t *from,
+                        const uint8_t *buf, const size_t buflen)
+{
+    uint8_t out[256];
+    size_t outlen = sizeof(out);
+    (void)arg;
+    if (!coap_handle_packet(resources, buf, buflen, out, &outlen)) {
+        coap_sim_send(&server, from, out, outlen);
+    }
+}
+
+static void peer_poll(void *arg)
+{
+    peer_t *p = arg;
+    if (coap_clock_now() != p->poll_at) {
+        return;     // superseded by an earlier timer
+    }
+    const coap_tick_t next = coap_client_poll(&p->client);
+    p->poll_at = next;
+    coap_sim_timer(&sim, next, peer_poll, p);
+}
+
+static void peer_send(void *arg);
+
+static void peer_done(void *arg, const int status, const coap_packet_t *rsppkt)
+{
+    peer_t *p = arg;
+    (void)rsppkt;
+    if (status == COAP_SUCCESS) {
+        completed++;
+    }
+    else if (status == COAP_ERR_TIMEOUT) {
+        timeouts++;
+    }
+    else {
+        resets++;
+    }
+    if (p->remaining) {
+        const coap_tick_t think = think_ms ? coap_random_next() % (2 * think_ms) : 0;
+        coap_sim_timer(&sim, coap_clock_now() + think, peer_send, p);
+    }
+}
+
+static void peer_send(void *arg)
+{
+    peer_t *p = arg;
+    coap_packet_t req;
+    coap_make_request(0, NULL, &request_sensor, NULL, 0, &req);
+    p->remaining--;
+    requests++;
+    if (coap_client_request(&p->client, server_ep, &req, peer_done, p)) {
+        failed++;
+        return;
+    }
+    // the first retransmission is due no earlier than this
+    const coap_tick_t at = coap_clock_now() + COAP_ACK_TIMEOUT;
+    if (at < p->poll_at) {
+        p->poll_at = at;
+        coap_sim_timer(&sim, at, peer_poll, p);
+    }
+}
+
+static void peer_recv(void *arg, const coap_endpoint_t *from,
+                      const uint8_t *buf, const size_t buflen)
+{
+    peer_t *p = arg;
+    coap_packet_t pkt;
+    if (!coap_parse(buf, buflen, &pkt)) {
+        coap_client_handle_packet(&p->client, from, &pkt);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "USAGE: %s [options]\n"
+            "  -n peers     default 20000\n"
+            "  -r requests  per peer, default 10\n"
+            "  -t ms        mean think time between requests, default 1000\n"
+            "  -l percent   datagrams lost, default 5\n"
+            "  -u percent   datagrams duplicated, default 1\n"
+            "  -d ms        one-way delay, default 20\n"
+            "  -j ms        max. jitter on top of the delay, default 30\n"
+            "  -s seed      default 1\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned npeers = 20000, nrequests = 10;
+    double loss = 5, dup = 1, delay = 20, jitter = 30;
+    uint32_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:t:l:u:d:j:s:")) != -1) {
+        switch (opt) {
+        case 'n': npeers = (unsigned)atoi(optarg); break;
+        case 'r': nrequests = (unsigned)atoi(optarg); break;
+        case 't': think_ms = (unsigned)atoi(optarg); break;
+        case 'l': loss = atof(optarg); break;
+        case 'u': dup = atof(optarg); break;
+        case 'd': delay = atof(optarg); break;
+        case 'j': jitter = atof(optarg); break;
+        case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc || !npeers) {
+        usage(argv[0]);
+        return 1;
+    }
+    const coap_sim_link_t link = {
+        (uint32_t)(loss * COAP_SIM_PPM / 100), (uint32_t)(dup * COAP_SIM_PPM / 100),
+        (uint32_t)(delay * 1000), (uint32_t)(jitter * 1000)};
+    // message IDs, tokens, jitter and losses all come from this thread
+    coap_sim_init(&sim, &link, seed);
+    coap_sim_attach(&sim, &server, server_recv, NULL);
+    server_ep = &server.ep;
+
+    peer_t *peers = calloc(npeers, sizeof(*peers));
+    if (!peers) {
+        perror("calloc");
+        return 1;
+    }
+    for (unsigned i = 0; i < npeers; ++i) {
+        peer_t *p = &peers[i];
+        if (coap_sim_attach(&sim, &p->node, peer_recv, p)) {
+            fprintf(stderr, "cannot attach %u peers\n", npeers);
+            return 1;
+        }
+        coap_client_init(&p->client, coap_sim_send, &p->node);
+        p->remaining = nrequests;
+        p->poll_at = COAP_TICK_NEVER;
+        if (nrequests) {
+            coap_sim_timer(&sim, coap_random_next() % (think_ms + 1), peer_send, p);
+        }
+    }
+
+    printf("%u peers x %u requests, loss %.1f%%, duplicates %.1f%%, delay %.0f+0..%.0f ms\n",
+           npeers, nrequests, loss, dup, delay, jitter);
+    const double wall0 = now_ns(CLOCK_MONOTONIC), cpu0 = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    coap_sim_run(&sim, COAP_TICK_NEVER);
+    const double wall = now_ns(CLOCK_MONOTONIC) - wall0;
+    const double cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+    const double virt = sim.now_us * 1e3;
+
+    uint64_t peer_tx = 0;
+    for (unsigned i = 0; i < npeers; ++i) {
+        peer_tx += peers[i].node.tx;
+    }
+    printf("exchanges %llu: completed %llu, timed out %llu, reset %llu, not sent %llu\n",
+           (unsigned long long)requests, (unsigned long long)completed,
+           (unsigned long long)timeouts, (unsigned long long)resets,
+           (unsigned long long)failed);
+    printf("retransmissions %llu, handler executions %llu\n",
+           (unsigned long long)(peer_tx - (requests - failed)),
+           (unsigned long long)executions);
+    printf("datagrams %llu: lost %llu, duplicated %llu, unreachable %llu\n",
+           (unsigned long long)sim.sent, (unsigned long long)sim.lost,
+           (unsigned long long)sim.duplicated, (unsigned long long)sim.unreachable);
+    printf("virtual %.1f s, wall %.3f s, %.0fx real time, %llu events\n",
+           virt / 1e9, wall / 1e9, virt / wall, (unsigned long long)sim.processed);
+    if (requests) {
+        printf("CPU per exchange %.0f ns\n", cpu / requests);
+    }
+    coap_sim_free(&sim);
+    free(peers);
+    // every exchange must end, one way or another
+    return (completed + timeouts + resets + failed == requests) ? 0 : 1;
+}